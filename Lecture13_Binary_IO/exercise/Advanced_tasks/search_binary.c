@@ -1,175 +1,1038 @@
 /*
- * Load a binary file and search for a specific bit pattern.
+ * Search a binary file for a specific bit pattern.
+ * The pattern may start at any bit of a byte. We report every match
+ * as a bit offset from the start of the file, bit 0 being the most
+ * significant bit of the first byte.
+ *
+ * The file is read in chunks of SEARCH_CHUNK_BYTES, so it may be much
+ * larger than the memory. A match may cross the end of a chunk, so the
+ * bytes after the last complete search position are carried over to
+ * the front of the next chunk. The buffer is never modified.
+ *
  * To explore the difference between buffered and unbuffered I/O
  * compare the timing between buffered and unbuffered reading from disk.
+ * -i picks how the file is read: fread() or read() one chunk at a time,
+ * or mmap() of the whole file. -r searches with all three and reports
+ * their timing. The first run also loads the file into the page cache,
+ * so run it twice for a fair comparison.
+ *
+ * Several patterns are searched for in a single pass over the file,
+ * see compile_pattern_set(). The data is split into -t ranges that
+ * are searched by one thread each, see search_buffer_parallel().
+ *
+ * Usage: search_binary [-m mask] [-f patternfile] [-i fread|read|mmap]
+ *            [-t threads] [-r] infilename [pattern ...]
+ * A pattern is up to PATTERN_MAX_BITS bits, given either in hex like
+ * 0x787E or as bits like 0111100001111110. A . among the bits matches
+ * either bit. A mask has the same length and format, its 0 bits are
+ * not compared. It follows its pattern after a colon, like 0x787E:0xFF0F,
+ * or -m gives it for all patterns. The pattern file has one pattern per
+ * line. The default pattern is 0x787E.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define INT_BUFFER_LENGTH 1024
+#define SEARCH_CHUNK_BYTES (1 << 20)
+#define BITS_PER_BYTE 8
+#define PATTERN_MAX_BITS 1024
+/* the pattern may start at any bit, so it touches one more byte */
+#define PATTERN_MAX_BYTES (PATTERN_MAX_BITS / BITS_PER_BYTE + 1)
+/* the bytes of every alignment we check at once, see compile_pattern() */
+#define PATTERN_FILTER_BYTES 8
+#define MATCH_LIST_START 64
+/* a thread searches at least this many bytes */
+#define SEARCH_MIN_RANGE_BYTES (1 << 16)
+#define SEARCH_MAX_THREADS 256
+/* the ways to read the file */
+#define IO_FREAD 0
+#define IO_READ 1
+#define IO_MMAP 2
+#define IO_STRATEGIES 3
+#define PATTERN_MAX_COUNT 4096
+/* a line of a pattern file holds a pattern and its mask as bits */
+#define PATTERN_LINE_LENGTH (2 * PATTERN_MAX_BITS + 4)
+/* the filter of a pattern set looks up 16 bits, at most 2^10 values per key */
+#define KEY_BITS 16
+#define KEY_MAX_FREE_BITS 10
+
+/* C does not know about MIN and MAX, so we define them as macros. */
+#define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
+#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
+
+
+/*
+ * A match of pattern uint_pattern at a bit offset.
+ */
+typedef struct {
+    uint64_t uint64_offset;
+    unsigned int uint_pattern;
+} match;
+
+
+/*
+ * The matches found so far. search_file() sorts them by their offsets.
+ */
+typedef struct {
+    match* matches;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} match_list;
+
+
+/*
+ * A compiled bit pattern.
+ * For every alignment j = 0 ... 7 we store the bytes the pattern covers
+ * when it starts at bit j of a byte: a byte matches if it masked with
+ * uchar_mask equals uchar_value. The mask is 0 for the bits before and
+ * after the pattern and for the don't care bits.
+ *
+ * Checking every alignment byte by byte would be slow, so we first run
+ * a shift-and automaton over the bytes: bit 8 j + t of uint64_state is
+ * set if the last t + 1 bytes match the first t + 1 bytes of alignment
+ * j. With one table look-up per byte we follow all 8 alignments at
+ * once, and only check the rest of the pattern if the first
+ * uint_filter_bytes bytes of an alignment matched.
+ */
+typedef struct {
+    unsigned int uint_bits;
+    unsigned int uint_care_bits;
+    unsigned int uint_bytes[BITS_PER_BYTE];
+    unsigned int uint_span_bytes;
+    unsigned int uint_filter_bytes;
+    unsigned char uchar_value[BITS_PER_BYTE][PATTERN_MAX_BYTES];
+    unsigned char uchar_mask[BITS_PER_BYTE][PATTERN_MAX_BYTES];
+    uint64_t uint64_table[256];
+    uint64_t uint64_start;
+    uint64_t uint64_accept;
+} bit_pattern;
+
+
+/*
+ * A pattern at one alignment that may match where its key is found:
+ * the 16 bits of the bytes uint_key_byte and uint_key_byte + 1 of the
+ * alignment.
+ */
+typedef struct {
+    unsigned int uint_pattern;
+    unsigned int uint_alignment;
+    unsigned int uint_key_byte;
+} pattern_candidate;
+
 
 /*
- * declare and initialise the static look-up tables
+ * Several patterns compiled into one filter, so a single pass over
+ * the data finds all of them.
+ * For every pattern at every alignment we pick the two neighbouring
+ * bytes with the fewest don't care bits as its key, and list it under
+ * every 16 bit value that matches the key. While we scan the data, we
+ * look up the 16 bits at every byte: uint64_present tells us in one
+ * bit test if anything is listed under them, and the candidates under
+ * value v are candidates[uint32_first[v]] ... candidates[uint32_first[v + 1] - 1].
+ * Only those candidates are checked in full. A key with more than
+ * KEY_MAX_FREE_BITS don't care bits would be listed under too many
+ * values, so such candidates are checked at every byte instead.
  */
-char char_mask_left[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-char char_mask_middle[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-char char_mask_right[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+typedef struct {
+    bit_pattern* patterns;
+    unsigned int uint_count;
+    unsigned int uint_span_bytes;
+    unsigned int uint_max_key_byte;
+    uint32_t* uint32_first;
+    pattern_candidate* candidates;
+    pattern_candidate* always;
+    unsigned int uint_num_always;
+    uint64_t uint64_present[(1 << KEY_BITS) / 64];
+} pattern_set;
 
 
-void byte_to_ASCII(char byte) {
+/*
+ * The part of a buffer one thread searches: the matches that start
+ * at the bytes uchar_buffer[size_t_start] ... uchar_buffer[size_t_end - 1].
+ * The bytes after size_t_end are read as far as a match needs them.
+ * Every thread collects its own matches, so they need no lock.
+ */
+typedef struct {
+    pattern_set* set;
+    const unsigned char* uchar_buffer;
+    size_t size_t_length;
+    size_t size_t_start;
+    size_t size_t_end;
+    uint64_t uint64_offset;
+    match_list matches;
+    int int_status;
+} search_range;
+
+
+static const char* char_io_names[IO_STRATEGIES] = {"fread", "read", "mmap"};
+
+
+/*
+ * Read a pattern given as hex digits after 0x, or as bits where . is a
+ * don't care bit. char_value[i] and char_care[i] get bit i, 0 or 1.
+ * Returns the number of bits or -1.
+ */
+int parse_bits(char* char_text, char* char_value, char* char_care) {
     int i = 0;
-    char ascii_array[8];
+    int k = 0;
+    int int_bits = 0;
+    unsigned int uint_digit = 0;
+
+    if(strncmp(char_text, "0x", 2) == 0 || strncmp(char_text, "0X", 2) == 0) {
+        for(i = 2; char_text[i] != '\0'; i ++) {
+            if(int_bits + 4 > PATTERN_MAX_BITS || sscanf(char_text + i, "%1x", &uint_digit) != 1) return(-1);
+            for(k = 3; k >= 0; k --) {
+                char_value[int_bits] = (uint_digit >> k) & 1;
+                char_care[int_bits ++] = 1;
+            }
+        }
+    } else {
+        for(i = 0; char_text[i] != '\0'; i ++) {
+            if(int_bits + 1 > PATTERN_MAX_BITS) return(-1);
+            if(char_text[i] == '0' || char_text[i] == '1') {
+                char_value[int_bits] = char_text[i] - '0';
+                char_care[int_bits ++] = 1;
+            } else if(char_text[i] == '.') {
+                char_value[int_bits] = 0;
+                char_care[int_bits ++] = 0;
+            } else {
+                return(-1);
+            }
+        }
+    }
+
+    return((int_bits > 0) ? int_bits : -1);
+}
+
+
+/*
+ * Build the bytes of every alignment and the shift-and table from a
+ * pattern and an optional mask (NULL compares all bits).
+ */
+int compile_pattern(bit_pattern* pattern, char* char_pattern, char* char_mask) {
+    static char char_value[PATTERN_MAX_BITS];
+    static char char_care[PATTERN_MAX_BITS];
+    static char char_mask_value[PATTERN_MAX_BITS];
+    static char char_mask_care[PATTERN_MAX_BITS];
+    int int_bits = 0;
+    unsigned int b = 0;
+    unsigned int c = 0;
+    unsigned int j = 0;
+    unsigned int t = 0;
 
-    for(i = 7; i >= 0; i --) {
-        ascii_array[i] = 48 + (byte & 1);
-        //printf("%c ",48 + (byte & 1));
+    memset(pattern, 0, sizeof(bit_pattern));
 
-        byte >>= 1;
+    int_bits = parse_bits(char_pattern, char_value, char_care);
+    if(int_bits < 0) {
+        fprintf(stderr, "compile_pattern: Invalid pattern %s\n", char_pattern);
+        return(-1);
+    }
+    if(char_mask != NULL) {
+        if(parse_bits(char_mask, char_mask_value, char_mask_care) != int_bits) {
+            fprintf(stderr, "compile_pattern: The mask %s does not have %d bits.\n", char_mask, int_bits);
+            return(-1);
+        }
+        for(b = 0; b < (unsigned int)int_bits; b ++) {
+            char_care[b] &= char_mask_value[b];
+        }
     }
+    pattern->uint_bits = int_bits;
 
-    
-    for(i = 0; i < 8; i ++) {
-       printf("%c ", ascii_array[i]);
+    /* bit b of the pattern at alignment j is bit 7 - (j + b) % 8 of byte (j + b) / 8 */
+    for(j = 0; j < BITS_PER_BYTE; j ++) {
+        pattern->uint_bytes[j] = (j + pattern->uint_bits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+        for(b = 0; b < pattern->uint_bits; b ++) {
+            if(!char_care[b]) continue;
+            pattern->uchar_mask[j][(j + b) / BITS_PER_BYTE] |= 1 << (BITS_PER_BYTE - 1 - (j + b) % BITS_PER_BYTE);
+            pattern->uchar_value[j][(j + b) / BITS_PER_BYTE] |= char_value[b] << (BITS_PER_BYTE - 1 - (j + b) % BITS_PER_BYTE);
+        }
+    }
+    for(b = 0; b < pattern->uint_bits; b ++) {
+        pattern->uint_care_bits += char_care[b];
     }
+    pattern->uint_span_bytes = pattern->uint_bytes[BITS_PER_BYTE - 1];
 
-    return;
+    /* the shift-and automaton over the first bytes of every alignment */
+    pattern->uint_filter_bytes = MIN(pattern->uint_bytes[0], PATTERN_FILTER_BYTES);
+    for(j = 0; j < BITS_PER_BYTE; j ++) {
+        pattern->uint64_start |= 1ull << (PATTERN_FILTER_BYTES * j);
+        pattern->uint64_accept |= 1ull << (PATTERN_FILTER_BYTES * j + pattern->uint_filter_bytes - 1);
+        for(t = 0; t < pattern->uint_filter_bytes; t ++) {
+            for(c = 0; c < 256; c ++) {
+                if((c & pattern->uchar_mask[j][t]) == pattern->uchar_value[j][t]) {
+                    pattern->uint64_table[c] |= 1ull << (PATTERN_FILTER_BYTES * j + t);
+                }
+            }
+        }
+    }
+
+    return(0);
 }
 
 
-void allocate_lookup_tables(char char_left, char char_right) {
-    int i = 0;
-    uint32_t uint_left_mask = 0xFF000000;
-    uint32_t uint_middle_mask = 0x00FF0000;
-    uint32_t uint_right_mask = 0x0000FF00;
-    uint32_t uint_tmp = 0;
-    char* char_tmp;
+void print_pattern(bit_pattern* pattern) {
+    unsigned int b = 0;
+    unsigned int j = 0;
 
     printf("input pattern: ");
-    byte_to_ASCII(char_left);
-    printf(", ");
-    byte_to_ASCII(char_right);
-    printf("\n");
-
-    /* copy our bit pattern into a 32 bit integer */
-    uint32_t uint_pattern = 0;
-    uint_pattern |= char_left;
-    uint_pattern <<= 8;
-    uint_pattern |= char_right;
-    uint_pattern <<= 16;
-
-    /* fill the look-up tables */
-    for(i = 0; i < 8; i ++ ) {
-        printf("%d, ", i);
-        uint_tmp = uint_pattern & uint_left_mask;
-        char_mask_left[i] = ((unsigned char *)&uint_tmp)[3];
-        byte_to_ASCII(char_mask_left[i]);
-        
-        printf(", ");
-        
-        uint_tmp = uint_pattern & uint_middle_mask;
-        char_mask_middle[i] = ((unsigned char *)&uint_tmp)[2];
-        byte_to_ASCII(char_mask_middle[i]);
-        printf(", ");
-
-        uint_tmp = uint_pattern & uint_right_mask;
-        char_mask_right[i] = ((unsigned char *)&uint_tmp)[1];
-        byte_to_ASCII(char_mask_right[i]);
-        printf(", ");
-
-        printf("\n");
-        uint_pattern >>= 1;
+    for(b = 0; b < pattern->uint_bits; b ++) {
+        j = b / BITS_PER_BYTE;
+        if((pattern->uchar_mask[0][j] >> (BITS_PER_BYTE - 1 - b % BITS_PER_BYTE)) & 1) {
+            printf("%c", '0' + ((pattern->uchar_value[0][j] >> (BITS_PER_BYTE - 1 - b % BITS_PER_BYTE)) & 1));
+        } else {
+            printf(".");
+        }
     }
+    printf(" (%u bits, %u compared)\n", pattern->uint_bits, pattern->uint_care_bits);
 
     return;
 }
 
 
-void match_pattern(char* char_buffer, uint32_t uint_length, uint32_t uint_offset) {
-    uint32_t i = 0;
-    uint32_t j = 0;
-    char char_tmp;
+/* append a match, the list grows as needed */
+int add_match(match_list* matches, uint64_t uint64_offset, unsigned int uint_pattern) {
+    match* match_grown;
 
-    /* we only need to search for a match in the left table */
-    for(i = 0; i < uint_length - 2; i ++) {
-        for(j = 0; j < 8; j ++) {
-          
-            /* mask */
-            char_buffer[i] <<= j;
-            char_buffer[i] >>= j;
+    if(matches->size_t_count == matches->size_t_capacity) {
+        matches->size_t_capacity = (matches->size_t_capacity == 0) ? MATCH_LIST_START : 2 * matches->size_t_capacity;
+        match_grown = (match*)realloc(matches->matches, matches->size_t_capacity * sizeof(match));
+        if(match_grown == NULL) {
+            perror("add_match: Error allocating storage space.\n");
+            return(-1);
+        }
+        matches->matches = match_grown;
+    }
 
-            char_tmp = char_buffer[i + 2] >> (8 - j);
-            char_tmp <<= (8 - j);
+    matches->matches[matches->size_t_count].uint64_offset = uint64_offset;
+    matches->matches[matches->size_t_count ++].uint_pattern = uint_pattern;
 
-            if(char_buffer[i] == char_mask_left[j]) {
-                /* we got a hit, now check the middle and right table */
-                if(char_buffer[i + 1] == char_mask_middle[j] && char_tmp == char_mask_right[j]) {
-                    printf("found pattern at position %d, offset %d.\n", uint_offset + i, j);
-                }
+    return(0);
+}
+
+
+int compare_matches(const void* void_a, const void* void_b) {
+    const match* match_a = (const match*)void_a;
+    const match* match_b = (const match*)void_b;
+
+    if(match_a->uint64_offset != match_b->uint64_offset) {
+        return((match_a->uint64_offset > match_b->uint64_offset) ? 1 : -1);
+    }
+
+    return((match_a->uint_pattern > match_b->uint_pattern) - (match_a->uint_pattern < match_b->uint_pattern));
+}
+
+
+/* append the matches of another list */
+int append_matches(match_list* matches, match_list* matches_more) {
+    match* match_grown;
+
+    if(matches->size_t_count + matches_more->size_t_count > matches->size_t_capacity) {
+        matches->size_t_capacity = MAX(MAX(MATCH_LIST_START, 2 * matches->size_t_capacity), matches->size_t_count + matches_more->size_t_count);
+        match_grown = (match*)realloc(matches->matches, matches->size_t_capacity * sizeof(match));
+        if(match_grown == NULL) {
+            perror("append_matches: Error allocating storage space.\n");
+            return(-1);
+        }
+        matches->matches = match_grown;
+    }
+
+    if(matches_more->size_t_count > 0) {
+        memcpy(matches->matches + matches->size_t_count, matches_more->matches, matches_more->size_t_count * sizeof(match));
+    }
+    matches->size_t_count += matches_more->size_t_count;
+
+    return(0);
+}
+
+
+void free_match_list(match_list* matches) {
+
+    free(matches->matches);
+    matches->matches = NULL;
+    matches->size_t_count = 0;
+    matches->size_t_capacity = 0;
+
+    return;
+}
+
+
+/* check the bytes of alignment j after the filter bytes */
+int verify_pattern(bit_pattern* pattern, const unsigned char* uchar_start, unsigned int j) {
+    unsigned int t = 0;
+
+    for(t = pattern->uint_filter_bytes; t < pattern->uint_bytes[j]; t ++) {
+        if((uchar_start[t] & pattern->uchar_mask[j][t]) != pattern->uchar_value[j][t]) return(0);
+    }
+
+    return(1);
+}
+
+
+/*
+ * Look for matches starting in the bytes 0 ... size_t_end - 1 of the
+ * buffer. The buffer holds size_t_length bytes, the first of them is
+ * byte uint64_offset of the file. A match must not reach beyond the
+ * buffer.
+ */
+int match_pattern(bit_pattern* pattern, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_end, uint64_t uint64_offset, match_list* matches) {
+    size_t i = 0;
+    size_t size_t_start = 0;
+    size_t size_t_scan = MIN(size_t_end + pattern->uint_filter_bytes - 1, size_t_length);
+    unsigned int j = 0;
+    uint64_t uint64_state = 0;
+    uint64_t uint64_hits = 0;
+
+    for(i = 0; i < size_t_scan; i ++) {
+        uint64_state = ((uint64_state << 1) | pattern->uint64_start) & pattern->uint64_table[uchar_buffer[i]];
+        uint64_hits = uint64_state & pattern->uint64_accept;
+        if(uint64_hits == 0) continue;
+
+        /* the filter bytes of some alignments match, check the rest */
+        size_t_start = i + 1 - pattern->uint_filter_bytes;
+        if(size_t_start >= size_t_end) continue;
+        for(j = 0; j < BITS_PER_BYTE; j ++) {
+            if(!((uint64_hits >> (PATTERN_FILTER_BYTES * j + pattern->uint_filter_bytes - 1)) & 1)) continue;
+            if(size_t_start + pattern->uint_bytes[j] > size_t_length) continue;
+            if(verify_pattern(pattern, uchar_buffer + size_t_start, j)) {
+                if(add_match(matches, (uint64_offset + size_t_start) * BITS_PER_BYTE + j, 0) != 0) return(-1);
             }
         }
-        
     }
 
-    /* check if the last two bytes match the patterm */
-    if(char_buffer[uint_length - 2] == char_mask_left[0] && char_buffer[uint_length - 1] == char_mask_middle[0]) {
-        printf("found pattern at position %d, offset %d.\n", uint_offset + uint_length - 2, 0);
+    return(0);
+}
+
+
+/* the number of don't care bits of the key at byte t of alignment j */
+unsigned int key_free_bits(bit_pattern* pattern, unsigned int j, unsigned int t) {
+    unsigned int uint_mask = (unsigned int)pattern->uchar_mask[j][t] << 8;
+
+    if(t + 1 < pattern->uint_bytes[j]) uint_mask |= pattern->uchar_mask[j][t + 1];
+
+    return(KEY_BITS - __builtin_popcount(uint_mask));
+}
+
+
+/*
+ * Call function_key for every 16 bit value that matches the key of a
+ * candidate: we run through all combinations of its don't care bits.
+ */
+void for_each_key(bit_pattern* pattern, pattern_candidate* candidate, void (*function_key)(pattern_set*, pattern_candidate*, unsigned int), pattern_set* set) {
+    unsigned int j = candidate->uint_alignment;
+    unsigned int t = candidate->uint_key_byte;
+    unsigned int uint_mask = (unsigned int)pattern->uchar_mask[j][t] << 8;
+    unsigned int uint_value = (unsigned int)pattern->uchar_value[j][t] << 8;
+    unsigned int uint_free = 0;
+    unsigned int uint_subset = 0;
+
+    if(t + 1 < pattern->uint_bytes[j]) {
+        uint_mask |= pattern->uchar_mask[j][t + 1];
+        uint_value |= pattern->uchar_value[j][t + 1];
     }
+    uint_free = ~uint_mask & ((1u << KEY_BITS) - 1);
+
+    do {
+        function_key(set, candidate, uint_value | uint_subset);
+        uint_subset = (uint_subset - uint_free) & uint_free;
+    } while(uint_subset != 0);
+
+    return;
+}
+
+
+void count_key(pattern_set* set, pattern_candidate* candidate, unsigned int uint_key) {
+    (void)candidate;
+    set->uint32_first[uint_key + 1] ++;
+
+    return;
+}
+
+
+/* uint32_first[v] is the next free place for value v while we fill the list */
+void insert_key(pattern_set* set, pattern_candidate* candidate, unsigned int uint_key) {
+    set->candidates[set->uint32_first[uint_key] ++] = *candidate;
+    set->uint64_present[uint_key / 64] |= 1ull << (uint_key % 64);
+
+    return;
+}
+
+
+void free_pattern_set(pattern_set* set) {
+
+    free(set->patterns);
+    free(set->uint32_first);
+    free(set->candidates);
+    free(set->always);
+    memset(set, 0, sizeof(pattern_set));
 
     return;
 }
 
 
 /*
- * unbuffered read
+ * Compile uint_count patterns, each with an optional mask (NULL entries
+ * compare all bits), and build the filter over all of them.
  */
-int main(int argc, char *argv[]) {
-    FILE *file_in;
-    char* char_buffer;
-    uint32_t uint_filelength = 0;
-    //char char_left = 0x50;
-    //char char_right = 0x34;
+int compile_pattern_set(pattern_set* set, char** char_patterns, char** char_masks, unsigned int uint_count) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int t = 0;
+    unsigned int v = 0;
+    unsigned int uint_best = 0;
+    size_t size_t_total = 0;
+    pattern_candidate* candidates;
+    pattern_candidate* candidate;
 
-    char char_left = 0x78;
-    char char_right = 0x7E;
+    memset(set, 0, sizeof(pattern_set));
+    set->uint_count = uint_count;
+    set->patterns = (bit_pattern*)malloc(uint_count * sizeof(bit_pattern));
+    set->uint32_first = (uint32_t*)calloc((1 << KEY_BITS) + 1, sizeof(uint32_t));
+    set->always = (pattern_candidate*)malloc(uint_count * BITS_PER_BYTE * sizeof(pattern_candidate));
+    candidates = (pattern_candidate*)malloc(uint_count * BITS_PER_BYTE * sizeof(pattern_candidate));
+    if(set->patterns == NULL || set->uint32_first == NULL || set->always == NULL || candidates == NULL) {
+        perror("compile_pattern_set: Error allocating storage space.\n");
+        free(candidates);
+        free_pattern_set(set);
+        return(-1);
+    }
 
-    if( argc != 2 ) {
-        perror("Usage: search_binary infilename pattern\n");
-        exit(1);
+    /* pick the key of every pattern at every alignment and count the values it matches */
+    for(i = 0; i < uint_count; i ++) {
+        if(compile_pattern(&set->patterns[i], char_patterns[i], char_masks[i]) != 0) {
+            free(candidates);
+            free_pattern_set(set);
+            return(-1);
+        }
+        set->uint_span_bytes = MAX(set->uint_span_bytes, set->patterns[i].uint_span_bytes);
+
+        for(j = 0; j < BITS_PER_BYTE; j ++) {
+            candidate = &candidates[i * BITS_PER_BYTE + j];
+            candidate->uint_pattern = i;
+            candidate->uint_alignment = j;
+            candidate->uint_key_byte = 0;
+            uint_best = key_free_bits(&set->patterns[i], j, 0);
+            for(t = 1; t + 1 < set->patterns[i].uint_bytes[j]; t ++) {
+                if(key_free_bits(&set->patterns[i], j, t) < uint_best) {
+                    uint_best = key_free_bits(&set->patterns[i], j, t);
+                    candidate->uint_key_byte = t;
+                }
+            }
+
+            if(uint_best > KEY_MAX_FREE_BITS) {
+                candidate->uint_key_byte = 0;
+                set->always[set->uint_num_always ++] = *candidate;
+            } else {
+                set->uint_max_key_byte = MAX(set->uint_max_key_byte, candidate->uint_key_byte);
+                for_each_key(&set->patterns[i], candidate, count_key, set);
+            }
+        }
+    }
+
+    /* the counts become the first place of every value, then we fill in the candidates */
+    for(v = 0; v < (1 << KEY_BITS); v ++) {
+        set->uint32_first[v + 1] += set->uint32_first[v];
+    }
+    size_t_total = set->uint32_first[1 << KEY_BITS];
+    set->candidates = (pattern_candidate*)malloc(MAX(size_t_total, 1) * sizeof(pattern_candidate));
+    if(set->candidates == NULL) {
+        perror("compile_pattern_set: Error allocating storage space.\n");
+        free(candidates);
+        free_pattern_set(set);
+        return(-1);
+    }
+    for(i = 0; i < uint_count * BITS_PER_BYTE; i ++) {
+        if(key_free_bits(&set->patterns[candidates[i].uint_pattern], candidates[i].uint_alignment, candidates[i].uint_key_byte) > KEY_MAX_FREE_BITS) continue;
+        for_each_key(&set->patterns[candidates[i].uint_pattern], &candidates[i], insert_key, set);
+    }
+    /* insert_key() moved every first place on to the next value */
+    for(v = (1 << KEY_BITS); v > 0; v --) {
+        set->uint32_first[v] = set->uint32_first[v - 1];
+    }
+    set->uint32_first[0] = 0;
+
+    free(candidates);
+
+    return(0);
+}
+
+
+/* check all bytes of a candidate starting at byte size_t_start */
+int verify_candidate(pattern_set* set, pattern_candidate* candidate, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_start, uint64_t uint64_offset, match_list* matches) {
+    bit_pattern* pattern = &set->patterns[candidate->uint_pattern];
+    unsigned int j = candidate->uint_alignment;
+    unsigned int t = 0;
+
+    if(size_t_start + pattern->uint_bytes[j] > size_t_length) return(0);
+
+    for(t = 0; t < pattern->uint_bytes[j]; t ++) {
+        if((uchar_buffer[size_t_start + t] & pattern->uchar_mask[j][t]) != pattern->uchar_value[j][t]) return(0);
+    }
+
+    return(add_match(matches, (uint64_offset + size_t_start) * BITS_PER_BYTE + j, candidate->uint_pattern));
+}
+
+
+/*
+ * Like match_pattern(), but for all patterns of a set. A single pattern
+ * is faster with the shift-and automaton of match_pattern().
+ * The matches of a chunk are not sorted, see search_file().
+ */
+int match_pattern_set(pattern_set* set, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_end, uint64_t uint64_offset, match_list* matches) {
+    size_t i = 0;
+    size_t size_t_scan = MIN(size_t_end + set->uint_max_key_byte, size_t_length);
+    unsigned int k = 0;
+    unsigned int uint_key = 0;
+    pattern_candidate* candidate;
+
+    if(set->uint_count == 1) {
+        return(match_pattern(&set->patterns[0], uchar_buffer, size_t_length, size_t_end, uint64_offset, matches));
+    }
+
+    for(i = 0; i < size_t_scan; i ++) {
+        /* the candidates that have no key start here */
+        if(i < size_t_end) {
+            for(k = 0; k < set->uint_num_always; k ++) {
+                if(verify_candidate(set, &set->always[k], uchar_buffer, size_t_length, i, uint64_offset, matches) != 0) return(-1);
+            }
+        }
+
+        uint_key = (unsigned int)uchar_buffer[i] << 8;
+        if(i + 1 < size_t_length) uint_key |= uchar_buffer[i + 1];
+        if(!((set->uint64_present[uint_key / 64] >> (uint_key % 64)) & 1)) continue;
+
+        /* a candidate with its key at byte t starts t bytes earlier */
+        for(k = set->uint32_first[uint_key]; k < set->uint32_first[uint_key + 1]; k ++) {
+            candidate = &set->candidates[k];
+            if(i < candidate->uint_key_byte || i - candidate->uint_key_byte >= size_t_end) continue;
+            if(verify_candidate(set, candidate, uchar_buffer, size_t_length, i - candidate->uint_key_byte, uint64_offset, matches) != 0) return(-1);
+        }
+    }
+
+    return(0);
+}
+
+
+/* search one range and sort its matches, see search_buffer_parallel() */
+void* search_range_worker(void* void_range) {
+    search_range* range = (search_range*)void_range;
+
+    range->matches.size_t_count = 0;
+    range->int_status = match_pattern_set(range->set, range->uchar_buffer + range->size_t_start,
+        range->size_t_length - range->size_t_start, range->size_t_end - range->size_t_start,
+        range->uint64_offset + range->size_t_start, &range->matches);
+
+    /* with several patterns the matches come in the order of their keys */
+    qsort(range->matches.matches, range->matches.size_t_count, sizeof(match), compare_matches);
+
+    return(NULL);
+}
+
+
+/*
+ * Like match_pattern_set(), but the start positions 0 ... size_t_end - 1
+ * are split into uint_threads ranges of the same size. The ranges do
+ * not overlap, but every thread may read on into the next range, up to
+ * the end of its last match. The matches of the ranges are appended in
+ * the order of the ranges, so they come out sorted by offset.
+ * ranges has room for uint_threads ranges, their match lists keep
+ * their memory from one call to the next.
+ */
+int search_buffer_parallel(pattern_set* set, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_end, uint64_t uint64_offset, search_range* ranges, unsigned int uint_threads, match_list* matches) {
+    unsigned int i = 0;
+    int int_result = 0;
+    pthread_t thread_ids[SEARCH_MAX_THREADS];
+
+    /* a small buffer is not worth a thread */
+    uint_threads = MAX(1, MIN(uint_threads, size_t_end / SEARCH_MIN_RANGE_BYTES));
+
+    for(i = 0; i < uint_threads; i ++) {
+        ranges[i].set = set;
+        ranges[i].uchar_buffer = uchar_buffer;
+        ranges[i].size_t_length = size_t_length;
+        ranges[i].size_t_start = size_t_end / uint_threads * i;
+        ranges[i].size_t_end = (i + 1 == uint_threads) ? size_t_end : size_t_end / uint_threads * (i + 1);
+        ranges[i].uint64_offset = uint64_offset;
+    }
+
+    /* the calling thread works on the first range itself */
+    for(i = 1; i < uint_threads; i ++) {
+        if(pthread_create(&thread_ids[i], NULL, search_range_worker, &ranges[i]) != 0) {
+            perror("search_buffer_parallel: Unable to start a thread.\n");
+            search_range_worker(&ranges[i]);
+            thread_ids[i] = pthread_self();
+        }
+    }
+    search_range_worker(&ranges[0]);
+    for(i = 1; i < uint_threads; i ++) {
+        if(!pthread_equal(thread_ids[i], pthread_self())) {
+            int_result |= pthread_join(thread_ids[i], NULL);
+        }
+    }
+
+    for(i = 0; i < uint_threads; i ++) {
+        int_result |= ranges[i].int_status;
+        if(int_result == 0) int_result = append_matches(matches, &ranges[i].matches);
+    }
+
+    return(int_result == 0 ? 0 : -1);
+}
+
+
+/* fill a chunk with read(), which may return less than we ask for */
+ssize_t read_chunk(int int_file, unsigned char* uchar_buffer, size_t size_t_bytes) {
+    size_t size_t_read = 0;
+    ssize_t ssize_t_result = 0;
+
+    while(size_t_read < size_t_bytes) {
+        ssize_t_result = read(int_file, uchar_buffer + size_t_read, size_t_bytes - size_t_read);
+        if(ssize_t_result == 0) break;
+        if(ssize_t_result < 0) return(-1);
+        size_t_read += ssize_t_result;
     }
 
-    /* open file read-only */
-    file_in = fopen(argv[1], "r");
-    if( file_in == NULL ) {
+    return((ssize_t)size_t_read);
+}
+
+
+/*
+ * Search the whole file one chunk at a time, read with fread() through
+ * the buffer of the C library or with read() directly into our buffer.
+ * A match may cross the end of a chunk, so the bytes after the last
+ * complete search position are carried over to the front of the next
+ * chunk.
+ */
+int search_file_chunks(pattern_set* set, char* char_name, int int_strategy, search_range* ranges, unsigned int uint_threads, match_list* matches) {
+    FILE* file_in = NULL;
+    int int_file = -1;
+    int int_status = 0;
+    unsigned char* uchar_buffer;
+    size_t size_t_carried = 0;
+    ssize_t ssize_t_read = 0;
+    size_t size_t_length = 0;
+    size_t size_t_end = 0;
+    uint64_t uint64_offset = 0;
+    int int_last = 0;
+
+    if(int_strategy == IO_FREAD) {
+        file_in = fopen(char_name, "rb");
+    } else {
+        int_file = open(char_name, O_RDONLY);
+    }
+    if(file_in == NULL && int_file < 0) {
         perror("Can't open input file.\n");
-        exit(1);
+        return(-1);
     }
 
-    /* get the size of the file */
-    fseek (file_in , 0 , SEEK_END);
-    uint_filelength = ftell(file_in);
-    rewind(file_in);
+    uchar_buffer = (unsigned char*)malloc(SEARCH_CHUNK_BYTES + set->uint_span_bytes);
+    if(uchar_buffer == NULL) {
+        perror("search_file_chunks: Error allocating storage space.\n");
+        if(file_in != NULL) fclose(file_in);
+        if(int_file >= 0) close(int_file);
+        return(-1);
+    }
 
-    allocate_lookup_tables(char_left, char_right);
+    do {
+        if(int_strategy == IO_FREAD) {
+            ssize_t_read = (ssize_t)fread(uchar_buffer + size_t_carried, 1, SEARCH_CHUNK_BYTES, file_in);
+            if(ferror(file_in)) ssize_t_read = -1;
+        } else {
+            ssize_t_read = read_chunk(int_file, uchar_buffer + size_t_carried, SEARCH_CHUNK_BYTES);
+        }
+        if(ssize_t_read < 0) {
+            perror("Reading error\n");
+            int_status = -1;
+            break;
+        }
+        size_t_length = size_t_carried + ssize_t_read;
+        int_last = (ssize_t_read < SEARCH_CHUNK_BYTES);
 
-    char_buffer = (char*)malloc(uint_filelength * sizeof(char));
-    
-    int result = fread (char_buffer, 1, uint_filelength, file_in);
-    if(result != uint_filelength){
-        fputs("Reading error",stderr);
-        exit(1);
+        /* the last chunk is searched up to its end */
+        if(int_last) {
+            size_t_end = size_t_length;
+        } else {
+            size_t_end = size_t_length - (set->uint_span_bytes - 1);
+        }
+
+        if(search_buffer_parallel(set, uchar_buffer, size_t_length, size_t_end, uint64_offset, ranges, uint_threads, matches) != 0) {
+            int_status = -1;
+            break;
+        }
+
+        size_t_carried = size_t_length - size_t_end;
+        memmove(uchar_buffer, uchar_buffer + size_t_end, size_t_carried);
+        uint64_offset += size_t_end;
+    } while(!int_last);
+
+    free(uchar_buffer);
+    if(file_in != NULL) fclose(file_in);
+    if(int_file >= 0) close(int_file);
+
+    return(int_status);
+}
+
+
+/*
+ * Map the whole file into memory and search it at once. There is
+ * no copy and no carry-over; MADV_SEQUENTIAL asks the kernel to
+ * read ahead. Files that can't be mapped, like pipes, are read in
+ * chunks instead.
+ */
+int search_file_mmap(pattern_set* set, char* char_name, search_range* ranges, unsigned int uint_threads, match_list* matches) {
+    int int_file = -1;
+    int int_status = 0;
+    struct stat stat_file;
+    unsigned char* uchar_map;
+
+    int_file = open(char_name, O_RDONLY);
+    if(int_file < 0) {
+        perror("Can't open input file.\n");
+        return(-1);
     }
-    
 
-    /* match the patter */
-    match_pattern(char_buffer, uint_filelength, 0);
+    if(fstat(int_file, &stat_file) != 0 || !S_ISREG(stat_file.st_mode)) {
+        close(int_file);
+        return(search_file_chunks(set, char_name, IO_READ, ranges, uint_threads, matches));
+    }
 
-    fclose(file_in);
-    free(char_buffer);
-    return 0;
+    /* an empty file can't be mapped and has no matches */
+    if(stat_file.st_size == 0) {
+        close(int_file);
+        return(0);
+    }
+
+    uchar_map = (unsigned char*)mmap(NULL, stat_file.st_size, PROT_READ, MAP_PRIVATE, int_file, 0);
+    close(int_file);
+    if(uchar_map == MAP_FAILED) {
+        perror("search_file_mmap: Unable to map the file.\n");
+        return(-1);
+    }
+    madvise(uchar_map, stat_file.st_size, MADV_SEQUENTIAL);
+
+    int_status = search_buffer_parallel(set, uchar_map, stat_file.st_size, stat_file.st_size, 0, ranges, uint_threads, matches);
+
+    munmap(uchar_map, stat_file.st_size);
+
+    return(int_status);
 }
 
 
+/*
+ * Search the whole file with one of the I/O strategies.
+ * The matches are sorted by their offsets.
+ */
+int search_file(pattern_set* set, char* char_name, int int_strategy, unsigned int uint_threads, match_list* matches) {
+    unsigned int i = 0;
+    int int_status = 0;
+    search_range* ranges;
+
+    uint_threads = MAX(1, MIN(uint_threads, SEARCH_MAX_THREADS));
+    ranges = (search_range*)calloc(uint_threads, sizeof(search_range));
+    if(ranges == NULL) {
+        perror("search_file: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    if(int_strategy == IO_MMAP) {
+        int_status = search_file_mmap(set, char_name, ranges, uint_threads, matches);
+    } else {
+        int_status = search_file_chunks(set, char_name, int_strategy, ranges, uint_threads, matches);
+    }
+
+    for(i = 0; i < uint_threads; i ++) {
+        free_match_list(&ranges[i].matches);
+    }
+    free(ranges);
+
+    return(int_status);
+}
+
+
+/* the time of a monotonic clock in seconds */
+double search_clock(void) {
+    struct timespec timespec_now;
+
+    clock_gettime(CLOCK_MONOTONIC, &timespec_now);
+
+    return(timespec_now.tv_sec + 1e-9 * timespec_now.tv_nsec);
+}
+
+
+/*
+ * Search the file with every I/O strategy and print the time each one
+ * takes. The matches of int_strategy, which runs last, are kept.
+ */
+int report_strategies(pattern_set* set, char* char_name, int int_strategy, unsigned int uint_threads, match_list* matches) {
+    int k = 0;
+    int int_current = 0;
+    double double_start = 0.0;
+    double double_seconds = 0.0;
+    struct stat stat_file;
+    double double_megabytes = 0.0;
+
+    if(stat(char_name, &stat_file) == 0) double_megabytes = stat_file.st_size / 1e6;
+
+    for(k = 1; k <= IO_STRATEGIES; k ++) {
+        int_current = (int_strategy + k) % IO_STRATEGIES;
+        matches->size_t_count = 0;
+
+        double_start = search_clock();
+        if(search_file(set, char_name, int_current, uint_threads, matches) != 0) return(-1);
+        double_seconds = search_clock() - double_start;
+
+        printf("%-5s: %.3f s, %.1f MB/s, %llu matches, %u threads.\n", char_io_names[int_current], double_seconds,
+            (double_seconds > 0.0) ? double_megabytes / double_seconds : 0.0, (unsigned long long)matches->size_t_count, uint_threads);
+    }
+
+    return(0);
+}
+
 
+/*
+ * Add the patterns of a file, one per line, to char_patterns.
+ * The lines are kept in char_lines, which the caller frees.
+ */
+int read_pattern_file(char* char_name, char** char_patterns, unsigned int* uint_count, char** char_lines) {
+    FILE* file_patterns;
+    char char_line[PATTERN_LINE_LENGTH];
+    size_t size_t_length = 0;
 
+    file_patterns = fopen(char_name, "r");
+    if(file_patterns == NULL) {
+        perror("Can't open pattern file.\n");
+        return(-1);
+    }
+
+    while(fgets(char_line, PATTERN_LINE_LENGTH, file_patterns) != NULL) {
+        size_t_length = strcspn(char_line, " \t\r\n");
+        char_line[size_t_length] = '\0';
+        if(size_t_length == 0) continue;
+        if(*uint_count == PATTERN_MAX_COUNT) {
+            fprintf(stderr, "At most %d patterns are supported.\n", PATTERN_MAX_COUNT);
+            fclose(file_patterns);
+            return(-1);
+        }
+        char_lines[*uint_count] = strdup(char_line);
+        char_patterns[*uint_count] = char_lines[*uint_count];
+        (*uint_count) ++;
+    }
+
+    fclose(file_patterns);
+
+    return(0);
+}
+
+
+void print_search_usage(void) {
+    fprintf(stderr, "Usage: search_binary [-m mask] [-f patternfile] [-i fread|read|mmap] [-t threads] [-r] infilename [pattern ...]\n");
+
+    return;
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t i = 0;
+    unsigned int k = 0;
+    int int_option = 0;
+    int int_status = 0;
+    int int_strategy = IO_MMAP;
+    int int_report = 0;
+    long long_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    char* char_mask = NULL;
+    char* char_pattern_file = NULL;
+    char* char_colon;
+    static char* char_patterns[PATTERN_MAX_COUNT];
+    static char* char_masks[PATTERN_MAX_COUNT];
+    static char* char_lines[PATTERN_MAX_COUNT];
+    unsigned int uint_count = 0;
+    pattern_set set;
+    match_list matches = {NULL, 0, 0};
+
+    while((int_option = getopt(argc, argv, "m:f:i:t:r")) != -1) {
+        switch(int_option) {
+            case 'm': char_mask = optarg; break;
+            case 'f': char_pattern_file = optarg; break;
+            case 'i':
+                for(int_strategy = 0; int_strategy < IO_STRATEGIES && strcmp(optarg, char_io_names[int_strategy]) != 0; int_strategy ++);
+                if(int_strategy == IO_STRATEGIES) {
+                    print_search_usage();
+                    exit(1);
+                }
+                break;
+            case 't': long_threads = strtol(optarg, NULL, 10); break;
+            case 'r': int_report = 1; break;
+            default:
+                print_search_usage();
+                exit(1);
+        }
+    }
+
+    if( argc - optind < 1 || argc - optind - 1 > PATTERN_MAX_COUNT ) {
+        print_search_usage();
+        exit(1);
+    }
+
+    /* the patterns of the command line, then those of the file */
+    for(k = optind + 1; k < (unsigned int)argc; k ++) {
+        char_patterns[uint_count ++] = argv[k];
+    }
+    if(char_pattern_file != NULL && read_pattern_file(char_pattern_file, char_patterns, &uint_count, char_lines) != 0) {
+        exit(1);
+    }
+    if(uint_count == 0) char_patterns[uint_count ++] = "0x787E";
+
+    /* a mask after a colon belongs to its pattern, -m to all others */
+    for(k = 0; k < uint_count; k ++) {
+        char_masks[k] = char_mask;
+        char_colon = strchr(char_patterns[k], ':');
+        if(char_colon != NULL) {
+            *char_colon = '\0';
+            char_masks[k] = char_colon + 1;
+        }
+    }
+
+    int_status = compile_pattern_set(&set, char_patterns, char_masks, uint_count);
+    for(k = 0; k < uint_count; k ++) {
+        free(char_lines[k]);
+    }
+    if(int_status != 0) exit(1);
+    for(k = 0; k < uint_count; k ++) {
+        if(uint_count > 1) printf("%u: ", k);
+        print_pattern(&set.patterns[k]);
+    }
+
+    /* match all patterns in one pass */
+    long_threads = MAX(1, MIN(long_threads, SEARCH_MAX_THREADS));
+    if(int_report) {
+        int_status = report_strategies(&set, argv[optind], int_strategy, (unsigned int)long_threads, &matches);
+    } else {
+        int_status = search_file(&set, argv[optind], int_strategy, (unsigned int)long_threads, &matches);
+    }
+    if(int_status != 0) {
+        free_pattern_set(&set);
+        free_match_list(&matches);
+        exit(1);
+    }
+
+    for(i = 0; i < matches.size_t_count; i ++) {
+        if(uint_count > 1) printf("%u: ", matches.matches[i].uint_pattern);
+        printf("found pattern at bit %llu (byte %llu, offset %u).\n",
+            (unsigned long long)matches.matches[i].uint64_offset,
+            (unsigned long long)(matches.matches[i].uint64_offset / BITS_PER_BYTE),
+            (unsigned int)(matches.matches[i].uint64_offset % BITS_PER_BYTE));
+    }
+    printf("%llu matches.\n", (unsigned long long)matches.size_t_count);
+
+    free_pattern_set(&set);
+    free_match_list(&matches);
+
+    return 0;
+}
@@ -1,34 +1,180 @@
+/*
+ * Convert a text of ASCII bits like binary_data.txt into bytes,
+ * or bytes into ASCII bits with -r.
+ *
+ * The input is read in blocks of CONVERTER_BLOCK_BYTES, so files of any
+ * size are converted in constant memory. White space between the bits
+ * is ignored. Instead of adding up powers of 2 for every bit, we pack
+ * 8 ASCII digits into a byte with a single multiplication, and expand
+ * a byte into its 8 digits with a table look-up.
+ *
+ * Usage: converter [-r] infilename outfilename
+ * Either name may be - for stdin or stdout.
+ */
+
+/* includes */
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* include the table and the packing of the bit digits */
+#include "bit_digits.h"
+
+
+/* definitions to avoid "magic numbers" */
+#define CONVERTER_BLOCK_BYTES (1 << 20)
+
+
+/*
+ * The bits of a byte may be split between two blocks,
+ * so we carry them over to the next call.
+ */
+typedef struct {
+    unsigned int uint_partial;
+    unsigned int uint_pending;
+    uint64_t uint64_invalid;
+} text_bits_state;
+
+
+/*
+ * Pack the ASCII bits of a block into bytes. uchar_output needs room for
+ * size_t_length / 8 + 1 bytes. Returns the number of bytes written.
+ * Characters other than 0, 1 and white space are counted in the state
+ * and skipped.
+ */
+size_t text_to_bytes(text_bits_state* state, const char* char_input, size_t size_t_length, unsigned char* uchar_output) {
+    size_t size_t_i = 0;
+    size_t size_t_written = 0;
+    uint64_t uint64_digits = 0;
+    char char_digit = 0;
+
+    while(size_t_i < size_t_length) {
+        /* the fast path: 8 digits in a row make a byte */
+        if(state->uint_pending == 0 && size_t_i + BITS_PER_BYTE <= size_t_length) {
+            memcpy(&uint64_digits, char_input + size_t_i, BITS_PER_BYTE);
+            if((uint64_digits & ~DIGITS_LOW_BIT) == DIGITS_ZERO) {
+                uchar_output[size_t_written ++] = PACK_DIGITS(uint64_digits);
+                size_t_i += BITS_PER_BYTE;
+                continue;
+            }
+        }
 
+        /* one character at a time around white space and block ends */
+        char_digit = char_input[size_t_i ++];
+        if(char_digit == '0' || char_digit == '1') {
+            state->uint_partial = (state->uint_partial << 1) | (char_digit - ASCII_ZERO);
+            if(++ state->uint_pending == BITS_PER_BYTE) {
+                uchar_output[size_t_written ++] = (unsigned char)state->uint_partial;
+                state->uint_partial = 0;
+                state->uint_pending = 0;
+            }
+        } else if(char_digit != ' ' && char_digit != '\t' && char_digit != '\n' && char_digit != '\r') {
+            state->uint64_invalid ++;
+        }
+    }
+
+    return(size_t_written);
+}
+
+
+/* convert the whole input one block at a time */
+int convert_stream(FILE* file_input, FILE* file_output, int int_reverse) {
+    size_t size_t_read = 0;
+    size_t size_t_converted = 0;
+    char* char_text;
+    unsigned char* uchar_bytes;
+    text_bits_state state = {0, 0, 0};
+    int int_return_value = 0;
+
+    /* a block of text packs into an eighth of its size, a block of bytes expands 8 times */
+    char_text = (char*)malloc((size_t)CONVERTER_BLOCK_BYTES * (int_reverse ? BITS_PER_BYTE : 1));
+    uchar_bytes = (unsigned char*)malloc(int_reverse ? CONVERTER_BLOCK_BYTES : CONVERTER_BLOCK_BYTES / BITS_PER_BYTE + 1);
+    if(char_text == NULL || uchar_bytes == NULL) {
+        perror("convert_stream: Error allocating storage space.\n");
+        free(char_text);
+        free(uchar_bytes);
+        return(-1);
+    }
+
+    if(int_reverse) {
+        allocate_digits_table();
+        while((size_t_read = fread(uchar_bytes, 1, CONVERTER_BLOCK_BYTES, file_input)) > 0) {
+            bytes_to_digits(uchar_bytes, size_t_read, char_text);
+            fwrite(char_text, 1, size_t_read * BITS_PER_BYTE, file_output);
+        }
+        fputc('\n', file_output);
+    } else {
+        while((size_t_read = fread(char_text, 1, CONVERTER_BLOCK_BYTES, file_input)) > 0) {
+            size_t_converted = text_to_bytes(&state, char_text, size_t_read, uchar_bytes);
+            fwrite(uchar_bytes, 1, size_t_converted, file_output);
+        }
+
+        if(state.uint_pending > 0) {
+            fprintf(stderr, "converter: %u bits left over at the end, padded with zeros.\n", state.uint_pending);
+            fputc(state.uint_partial << (BITS_PER_BYTE - state.uint_pending), file_output);
+        }
+        if(state.uint64_invalid > 0) {
+            fprintf(stderr, "converter: skipped %llu characters that are not bits.\n", (unsigned long long)state.uint64_invalid);
+            int_return_value = -1;
+        }
+    }
+
+    if(ferror(file_input) || ferror(file_output)) {
+        perror("convert_stream: Error reading or writing.\n");
+        int_return_value = -1;
+    }
+
+    free(char_text);
+    free(uchar_bytes);
+
+    return(int_return_value);
+}
+
+
+/* We expect the input file name and the output file name
+ * after the options.
+ */
 int main(int argc, char* argv[]) {
-    FILE *binary_input;
-    char str[8];
-    char buffer[10000];
-    int i = 0;
-    int j = 0;
-    char s = 0;
-   
-    if((binary_input = fopen(argv[1], "r")) == NULL) {
-        perror("File not found\n");
+    int int_option = 0;
+    int int_reverse = 0;
+    int int_status = 0;
+    FILE* file_input;
+    FILE* file_output;
+
+    while((int_option = getopt(argc, argv, "r")) != -1) {
+        switch(int_option) {
+            case 'r': int_reverse = 1; break;
+            default:
+                fprintf(stderr, "Usage: converter [-r] infilename outfilename\n");
+                exit(1);
+        }
+    }
+
+    if(argc - optind != 2) {
+        fprintf(stderr, "Usage: converter [-r] infilename outfilename\n");
         exit(1);
     }
 
-    while(!feof(binary_input)) {
-        fgets(str, 8, binary_input);
-        for(i = 0; i < 8; i++) {
-            if(str[i] == '1') {
-                s = s + pow(2, 7-i);
-            }
-        }
+    file_input = (strcmp(argv[optind], "-") == 0) ? stdin : fopen(argv[optind], "rb");
+    if(file_input == NULL) {
+        perror("File not found\n");
+        exit(1);
+    }
 
-        sprintf(buffer[j], "%c ", s);
-        s = 0;
-        j++;
+    file_output = (strcmp(argv[optind + 1], "-") == 0) ? stdout : fopen(argv[optind + 1], "wb");
+    if(file_output == NULL) {
+        perror("Can't open output file.\n");
+        if(file_input != stdin) fclose(file_input);
+        exit(1);
     }
 
-    fclose(binary_input);
+    int_status = convert_stream(file_input, file_output, int_reverse);
+
+    if(file_input != stdin) fclose(file_input);
+    if(file_output != stdout && fclose(file_output) != 0) int_status = -1;
 
-    return(1);
+    return((int_status == 0) ? 0 : 1);
 }
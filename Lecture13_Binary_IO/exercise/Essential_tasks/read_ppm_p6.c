@@ -0,0 +1,139 @@
+/*
+ * Read a binary colour image (P6) like microscopy.ppm with the
+ * image library and print its header and its first pixels, as
+ * read_ppm_p6.pl does. The whole image is read with one fread,
+ * instead of 40 bytes at a time.
+ *
+ * -g writes the grey levels as a PGM file, -p writes every channel
+ * as a PGM file of its own, <prefix>_red.pgm and so on, and -o
+ * writes the image back as a P6 file after a round trip through
+ * the planar layout.
+ *
+ * Usage: read_ppm_p6 [-n pixels] [-g grey.pgm] [-p prefix] [-o out.ppm] infilename
+ * -n is the number of pixels to print (default 8).
+ */
+
+/* includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "image_p2.h"
+#include "image_p6.h"
+
+
+/* definitions to avoid "magic numbers" */
+#define DEFAULT_PRINT_PIXELS 8
+
+
+static const char* char_channel_names[RGB_CHANNELS] = {"red", "green", "blue"};
+
+
+/* write the grey levels of the image into a PGM file */
+int write_grey(image_rgb* image_input, char* char_name) {
+    image image_grey;
+    image_view view_grey;
+    int int_status = 0;
+
+    if(allocate_image_p2(&image_grey, image_input->uint_xres, image_input->uint_yres, 0) != 0) return(-1);
+    view_image_p2(&image_grey, &view_grey);
+
+    int_status = rgb_to_grey(image_input, &view_grey);
+    image_grey.uint_max = image_input->uint_max;
+    if(int_status == 0) int_status = write_image_p2(char_name, &image_grey);
+
+    free_image_p2(&image_grey);
+
+    return(int_status);
+}
+
+
+/*
+ * Split the image into its channels, write every channel
+ * as a PGM file if char_prefix is given, and the image
+ * put back together as a P6 file if char_output is given.
+ */
+int write_planes(image_rgb* image_input, char* char_prefix, char* char_output) {
+    image_planar image_planes;
+    image_rgb image_copy;
+    char char_name[FILENAME_MAX];
+    int c = 0;
+    int int_status = 0;
+
+    if(allocate_image_planar(&image_planes, image_input->uint_xres, image_input->uint_yres, image_input->uint_max) != 0) return(-1);
+    int_status = rgb_to_planar(image_input, &image_planes);
+
+    for(c = 0; c < RGB_CHANNELS && char_prefix != NULL && int_status == 0; c ++) {
+        snprintf(char_name, FILENAME_MAX, "%s_%s.pgm", char_prefix, char_channel_names[c]);
+        int_status = write_image_p2(char_name, &image_planes.image_channels[c]);
+    }
+
+    if(char_output != NULL && int_status == 0) {
+        int_status = allocate_image_rgb(&image_copy, image_input->uint_xres, image_input->uint_yres, image_input->uint_max);
+        if(int_status == 0) {
+            int_status = planar_to_rgb(&image_planes, &image_copy);
+            if(int_status == 0) int_status = write_image_p6(char_output, &image_copy);
+            free_image_rgb(&image_copy);
+        }
+    }
+
+    free_image_planar(&image_planes);
+
+    return(int_status);
+}
+
+
+/* We expect the input file name after the options. */
+int main(int argc, char* argv[]) {
+    int int_option = 0;
+    int int_status = 0;
+    unsigned int j = 0;
+    unsigned int uint_print = DEFAULT_PRINT_PIXELS;
+    unsigned char* uchar_pixel;
+    char* char_grey = NULL;
+    char* char_prefix = NULL;
+    char* char_output = NULL;
+    image_rgb image_input;
+
+    while((int_option = getopt(argc, argv, "n:g:p:o:")) != -1) {
+        switch(int_option) {
+            case 'n': uint_print = strtoul(optarg, NULL, 10); break;
+            case 'g': char_grey = optarg; break;
+            case 'p': char_prefix = optarg; break;
+            case 'o': char_output = optarg; break;
+            default:
+                fprintf(stderr, "Usage: read_ppm_p6 [-n pixels] [-g grey.pgm] [-p prefix] [-o out.ppm] infilename\n");
+                exit(1);
+        }
+    }
+
+    if(argc - optind != 1) {
+        fprintf(stderr, "Usage: read_ppm_p6 [-n pixels] [-g grey.pgm] [-p prefix] [-o out.ppm] infilename\n");
+        exit(1);
+    }
+
+    if(read_image_p6(argv[optind], &image_input) != 0) {
+        exit(1);
+    }
+
+    printf("Reading a PPM file, format P6, name %s\n", argv[optind]);
+    printf("This image is %u by %u\n", image_input.uint_xres, image_input.uint_yres);
+    printf("Each pixel can take one of %u possible values\n\n", image_input.uint_max);
+
+    uint_print = MIN(uint_print, image_input.uint_xres * image_input.uint_yres);
+    for(j = 0; j < uint_print; j ++) {
+        uchar_pixel = RGB_PIXEL(&image_input, j % image_input.uint_xres, j / image_input.uint_xres);
+        printf("pixel %u (%u, %u, %u)\n", j, uchar_pixel[RGB_RED], uchar_pixel[RGB_GREEN], uchar_pixel[RGB_BLUE]);
+    }
+
+    if(char_grey != NULL) {
+        int_status |= write_grey(&image_input, char_grey);
+    }
+    if(char_prefix != NULL || char_output != NULL) {
+        int_status |= write_planes(&image_input, char_prefix, char_output);
+    }
+
+    free_image_rgb(&image_input);
+
+    return((int_status == 0) ? 0 : 1);
+}
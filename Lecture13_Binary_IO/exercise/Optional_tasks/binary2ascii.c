@@ -1,123 +1,267 @@
+/*
+ * Convert a binary portable bitmap (P4) into an ASCII one (P1),
+ * or the other way round. The direction follows from the magic
+ * number of the input file.
+ *
+ * Every byte of a P4 row holds 8 pixels, the most significant bit
+ * first. Instead of dividing every byte by 2 eight times, we look
+ * up its 8 ASCII digits in a table of 256 entries and copy them
+ * all at once. Going back, we pack 8 ASCII digits with a single
+ * multiplication. Either way a row is written with one fwrite.
+ *
+ * Usage: binary2ascii [-v] infilename outfilename
+ * -v prints a line for every row converted.
+ */
 
 /* includes */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 
 
+/* include the header skipper of our PBM routines and the bit digits */
+#include "image_p2.h"
+#include "bit_digits.h"
+
+
 /* definitions to avoid "magic numbers" */
 #define INT_BUFFERLENGTH 1024
-#define BITS_PER_BYTE 8
-#define ASCII_ZERO 48
 
-/* We expect the input file name in argv[1] 
- * and the outout file name in argv[2] 
+
+/* the number of bytes of a P4 row, the last byte may be filled up with 0 bits */
+unsigned int bitmap_row_bytes(unsigned int uint_xres) {
+    return(uint_xres / BITS_PER_BYTE + ((uint_xres % BITS_PER_BYTE) > 0));
+}
+
+
+/* expand a P4 row into uint_xres ASCII digits, see allocate_digits_table() */
+void unpack_bits_row(unsigned char* uchar_binary, char* char_ascii, unsigned int uint_xres) {
+    unsigned int uint_full_bytes = uint_xres / BITS_PER_BYTE;
+    char char_last[BITS_PER_BYTE];
+
+    bytes_to_digits(uchar_binary, uint_full_bytes, char_ascii);
+
+    /* the pixels in the last byte of the row */
+    if(uint_xres % BITS_PER_BYTE > 0) {
+        bytes_to_digits(uchar_binary + uint_full_bytes, 1, char_last);
+        memcpy(char_ascii + uint_full_bytes * BITS_PER_BYTE, char_last, uint_xres % BITS_PER_BYTE);
+    }
+
+    return;
+}
+
+
+/* pack uint_xres ASCII digits into a P4 row */
+void pack_bits_row(char* char_ascii, unsigned char* uchar_binary, unsigned int uint_xres) {
+    unsigned int j = uint_xres / BITS_PER_BYTE;
+    unsigned int k = 0;
+
+    digits_to_bytes(char_ascii, j, uchar_binary);
+
+    /* the pixels in the last byte of the row, the rest is 0 */
+    if(uint_xres % BITS_PER_BYTE > 0) {
+        uchar_binary[j] = 0;
+        for(k = 0; k < uint_xres % BITS_PER_BYTE; k ++) {
+            uchar_binary[j] |= (char_ascii[j * BITS_PER_BYTE + k] & 1) << (BITS_PER_BYTE - 1 - k);
+        }
+    }
+
+    return;
+}
+
+
+/*
+ * Read the magic number and the resolution of a bitmap.
+ * Comments may appear anywhere in the header. After the
+ * resolution there is exactly one white space character,
+ * then the pixels start.
+ */
+int read_pbm_header(FILE* file_input, char* char_type, unsigned int* uint_xres, unsigned int* uint_yres) {
+    char char_magic[3] = {0, 0, 0};
+
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2 || char_magic[0] != 'P' ||
+        (char_magic[1] != '1' && char_magic[1] != '4')) {
+        perror("Not a P1 or P4 image (portable bitmap)\n");
+        return(-1);
+    }
+    *char_type = char_magic[1];
+
+    if(skip_PBM_space(file_input) != 0 || fscanf(file_input, "%u", uint_xres) != 1 ||
+        skip_PBM_space(file_input) != 0 || fscanf(file_input, "%u", uint_yres) != 1 ||
+        *uint_xres == 0 || *uint_yres == 0) {
+        perror("Invalid resolution in the bitmap header\n");
+        return(-1);
+    }
+    getc(file_input);
+
+    return(0);
+}
+
+
+/* read the next uint_xres ASCII digits of a P1 image, ignoring white space and comments */
+int read_ascii_row(FILE* file_input, char* char_ascii, unsigned int uint_xres) {
+    unsigned int j = 0;
+    int int_char = 0;
+
+    while(j < uint_xres) {
+        int_char = getc(file_input);
+        if(int_char == '0' || int_char == '1') {
+            char_ascii[j ++] = (char)int_char;
+        } else if(int_char == '#') {
+            while((int_char = getc(file_input)) != EOF && int_char != '\n');
+        } else if(int_char == EOF) {
+            return(-1);
+        } else if(int_char != ' ' && int_char != '\t' && int_char != '\n' && int_char != '\r') {
+            return(-1);
+        }
+    }
+
+    return(0);
+}
+
+
+/* convert the rows of a P4 image, the header is already read */
+int binary_to_ascii(FILE* file_input, FILE* file_output, unsigned int uint_xres, unsigned int uint_yres, int int_verbose) {
+    unsigned int i = 0;
+    unsigned int uint_imageline_in_bytes = bitmap_row_bytes(uint_xres);
+    unsigned char* uchar_binary_imageline;
+    char* char_ascii_imageline;
+
+    /* allocate the memory for a line of the binary and ascii image,
+     * the ascii line ends with a new line
+     */
+    uchar_binary_imageline = (unsigned char*)malloc(uint_imageline_in_bytes);
+    char_ascii_imageline = (char*)malloc((uint_xres + 1) * sizeof(char));
+    if(uchar_binary_imageline == NULL || char_ascii_imageline == NULL) {
+        perror("binary_to_ascii: Error allocating storage space.\n");
+        free(uchar_binary_imageline);
+        free(char_ascii_imageline);
+        return(-1);
+    }
+    char_ascii_imageline[uint_xres] = '\n';
+
+    fprintf(file_output, "P1\n# CREATOR: binary2ascii\n%u %u\n", uint_xres, uint_yres);
+
+    for(i = 0; i < uint_yres; i ++) {
+        if(fread(uchar_binary_imageline, sizeof(char), uint_imageline_in_bytes, file_input) != uint_imageline_in_bytes) {
+            perror("Unexpected end of pbm file.\n");
+            break;
+        }
+
+        unpack_bits_row(uchar_binary_imageline, char_ascii_imageline, uint_xres);
+        fwrite(char_ascii_imageline, sizeof(char), uint_xres + 1, file_output);
+
+        if(int_verbose) printf("converted line %u of binary image.\n", i);
+    }
+
+    free(uchar_binary_imageline);
+    free(char_ascii_imageline);
+
+    return((i == uint_yres) ? 0 : -1);
+}
+
+
+/* convert the rows of a P1 image, the header is already read */
+int ascii_to_binary(FILE* file_input, FILE* file_output, unsigned int uint_xres, unsigned int uint_yres, int int_verbose) {
+    unsigned int i = 0;
+    unsigned int uint_imageline_in_bytes = bitmap_row_bytes(uint_xres);
+    unsigned char* uchar_binary_imageline;
+    char* char_ascii_imageline;
+
+    uchar_binary_imageline = (unsigned char*)malloc(uint_imageline_in_bytes);
+    char_ascii_imageline = (char*)malloc(uint_xres * sizeof(char));
+    if(uchar_binary_imageline == NULL || char_ascii_imageline == NULL) {
+        perror("ascii_to_binary: Error allocating storage space.\n");
+        free(uchar_binary_imageline);
+        free(char_ascii_imageline);
+        return(-1);
+    }
+
+    fprintf(file_output, "P4\n# CREATOR: binary2ascii\n%u %u\n", uint_xres, uint_yres);
+
+    for(i = 0; i < uint_yres; i ++) {
+        if(read_ascii_row(file_input, char_ascii_imageline, uint_xres) != 0) {
+            perror("Unexpected end of pbm file.\n");
+            break;
+        }
+
+        pack_bits_row(char_ascii_imageline, uchar_binary_imageline, uint_xres);
+        fwrite(uchar_binary_imageline, sizeof(char), uint_imageline_in_bytes, file_output);
+
+        if(int_verbose) printf("converted line %u of ASCII image.\n", i);
+    }
+
+    free(uchar_binary_imageline);
+    free(char_ascii_imageline);
+
+    return((i == uint_yres) ? 0 : -1);
+}
+
+
+/* We expect the input file name and the output file name
+ * after the options.
  */
 int main(int argc, char *argv[]) {
-    int i = 0;
+    int int_option = 0;
+    int int_verbose = 0;
+    int int_status = 0;
+    char char_type = 0;
     FILE *file_input;
     FILE *file_output;
-    char *char_buffer;
-    char *char_binary_imageline;
-    char *char_ascii_imageline;
     unsigned int uint_xres = 0;
     unsigned int uint_yres = 0;
-    unsigned int uint_imageline_in_bytes = 0;
 
-    /* We expect the file name in argv[1],
-     * otherwise print a meaningful message
-     * and exit with an error number set.
+    while((int_option = getopt(argc, argv, "v")) != -1) {
+        switch(int_option) {
+            case 'v': int_verbose = 1; break;
+            default:
+                fprintf(stderr, "Usage: binary2ascii [-v] infilename outfilename\n");
+                exit(1);
+        }
+    }
+
+    /* We expect two file names, otherwise print
+     * a meaningful message and exit with an error number set.
      */
-    if( argc != 3 ) {
-        perror("Usage: binary2ascii infilename outfilename\n");
+    if( argc - optind != 2 ) {
+        fprintf(stderr, "Usage: binary2ascii [-v] infilename outfilename\n");
         exit(1);
     }
 
     /* open file read-only */
-    file_input = fopen(argv[1], "r");
+    file_input = fopen(argv[optind], "rb");
     if( file_input == NULL ) {
         perror("Can't open input file.\n");
         exit(1);
     }
 
-    /* open output file */
-    file_output = fopen(argv[2], "w");
-    if( file_output  == NULL ) {
-        perror("Can't open output file.\n");
+    /* Get the image type and resolution from the file. */
+    if(read_pbm_header(file_input, &char_type, &uint_xres, &uint_yres) != 0) {
+        fclose(file_input);
         exit(1);
     }
+    printf("Image %s is a P%c bitmap of %u by %u pixels.\n", argv[optind], char_type, uint_xres, uint_yres);
 
-    /* Get the image type and resolution from the file.
-     * We know that the first line gives the image type
-     * and the second or third line the dimension.
-     */
-    printf("read header of binary image: %s.\n", argv[1]);
-    char_buffer = (char*)malloc(INT_BUFFERLENGTH * sizeof(char) );
-
-
-    fgets(char_buffer, INT_BUFFERLENGTH, file_input);
-    if( strncmp(char_buffer, "P4", 2 * sizeof(char)) != 0) {
-        perror("Not a P4 image (binary encoded portable bitmap)\n");
+    /* open output file */
+    file_output = fopen(argv[optind + 1], "wb");
+    if( file_output  == NULL ) {
+        perror("Can't open output file.\n");
+        fclose(file_input);
         exit(1);
     }
 
-    fgets(char_buffer, INT_BUFFERLENGTH, file_input);
-    while(char_buffer[0] == '#') {
-         fgets(char_buffer, INT_BUFFERLENGTH, file_input);
+    if(char_type == '4') {
+        allocate_digits_table();
+        int_status = binary_to_ascii(file_input, file_output, uint_xres, uint_yres, int_verbose);
+    } else {
+        int_status = ascii_to_binary(file_input, file_output, uint_xres, uint_yres, int_verbose);
     }
-    sscanf(char_buffer, "%d %d", &uint_xres, &uint_yres);
-    
-    printf("Image resolution is %d by %d pixels.\n", uint_xres, uint_yres);
 
-    /* How many bytes to we need to store a single line of the image? Consider an 
-     * image of size 3 pixels, we still need to store an entire bytes.
-     */
-    uint_imageline_in_bytes = uint_xres / BITS_PER_BYTE + ((uint_xres % BITS_PER_BYTE) > 0);
-    printf("binary image line in bytes: %d\n", uint_imageline_in_bytes);
-
-
-    /* allocate the memory for a line of the binary and ascii image */
-    char_binary_imageline = (char*)malloc( uint_imageline_in_bytes );
-    char_ascii_imageline = (char*)malloc(uint_xres * sizeof(char));
-
-    /* write the header information */
-    fprintf(file_output, "P1\n%d %d\n# CREATOR: binary2ascii\n", uint_xres, uint_yres);
-
-    for(i = 0; i < uint_yres; i ++) {
-        /* read a single line of the binary image */
-        printf("read line %d of binary image, ", i);
-        fread(char_binary_imageline, sizeof(char), uint_imageline_in_bytes, file_input);
-        if (feof(file_input)) {
-            perror("Unexpected end of pbm file.\n");
-            exit(1);
-        }   
-
-        /*---------------------------------*/
-        /* Your conversion code goes here! */
-        /*---------------------------------*/
-
-        /* you have got a character array full of binary data */
-        /* your job is to take this data character by character and convert */
-        /* and print out every bit of it  */
-        /* To do this use the algorithm continually dividing a decimal number by 2 */
-        /* to get it binary representation */ 
-
-        /* append the line to the output file */
-        printf("write line of ASCII image.\n");
-        fwrite(char_ascii_imageline, sizeof(char), uint_xres, file_output);
-        fputc('\n', file_output);
-    }
-        
-    
     /* close file */
     fclose(file_input);
     fclose(file_output);
 
-    /* free the allocated memory */
-    free(char_buffer);
-    free(char_binary_imageline);
-    free(char_ascii_imageline);
-
-    return(0);
+    return((int_status == 0) ? 0 : 1);
 }
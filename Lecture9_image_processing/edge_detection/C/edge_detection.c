@@ -1,11 +1,25 @@
 /*
- * This code accepts portable greymap (P2) images.
+ * This code accepts portable greymap images with up to 16 bit
+ * (P2 and P5) and grey portable float maps (PFM).
+ *
+ * To compile it use:
+ * make edge_detection
+ *
+ * in the top directory of the repository, or by hand:
+ * C=../../../common
+ * gcc edge_detection.c $C/image_p2.c $C/image_p5.c $C/image_p6.c $C/image_arena.c $C/histogram.c $C/instrument.c $C/cpu_dispatch.c $C/image_bitmap.c -o edge_detection -I $C -lm -lpthread
+ *
+ * Add -DINSTRUMENT to time the stages, see the -i option.
  */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
 
 #define ASCII_ZERO 48
 #define MAX_RECURSIONS 100
@@ -18,18 +32,31 @@
 #define EDGE_START 670
 #define EDGE_STOP 670
 
-/* C does not know about MIN and MAX, so we define them as macros.
- * Beware, this code only works for built-in data types like float or int.
- */
-#define MIN(X, Y) ((X) < (Y) ? (X) : (Y))
-#define MAX(X, Y) ((X) > (Y) ? (X) : (Y))
+/* The number of 16 bit temporary images canny() takes from its arena */
+#define CANNY_TEMPORARY_IMAGES 3
 
-typedef struct {
-    unsigned int** int_image_data;
-    unsigned int uint_xres;
-    unsigned int uint_yres;
-    unsigned int uint_max;
-} image;
+/* Pass CANNY_AUTO_THRESHOLD as both thresholds to let canny() pick them.
+ * tmin and tmax are then the given percentiles of all non-zero
+ * gradient magnitudes in the image.
+ */
+#define CANNY_AUTO_THRESHOLD 0xFFFFFFFFu
+#define CANNY_LOW_PERCENTILE 70.0
+#define CANNY_HIGH_PERCENTILE 90.0
+
+/* Threads for the hysteresis of canny_streaming(), 0 traces the edges serially */
+#ifndef HYSTERESIS_THREADS
+#define HYSTERESIS_THREADS 0
+#endif
+
+/* include our PGM routines, the arena for temporary images, the instrumentation and the CPU dispatch */
+#include "image_p2.h"
+#include "image_arena.h"
+#include "histogram.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
+#include "image_bitmap.h"
+#include "image_p6.h"
+#include "image_p5.h"
 
 
 typedef struct {
@@ -55,14 +82,14 @@ static int int_gaussian_5x5[5][5] = {1, 4, 7, 4, 1,
 /* this function should not be called directly.
  * It does not do any boundary checks.
  */
-int gaussian_filter(image* the_image, unsigned int uint_x, unsigned int uint_y) {
+int gaussian_filter(image_view* the_image, unsigned int uint_x, unsigned int uint_y) {
     int i = 0;
     int j = 0;
     float float_tmp = 0.0f;
     
     for(i = - GAUSSIAN_KERNEL_SIZE / 2; i <= GAUSSIAN_KERNEL_SIZE / 2; i ++) {
          for(j = - GAUSSIAN_KERNEL_SIZE / 2; j <= GAUSSIAN_KERNEL_SIZE / 2; j ++) {        
-             float_tmp += int_gaussian_5x5[i + 2][j + 2] * the_image->int_image_data[uint_y + i][uint_x + j];
+             float_tmp += int_gaussian_5x5[i + 2][j + 2] * VIEW_PIXEL(the_image, uint_x + j, uint_y + i);
              //printf("j: %d, i: %d, f: %f\n", j, i, float_tmp);
          }
     }
@@ -75,27 +102,67 @@ int gaussian_filter(image* the_image, unsigned int uint_x, unsigned int uint_y)
  * This code should work with all kind of filter kernels.
  * You only have to change the actual filter function.
  */
-void filter_image(image* the_image, image* image_gradient, unsigned int uint_width, unsigned int uint_height, int (filter_pixel)(image*, unsigned int, unsigned int), unsigned int uint_neutral ) {
+void filter_image(image_view* the_image, image_view* image_gradient, unsigned int uint_width, unsigned int uint_height, int (filter_pixel)(image_view*, unsigned int, unsigned int), unsigned int uint_neutral ) {
     int i = 0;
     int j = 0;
 
+    INSTRUMENT_BEGIN(filter_image);
+
     for(i = 0; i < the_image->uint_yres; i ++) {
         for(j = 0; j < the_image->uint_xres; j ++) {
 
             /* set the border pixels to 255 (neutral for edge detection) */
             if(i <= uint_height / 2 || i >= the_image->uint_yres - uint_height / 2 || j <= uint_width / 2 || j >= the_image->uint_xres - uint_width / 2) {
-                image_gradient->int_image_data[i][j] = uint_neutral;
+                VIEW_PIXEL(image_gradient, j, i) = uint_neutral;
             } else {
                 /* change this line to use a different filter */
-                image_gradient->int_image_data[i][j] = filter_pixel(the_image, j, i);
+                VIEW_PIXEL(image_gradient, j, i) = filter_pixel(the_image, j, i);
             }
         }
     }
 
+    INSTRUMENT_COUNT(filter_image, INSTRUMENT_PIXELS, (uint64_t)the_image->uint_xres * the_image->uint_yres);
+    INSTRUMENT_END(filter_image);
+
     return;
 }
 
 
+/* The filter that filter_channel() runs on every channel */
+typedef struct {
+    unsigned int uint_width;
+    unsigned int uint_height;
+    int (*filter_pixel)(image_view*, unsigned int, unsigned int);
+    unsigned int uint_neutral;
+} filter_arguments;
+
+
+int filter_channel(image_view* view_input, image_view* view_output, int int_channel, void* void_argument) {
+    filter_arguments* arguments = (filter_arguments*)void_argument;
+    (void)int_channel;
+
+    filter_image(view_input, view_output, arguments->uint_width, arguments->uint_height, arguments->filter_pixel, arguments->uint_neutral);
+
+    return(0);
+}
+
+
+/* Linear filter of a colour image
+ * Every channel is filtered on its own, all three in parallel.
+ * image_output has to be allocated with the size of image_input.
+ */
+int filter_planar(image_planar* image_input, image_planar* image_output, unsigned int uint_width, unsigned int uint_height, int (filter_pixel)(image_view*, unsigned int, unsigned int), unsigned int uint_neutral) {
+    filter_arguments arguments;
+
+    arguments.uint_width = uint_width;
+    arguments.uint_height = uint_height;
+    arguments.filter_pixel = filter_pixel;
+    arguments.uint_neutral = uint_neutral;
+
+    return(for_each_channel(image_input, image_output, filter_channel, &arguments));
+}
+
+
 /*----------------------
  * CANNY EDGE DETECTION
  *--------------------*/
@@ -108,42 +175,57 @@ void filter_image(image* the_image, image* image_gradient, unsigned int uint_wid
 
 /* The sobel operator in x and y direction*/
 #define SOBEL_KERNEL_SIZE 3
-int sobel_gx(image* the_image, unsigned int uint_x, unsigned int uint_y) {
+int sobel_gx(image_view* the_image, unsigned int uint_x, unsigned int uint_y) {
     int float_tmp = 0;
     
-    float_tmp = - the_image->int_image_data[uint_y - 1][uint_x - 1] 
-                + the_image->int_image_data[uint_y - 1][uint_x + 1]
-                - 2 * the_image->int_image_data[uint_y][uint_x - 1]
-                + 2 * the_image->int_image_data[uint_y][uint_x + 1]
-                - the_image->int_image_data[uint_y + 1][uint_x - 1]
-                + the_image->int_image_data[uint_y + 1][uint_x + 1];
+    float_tmp = - VIEW_PIXEL(the_image, uint_x - 1, uint_y - 1) 
+                + VIEW_PIXEL(the_image, uint_x + 1, uint_y - 1)
+                - 2 * VIEW_PIXEL(the_image, uint_x - 1, uint_y)
+                + 2 * VIEW_PIXEL(the_image, uint_x + 1, uint_y)
+                - VIEW_PIXEL(the_image, uint_x - 1, uint_y + 1)
+                + VIEW_PIXEL(the_image, uint_x + 1, uint_y + 1);
 
     return(float_tmp);
 }
 
-int sobel_gy(image* the_image, unsigned int uint_x, unsigned int uint_y) {
+int sobel_gy(image_view* the_image, unsigned int uint_x, unsigned int uint_y) {
     int float_tmp = 0;
     
-    float_tmp = (- the_image->int_image_data[uint_y - 1][uint_x - 1] 
-                - 2 * the_image->int_image_data[uint_y - 1][uint_x]
-                - the_image->int_image_data[uint_y - 1][uint_x + 1]
-                + the_image->int_image_data[uint_y + 1][uint_x - 1]
-                + 2 * the_image->int_image_data[uint_y + 1][uint_x]
-                + the_image->int_image_data[uint_y + 1][uint_x + 1]);
+    float_tmp = (- VIEW_PIXEL(the_image, uint_x - 1, uint_y - 1) 
+                - 2 * VIEW_PIXEL(the_image, uint_x, uint_y - 1)
+                - VIEW_PIXEL(the_image, uint_x + 1, uint_y - 1)
+                + VIEW_PIXEL(the_image, uint_x - 1, uint_y + 1)
+                + 2 * VIEW_PIXEL(the_image, uint_x, uint_y + 1)
+                + VIEW_PIXEL(the_image, uint_x + 1, uint_y + 1));
 
     return(float_tmp);
 }
 
 
-void gradient_magnitude(image* image_gradientmagnitude, image* image_gradientx, image* image_gradienty) {
-    int i = 0;
-    int j = 0;
-    float float_tmp = 0.0f;
+/* The gradient magnitude of a single row, shifted right by uint_shift bits.
+ * The squares are summed in float like sobel_magnitude_row(), the gradients
+ * of a 16 bit image would overflow in 32 bit. For 8 bit images they are exact.
+ * If histogram_magnitude is not NULL, we also count all non-zero magnitudes
+ * in it while we have them at hand. The histogram must have one bin per level,
+ * see allocate_magnitude_histogram().
+ * The first loop is vectorised for the CPU we run on, see cpu_dispatch.h.
+ */
+CPU_DISPATCH void gradient_magnitude_row(unsigned int* uint_magnitude, unsigned int* uint_gradientx, unsigned int* uint_gradienty, unsigned int uint_xres, unsigned int uint_shift, histogram* histogram_magnitude) {
+    unsigned int j = 0;
+    float float_gx = 0.0f;
+    float float_gy = 0.0f;
 
-    for(i = 0; i < image_gradientmagnitude->uint_yres; i ++) {
-        for(j = 0; j < image_gradientmagnitude->uint_xres; j ++) {
-            float_tmp = sqrtf(image_gradientx->int_image_data[i][j] * image_gradientx->int_image_data[i][j] + image_gradienty->int_image_data[i][j] * image_gradienty->int_image_data[i][j]);
-            image_gradientmagnitude->int_image_data[i][j] = (int)(float_tmp + 0.5f);
+    for(j = 0; j < uint_xres; j ++) {
+        float_gx = (float)(int)uint_gradientx[j];
+        float_gy = (float)(int)uint_gradienty[j];
+        uint_magnitude[j] = (unsigned int)(int)(sqrtf(float_gx * float_gx + float_gy * float_gy) + 0.5f) >> uint_shift;
+    }
+
+    if(histogram_magnitude != NULL) {
+        for(j = 0; j < uint_xres; j ++) {
+            if(uint_magnitude[j] == 0) continue;
+            histogram_magnitude->uint64_bins[MIN(uint_magnitude[j], histogram_magnitude->uint_max)] ++;
+            histogram_magnitude->uint64_total ++;
         }
     }
 
@@ -151,37 +233,72 @@ void gradient_magnitude(image* image_gradientmagnitude, image* image_gradientx,
 }
 
 
-void gradient_nms(image* image_nms, image* image_gradientx, image* image_gradienty, image* image_gradientmagnitude) {
-    int i = 0;
-    int j = 0;
+void gradient_magnitude(image_view* image_gradientmagnitude, image_view* image_gradientx, image_view* image_gradienty, histogram* histogram_magnitude) {
+    unsigned int i = 0;
+
+    for(i = 0; i < image_gradientmagnitude->uint_yres; i ++) {
+        gradient_magnitude_row(VIEW_ROW(image_gradientmagnitude, i), VIEW_ROW(image_gradientx, i), VIEW_ROW(image_gradienty, i), image_gradientmagnitude->uint_xres, 0, histogram_magnitude);
+    }
+
+    return;
+}
+
+
+/* A histogram of the gradient magnitudes with one bin per level.
+ * The Sobel gradients are at most 4 times the max. grey level in either
+ * direction, so the magnitude is at most 4 * sqrt(2) times the max. grey level.
+ */
+int allocate_magnitude_histogram(histogram* histogram_magnitude, unsigned int uint_max_grey) {
+    unsigned int uint_max = (unsigned int)MIN(ceil(4.0 * sqrt(2.0) * uint_max_grey), HISTOGRAM_MAX_LEVEL);
+
+    return(allocate_histogram(histogram_magnitude, uint_max + 1, 0, uint_max));
+}
+
+
+/* pick the hysteresis thresholds from the histogram of the gradient magnitudes */
+void canny_auto_thresholds(histogram* histogram_magnitude, unsigned int* uint_tmin, unsigned int* uint_tmax) {
+    update_cumulative_histogram(histogram_magnitude);
+
+    *uint_tmin = histogram_percentile(histogram_magnitude, CANNY_LOW_PERCENTILE);
+    *uint_tmax = histogram_percentile(histogram_magnitude, CANNY_HIGH_PERCENTILE);
+
+    printf("canny: automatic thresholds, tmin: %u, tmax: %u\n", *uint_tmin, *uint_tmax);
+
+    return;
+}
+
+
+/* Non-maximum suppression of a single row.
+ * We need the magnitude of the rows above and below the current one,
+ * but the gradient direction of the current row only.
+ */
+void gradient_nms_row(unsigned int* uint_nms, unsigned int* uint_above, unsigned int* uint_row, unsigned int* uint_below, unsigned int* uint_gradientx, unsigned int* uint_gradienty, unsigned int uint_xres) {
+    unsigned int j = 0;
     int int_degrees0 = 0;
     int int_degrees45 = 0;
     int int_degrees90 = 0;
     int int_degrees135 = 0;
     float float_direction = 0.0f;
-    float float_tmp = 0.0f;
 
-    for(i = 1; i < image_gradientmagnitude->uint_yres - 1; i ++) {
-        for(j = 1; j < image_gradientmagnitude->uint_xres - 1; j ++) {
-            if(image_gradientmagnitude->int_image_data[i][j] == 0) continue;
-           
-            float_direction = (fmodf(atan2((float)image_gradienty->int_image_data[i][j], (float)image_gradientx->int_image_data[i][j]) + M_PI, M_PI) / M_PI) * 8.0f;
+    for(j = 1; j < uint_xres - 1; j ++) {
+        if(uint_row[j] == 0) continue;
+       
+        float_direction = (fmodf(atan2((float)uint_gradienty[j], (float)uint_gradientx[j]) + M_PI, M_PI) / M_PI) * 8.0f;
 
-            /* for readability: compute the non-maximum suppression conditions */
-            int_degrees0 = (float_direction <= 1 || float_direction > 7) && image_gradientmagnitude->int_image_data[i][j] >= image_gradientmagnitude->int_image_data[i][j + 1] && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i][j - 1];
+        /* for readability: compute the non-maximum suppression conditions */
+        int_degrees0 = (float_direction <= 1 || float_direction > 7) && uint_row[j] >= uint_row[j + 1] && uint_row[j] > uint_row[j - 1];
 
-            int_degrees45 = (float_direction > 1 || float_direction <= 3) && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i - 1][j - 1] && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i + 1][j + 1];
+        int_degrees45 = (float_direction > 1 || float_direction <= 3) && uint_row[j] > uint_above[j - 1] && uint_row[j] > uint_below[j + 1];
 
-            int_degrees90 = (float_direction > 3 || float_direction <= 5) && image_gradientmagnitude->int_image_data[i][j] >= image_gradientmagnitude->int_image_data[i + 1][j] && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i - 1][j];
+        int_degrees90 = (float_direction > 3 || float_direction <= 5) && uint_row[j] >= uint_below[j] && uint_row[j] > uint_above[j];
 
-            int_degrees135 = (float_direction > 5 || float_direction <= 7) && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i - 1][j + 1] && image_gradientmagnitude->int_image_data[i][j] > image_gradientmagnitude->int_image_data[i + 1][j - 1];
+        int_degrees135 = (float_direction > 5 || float_direction <= 7) && uint_row[j] > uint_above[j + 1] && uint_row[j] > uint_below[j - 1];
 
-            /* if non of it applies delete the edge point */
-            if((int_degrees0 || int_degrees45 || int_degrees90 || int_degrees135)) {
-               image_nms->int_image_data[i][j] = image_gradientmagnitude->int_image_data[i][j];
-            } else { 
-               image_nms->int_image_data[i][j] = 0;
-            }
+        /* if non of it applies delete the edge point */
+        if((int_degrees0 || int_degrees45 || int_degrees90 || int_degrees135)) {
+           uint_nms[j] = uint_row[j];
+        } else { 
+           uint_nms[j] = 0;
         }
     }
 
@@ -189,50 +306,61 @@ void gradient_nms(image* image_nms, image* image_gradientx, image* image_gradien
 }
 
 
+void gradient_nms(image_view* image_nms, image_view* image_gradientx, image_view* image_gradienty, image_view* image_gradientmagnitude) {
+    unsigned int i = 0;
+
+    for(i = 1; i < image_gradientmagnitude->uint_yres - 1; i ++) {
+        gradient_nms_row(VIEW_ROW(image_nms, i), VIEW_ROW(image_gradientmagnitude, i - 1), VIEW_ROW(image_gradientmagnitude, i), VIEW_ROW(image_gradientmagnitude, i + 1), VIEW_ROW(image_gradientx, i), VIEW_ROW(image_gradienty, i), image_gradientmagnitude->uint_xres);
+    }
+
+    return;
+}
+
+
 /* recursively follow the edge */
-void follow_edge(image* image_edges, image* image_gradientmap, unsigned int uint_tmin, unsigned int x, unsigned int y, unsigned int depth) {
+void follow_edge(image_view* image_edges, image_view* image_gradientmap, unsigned int uint_tmin, unsigned int x, unsigned int y, unsigned int depth) {
     // check image boundaries
     if(x <= 0 || y <= 0 || x >= image_edges->uint_xres - 1 || y >= image_edges->uint_yres - 1 || depth > MAX_RECURSIONS) return;
 
-    image_edges->int_image_data[y][x] = 255;
+    VIEW_PIXEL(image_edges, x, y) = 255;
 
     // nw
-    if(image_gradientmap->int_image_data[y - 1][x - 1] > uint_tmin && image_edges->int_image_data[y - 1][x - 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x - 1, y - 1) > uint_tmin && VIEW_PIXEL(image_edges, x - 1, y - 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x - 1, y - 1, depth + 1);
     }
 
     // nn
-    if(image_gradientmap->int_image_data[y - 1][x] > uint_tmin && image_edges->int_image_data[y - 1][x] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x, y - 1) > uint_tmin && VIEW_PIXEL(image_edges, x, y - 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x, y - 1, depth + 1);
     }
 
     // ne
-    if(image_gradientmap->int_image_data[y - 1][x + 1] > uint_tmin && image_edges->int_image_data[y - 1][x + 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x + 1, y - 1) > uint_tmin && VIEW_PIXEL(image_edges, x + 1, y - 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x + 1, y - 1, depth + 1);
     }
 
     // ee
-    if(image_gradientmap->int_image_data[y][x + 1] > uint_tmin && image_edges->int_image_data[y][x + 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x + 1, y) > uint_tmin && VIEW_PIXEL(image_edges, x + 1, y) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x + 1, y, depth + 1);
     }
 
     // se
-    if(image_gradientmap->int_image_data[y + 1][x + 1] > uint_tmin && image_edges->int_image_data[y + 1][x + 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x + 1, y + 1) > uint_tmin && VIEW_PIXEL(image_edges, x + 1, y + 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x + 1, y + 1, depth + 1);
     }
 
     // ss
-    if(image_gradientmap->int_image_data[y + 1][x] > uint_tmin && image_edges->int_image_data[y + 1][x] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x, y + 1) > uint_tmin && VIEW_PIXEL(image_edges, x, y + 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x, y + 1, depth + 1);
     }
 
     // sw
-    if(image_gradientmap->int_image_data[y + 1][x - 1] > uint_tmin && image_edges->int_image_data[y + 1][x - 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x - 1, y + 1) > uint_tmin && VIEW_PIXEL(image_edges, x - 1, y + 1) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x - 1, y + 1, depth + 1);
     }
 
     // ww
-    if(image_gradientmap->int_image_data[y][x - 1] > uint_tmin && image_edges->int_image_data[y][x - 1] == 0) {
+    if(VIEW_PIXEL(image_gradientmap, x - 1, y) > uint_tmin && VIEW_PIXEL(image_edges, x - 1, y) == 0) {
         follow_edge(image_edges, image_gradientmap, uint_tmin, x - 1, y, depth + 1);
     }
 
@@ -240,14 +368,14 @@ void follow_edge(image* image_edges, image* image_gradientmap, unsigned int uint
 }
 
 
-void trace_edges(image* image_edges, image* image_gradientmap, unsigned int uint_tmin, unsigned int uint_tmax) {
+void trace_edges(image_view* image_edges, image_view* image_gradientmap, unsigned int uint_tmin, unsigned int uint_tmax) {
     int i = 0;
     int j = 0;
 
     for(i = 0; i < image_edges->uint_yres; i ++) {
         for(j = 0; j < image_edges->uint_xres; j ++) {
             /* check if the point is above tmax and not yet part of an edge */
-            if(image_gradientmap->int_image_data[i][j] > uint_tmax && image_edges->int_image_data[i][j] == 0) {
+            if(VIEW_PIXEL(image_gradientmap, j, i) > uint_tmax && VIEW_PIXEL(image_edges, j, i) == 0) {
                 /* follow the edge recursivley */
                 follow_edge(image_edges, image_gradientmap, uint_tmin, j, i, 0);
             }
@@ -258,209 +386,124 @@ void trace_edges(image* image_edges, image* image_gradientmap, unsigned int uint
     return;
 }
 
-/* parameters for tracing edges with hysteresis: 
- * uint_tmin: we mus fall below this to end an edge
- * uint_tmax: we need to be above this to start an edge
+/*---------------------------------
+ * CANNY ON 16 BIT INTERMEDIATES
+ *-------------------------------*/
+
+/*
+ * The stages above keep every intermediate as unsigned int, so the
+ * blurred image, both gradients and their magnitude take 16 bytes per
+ * pixel. The blurred image and the magnitude fit into 16 bits, and the
+ * gradients are only needed for the magnitude and for the direction in
+ * the non-maximum suppression. canny_u16() therefore keeps the blurred
+ * image and the magnitude at 2 bytes per pixel each and computes the
+ * Sobel gradients of a row again whenever it needs them.
+ *
+ * The magnitude of an image with more than 11585 grey levels does not
+ * fit into 16 bits. It is stored shifted right by magnitude_shift()
+ * bits and the thresholds are shifted with it. For 8 bit images nothing
+ * is shifted, and we get exactly the edges of the stages above.
  */
-void canny(image* image_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax) {
-    int i = 0;
-    int j = 0;
-    float float_tmp = 0.0f;
-    image image_filtered;
-    image image_gradientx;
-    image image_gradienty;
-    image image_gradientmagnitude;
-    image image_gradientmap;
 
-    /* Gauusian noise filtering */
-    allocate_image_p2(&image_filtered, image_input->uint_xres, image_input->uint_yres, 255);
-    filter_image(image_input, &image_filtered, GAUSSIAN_KERNEL_SIZE, GAUSSIAN_KERNEL_SIZE, gaussian_filter, 255);
-
-    /* compute gradients in x and y direction */
-    allocate_image_p2(&image_gradientx, image_input->uint_xres, image_input->uint_yres, 255);
-    allocate_image_p2(&image_gradienty, image_input->uint_xres, image_input->uint_yres, 255);
-    filter_image(&image_filtered, &image_gradientx, SOBEL_KERNEL_SIZE, SOBEL_KERNEL_SIZE, sobel_gx, 0);
-    filter_image(&image_filtered, &image_gradienty, SOBEL_KERNEL_SIZE, SOBEL_KERNEL_SIZE, sobel_gy, 0);
-
-    /* compute gradient magnitude and direction and do a non-maximum suppression */
-    allocate_image_p2(&image_gradientmagnitude, image_input->uint_xres, image_input->uint_yres, 0);
-    allocate_image_p2(&image_gradientmap, image_input->uint_xres, image_input->uint_yres, 0);    
-    gradient_magnitude(&image_gradientmagnitude, &image_gradientx, &image_gradienty);
-    write_image_p2("edge_gradientx.pgm", &image_gradientx);
-    write_image_p2("edge_gradienty.pgm", &image_gradienty);
-    write_image_p2("edge_gradient_magnitude.pgm", &image_gradientmagnitude);
+/* The neutral border of the blurred image. 8 bit images get 255 as in
+ * filter_image(), brighter images their max. grey level, otherwise
+ * Sobel finds an edge all along the border of a 16 bit image.
+ */
+#define GAUSSIAN_BORDER(MAX_GREY) MAX((MAX_GREY), 255)
 
-    /* suppress non-maxima */
-    allocate_image_p2(image_edges, image_input->uint_xres, image_input->uint_yres, 0);
-    //clone_image_p2(&image_gradientmagnitude, image_edges);
-    image_edges->uint_max = 255;
-    gradient_nms(image_edges, &image_gradientx, &image_gradienty, &image_gradientmagnitude);   
 
-    /* trace the edges with hysteresis*/
-    trace_edges(image_edges, &image_gradientmagnitude, uint_tmin, uint_tmax);
+/* The largest gradient magnitude, see allocate_magnitude_histogram().
+ * The border of the blurred image is at least 255, so we never assume less.
+ */
+unsigned int magnitude_limit(unsigned int uint_max_grey) {
+    return((unsigned int)ceil(4.0 * sqrt(2.0) * MAX(uint_max_grey, 255)));
+}
 
-    /* clean-up temporary storage */
-    free_image_p2(&image_filtered);
-    free_image_p2(&image_gradientx);
-    free_image_p2(&image_gradienty);
-    free_image_p2(&image_gradientmagnitude);
-    free_image_p2(&image_gradientmap);
 
-    return;
+/* the number of bits we drop so the magnitude fits into 16 bits */
+unsigned int magnitude_shift(unsigned int uint_max_grey) {
+    unsigned int uint_limit = magnitude_limit(uint_max_grey);
+    unsigned int uint_shift = 0;
+
+    while((uint_limit >> uint_shift) > UINT16_MAX) uint_shift ++;
+
+    return(uint_shift);
 }
 
-/*
- * this function actually render the line into the image
+
+/* The Gaussian filtered row uint_y of a 16 bit image, the border of
+ * filter_image() with the value of GAUSSIAN_BORDER() and the same sums as
+ * gaussian_filter(). Every pixel adds up its own 25 products, so the
+ * clones may work on several pixels at once.
  */
-void set_line_pixels(image* image_in, point point_start, point point_end) {
+CPU_DISPATCH void gaussian_row_u16(image_u16* image_input, uint16_t* restrict uint16_blurred, unsigned int uint_y) {
+    size_t j = 0;
     int i = 0;
-    int dx = point_end.uint_x - point_start.uint_x;
-    int dy = point_end.uint_y - point_start.uint_y;
-    int int_increment = 0;
-    float float_slope = 0.0;
-    float float_perpendicular_axis = 0.0;
-
-    printf("render line, start: (%d, %d), end: (%d, %d)\n", point_start.uint_x, point_start.uint_y, point_end.uint_x, point_end.uint_y);
-
-    if(point_start.uint_x == point_end.uint_x && point_start.uint_y == point_end.uint_y) return;
+    int k = 0;
+    float float_tmp = 0.0f;
+    unsigned int uint_xres = image_input->uint_xres;
+    uint16_t uint16_border = (uint16_t)GAUSSIAN_BORDER(image_input->uint_max);
+    const uint16_t* uint16_rows[GAUSSIAN_KERNEL_SIZE];
 
-    if( abs(dx) > abs(dy) ) {
-        /* render in x direction */
-        int_increment = dx / abs(dx); // 1 or -1
-        float_slope = (float) dy / fabs((float) dx);
-        float_perpendicular_axis = (float)point_start.uint_y;
-        for(i = point_start.uint_x; i != point_end.uint_x; i += int_increment) {
-            /* set pixel i, (int)float_perpendicular_axis */
-            image_in->int_image_data[(int)(float_perpendicular_axis + 0.5f)][i] = 0;
-            float_perpendicular_axis += float_slope;
-        }
-    } else {
-        /* render in y direction */
-        int_increment = dy / abs(dy);
-        float_slope = (float) dx / fabs((float) dy);
-        
-        float_perpendicular_axis = (float)point_start.uint_x;
-        printf("inc: %d, slope: %f, x0: %f\n", int_increment, float_slope, float_perpendicular_axis);
-        for(i = point_start.uint_y; i != point_end.uint_y; i += int_increment) {
-            /* set pixel i, (int)float_perpendicular_axis */
-            image_in->int_image_data[i][(int)(float_perpendicular_axis + 0.5f)] = 0;
-            float_perpendicular_axis += float_slope;
-        }
+    if(uint_y <= GAUSSIAN_KERNEL_SIZE / 2 || uint_y + GAUSSIAN_KERNEL_SIZE / 2 >= image_input->uint_yres) {
+        for(j = 0; j < uint_xres; j ++) uint16_blurred[j] = uint16_border;
+        return;
     }
 
-    return;
-}
-
-void render_line(image* buffer, float float_slope, float b) {
-    float x0 = 0.0f;
-    float xmax = 0.0f;
-    float ymax = 0.0f;
-    point point_start;
-    point point_end;
- 
-    /* intersections with the image boundary */
-    x0 = - b / float_slope;       // intersect with y = 0
-    xmax = (buffer->uint_yres - b) / float_slope; // intersect with y = Y
-    
-    // y0 = b; we got this as a parameter
-    ymax = float_slope * buffer->uint_xres + b;   // intersect with x = X
-           
-    /* positive slope, line does not intersect with the image */
-    if((float_slope >= 0.0f) && (x0 > buffer->uint_xres - 1 || b > buffer->uint_yres - 1)) return;
-
-    /* negative slope, line does not intersect with the image */
-    if((float_slope < 0.0f) && (b < 0 || b > buffer->uint_yres - 1 - float_slope * buffer->uint_xres)) return;
+    for(i = 0; i < GAUSSIAN_KERNEL_SIZE; i ++) {
+        uint16_rows[i] = U16_ROW(image_input, uint_y + i - GAUSSIAN_KERNEL_SIZE / 2);
+    }
 
-    /* at the moment this code is not able to plot vertical lines */
-    if(isinf(float_slope) || isinf(float_slope)) return;
+    /* the border columns first, then the pixels with a full neighbourhood */
+    for(j = 0; j < uint_xres; j ++) uint16_blurred[j] = uint16_border;
 
-    if(float_slope >= 0.0f) {
-        /* start point */
-        if(b >= 0) {
-            point_start.uint_x = 0;
-            point_start.uint_y = b;
-        } else if(float_slope > 0.0f) {
-            point_start.uint_x = x0;
-            point_start.uint_y = 0;
-        } else {
-            return;
-        }
-                 
-        /* end point */
-        if(ymax <= buffer->uint_yres) {
-            point_end.uint_x = buffer->uint_xres - 1;
-            point_end.uint_y = ymax;
-        } else {
-            point_end.uint_x = xmax;
-            point_end.uint_y = buffer->uint_yres - 1;
-        }
-    } else {
-        /* start point */
-        if(b <= buffer->uint_yres) {
-            point_start.uint_x = 0;
-            point_start.uint_y = b;
-        } else {
-            point_start.uint_x = xmax;
-            point_start.uint_y = buffer->uint_yres - 1;
-        }
-                     
-        /* end point */
-        if(float_slope * buffer->uint_xres + b >= 0.0f) {
-             point_end.uint_x = buffer->uint_xres - 1;
-             point_end.uint_y = ymax; 
-        } else {
-             point_end.uint_x = x0;
-             point_end.uint_y = 0;
+    for(j = GAUSSIAN_KERNEL_SIZE / 2 + 1; j + GAUSSIAN_KERNEL_SIZE / 2 < uint_xres; j ++) {
+        float_tmp = 0.0f;
+        for(i = 0; i < GAUSSIAN_KERNEL_SIZE; i ++) {
+            for(k = 0; k < GAUSSIAN_KERNEL_SIZE; k ++) {
+                float_tmp += int_gaussian_5x5[i][k] * uint16_rows[i][j + k - GAUSSIAN_KERNEL_SIZE / 2];
+            }
         }
+        uint16_blurred[j] = (uint16_t)(int)(float_tmp / GAUSSIAN_KERNEL_WEIGHT + 0.5f);
     }
 
-    set_line_pixels(buffer, point_start, point_end);
-
     return;
 }
 
-void reverse_transform(image* image_foundlines, image* image_houghmap, float float_threshold) {
-    int i = 0;
-    int j = 0;
-    float float_deltarho = 0.0f;
-    float float_deltatheta = 0.0f;
-    float float_rho = 0.0f;
-    float float_theta = 0.0f;
-    point point_start;
-    point point_end;
 
-    float float_slope = 0.0f;
-    float float_offset = 0.0f;
+/* The Sobel gradients of pixel j from the three blurred rows around it */
+#define SOBEL_U16_GX(ABOVE, ROW, BELOW, J) (- (int)(ABOVE)[(J) - 1] + (int)(ABOVE)[(J) + 1] - 2 * (int)(ROW)[(J) - 1] + 2 * (int)(ROW)[(J) + 1] - (int)(BELOW)[(J) - 1] + (int)(BELOW)[(J) + 1])
+#define SOBEL_U16_GY(ABOVE, ROW, BELOW, J) (- (int)(ABOVE)[(J) - 1] - 2 * (int)(ABOVE)[J] - (int)(ABOVE)[(J) + 1] + (int)(BELOW)[(J) - 1] + 2 * (int)(BELOW)[J] + (int)(BELOW)[(J) + 1])
 
-    float_deltatheta = M_PI / image_houghmap->uint_xres;
-    float_deltarho = 2.0f * hypotf(image_foundlines->uint_xres, image_foundlines->uint_yres) / image_houghmap->uint_yres;
 
-    /* find all points above the threshold */
-    for(i = 0; i < image_houghmap->uint_yres; i ++) {
-        for(j = 0; j < image_houghmap->uint_xres; j ++) {
-            //if(image_houghmap->int_image_data[i][j] > uint_threshold) {
-            if(image_houghmap->int_image_data[i][j] > (int)(float_threshold * image_houghmap->uint_max)) {
+/* The gradient magnitude of a row straight from the blurred rows around it.
+ * The caller passes only rows inside the Sobel border, the border columns
+ * are 0 as in filter_image(). The squares are summed in float, so a 16 bit
+ * image does not overflow, and for 8 bit images they are exact.
+ * Non-zero magnitudes are counted in histogram_magnitude unless it is NULL.
+ */
+CPU_DISPATCH void sobel_magnitude_row(const uint16_t* restrict uint16_above, const uint16_t* restrict uint16_row, const uint16_t* restrict uint16_below, uint16_t* restrict uint16_magnitude, unsigned int uint_xres, unsigned int uint_shift, histogram* histogram_magnitude) {
+    size_t j = 0;
+    float float_gx = 0.0f;
+    float float_gy = 0.0f;
+    unsigned int uint_magnitude = 0;
+
+    uint16_magnitude[0] = 0;
+    if(uint_xres > 1) uint16_magnitude[1] = 0;
+    if(uint_xres > 2) uint16_magnitude[uint_xres - 1] = 0;
+
+    for(j = SOBEL_KERNEL_SIZE / 2 + 1; j + SOBEL_KERNEL_SIZE / 2 < uint_xres; j ++) {
+        float_gx = (float)SOBEL_U16_GX(uint16_above, uint16_row, uint16_below, j);
+        float_gy = (float)SOBEL_U16_GY(uint16_above, uint16_row, uint16_below, j);
+        uint_magnitude = (unsigned int)(int)(sqrtf(float_gx * float_gx + float_gy * float_gy) + 0.5f) >> uint_shift;
+        uint16_magnitude[j] = (uint16_t)MIN(uint_magnitude, UINT16_MAX);
+    }
 
-                 /* convert bins to r and theta values */
-                 float_theta = j *  float_deltatheta;
-                 float_rho =  float_deltarho * (image_houghmap->uint_yres / 2.0f - i);
-                 
-                 if(fabs(sinf(float_theta)) > sqrtf(2.0f)/2.0f ) {
-                     /* slope and offset */
-                     float_slope = -cosf(float_theta) / sinf(float_theta);
-                     float_offset = float_rho / sinf(float_theta);
-                 } else {
-                     /* slope and offset */
-                     //float_slope = -sinf(float_theta) / cosf(float_theta);
-                     float_slope = -cosf(float_theta) / sinf(float_theta);
-                     //float_offset = float_rho / cosf(float_theta);
-                     float_offset = float_rho / sinf(float_theta);
-                 } 
-
-                 printf("found line at [%d][%d] threshold: %f, theta: %f, rho: %f, slope: %f, offset: %f\n", i, j, (float_threshold * image_houghmap->uint_max), float_theta, float_rho, float_slope, float_offset);
-
-                 render_line(image_foundlines, float_slope, float_offset);
-            }
+    if(histogram_magnitude != NULL) {
+        for(j = 0; j < uint_xres; j ++) {
+            if(uint16_magnitude[j] == 0) continue;
+            histogram_magnitude->uint64_bins[MIN(uint16_magnitude[j], histogram_magnitude->uint_max)] ++;
+            histogram_magnitude->uint64_total ++;
         }
     }
 
@@ -468,56 +511,41 @@ void reverse_transform(image* image_foundlines, image* image_houghmap, float flo
 }
 
 
-/*-----------------------
- * HOUGH TRANSFORMATION
- *---------------------*/
-
-/* we are not considering the gradient information yet */
-/* advanced task: how to make this loop structure more efficient assuming that
- * there are only few edges in the image
+/* Non-maximum suppression of a row, like gradient_nms_row(). The gradients
+ * are computed from the blurred rows again. We take the direction from their
+ * unsigned int values, as gradient_nms_row() gets them from filter_image(),
+ * so both keep the same pixels.
  */
-void hough_transform(image* image_edgemap, image* image_houghmap, unsigned int uint_binstheta, unsigned int uint_binsrho) {
-    int i = 0;
-    int j = 0;
-    int k = 0;
-    int int_y;
-    float float_theta = 0.0f;
-    float float_rho = 0.0f;
+void nms_row_u16(unsigned int* uint_nms, const uint16_t* uint16_above, const uint16_t* uint16_row, const uint16_t* uint16_below, const uint16_t* uint16_blurred_above, const uint16_t* uint16_blurred_row, const uint16_t* uint16_blurred_below, unsigned int uint_xres) {
+    unsigned int j = 0;
+    int int_degrees0 = 0;
+    int int_degrees45 = 0;
+    int int_degrees90 = 0;
+    int int_degrees135 = 0;
+    unsigned int uint_gx = 0;
+    unsigned int uint_gy = 0;
+    float float_direction = 0.0f;
 
-    /* the inclement in the angle theta */
-    float float_deltatheta = M_PI / uint_binstheta;
+    for(j = 1; j < uint_xres - 1; j ++) {
+        /* the magnitude is 0 on the Sobel border, so we never read outside the rows */
+        if(uint16_row[j] == 0) continue;
 
-    /* the maximum value of the radius (diagonal of the image) */
-    float float_deltarho = 2.0f * (sqrtf(image_edgemap->uint_xres * image_edgemap->uint_xres + image_edgemap->uint_yres * image_edgemap->uint_yres)) / uint_binsrho;
+        uint_gx = (unsigned int)SOBEL_U16_GX(uint16_blurred_above, uint16_blurred_row, uint16_blurred_below, j);
+        uint_gy = (unsigned int)SOBEL_U16_GY(uint16_blurred_above, uint16_blurred_row, uint16_blurred_below, j);
+        float_direction = (fmodf(atan2((float)uint_gy, (float)uint_gx) + M_PI, M_PI) / M_PI) * 8.0f;
 
-    /* allocate memory sapce for the hough map
-     * and set its size in x and y
-     */
-    allocate_image_p2(image_houghmap, uint_binstheta, uint_binsrho, 0);
+        int_degrees0 = (float_direction <= 1 || float_direction > 7) && uint16_row[j] >= uint16_row[j + 1] && uint16_row[j] > uint16_row[j - 1];
 
-    /* iterate all pixels of the input image */
-    for(i = 0; i < image_edgemap->uint_yres; i ++) {
-        for(j = 0; j < image_edgemap->uint_xres; j ++) {
+        int_degrees45 = (float_direction > 1 || float_direction <= 3) && uint16_row[j] > uint16_above[j - 1] && uint16_row[j] > uint16_below[j + 1];
 
-            /* check if we are on an edge otherwise do nothing */
-            if(image_edgemap->int_image_data[i][j] == 255) continue;
+        int_degrees90 = (float_direction > 3 || float_direction <= 5) && uint16_row[j] >= uint16_below[j] && uint16_row[j] > uint16_above[j];
 
-            /* iterate the angle theta */
-            for(k = 0; k < image_houghmap->uint_xres; k ++) {
-                
-                float_theta = k * float_deltatheta;
-                float_rho = j * cosf(float_theta) + i * sinf(float_theta);
-                int_y = (int)(image_houghmap->uint_yres / 2.0f) - (float_rho / float_deltarho) + 0.5f;
+        int_degrees135 = (float_direction > 5 || float_direction <= 7) && uint16_row[j] > uint16_above[j + 1] && uint16_row[j] > uint16_below[j - 1];
 
-                //printf("i: %d, j: %d, k: %d, int_y: %d\n", i, j, k, int_y);
-                /* possible extension: compute the int Hough transform
-                 * and compress it into 8 bits
-                 */
-                //if(image_houghmap->int_image_data[int_y][k] > 0) {
-                image_houghmap->int_image_data[int_y][k] ++;
-                //}
-                image_houghmap->uint_max = MAX(image_houghmap->int_image_data[int_y][k], image_houghmap->uint_max);
-            }
+        if((int_degrees0 || int_degrees45 || int_degrees90 || int_degrees135)) {
+           uint_nms[j] = uint16_row[j];
+        } else {
+           uint_nms[j] = 0;
         }
     }
 
@@ -525,342 +553,2814 @@ void hough_transform(image* image_edgemap, image* image_houghmap, unsigned int u
 }
 
 
-/*-----------------------------------------
- * Generic netPBM functions
- *---------------------------------------*/
-// read image header
-int read_PBM_header(FILE* file_input, image* image_input) {
-    char* char_buffer;
- 
-    char_buffer = (char*)malloc(INT_BUFFERLENGTH * sizeof(char) );
+/* recursively follow the edge, like follow_edge() on a 16 bit magnitude */
+void follow_edge_u16(image_view* image_edges, image_u16* image_magnitude, unsigned int uint_tmin, unsigned int x, unsigned int y, unsigned int depth) {
+    int i = 0;
+    /* nw, nn, ne, ee, se, ss, sw, ww; the same order as follow_edge() */
+    static int int_dx[8] = {-1, 0, 1, 1, 1, 0, -1, -1};
+    static int int_dy[8] = {-1, -1, -1, 0, 1, 1, 1, 0};
 
-    fgets(char_buffer, INT_BUFFERLENGTH, file_input);
-    if( strncmp(char_buffer, "P2", 2 * sizeof(char)) != 0) {
-        perror("Not a P2 image (ASCII encoded portable greymap)\n");
-        free(char_buffer);
+    // check image boundaries
+    if(x <= 0 || y <= 0 || x >= image_edges->uint_xres - 1 || y >= image_edges->uint_yres - 1 || depth > MAX_RECURSIONS) return;
+
+    VIEW_PIXEL(image_edges, x, y) = 255;
+
+    for(i = 0; i < 8; i ++) {
+        if(U16_PIXEL(image_magnitude, x + int_dx[i], y + int_dy[i]) > uint_tmin && VIEW_PIXEL(image_edges, x + int_dx[i], y + int_dy[i]) == 0) {
+            follow_edge_u16(image_edges, image_magnitude, uint_tmin, x + int_dx[i], y + int_dy[i], depth + 1);
+        }
+    }
+
+    return;
+}
+
+
+void trace_edges_u16(image_view* image_edges, image_u16* image_magnitude, unsigned int uint_tmin, unsigned int uint_tmax) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+
+    for(i = 0; i < image_edges->uint_yres; i ++) {
+        for(j = 0; j < image_edges->uint_xres; j ++) {
+            if(U16_PIXEL(image_magnitude, j, i) > uint_tmax && VIEW_PIXEL(image_edges, j, i) == 0) {
+                follow_edge_u16(image_edges, image_magnitude, uint_tmin, j, i, 0);
+            }
+        }
+    }
+
+    return;
+}
+
+
+/* Write the gradients of the blurred image as PFM files and the
+ * magnitude as a 16 bit PGM file, the gradients may be negative.
+ */
+void dump_gradients_u16(image_u16* image_blurred, image_u16* image_magnitude, const char* char_dump_prefix, image_arena* arena_scratch) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    uint16_t* uint16_above;
+    uint16_t* uint16_row;
+    uint16_t* uint16_below;
+    image_f32 image_gradientx;
+    image_f32 image_gradienty;
+    char char_dump_name[FILENAME_MAX];
+
+    if(arena_allocate_f32(arena_scratch, &image_gradientx, image_blurred->uint_xres, image_blurred->uint_yres) != 0 ||
+        arena_allocate_f32(arena_scratch, &image_gradienty, image_blurred->uint_xres, image_blurred->uint_yres) != 0) {
+        return;
+    }
+
+    for(i = 0; i < image_blurred->uint_yres; i ++) {
+        for(j = 0; j < image_blurred->uint_xres; j ++) {
+            F32_PIXEL(&image_gradientx, j, i) = 0.0f;
+            F32_PIXEL(&image_gradienty, j, i) = 0.0f;
+            if(i <= SOBEL_KERNEL_SIZE / 2 || i + SOBEL_KERNEL_SIZE / 2 >= image_blurred->uint_yres || j <= SOBEL_KERNEL_SIZE / 2 || j + SOBEL_KERNEL_SIZE / 2 >= image_blurred->uint_xres) continue;
+
+            uint16_above = U16_ROW(image_blurred, i - 1);
+            uint16_row = U16_ROW(image_blurred, i);
+            uint16_below = U16_ROW(image_blurred, i + 1);
+            F32_PIXEL(&image_gradientx, j, i) = (float)SOBEL_U16_GX(uint16_above, uint16_row, uint16_below, j);
+            F32_PIXEL(&image_gradienty, j, i) = (float)SOBEL_U16_GY(uint16_above, uint16_row, uint16_below, j);
+        }
+    }
+
+    snprintf(char_dump_name, FILENAME_MAX, "%s_gradientx.pfm", char_dump_prefix);
+    write_image_pfm(char_dump_name, &image_gradientx);
+    snprintf(char_dump_name, FILENAME_MAX, "%s_gradienty.pfm", char_dump_prefix);
+    write_image_pfm(char_dump_name, &image_gradienty);
+    snprintf(char_dump_name, FILENAME_MAX, "%s_gradient_magnitude.pgm", char_dump_prefix);
+    write_image_p5(char_dump_name, image_magnitude);
+
+    return;
+}
+
+
+/* parameters for tracing edges with hysteresis: 
+ * uint_tmin: we mus fall below this to end an edge
+ * uint_tmax: we need to be above this to start an edge
+ *
+ * Canny edge detection of a 16 bit image. The blurred image and the
+ * gradient magnitude are taken from arena_scratch at 2 bytes per pixel,
+ * see above. The arena is reset before we return, so the memory is
+ * reused by the next call. image_edges gets the size of the input.
+ * If char_dump_prefix is not NULL, the gradients are written to
+ * <prefix>_gradientx.pfm and <prefix>_gradienty.pfm, and their
+ * magnitude to <prefix>_gradient_magnitude.pgm.
+ */
+void canny_u16(image_u16* image_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, const char* char_dump_prefix, image_arena* arena_scratch) {
+    unsigned int i = 0;
+    unsigned int uint_xres = image_input->uint_xres;
+    unsigned int uint_yres = image_input->uint_yres;
+    unsigned int uint_shift = magnitude_shift(image_input->uint_max);
+    image_u16 image_blurred;
+    image_u16 image_magnitude;
+    image_view view_edges;
+    histogram histogram_magnitude;
+    histogram* histogram_auto = NULL;
+
+    /* the edges are returned even if we run out of scratch memory */
+    allocate_image_p2(image_edges, uint_xres, uint_yres, 0);
+    image_edges->uint_max = 255;
+    view_image_p2(image_edges, &view_edges);
+
+    if(arena_allocate_u16(arena_scratch, &image_blurred, uint_xres, uint_yres, image_input->uint_max) != 0 ||
+        arena_allocate_u16(arena_scratch, &image_magnitude, uint_xres, uint_yres, MIN(magnitude_limit(image_input->uint_max) >> uint_shift, UINT16_MAX)) != 0) {
+        reset_arena(arena_scratch);
+        return;
+    }
+
+    /* collect the magnitudes if we have to pick the thresholds ourselves,
+     * otherwise they are shifted like the magnitudes
+     */
+    if(uint_tmin == CANNY_AUTO_THRESHOLD && uint_tmax == CANNY_AUTO_THRESHOLD) {
+        if(allocate_magnitude_histogram(&histogram_magnitude, image_input->uint_max >> uint_shift) == 0) {
+            histogram_auto = &histogram_magnitude;
+        }
+    } else {
+        uint_tmin >>= uint_shift;
+        uint_tmax >>= uint_shift;
+    }
+
+    INSTRUMENT_BEGIN(canny);
+    INSTRUMENT_COUNT(canny, INSTRUMENT_PIXELS, (uint64_t)uint_xres * uint_yres);
+
+    /* Gauusian noise filtering */
+    INSTRUMENT_BEGIN(canny_gaussian);
+    for(i = 0; i < uint_yres; i ++) {
+        gaussian_row_u16(image_input, U16_ROW(&image_blurred, i), i);
+    }
+    INSTRUMENT_END(canny_gaussian);
+
+    /* compute the gradient magnitude, the Sobel border rows are 0 */
+    INSTRUMENT_BEGIN(canny_magnitude);
+    for(i = 0; i < uint_yres; i ++) {
+        if(i <= SOBEL_KERNEL_SIZE / 2 || i + SOBEL_KERNEL_SIZE / 2 >= uint_yres) {
+            memset(U16_ROW(&image_magnitude, i), 0, uint_xres * sizeof(uint16_t));
+            continue;
+        }
+        sobel_magnitude_row(U16_ROW(&image_blurred, i - 1), U16_ROW(&image_blurred, i), U16_ROW(&image_blurred, i + 1), U16_ROW(&image_magnitude, i), uint_xres, uint_shift, histogram_auto);
+    }
+    if(histogram_auto != NULL) {
+        canny_auto_thresholds(histogram_auto, &uint_tmin, &uint_tmax);
+        free_histogram(histogram_auto);
+    }
+    INSTRUMENT_END(canny_magnitude);
+    if(char_dump_prefix != NULL) {
+        dump_gradients_u16(&image_blurred, &image_magnitude, char_dump_prefix, arena_scratch);
+    }
+
+    /* suppress non-maxima */
+    INSTRUMENT_BEGIN(canny_nms);
+    for(i = 1; i + 1 < uint_yres; i ++) {
+        nms_row_u16(VIEW_ROW(&view_edges, i), U16_ROW(&image_magnitude, i - 1), U16_ROW(&image_magnitude, i), U16_ROW(&image_magnitude, i + 1), U16_ROW(&image_blurred, i - 1), U16_ROW(&image_blurred, i), U16_ROW(&image_blurred, i + 1), uint_xres);
+    }
+    INSTRUMENT_END(canny_nms);
+
+    /* trace the edges with hysteresis*/
+    INSTRUMENT_BEGIN(canny_hysteresis);
+    trace_edges_u16(&view_edges, &image_magnitude, uint_tmin, uint_tmax);
+    INSTRUMENT_END(canny_hysteresis);
+
+    /* release all temporary storage at once */
+    reset_arena(arena_scratch);
+
+    INSTRUMENT_END(canny);
+
+    return;
+}
+
+
+/* Canny edge detection of a view, see canny_u16().
+ * view_input may be a region of interest of a larger image,
+ * image_edges gets the size of the region. The view is copied
+ * into a 16 bit image from arena_scratch first.
+ */
+void canny(image_view* view_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, const char* char_dump_prefix, image_arena* arena_scratch) {
+    image_u16 image_input;
+
+    if(arena_allocate_u16(arena_scratch, &image_input, view_input->uint_xres, view_input->uint_yres, 0) != 0 ||
+        view_to_u16(view_input, &image_input) != 0) {
+        reset_arena(arena_scratch);
+        allocate_image_p2(image_edges, view_input->uint_xres, view_input->uint_yres, 0);
+        image_edges->uint_max = 255;
+        return;
+    }
+
+    canny_u16(&image_input, image_edges, uint_tmin, uint_tmax, char_dump_prefix, arena_scratch);
+
+    return;
+}
+
+/*-------------------------
+ * STREAMING CANNY DETECTION
+ *-----------------------*/
+
+/*
+ * canny() keeps four full-size temporary images. The streaming version
+ * below only keeps the last few rows of every stage in a ring buffer
+ * and pushes each row through the pipeline as soon as its neighbourhood
+ * is available:
+ *   input row y      -> blurred row y
+ *   blurred row y    -> gradient and magnitude of row y - 1
+ *   magnitude row y  -> non-maximum suppression of row y - 1
+ * The scratch memory therefore does not depend on the image height.
+ * Only the hysteresis needs the whole image. Instead of keeping the
+ * gradient magnitude for it, we store the magnitude of every suppressed
+ * pixel in the edge image itself and mark it with a flag. Thus the
+ * thresholds are only needed once all rows are through, which allows
+ * us to pick them from the histogram of the magnitudes.
+ */
+
+/* number of rows kept per stage, enough for a 3x3 neighbourhood */
+#define STREAM_RING_ROWS 3
+#define RING_ROW(RING, Y) ((RING)[(Y) % STREAM_RING_ROWS])
+
+/* flag for suppressed pixels, gradient magnitudes never get this large */
+#define EDGE_SUPPRESSED_FLAG 0x80000000u
+#define EDGE_MAGNITUDE(P) ((P) & ~EDGE_SUPPRESSED_FLAG)
+
+/* suppressed pixels above tmin may continue an edge, above tmax they start one */
+#define EDGE_IS_WEAK(P, TMIN) (((P) & EDGE_SUPPRESSED_FLAG) && EDGE_MAGNITUDE(P) > (TMIN))
+#define EDGE_IS_STRONG(P, TMAX) (((P) & EDGE_SUPPRESSED_FLAG) && EDGE_MAGNITUDE(P) > (TMAX))
+
+
+/* the Gaussian filtered row uint_y of the input image */
+void stream_gaussian_row(image_view* view_input, unsigned int* uint_blurred, unsigned int uint_y) {
+    unsigned int j = 0;
+
+    for(j = 0; j < view_input->uint_xres; j ++) {
+        /* same border handling as filter_image() */
+        if(uint_y <= GAUSSIAN_KERNEL_SIZE / 2 || uint_y >= view_input->uint_yres - GAUSSIAN_KERNEL_SIZE / 2 || j <= GAUSSIAN_KERNEL_SIZE / 2 || j >= view_input->uint_xres - GAUSSIAN_KERNEL_SIZE / 2) {
+            uint_blurred[j] = GAUSSIAN_BORDER(view_input->uint_max);
+        } else {
+            uint_blurred[j] = gaussian_filter(view_input, j, uint_y);
+        }
+    }
+
+    return;
+}
+
+
+/* the Sobel gradients of row uint_y from the three blurred rows around it */
+CPU_DISPATCH void stream_sobel_row(unsigned int* uint_above, unsigned int* uint_row, unsigned int* uint_below, unsigned int* uint_gradientx, unsigned int* uint_gradienty, unsigned int uint_xres, unsigned int uint_yres, unsigned int uint_y) {
+    unsigned int j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        /* same border handling as filter_image() */
+        if(uint_y <= SOBEL_KERNEL_SIZE / 2 || uint_y >= uint_yres - SOBEL_KERNEL_SIZE / 2 || j <= SOBEL_KERNEL_SIZE / 2 || j >= uint_xres - SOBEL_KERNEL_SIZE / 2) {
+            uint_gradientx[j] = 0;
+            uint_gradienty[j] = 0;
+        } else {
+            uint_gradientx[j] = (int)(- uint_above[j - 1] + uint_above[j + 1] - 2 * uint_row[j - 1] + 2 * uint_row[j + 1] - uint_below[j - 1] + uint_below[j + 1]);
+            uint_gradienty[j] = (int)(- uint_above[j - 1] - 2 * uint_above[j] - uint_above[j + 1] + uint_below[j - 1] + 2 * uint_below[j] + uint_below[j + 1]);
+        }
+    }
+
+    return;
+}
+
+
+/* keep the magnitude of the suppressed pixels of a row for the hysteresis */
+void stream_flag_row(unsigned int* uint_edges, unsigned int* uint_magnitude, unsigned int uint_xres) {
+    unsigned int j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        if(uint_edges[j] != 0 || uint_magnitude[j] == 0) continue;
+        uint_edges[j] = EDGE_SUPPRESSED_FLAG | uint_magnitude[j];
+    }
+
+    return;
+}
+
+
+/* recursively follow the edge, like follow_edge() but on the flags */
+void follow_flagged_edge(image_view* image_edges, unsigned int uint_tmin, unsigned int x, unsigned int y, unsigned int depth) {
+    int i = 0;
+    /* nw, nn, ne, ee, se, ss, sw, ww; the same order as follow_edge() */
+    static int int_dx[8] = {-1, 0, 1, 1, 1, 0, -1, -1};
+    static int int_dy[8] = {-1, -1, -1, 0, 1, 1, 1, 0};
+
+    // check image boundaries
+    if(x <= 0 || y <= 0 || x >= image_edges->uint_xres - 1 || y >= image_edges->uint_yres - 1 || depth > MAX_RECURSIONS) return;
+
+    VIEW_PIXEL(image_edges, x, y) = 255;
+
+    for(i = 0; i < 8; i ++) {
+        if(EDGE_IS_WEAK(VIEW_PIXEL(image_edges, x + int_dx[i], y + int_dy[i]), uint_tmin)) {
+            follow_flagged_edge(image_edges, uint_tmin, x + int_dx[i], y + int_dy[i], depth + 1);
+        }
+    }
+
+    return;
+}
+
+
+/* the deferred hysteresis, like trace_edges() but on the flags */
+void trace_flagged_edges(image_view* image_edges, unsigned int uint_tmin, unsigned int uint_tmax) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+
+    for(i = 0; i < image_edges->uint_yres; i ++) {
+        for(j = 0; j < image_edges->uint_xres; j ++) {
+            if(EDGE_IS_STRONG(VIEW_PIXEL(image_edges, j, i), uint_tmax)) {
+                follow_flagged_edge(image_edges, uint_tmin, j, i, 0);
+            }
+        }
+    }
+
+    /* pixels with a flag left have not been reached by any edge */
+    for(i = 0; i < image_edges->uint_yres; i ++) {
+        for(j = 0; j < image_edges->uint_xres; j ++) {
+            if(VIEW_PIXEL(image_edges, j, i) & EDGE_SUPPRESSED_FLAG) VIEW_PIXEL(image_edges, j, i) = 0;
+        }
+    }
+
+    return;
+}
+
+
+/*------------------------
+ * PARALLEL HYSTERESIS
+ *----------------------*/
+
+/*
+ * The recursive trace visits the image pixel by pixel and cannot be
+ * split across threads. Instead we can look at hysteresis as a
+ * connected component problem: all weak pixels that are 8-connected
+ * form a component, and we keep a component if it contains a strong
+ * pixel. The components are found with union-find:
+ *   1. every thread labels a strip of rows on its own,
+ *   2. the components are merged across the seams between the strips,
+ *   3. every thread marks the components of its strong pixels,
+ *   4. every thread sets the pixels of marked components to 255.
+ * Unlike trace_edges() this does not stop after MAX_RECURSIONS pixels,
+ * so long edges are kept entirely. We assume uint_tmin <= uint_tmax.
+ */
+
+/* no label, the pixel is not a candidate for an edge */
+#define LABEL_NONE 0xFFFFFFFFu
+
+typedef struct {
+    image_view* view_edges;
+    uint32_t* uint32_parent;
+    unsigned char* uchar_strong;
+    unsigned int uint_tmin;
+    unsigned int uint_tmax;
+    unsigned int uint_first_row;
+    unsigned int uint_last_row;
+} hysteresis_strip;
+
+
+/* Find the root of a component, reading the parents atomically. On the
+ * way every label is pointed at its grandparent (path halving), so long
+ * chains get short. A parent only ever moves to a smaller label of the
+ * same component, so another thread halving the same path at the same
+ * time does no harm, and a failed exchange is simply skipped.
+ */
+uint32_t label_find(uint32_t* uint32_parent, uint32_t uint32_label) {
+    uint32_t uint32_next = __atomic_load_n(&uint32_parent[uint32_label], __ATOMIC_RELAXED);
+    uint32_t uint32_grandparent = 0;
+
+    while(uint32_next != uint32_label) {
+        uint32_grandparent = __atomic_load_n(&uint32_parent[uint32_next], __ATOMIC_RELAXED);
+        if(uint32_grandparent != uint32_next) {
+            __atomic_compare_exchange_n(&uint32_parent[uint32_label], &uint32_next, uint32_grandparent, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+        uint32_label = uint32_grandparent;
+        uint32_next = __atomic_load_n(&uint32_parent[uint32_label], __ATOMIC_RELAXED);
+    }
+
+    return(uint32_label);
+}
+
+
+/* merge two components, the smaller label becomes the root */
+void label_union(uint32_t* uint32_parent, uint32_t uint32_a, uint32_t uint32_b) {
+    uint32_a = label_find(uint32_parent, uint32_a);
+    uint32_b = label_find(uint32_parent, uint32_b);
+
+    if(uint32_a < uint32_b) {
+        uint32_parent[uint32_b] = uint32_a;
+    } else if(uint32_b < uint32_a) {
+        uint32_parent[uint32_a] = uint32_b;
+    }
+
+    return;
+}
+
+
+/* candidates are the weak pixels inside the image border, see follow_edge() */
+int is_edge_candidate(image_view* view_edges, unsigned int uint_tmin, unsigned int x, unsigned int y) {
+    return(x > 0 && y > 0 && x < view_edges->uint_xres - 1 && y < view_edges->uint_yres - 1 && EDGE_IS_WEAK(VIEW_PIXEL(view_edges, x, y), uint_tmin));
+}
+
+
+/* step 1: label the strip, only looking at neighbours inside the strip */
+void* hysteresis_label_strip(void* void_strip) {
+    hysteresis_strip* strip = (hysteresis_strip*)void_strip;
+    image_view* view_edges = strip->view_edges;
+    uint32_t* uint32_parent = strip->uint32_parent;
+    uint32_t uint32_label = 0;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    for(y = strip->uint_first_row; y < strip->uint_last_row; y ++) {
+        for(x = 0; x < view_edges->uint_xres; x ++) {
+            uint32_label = y * view_edges->uint_xres + x;
+
+            if(!is_edge_candidate(view_edges, strip->uint_tmin, x, y)) {
+                uint32_parent[uint32_label] = LABEL_NONE;
+                continue;
+            }
+
+            uint32_parent[uint32_label] = uint32_label;
+
+            /* the neighbours we have already visited: ww, nw, nn, ne */
+            if(uint32_parent[uint32_label - 1] != LABEL_NONE) {
+                label_union(uint32_parent, uint32_label, uint32_label - 1);
+            }
+            if(y > strip->uint_first_row) {
+                if(uint32_parent[uint32_label - view_edges->uint_xres - 1] != LABEL_NONE) {
+                    label_union(uint32_parent, uint32_label, uint32_label - view_edges->uint_xres - 1);
+                }
+                if(uint32_parent[uint32_label - view_edges->uint_xres] != LABEL_NONE) {
+                    label_union(uint32_parent, uint32_label, uint32_label - view_edges->uint_xres);
+                }
+                if(uint32_parent[uint32_label - view_edges->uint_xres + 1] != LABEL_NONE) {
+                    label_union(uint32_parent, uint32_label, uint32_label - view_edges->uint_xres + 1);
+                }
+            }
+        }
+    }
+
+    return(NULL);
+}
+
+
+/* step 2: merge the components across the seam above uint_row */
+void hysteresis_merge_seam(image_view* view_edges, uint32_t* uint32_parent, unsigned int uint_row) {
+    uint32_t uint32_label = 0;
+    unsigned int x = 0;
+    int int_dx = 0;
+
+    for(x = 1; x < view_edges->uint_xres - 1; x ++) {
+        uint32_label = uint_row * view_edges->uint_xres + x;
+        if(uint32_parent[uint32_label] == LABEL_NONE) continue;
+
+        for(int_dx = -1; int_dx <= 1; int_dx ++) {
+            if(uint32_parent[uint32_label - view_edges->uint_xres + int_dx] != LABEL_NONE) {
+                label_union(uint32_parent, uint32_label, uint32_label - view_edges->uint_xres + int_dx);
+            }
+        }
+    }
+
+    return;
+}
+
+
+/* step 3: point every pixel at its root and mark the roots of strong pixels */
+void* hysteresis_mark_strip(void* void_strip) {
+    hysteresis_strip* strip = (hysteresis_strip*)void_strip;
+    image_view* view_edges = strip->view_edges;
+    uint32_t uint32_label = 0;
+    uint32_t uint32_root = 0;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    for(y = strip->uint_first_row; y < strip->uint_last_row; y ++) {
+        for(x = 0; x < view_edges->uint_xres; x ++) {
+            uint32_label = y * view_edges->uint_xres + x;
+            if(__atomic_load_n(&strip->uint32_parent[uint32_label], __ATOMIC_RELAXED) == LABEL_NONE) continue;
+
+            uint32_root = label_find(strip->uint32_parent, uint32_label);
+            __atomic_store_n(&strip->uint32_parent[uint32_label], uint32_root, __ATOMIC_RELAXED);
+
+            if(EDGE_IS_STRONG(VIEW_PIXEL(view_edges, x, y), strip->uint_tmax)) {
+                __atomic_store_n(&strip->uchar_strong[uint32_root], 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return(NULL);
+}
+
+
+/* step 4: keep the pixels of strong components and clear all flags */
+void* hysteresis_keep_strip(void* void_strip) {
+    hysteresis_strip* strip = (hysteresis_strip*)void_strip;
+    image_view* view_edges = strip->view_edges;
+    uint32_t uint32_root = 0;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    for(y = strip->uint_first_row; y < strip->uint_last_row; y ++) {
+        for(x = 0; x < view_edges->uint_xres; x ++) {
+            uint32_root = strip->uint32_parent[y * view_edges->uint_xres + x];
+            if(uint32_root != LABEL_NONE && strip->uchar_strong[uint32_root]) {
+                VIEW_PIXEL(view_edges, x, y) = 255;
+            } else if(VIEW_PIXEL(view_edges, x, y) & EDGE_SUPPRESSED_FLAG) {
+                VIEW_PIXEL(view_edges, x, y) = 0;
+            }
+        }
+    }
+
+    return(NULL);
+}
+
+
+/* run one step of the parallel hysteresis on all strips */
+int hysteresis_run_strips(hysteresis_strip* strips, unsigned int uint_threads, void* (step)(void*)) {
+    unsigned int i = 0;
+    int int_result = 0;
+    pthread_t* thread_ids;
+
+    thread_ids = (pthread_t*)malloc(uint_threads * sizeof(pthread_t));
+    if(thread_ids == NULL) {
+        perror("hysteresis: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    /* the calling thread works on the first strip itself */
+    for(i = 1; i < uint_threads; i ++) {
+        if(pthread_create(&thread_ids[i], NULL, step, &strips[i]) != 0) {
+            perror("hysteresis: Unable to start a thread.\n");
+            step(&strips[i]);
+            thread_ids[i] = pthread_self();
+        }
+    }
+    step(&strips[0]);
+    for(i = 1; i < uint_threads; i ++) {
+        if(!pthread_equal(thread_ids[i], pthread_self())) {
+            int_result |= pthread_join(thread_ids[i], NULL);
+        }
+    }
+
+    free(thread_ids);
+
+    return(int_result == 0 ? 0 : -1);
+}
+
+
+/* Parallel version of trace_flagged_edges().
+ * The labels need 5 bytes per pixel, they are taken from arena_scratch.
+ */
+int trace_flagged_edges_parallel(image_view* view_edges, unsigned int uint_tmin, unsigned int uint_tmax, unsigned int uint_threads, image_arena* arena_scratch) {
+    unsigned int i = 0;
+    size_t size_t_pixels = (size_t)view_edges->uint_xres * view_edges->uint_yres;
+    uint32_t* uint32_parent;
+    unsigned char* uchar_strong;
+    hysteresis_strip* strips;
+
+    /* the labels are pixel indices, make sure they fit into 32 bit */
+    if(size_t_pixels >= LABEL_NONE) {
+        perror("trace_flagged_edges_parallel: image too large.\n");
+        return(-1);
+    }
+
+    uint_threads = MAX(1, MIN(uint_threads, view_edges->uint_yres));
+
+    uint32_parent = (uint32_t*)arena_allocate(arena_scratch, size_t_pixels * sizeof(uint32_t));
+    uchar_strong = (unsigned char*)arena_allocate(arena_scratch, size_t_pixels);
+    strips = (hysteresis_strip*)arena_allocate(arena_scratch, uint_threads * sizeof(hysteresis_strip));
+    if(uint32_parent == NULL || uchar_strong == NULL || strips == NULL) {
+        return(-1);
+    }
+    memset(uchar_strong, 0, size_t_pixels);
+
+    /* split the image into strips of rows of about the same height */
+    for(i = 0; i < uint_threads; i ++) {
+        strips[i].view_edges = view_edges;
+        strips[i].uint32_parent = uint32_parent;
+        strips[i].uchar_strong = uchar_strong;
+        strips[i].uint_tmin = uint_tmin;
+        strips[i].uint_tmax = uint_tmax;
+        strips[i].uint_first_row = (unsigned int)((uint64_t)view_edges->uint_yres * i / uint_threads);
+        strips[i].uint_last_row = (unsigned int)((uint64_t)view_edges->uint_yres * (i + 1) / uint_threads);
+    }
+
+    if(hysteresis_run_strips(strips, uint_threads, hysteresis_label_strip) != 0) return(-1);
+
+    /* the seams are only a few rows, we merge them serially */
+    for(i = 1; i < uint_threads; i ++) {
+        hysteresis_merge_seam(view_edges, uint32_parent, strips[i].uint_first_row);
+    }
+
+    if(hysteresis_run_strips(strips, uint_threads, hysteresis_mark_strip) != 0) return(-1);
+    if(hysteresis_run_strips(strips, uint_threads, hysteresis_keep_strip) != 0) return(-1);
+
+    return(0);
+}
+
+
+/* Streaming version of canny_u16() with the same result, the magnitudes
+ * of a 16 bit image are shifted the same way. There are no
+ * full-size gradient images, so there is nothing to dump either.
+ * The ring buffers are taken from arena_scratch, which is reset before we return.
+ * With uint_threads > 0 the hysteresis runs in parallel on that many threads,
+ * see trace_flagged_edges_parallel().
+ * Returns -1 if we run out of memory, image_edges is not allocated then.
+ */
+int canny_streaming(image_view* view_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, unsigned int uint_threads, image_arena* arena_scratch) {
+    int i = 0;
+    unsigned int y = 0;
+    unsigned int uint_xres = view_input->uint_xres;
+    unsigned int uint_yres = view_input->uint_yres;
+    unsigned int* uint_blurred[STREAM_RING_ROWS];
+    unsigned int* uint_gradientx[STREAM_RING_ROWS];
+    unsigned int* uint_gradienty[STREAM_RING_ROWS];
+    unsigned int* uint_magnitude[STREAM_RING_ROWS];
+    image_view view_edges;
+    histogram histogram_magnitude;
+    histogram* histogram_auto = NULL;
+    unsigned int uint_shift = magnitude_shift(view_input->uint_max);
+
+    /* collect the magnitudes if we have to pick the thresholds ourselves,
+     * otherwise they are shifted like the magnitudes, see canny_u16()
+     */
+    if(uint_tmin == CANNY_AUTO_THRESHOLD && uint_tmax == CANNY_AUTO_THRESHOLD) {
+        if(allocate_magnitude_histogram(&histogram_magnitude, view_input->uint_max >> uint_shift) == 0) {
+            histogram_auto = &histogram_magnitude;
+        }
+    } else {
+        uint_tmin >>= uint_shift;
+        uint_tmax >>= uint_shift;
+    }
+
+    for(i = 0; i < STREAM_RING_ROWS; i ++) {
+        uint_blurred[i] = (unsigned int*)arena_allocate(arena_scratch, uint_xres * sizeof(unsigned int));
+        uint_gradientx[i] = (unsigned int*)arena_allocate(arena_scratch, uint_xres * sizeof(unsigned int));
+        uint_gradienty[i] = (unsigned int*)arena_allocate(arena_scratch, uint_xres * sizeof(unsigned int));
+        uint_magnitude[i] = (unsigned int*)arena_allocate(arena_scratch, uint_xres * sizeof(unsigned int));
+        if(uint_blurred[i] == NULL || uint_gradientx[i] == NULL || uint_gradienty[i] == NULL || uint_magnitude[i] == NULL) break;
+    }
+
+    if(i < STREAM_RING_ROWS || allocate_image_p2(image_edges, uint_xres, uint_yres, 0) != 0) {
+        if(histogram_auto != NULL) free_histogram(histogram_auto);
+        reset_arena(arena_scratch);
+        return(-1);
+    }
+    image_edges->uint_max = 255;
+    view_image_p2(image_edges, &view_edges);
+
+    INSTRUMENT_BEGIN(canny_streaming);
+    INSTRUMENT_COUNT(canny_streaming, INSTRUMENT_PIXELS, (uint64_t)uint_xres * uint_yres);
+
+    /* row y enters the pipeline, the later stages lag behind by one row each */
+    INSTRUMENT_BEGIN(canny_streaming_rows);
+    for(y = 0; y < uint_yres + 2; y ++) {
+        if(y < uint_yres) {
+            stream_gaussian_row(view_input, RING_ROW(uint_blurred, y), y);
+        }
+
+        /* gradients and magnitude of row y - 1 */
+        if(y >= 1 && y - 1 < uint_yres) {
+            stream_sobel_row(RING_ROW(uint_blurred, y + STREAM_RING_ROWS - 2), RING_ROW(uint_blurred, y - 1), RING_ROW(uint_blurred, y), RING_ROW(uint_gradientx, y - 1), RING_ROW(uint_gradienty, y - 1), uint_xres, uint_yres, y - 1);
+            gradient_magnitude_row(RING_ROW(uint_magnitude, y - 1), RING_ROW(uint_gradientx, y - 1), RING_ROW(uint_gradienty, y - 1), uint_xres, uint_shift, histogram_auto);
+        }
+
+        /* non-maximum suppression of row y - 2, the border rows are never edges */
+        if(y >= 2 && y - 2 < uint_yres) {
+            if(y - 2 >= 1 && y - 2 < uint_yres - 1) {
+                gradient_nms_row(VIEW_ROW(&view_edges, y - 2), RING_ROW(uint_magnitude, y + STREAM_RING_ROWS - 3), RING_ROW(uint_magnitude, y - 2), RING_ROW(uint_magnitude, y - 1), RING_ROW(uint_gradientx, y - 2), RING_ROW(uint_gradienty, y - 2), uint_xres);
+            }
+            stream_flag_row(VIEW_ROW(&view_edges, y - 2), RING_ROW(uint_magnitude, y - 2), uint_xres);
+        }
+    }
+    INSTRUMENT_END(canny_streaming_rows);
+
+    /* all magnitudes are known now, so we can pick the thresholds */
+    if(histogram_auto != NULL) {
+        canny_auto_thresholds(histogram_auto, &uint_tmin, &uint_tmax);
+        free_histogram(histogram_auto);
+    }
+
+    /* trace the edges with hysteresis*/
+    INSTRUMENT_BEGIN(canny_streaming_hysteresis);
+    if(uint_threads == 0 || trace_flagged_edges_parallel(&view_edges, uint_tmin, uint_tmax, uint_threads, arena_scratch) != 0) {
+        trace_flagged_edges(&view_edges, uint_tmin, uint_tmax);
+    }
+    INSTRUMENT_END(canny_streaming_hysteresis);
+
+    /* release the ring buffers */
+    reset_arena(arena_scratch);
+
+    INSTRUMENT_END(canny_streaming);
+
+    return(0);
+}
+
+/*
+ * this function actually render the line into the image
+ */
+void set_line_pixels(image* image_in, point point_start, point point_end) {
+    int i = 0;
+    int dx = point_end.uint_x - point_start.uint_x;
+    int dy = point_end.uint_y - point_start.uint_y;
+    int int_increment = 0;
+    float float_slope = 0.0;
+    float float_perpendicular_axis = 0.0;
+
+    printf("render line, start: (%d, %d), end: (%d, %d)\n", point_start.uint_x, point_start.uint_y, point_end.uint_x, point_end.uint_y);
+
+    if(point_start.uint_x == point_end.uint_x && point_start.uint_y == point_end.uint_y) return;
+
+    if( abs(dx) > abs(dy) ) {
+        /* render in x direction */
+        int_increment = dx / abs(dx); // 1 or -1
+        float_slope = (float) dy / fabs((float) dx);
+        float_perpendicular_axis = (float)point_start.uint_y;
+        for(i = point_start.uint_x; i != point_end.uint_x; i += int_increment) {
+            /* set pixel i, (int)float_perpendicular_axis */
+            image_in->int_image_data[(int)(float_perpendicular_axis + 0.5f)][i] = 0;
+            float_perpendicular_axis += float_slope;
+        }
+    } else {
+        /* render in y direction */
+        int_increment = dy / abs(dy);
+        float_slope = (float) dx / fabs((float) dy);
+        
+        float_perpendicular_axis = (float)point_start.uint_x;
+        printf("inc: %d, slope: %f, x0: %f\n", int_increment, float_slope, float_perpendicular_axis);
+        for(i = point_start.uint_y; i != point_end.uint_y; i += int_increment) {
+            /* set pixel i, (int)float_perpendicular_axis */
+            image_in->int_image_data[i][(int)(float_perpendicular_axis + 0.5f)] = 0;
+            float_perpendicular_axis += float_slope;
+        }
+    }
+
+    return;
+}
+
+void render_line(image* buffer, float float_slope, float b) {
+    float x0 = 0.0f;
+    float xmax = 0.0f;
+    float ymax = 0.0f;
+    point point_start;
+    point point_end;
+ 
+    /* intersections with the image boundary */
+    x0 = - b / float_slope;       // intersect with y = 0
+    xmax = (buffer->uint_yres - b) / float_slope; // intersect with y = Y
+    
+    // y0 = b; we got this as a parameter
+    ymax = float_slope * buffer->uint_xres + b;   // intersect with x = X
+           
+    /* positive slope, line does not intersect with the image */
+    if((float_slope >= 0.0f) && (x0 > buffer->uint_xres - 1 || b > buffer->uint_yres - 1)) return;
+
+    /* negative slope, line does not intersect with the image */
+    if((float_slope < 0.0f) && (b < 0 || b > buffer->uint_yres - 1 - float_slope * buffer->uint_xres)) return;
+
+    /* at the moment this code is not able to plot vertical lines */
+    if(isinf(float_slope) || isinf(float_slope)) return;
+
+    if(float_slope >= 0.0f) {
+        /* start point */
+        if(b >= 0) {
+            point_start.uint_x = 0;
+            point_start.uint_y = b;
+        } else if(float_slope > 0.0f) {
+            point_start.uint_x = x0;
+            point_start.uint_y = 0;
+        } else {
+            return;
+        }
+                 
+        /* end point */
+        if(ymax <= buffer->uint_yres) {
+            point_end.uint_x = buffer->uint_xres - 1;
+            point_end.uint_y = ymax;
+        } else {
+            point_end.uint_x = xmax;
+            point_end.uint_y = buffer->uint_yres - 1;
+        }
+    } else {
+        /* start point */
+        if(b <= buffer->uint_yres) {
+            point_start.uint_x = 0;
+            point_start.uint_y = b;
+        } else {
+            point_start.uint_x = xmax;
+            point_start.uint_y = buffer->uint_yres - 1;
+        }
+                     
+        /* end point */
+        if(float_slope * buffer->uint_xres + b >= 0.0f) {
+             point_end.uint_x = buffer->uint_xres - 1;
+             point_end.uint_y = ymax; 
+        } else {
+             point_end.uint_x = x0;
+             point_end.uint_y = 0;
+        }
+    }
+
+    set_line_pixels(buffer, point_start, point_end);
+
+    return;
+}
+
+/* convert Hough bin rho i, theta j into a line and render it */
+void render_hough_line(image* image_foundlines, int i, int j, unsigned int uint_binsrho, float float_deltatheta, float float_deltarho, float float_level) {
+    float float_rho = 0.0f;
+    float float_theta = 0.0f;
+    float float_slope = 0.0f;
+    float float_offset = 0.0f;
+
+    /* convert bins to r and theta values */
+    float_theta = j *  float_deltatheta;
+    float_rho =  float_deltarho * (uint_binsrho / 2.0f - i);
+
+    if(fabs(sinf(float_theta)) > sqrtf(2.0f)/2.0f ) {
+        /* slope and offset */
+        float_slope = -cosf(float_theta) / sinf(float_theta);
+        float_offset = float_rho / sinf(float_theta);
+    } else {
+        /* slope and offset */
+        //float_slope = -sinf(float_theta) / cosf(float_theta);
+        float_slope = -cosf(float_theta) / sinf(float_theta);
+        //float_offset = float_rho / cosf(float_theta);
+        float_offset = float_rho / sinf(float_theta);
+    }
+
+    printf("found line at [%d][%d] threshold: %f, theta: %f, rho: %f, slope: %f, offset: %f\n", i, j, float_level, float_theta, float_rho, float_slope, float_offset);
+
+    render_line(image_foundlines, float_slope, float_offset);
+
+    return;
+}
+
+void reverse_transform(image* image_foundlines, image* image_houghmap, float float_threshold) {
+    int i = 0;
+    int j = 0;
+    float float_deltarho = 0.0f;
+    float float_deltatheta = 0.0f;
+
+    INSTRUMENT_BEGIN(reverse_transform);
+    INSTRUMENT_COUNT(reverse_transform, INSTRUMENT_PIXELS, (uint64_t)image_houghmap->uint_xres * image_houghmap->uint_yres);
+
+    float_deltatheta = M_PI / image_houghmap->uint_xres;
+    float_deltarho = 2.0f * hypotf(image_foundlines->uint_xres, image_foundlines->uint_yres) / image_houghmap->uint_yres;
+
+    /* find all points above the threshold */
+    for(i = 0; i < image_houghmap->uint_yres; i ++) {
+        for(j = 0; j < image_houghmap->uint_xres; j ++) {
+            //if(image_houghmap->int_image_data[i][j] > uint_threshold) {
+            if(image_houghmap->int_image_data[i][j] > (int)(float_threshold * image_houghmap->uint_max)) {
+                render_hough_line(image_foundlines, i, j, image_houghmap->uint_yres, float_deltatheta, float_deltarho, float_threshold * image_houghmap->uint_max);
+            }
+        }
+    }
+
+    INSTRUMENT_END(reverse_transform);
+
+    return;
+}
+
+
+/* The same for a compact accumulator, see hough_transform_u16().
+ * Its rows are the theta bins, so we go through it in memory order
+ * and the lines are reported theta by theta.
+ */
+void reverse_transform_u16(image* image_foundlines, image_u16* image_houghmap, float float_threshold) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    int int_level = (int)(float_threshold * image_houghmap->uint_max);
+    float float_deltarho = 0.0f;
+    float float_deltatheta = 0.0f;
+    uint16_t* uint16_row;
+
+    INSTRUMENT_BEGIN(reverse_transform);
+    INSTRUMENT_COUNT(reverse_transform, INSTRUMENT_PIXELS, (uint64_t)image_houghmap->uint_xres * image_houghmap->uint_yres);
+
+    float_deltatheta = M_PI / image_houghmap->uint_yres;
+    float_deltarho = 2.0f * hypotf(image_foundlines->uint_xres, image_foundlines->uint_yres) / image_houghmap->uint_xres;
+
+    for(j = 0; j < image_houghmap->uint_yres; j ++) {
+        uint16_row = U16_ROW(image_houghmap, j);
+        for(i = 0; i < image_houghmap->uint_xres; i ++) {
+            if((int)uint16_row[i] > int_level) {
+                render_hough_line(image_foundlines, i, j, image_houghmap->uint_xres, float_deltatheta, float_deltarho, float_threshold * image_houghmap->uint_max);
+            }
+        }
+    }
+
+    INSTRUMENT_END(reverse_transform);
+
+    return;
+}
+
+
+/*-----------------------
+ * HOUGH TRANSFORMATION
+ *---------------------*/
+
+/* we are not considering the gradient information yet */
+/* advanced task: how to make this loop structure more efficient assuming that
+ * there are only few edges in the image
+ */
+void hough_transform(image* image_edgemap, image* image_houghmap, unsigned int uint_binstheta, unsigned int uint_binsrho) {
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    int int_y;
+    float float_theta = 0.0f;
+    float float_rho = 0.0f;
+
+    /* the inclement in the angle theta */
+    float float_deltatheta = M_PI / uint_binstheta;
+
+    /* the maximum value of the radius (diagonal of the image) */
+    float float_deltarho = 2.0f * (sqrtf(image_edgemap->uint_xres * image_edgemap->uint_xres + image_edgemap->uint_yres * image_edgemap->uint_yres)) / uint_binsrho;
+
+    /* allocate memory sapce for the hough map
+     * and set its size in x and y
+     */
+    INSTRUMENT_BEGIN(hough_transform);
+    INSTRUMENT_COUNT(hough_transform, INSTRUMENT_PIXELS, (uint64_t)image_edgemap->uint_xres * image_edgemap->uint_yres);
+    allocate_image_p2(image_houghmap, uint_binstheta, uint_binsrho, 0);
+
+    /* iterate all pixels of the input image */
+    for(i = 0; i < image_edgemap->uint_yres; i ++) {
+        for(j = 0; j < image_edgemap->uint_xres; j ++) {
+
+            /* check if we are on an edge otherwise do nothing,
+             * white is the max. grey level, 65535 in a 16 bit image
+             */
+            if(image_edgemap->int_image_data[i][j] == image_edgemap->uint_max) continue;
+
+            /* iterate the angle theta */
+            for(k = 0; k < image_houghmap->uint_xres; k ++) {
+                
+                float_theta = k * float_deltatheta;
+                float_rho = j * cosf(float_theta) + i * sinf(float_theta);
+                int_y = (int)(image_houghmap->uint_yres / 2.0f) - (float_rho / float_deltarho) + 0.5f;
+                /* with fewer rho bins than the diagonal, a wide image
+                 * can round to one bin past the last one
+                 */
+                int_y = MIN(int_y, (int)image_houghmap->uint_yres - 1);
+
+                //printf("i: %d, j: %d, k: %d, int_y: %d\n", i, j, k, int_y);
+                /* possible extension: compute the int Hough transform
+                 * and compress it into 8 bits, see hough_transform_u16()
+                 * for 16 bit bins
+                 */
+                //if(image_houghmap->int_image_data[int_y][k] > 0) {
+                image_houghmap->int_image_data[int_y][k] ++;
+                //}
+                image_houghmap->uint_max = MAX(image_houghmap->int_image_data[int_y][k], image_houghmap->uint_max);
+            }
+        }
+    }
+
+    INSTRUMENT_END(hough_transform);
+
+    return;
+}
+
+
+
+/*-----------------------
+ * COMPACT HOUGH TRANSFORMATION
+ *---------------------*/
+
+/* The compact accumulator has 16 bit bins that saturate at 65535
+ * and one row per theta bin, so the votes of a point for one theta
+ * bin go into a row of a few KB. The points stream past the
+ * accumulator once per tile of HOUGH_THETA_TILE rows, which stays
+ * in the L2 cache while it collects their votes.
+ */
+#define HOUGH_THETA_TILE 16
+
+/* Coarse-to-fine: the coarse accumulator has uint_factor times fewer
+ * bins in theta and rho. Only the theta rows around coarse bins above
+ * HOUGH_COARSE_SLACK times the line threshold are voted for again
+ * at full resolution, all other rows stay 0.
+ */
+#define HOUGH_COARSE_SLACK 0.5f
+
+
+/* Collect the x, y pairs of all edge pixels, which are all pixels that
+ * are not white (the max. grey level) like in hough_transform(). Returns the number of points
+ * or -1 if we run out of memory or the image is too large for 16 bit
+ * coordinates.
+ */
+long hough_edge_points(image_view* view_edgemap, uint16_t** uint16_points) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    size_t size_t_points = 0;
+    unsigned int* uint_row;
+
+    *uint16_points = NULL;
+    if(view_edgemap->uint_xres > UINT16_MAX + 1u || view_edgemap->uint_yres > UINT16_MAX + 1u) {
+        fprintf(stderr, "hough_edge_points: the compact Hough transform takes at most %u by %u pixels.\n", UINT16_MAX + 1u, UINT16_MAX + 1u);
+        return(-1);
+    }
+
+    for(i = 0; i < view_edgemap->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_edgemap, i);
+        for(j = 0; j < view_edgemap->uint_xres; j ++) {
+            size_t_points += (uint_row[j] != view_edgemap->uint_max);
+        }
+    }
+
+    *uint16_points = (uint16_t*)malloc(MAX(size_t_points, 1) * 2 * sizeof(uint16_t));
+    if(*uint16_points == NULL) {
+        perror("hough_edge_points: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    size_t_points = 0;
+    for(i = 0; i < view_edgemap->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_edgemap, i);
+        for(j = 0; j < view_edgemap->uint_xres; j ++) {
+            if(uint_row[j] == view_edgemap->uint_max) continue;
+            (*uint16_points)[2 * size_t_points] = j;
+            (*uint16_points)[2 * size_t_points + 1] = i;
+            size_t_points ++;
+        }
+    }
+
+    return((long)size_t_points);
+}
+
+
+/* The rho bins of point x, y for uint_count theta bins, computed like
+ * in hough_transform(), so both accumulators get the same votes.
+ * int_last is the last rho bin.
+ */
+CPU_DISPATCH void hough_rho_bins(float float_x, float float_y, const float* restrict float_cos, const float* restrict float_sin, int* restrict int_bins, unsigned int uint_count, float float_centre, float float_deltarho, int int_last) {
+    unsigned int k = 0;
+    int int_bin = 0;
+    float float_rho = 0.0f;
+
+    for(k = 0; k < uint_count; k ++) {
+        float_rho = float_x * float_cos[k] + float_y * float_sin[k];
+        int_bin = float_centre - (float_rho / float_deltarho) + 0.5f;
+        int_bins[k] = MIN(int_bin, int_last);
+    }
+
+    return;
+}
+
+
+/* Vote with all points in the rows of image_accumulator for which
+ * uchar_active is not 0, or in all rows if it is NULL. float_cos and
+ * float_sin hold the angle of every row.
+ */
+void hough_vote(const uint16_t* uint16_points, size_t size_t_points, image_u16* image_accumulator, const float* float_cos, const float* float_sin, const unsigned char* uchar_active, float float_deltarho) {
+    unsigned int uint_rows[HOUGH_THETA_TILE];
+    float float_tile_cos[HOUGH_THETA_TILE];
+    float float_tile_sin[HOUGH_THETA_TILE];
+    int int_bins[HOUGH_THETA_TILE];
+    unsigned int uint_count = 0;
+    unsigned int k = 0;
+    unsigned int t = 0;
+    size_t p = 0;
+    float float_centre = (int)(image_accumulator->uint_xres / 2.0f);
+    uint16_t* uint16_bin;
+
+    for(k = 0; k < image_accumulator->uint_yres; ) {
+        /* the next tile of active rows */
+        for(uint_count = 0; uint_count < HOUGH_THETA_TILE && k < image_accumulator->uint_yres; k ++) {
+            if(uchar_active != NULL && !uchar_active[k]) continue;
+            uint_rows[uint_count] = k;
+            float_tile_cos[uint_count] = float_cos[k];
+            float_tile_sin[uint_count] = float_sin[k];
+            uint_count ++;
+        }
+
+        for(p = 0; p < size_t_points && uint_count > 0; p ++) {
+            hough_rho_bins(uint16_points[2 * p], uint16_points[2 * p + 1], float_tile_cos, float_tile_sin, int_bins, uint_count, float_centre, float_deltarho, (int)image_accumulator->uint_xres - 1);
+            for(t = 0; t < uint_count; t ++) {
+                uint16_bin = &U16_PIXEL(image_accumulator, int_bins[t], uint_rows[t]);
+                *uint16_bin += (*uint16_bin < UINT16_MAX);
+            }
+        }
+    }
+
+    /* the max. is found once at the end, not per vote */
+    image_accumulator->uint_max = 0;
+    for(k = 0; k < image_accumulator->uint_yres; k ++) {
+        if(uchar_active != NULL && !uchar_active[k]) continue;
+        for(t = 0; t < image_accumulator->uint_xres; t ++) {
+            image_accumulator->uint_max = MAX(U16_PIXEL(image_accumulator, t, k), image_accumulator->uint_max);
+        }
+    }
+
+    return;
+}
+
+
+/* the angles of uint_rows theta bins, every uint_step-th of uint_binstheta */
+void hough_angles(float* float_cos, float* float_sin, unsigned int uint_rows, unsigned int uint_step, unsigned int uint_binstheta) {
+    unsigned int k = 0;
+    float float_deltatheta = M_PI / uint_binstheta;
+
+    for(k = 0; k < uint_rows; k ++) {
+        float_cos[k] = cosf((int)(k * uint_step) * float_deltatheta);
+        float_sin[k] = sinf((int)(k * uint_step) * float_deltatheta);
+    }
+
+    return;
+}
+
+
+/* The Hough transform into a compact accumulator: image_houghmap
+ * gets uint_binstheta rows of uint_binsrho 16 bit bins, i.e. it is
+ * the transpose of the map of hough_transform(). For 1024x768 pixels
+ * and 10000 theta bins it needs 26 MB instead of 51 MB, and the votes
+ * of a tile of rows are collected in the cache. Below 65535 votes per
+ * bin both maps hold the same counts.
+ * If uint_factor is larger than 1, a coarse accumulator picks the rows
+ * we vote for, see HOUGH_COARSE_SLACK. float_threshold is the line
+ * threshold relative to the max., as for reverse_transform().
+ * Returns 0, or -1 if we run out of memory.
+ */
+int hough_transform_u16(image_view* view_edgemap, image_u16* image_houghmap, unsigned int uint_binstheta, unsigned int uint_binsrho, unsigned int uint_factor, float float_threshold) {
+    uint16_t* uint16_points;
+    long long_points = 0;
+    unsigned int k = 0;
+    unsigned int t = 0;
+    unsigned int uint_coarse_theta = 0;
+    unsigned int uint_coarse_rho = 0;
+    float* float_cos = NULL;
+    float* float_sin = NULL;
+    unsigned char* uchar_active = NULL;
+    image_u16 image_coarse;
+    int int_return_value = 0;
+
+    /* the maximum value of the radius (diagonal of the image) */
+    float float_diagonal = 2.0f * (sqrtf(view_edgemap->uint_xres * view_edgemap->uint_xres + view_edgemap->uint_yres * view_edgemap->uint_yres));
+
+    INSTRUMENT_BEGIN(hough_transform_u16);
+    INSTRUMENT_COUNT(hough_transform_u16, INSTRUMENT_PIXELS, (uint64_t)view_edgemap->uint_xres * view_edgemap->uint_yres);
+
+    long_points = hough_edge_points(view_edgemap, &uint16_points);
+    if(long_points < 0) return(-1);
+    if(allocate_image_u16(image_houghmap, uint_binsrho, uint_binstheta, 0) != 0) {
+        free(uint16_points);
+        return(-1);
+    }
+
+    /* the coarse pass only sets the angles of its rows, the others stay 0 */
+    float_cos = (float*)calloc(uint_binstheta, sizeof(float));
+    float_sin = (float*)calloc(uint_binstheta, sizeof(float));
+    if(float_cos == NULL || float_sin == NULL) {
+        perror("hough_transform_u16: Error allocating storage space.\n");
+        int_return_value = -1;
+        goto cleanup;
+    }
+
+    /* vote at coarse resolution and mark the rows around its peaks */
+    if(uint_factor > 1) {
+        uint_coarse_theta = (uint_binstheta + uint_factor - 1) / uint_factor;
+        uint_coarse_rho = MAX(uint_binsrho / uint_factor, 1);
+        uchar_active = (unsigned char*)calloc(uint_binstheta, sizeof(unsigned char));
+        if(uchar_active == NULL || allocate_image_u16(&image_coarse, uint_coarse_rho, uint_coarse_theta, 0) != 0) {
+            int_return_value = -1;
+            goto cleanup;
+        }
+
+        hough_angles(float_cos, float_sin, uint_coarse_theta, uint_factor, uint_binstheta);
+        hough_vote(uint16_points, long_points, &image_coarse, float_cos, float_sin, NULL, float_diagonal / uint_coarse_rho);
+        for(k = 0; k < uint_coarse_theta; k ++) {
+            for(t = 0; t < uint_coarse_rho; t ++) {
+                if(U16_PIXEL(&image_coarse, t, k) > HOUGH_COARSE_SLACK * float_threshold * image_coarse.uint_max) break;
+            }
+            if(t == uint_coarse_rho) continue;
+            for(t = (k * uint_factor > uint_factor) ? k * uint_factor - uint_factor : 0; t <= k * uint_factor + uint_factor && t < uint_binstheta; t ++) {
+                uchar_active[t] = 1;
+            }
+        }
+        free_image_u16(&image_coarse);
+    }
+
+    /* vote at full resolution */
+    hough_angles(float_cos, float_sin, uint_binstheta, 1, uint_binstheta);
+    hough_vote(uint16_points, long_points, image_houghmap, float_cos, float_sin, uchar_active, float_diagonal / uint_binsrho);
+
+cleanup:
+    if(int_return_value != 0) free_image_u16(image_houghmap);
+    free(uchar_active);
+    free(float_sin);
+    free(float_cos);
+    free(uint16_points);
+
+    INSTRUMENT_END(hough_transform_u16);
+
+    return(int_return_value);
+}
+
+
+/*-----------------------
+ * PROGRESSIVE PROBABILISTIC HOUGH TRANSFORMATION
+ *---------------------*/
+
+/* The edge points vote one by one in random order. As soon as the
+ * bin a point voted for is significant, i.e. it has at least
+ * HOUGH_MIN_VOTES votes and HOUGH_SIGNIFICANCE standard deviations
+ * more than the mean of its row, we follow the line through the point
+ * over gaps of up to uint_max_gap pixels. All edge pixels on it are
+ * removed, and their votes with them, so they never vote again.
+ * Most points of a long line are removed before they vote.
+ */
+#define HOUGH_MIN_VOTES 10
+#define HOUGH_SIGNIFICANCE 4.0f
+#define HOUGH_RANDOM_SEED 2463534242u
+
+/* the states of a pixel in the mask of hough_progressive() */
+#define HOUGH_PIXEL_EDGE 1
+#define HOUGH_PIXEL_VOTED 2
+
+#define SEGMENT_LIST_START 64
+
+/* a line segment, ready for set_line_pixels() */
+typedef struct {
+    point point_start;
+    point point_end;
+    unsigned int uint_votes;
+} line_segment;
+
+/* the segments found so far */
+typedef struct {
+    line_segment* segments;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} segment_list;
+
+
+/* append a segment, the list grows as needed */
+int add_segment(segment_list* segments, point point_start, point point_end, unsigned int uint_votes) {
+    line_segment* segment_grown;
+
+    if(segments->size_t_count == segments->size_t_capacity) {
+        segments->size_t_capacity = (segments->size_t_capacity == 0) ? SEGMENT_LIST_START : 2 * segments->size_t_capacity;
+        segment_grown = (line_segment*)realloc(segments->segments, segments->size_t_capacity * sizeof(line_segment));
+        if(segment_grown == NULL) {
+            perror("add_segment: Error allocating storage space.\n");
+            return(-1);
+        }
+        segments->segments = segment_grown;
+    }
+
+    segments->segments[segments->size_t_count].point_start = point_start;
+    segments->segments[segments->size_t_count].point_end = point_end;
+    segments->segments[segments->size_t_count ++].uint_votes = uint_votes;
+
+    return(0);
+}
+
+
+void free_segment_list(segment_list* segments) {
+    free(segments->segments);
+    segments->segments = NULL;
+    segments->size_t_count = 0;
+    segments->size_t_capacity = 0;
+
+    return;
+}
+
+
+/* xorshift, so every run finds the same segments */
+uint32_t hough_random(uint32_t* uint32_state) {
+    *uint32_state ^= *uint32_state << 13;
+    *uint32_state ^= *uint32_state >> 17;
+    *uint32_state ^= *uint32_state << 5;
+
+    return(*uint32_state);
+}
+
+
+/* Add (int_sign 1) or remove (int_sign -1) the votes of point x, y
+ * in all theta rows. Returns the row of the largest bin it voted for,
+ * its count is in *uint_votes.
+ */
+unsigned int hough_vote_point(image_u16* image_accumulator, uint16_t uint16_x, uint16_t uint16_y, int int_sign, const float* float_cos, const float* float_sin, int* int_bins, float float_deltarho, unsigned int* uint_votes) {
+    unsigned int k = 0;
+    unsigned int uint_best = 0;
+    float float_centre = (int)(image_accumulator->uint_xres / 2.0f);
+    uint16_t* uint16_bin;
+
+    hough_rho_bins(uint16_x, uint16_y, float_cos, float_sin, int_bins, image_accumulator->uint_yres, float_centre, float_deltarho, (int)image_accumulator->uint_xres - 1);
+
+    *uint_votes = 0;
+    for(k = 0; k < image_accumulator->uint_yres; k ++) {
+        uint16_bin = &U16_PIXEL(image_accumulator, int_bins[k], k);
+        if(int_sign > 0) {
+            *uint16_bin += (*uint16_bin < UINT16_MAX);
+        } else {
+            *uint16_bin -= (*uint16_bin > 0);
+        }
+        if(*uint16_bin > *uint_votes) {
+            *uint_votes = *uint16_bin;
+            uint_best = k;
+        }
+    }
+
+    return(uint_best);
+}
+
+
+/* Follow the line with direction float_dx, float_dy from x, y over
+ * gaps of up to uint_max_gap pixels. Returns the number of steps to
+ * the last edge pixel, its position is in *point_end.
+ */
+unsigned int hough_follow_line(unsigned char* uchar_mask, unsigned int uint_xres, unsigned int uint_yres, int int_x, int int_y, float float_dx, float float_dy, unsigned int uint_max_gap, point* point_end) {
+    unsigned int i = 0;
+    unsigned int uint_gap = 0;
+    unsigned int uint_last = 0;
+    int int_px = 0;
+    int int_py = 0;
+
+    point_end->uint_x = int_x;
+    point_end->uint_y = int_y;
+
+    for(i = 1; uint_gap <= uint_max_gap; i ++) {
+        int_px = (int)floorf(int_x + i * float_dx + 0.5f);
+        int_py = (int)floorf(int_y + i * float_dy + 0.5f);
+        if(int_px < 0 || int_py < 0 || int_px >= (int)uint_xres || int_py >= (int)uint_yres) break;
+
+        if(uchar_mask[(size_t)int_py * uint_xres + int_px]) {
+            uint_gap = 0;
+            uint_last = i;
+            point_end->uint_x = int_px;
+            point_end->uint_y = int_py;
+        } else {
+            uint_gap ++;
+        }
+    }
+
+    return(uint_last);
+}
+
+
+/* Remove x, y and the edge pixels of the first uint_steps steps from
+ * it, and their votes if they voted, see hough_follow_line().
+ * Returns the number of points whose votes were taken back.
+ */
+unsigned int hough_remove_line(unsigned char* uchar_mask, image_u16* image_accumulator, unsigned int uint_xres, int int_x, int int_y, float float_dx, float float_dy, unsigned int uint_steps, const float* float_cos, const float* float_sin, int* int_bins, float float_deltarho) {
+    unsigned int i = 0;
+    unsigned int uint_votes = 0;
+    unsigned int uint_removed = 0;
+    int int_px = 0;
+    int int_py = 0;
+    unsigned char* uchar_pixel;
+
+    for(i = 0; i <= uint_steps; i ++) {
+        int_px = (int)floorf(int_x + i * float_dx + 0.5f);
+        int_py = (int)floorf(int_y + i * float_dy + 0.5f);
+        uchar_pixel = &uchar_mask[(size_t)int_py * uint_xres + int_px];
+        if(*uchar_pixel & HOUGH_PIXEL_VOTED) {
+            hough_vote_point(image_accumulator, int_px, int_py, -1, float_cos, float_sin, int_bins, float_deltarho, &uint_votes);
+            uint_removed ++;
+        }
+        *uchar_pixel = 0;
+    }
+
+    return(uint_removed);
+}
+
+
+/* The progressive probabilistic Hough transform (Matas, Galambos and
+ * Kittler 2000). Adds all segments of at least uint_min_length pixels
+ * to segments. The accumulator is the same as for hough_transform_u16().
+ * Returns the number of points that voted, or -1 if we run out of memory.
+ */
+long hough_progressive(image_view* view_edgemap, segment_list* segments, unsigned int uint_binstheta, unsigned int uint_binsrho, unsigned int uint_min_length, unsigned int uint_max_gap) {
+    uint16_t* uint16_points;
+    uint16_t uint16_swap[2];
+    long long_points = 0;
+    long long_voted = 0;
+    long long_voting = 0;
+    long p = 0;
+    long q = 0;
+    unsigned int uint_xres = view_edgemap->uint_xres;
+    unsigned int uint_yres = view_edgemap->uint_yres;
+    unsigned int uint_best = 0;
+    unsigned int uint_votes = 0;
+    unsigned int uint_steps[2];
+    unsigned int uint_length = 0;
+    uint32_t uint32_state = HOUGH_RANDOM_SEED;
+    int int_x = 0;
+    int int_y = 0;
+    float float_mean = 0.0f;
+    float float_theta = 0.0f;
+    float float_dx = 0.0f;
+    float float_dy = 0.0f;
+    float float_diagonal = 2.0f * (sqrtf(uint_xres * uint_xres + uint_yres * uint_yres));
+    float* float_cos = NULL;
+    float* float_sin = NULL;
+    int* int_bins = NULL;
+    unsigned char* uchar_mask = NULL;
+    point point_ends[2];
+    image_u16 image_accumulator;
+
+    long_points = hough_edge_points(view_edgemap, &uint16_points);
+    if(long_points < 0) return(-1);
+    if(allocate_image_u16(&image_accumulator, uint_binsrho, uint_binstheta, 0) != 0) {
+        free(uint16_points);
         return(-1);
     }
 
-    /* get the image resolution */
-    fgets(char_buffer, INT_BUFFERLENGTH, file_input);
-    while(char_buffer[0] == '#') {
-         fgets(char_buffer, INT_BUFFERLENGTH, file_input);
+    INSTRUMENT_BEGIN(hough_progressive);
+    INSTRUMENT_COUNT(hough_progressive, INSTRUMENT_PIXELS, (uint64_t)uint_xres * uint_yres);
+
+    float_cos = (float*)malloc(uint_binstheta * sizeof(float));
+    float_sin = (float*)malloc(uint_binstheta * sizeof(float));
+    int_bins = (int*)malloc(uint_binstheta * sizeof(int));
+    uchar_mask = (unsigned char*)calloc((size_t)uint_xres * uint_yres, sizeof(unsigned char));
+    if(float_cos == NULL || float_sin == NULL || int_bins == NULL || uchar_mask == NULL) {
+        perror("hough_progressive: Error allocating storage space.\n");
+        long_voted = -1;
+        long_points = 0;
+    } else {
+        hough_angles(float_cos, float_sin, uint_binstheta, 1, uint_binstheta);
+    }
+
+    /* shuffle the points and mark them in the mask */
+    for(p = long_points - 1; p >= 0; p --) {
+        q = hough_random(&uint32_state) % (p + 1);
+        memcpy(uint16_swap, &uint16_points[2 * p], sizeof(uint16_swap));
+        memcpy(&uint16_points[2 * p], &uint16_points[2 * q], sizeof(uint16_swap));
+        memcpy(&uint16_points[2 * q], uint16_swap, sizeof(uint16_swap));
+        uchar_mask[(size_t)uint16_points[2 * p + 1] * uint_xres + uint16_points[2 * p]] = HOUGH_PIXEL_EDGE;
+    }
+
+    for(p = 0; p < long_points; p ++) {
+        int_x = uint16_points[2 * p];
+        int_y = uint16_points[2 * p + 1];
+        if(uchar_mask[(size_t)int_y * uint_xres + int_x] == 0) continue;
+
+        uint_best = hough_vote_point(&image_accumulator, int_x, int_y, 1, float_cos, float_sin, int_bins, float_diagonal / uint_binsrho, &uint_votes);
+        uchar_mask[(size_t)int_y * uint_xres + int_x] |= HOUGH_PIXEL_VOTED;
+        long_voted ++;
+        long_voting ++;
+
+        /* every point that voted and is still there put one vote in each row */
+        float_mean = (float)long_voting / uint_binsrho;
+        if(uint_votes < HOUGH_MIN_VOTES || uint_votes < float_mean + HOUGH_SIGNIFICANCE * sqrtf(float_mean)) continue;
+
+        /* theta is the direction of the normal, we walk along the line
+         * one pixel at a time in x or y, whichever changes faster
+         */
+        float_theta = uint_best * (float)(M_PI / uint_binstheta);
+        float_dx = -sinf(float_theta);
+        float_dy = cosf(float_theta);
+        if(fabsf(float_dx) > fabsf(float_dy)) {
+            float_dy /= fabsf(float_dx);
+            float_dx = (float_dx > 0.0f) ? 1.0f : -1.0f;
+        } else {
+            float_dx /= fabsf(float_dy);
+            float_dy = (float_dy > 0.0f) ? 1.0f : -1.0f;
+        }
+        uint_steps[0] = hough_follow_line(uchar_mask, uint_xres, uint_yres, int_x, int_y, float_dx, float_dy, uint_max_gap, &point_ends[0]);
+        uint_steps[1] = hough_follow_line(uchar_mask, uint_xres, uint_yres, int_x, int_y, -float_dx, -float_dy, uint_max_gap, &point_ends[1]);
+        uint_length = uint_steps[0] + uint_steps[1];
+
+        /* the pixels of short segments are removed as well */
+        long_voting -= hough_remove_line(uchar_mask, &image_accumulator, uint_xres, int_x, int_y, float_dx, float_dy, uint_steps[0], float_cos, float_sin, int_bins, float_diagonal / uint_binsrho);
+        long_voting -= hough_remove_line(uchar_mask, &image_accumulator, uint_xres, int_x, int_y, -float_dx, -float_dy, uint_steps[1], float_cos, float_sin, int_bins, float_diagonal / uint_binsrho);
+
+        if(uint_length >= uint_min_length && add_segment(segments, point_ends[1], point_ends[0], uint_votes) != 0) {
+            long_voted = -1;
+            break;
+        }
+    }
+
+    INSTRUMENT_END(hough_progressive);
+
+    free(uchar_mask);
+    free(int_bins);
+    free(float_sin);
+    free(float_cos);
+    free_image_u16(&image_accumulator);
+    free(uint16_points);
+
+    return(long_voted);
+}
+
+
+/*-----------------------
+ * CIRCLE HOUGH TRANSFORMATION
+ *---------------------*/
+
+/* An edge pixel on a circle has its gradient along the radius, so it
+ * votes for the centres on its gradient line only, uint_rmin ... uint_rmax
+ * pixels away on both sides, instead of for a whole circle of centres
+ * per radius. The centres go into a 2D accumulator of the image size.
+ * For every peak of it we then make a histogram of the distances of
+ * the edge pixels whose gradient points at it, and take the radius
+ * with the most support. hough_circles_3d() is the brute force
+ * transform with a full centre x radius volume, for comparison.
+ */
+
+/* The centre accumulator is summed over 3x3 bins before we look for
+ * peaks, which catches the votes scattered by the error of the gradient
+ * direction. A circle needs at least HOUGH_CIRCLE_COVERAGE of its
+ * circumference, counted by edge pixels whose gradient is within
+ * acos(HOUGH_CIRCLE_ALIGNMENT) of its radius.
+ */
+#define HOUGH_CIRCLE_MIN_VOTES 20
+#define HOUGH_CIRCLE_COVERAGE 0.5f
+#define HOUGH_CIRCLE_ALIGNMENT 0.9f
+#define HOUGH_CIRCLE_MAX_CANDIDATES 1024
+
+#define CIRCLE_LIST_START 16
+
+
+/* a circle found by hough_circles() or hough_circles_3d() */
+typedef struct {
+    unsigned int uint_x;
+    unsigned int uint_y;
+    unsigned int uint_radius;
+    unsigned int uint_votes;
+} circle;
+
+/* the circles found so far */
+typedef struct {
+    circle* circles;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} circle_list;
+
+/* an edge pixel and the unit vector of its gradient */
+typedef struct {
+    float float_x;
+    float float_y;
+    float float_dx;
+    float float_dy;
+} circle_point;
+
+/* the centre rows uint_first_row ... uint_last_row - 1 of one voting thread */
+typedef struct {
+    const circle_point* points;
+    size_t size_t_points;
+    image_u16* image_centres;
+    unsigned int uint_rmin;
+    unsigned int uint_rmax;
+    unsigned int uint_first_row;
+    unsigned int uint_last_row;
+} circle_strip;
+
+
+/* append a circle, the list grows as needed */
+int add_circle(circle_list* circles, unsigned int uint_x, unsigned int uint_y, unsigned int uint_radius, unsigned int uint_votes) {
+    circle* circle_grown;
+
+    if(circles->size_t_count == circles->size_t_capacity) {
+        circles->size_t_capacity = (circles->size_t_capacity == 0) ? CIRCLE_LIST_START : 2 * circles->size_t_capacity;
+        circle_grown = (circle*)realloc(circles->circles, circles->size_t_capacity * sizeof(circle));
+        if(circle_grown == NULL) {
+            perror("add_circle: Error allocating storage space.\n");
+            return(-1);
+        }
+        circles->circles = circle_grown;
+    }
+
+    circles->circles[circles->size_t_count].uint_x = uint_x;
+    circles->circles[circles->size_t_count].uint_y = uint_y;
+    circles->circles[circles->size_t_count].uint_radius = uint_radius;
+    circles->circles[circles->size_t_count ++].uint_votes = uint_votes;
+
+    return(0);
+}
+
+
+void free_circle_list(circle_list* circles) {
+    free(circles->circles);
+    circles->circles = NULL;
+    circles->size_t_count = 0;
+    circles->size_t_capacity = 0;
+
+    return;
+}
+
+
+/* the stronger circle first */
+int compare_circles(const void* void_a, const void* void_b) {
+    const circle* circle_a = (const circle*)void_a;
+    const circle* circle_b = (const circle*)void_b;
+
+    return((circle_a->uint_votes < circle_b->uint_votes) - (circle_a->uint_votes > circle_b->uint_votes));
+}
+
+
+/* The offsets of the pixels of a circle with radius uint_radius, drawn
+ * with the midpoint algorithm. point_offsets needs room for
+ * 8 * (uint_radius + 1) points. Returns the number of offsets.
+ */
+unsigned int circle_offsets(unsigned int uint_radius, point* point_offsets) {
+    int x = uint_radius;
+    int y = 0;
+    int int_error = 1 - x;
+    unsigned int uint_count = 0;
+    unsigned int i = 0;
+    int int_octants[8][2];
+
+    if(uint_radius == 0) {
+        point_offsets[0].uint_x = 0;
+        point_offsets[0].uint_y = 0;
+        return(1);
+    }
+
+    while(x >= y) {
+        int_octants[0][0] = x;  int_octants[0][1] = y;
+        int_octants[1][0] = y;  int_octants[1][1] = x;
+        int_octants[2][0] = -y; int_octants[2][1] = x;
+        int_octants[3][0] = -x; int_octants[3][1] = y;
+        int_octants[4][0] = -x; int_octants[4][1] = -y;
+        int_octants[5][0] = -y; int_octants[5][1] = -x;
+        int_octants[6][0] = y;  int_octants[6][1] = -x;
+        int_octants[7][0] = x;  int_octants[7][1] = -y;
+
+        /* the pixels on the diagonals and the axes are in two octants */
+        for(i = 0; i < 8; i ++) {
+            if((y == 0 || x == y) && (i % 2 == 1)) continue;
+            point_offsets[uint_count].uint_x = int_octants[i][0];
+            point_offsets[uint_count ++].uint_y = int_octants[i][1];
+        }
+
+        y ++;
+        if(int_error < 0) {
+            int_error += 2 * y + 1;
+        } else {
+            x --;
+            int_error += 2 * (y - x) + 1;
+        }
     }
-    sscanf(char_buffer, "%d %d", &(image_input->uint_xres), &(image_input->uint_yres));
 
-    /* get the max. grey level */
-    fgets(char_buffer, INT_BUFFERLENGTH, file_input);
-    while(char_buffer[0] == '#') {
-         fgets(char_buffer, INT_BUFFERLENGTH, file_input);
+    return(uint_count);
+}
+
+
+/* render a circle into the image in black like set_line_pixels(), pixels outside are skipped */
+void set_circle_pixels(image* image_in, circle* circle_found) {
+    point* point_offsets;
+    unsigned int i = 0;
+    unsigned int uint_count = 0;
+    int int_x = 0;
+    int int_y = 0;
+
+    point_offsets = (point*)malloc(8 * (circle_found->uint_radius + 1) * sizeof(point));
+    if(point_offsets == NULL) return;
+
+    uint_count = circle_offsets(circle_found->uint_radius, point_offsets);
+    for(i = 0; i < uint_count; i ++) {
+        int_x = (int)circle_found->uint_x + point_offsets[i].uint_x;
+        int_y = (int)circle_found->uint_y + point_offsets[i].uint_y;
+        if(int_x < 0 || int_y < 0 || int_x >= (int)image_in->uint_xres || int_y >= (int)image_in->uint_yres) continue;
+        image_in->int_image_data[int_y][int_x] = 0;
     }
-    sscanf(char_buffer, "%d", &(image_input->uint_max));
 
-    free(char_buffer);
-    return(0);
-} 
+    free(point_offsets);
 
+    return;
+}
 
 
-/*-----------------------------------------
- * functions to deal with a greyscale image
- *---------------------------------------*/
-int allocate_image_data(image* image_p2, unsigned int uint_initialgreylevel) {
+/* Pixel x, y of the image blurred by gaussian_row_u16(), border included.
+ * Only the edge pixels need their gradient, so we blur the pixels around
+ * them instead of the whole image, with the same sums.
+ */
+unsigned int circle_blurred_pixel(image_u16* image_input, unsigned int uint_x, unsigned int uint_y) {
     int i = 0;
-    int j = 0;
+    int k = 0;
+    float float_tmp = 0.0f;
 
-    if(image_p2->uint_xres == 0 || image_p2->uint_yres == 0) {
-        perror("allocate_image: At least one dimension is zero.");
-        return(-1);
+    if(uint_y <= GAUSSIAN_KERNEL_SIZE / 2 || uint_y + GAUSSIAN_KERNEL_SIZE / 2 >= image_input->uint_yres ||
+        uint_x <= GAUSSIAN_KERNEL_SIZE / 2 || uint_x + GAUSSIAN_KERNEL_SIZE / 2 >= image_input->uint_xres) {
+        return(GAUSSIAN_BORDER(image_input->uint_max));
     }
 
-    if(uint_initialgreylevel > 255) {
-       perror("allocate image: Invalid initial grey level given.\n");
-       return(-1);
+    for(i = 0; i < GAUSSIAN_KERNEL_SIZE; i ++) {
+        for(k = 0; k < GAUSSIAN_KERNEL_SIZE; k ++) {
+            float_tmp += int_gaussian_5x5[i][k] * U16_PIXEL(image_input, uint_x + k - GAUSSIAN_KERNEL_SIZE / 2, uint_y + i - GAUSSIAN_KERNEL_SIZE / 2);
+        }
     }
 
-    image_p2->int_image_data = (unsigned int**)malloc(image_p2->uint_yres * sizeof(unsigned int*));
-    if(image_p2->int_image_data == NULL) {
-        perror("allocate_image: Error allocating storage space.\n");
-        return(-1);
+    return((uint16_t)(int)(float_tmp / GAUSSIAN_KERNEL_WEIGHT + 0.5f));
+}
+
+
+/* Collect the edge pixels (255 in view_edges) and the direction of
+ * their gradient in the blurred image. The pixels on the Sobel border
+ * and those without a gradient are left out. point_edges is taken
+ * from arena_scratch. Returns the number of points.
+ */
+size_t circle_edge_points(image_u16* image_input, image_view* view_edges, circle_point** point_edges, image_arena* arena_scratch) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    int x = 0;
+    int y = 0;
+    size_t size_t_points = 0;
+    float float_gx = 0.0f;
+    float float_gy = 0.0f;
+    float float_magnitude = 0.0f;
+    uint16_t uint16_blurred[SOBEL_KERNEL_SIZE][SOBEL_KERNEL_SIZE];
+
+    for(i = 1; i + 1 < view_edges->uint_yres; i ++) {
+        for(j = 1; j + 1 < view_edges->uint_xres; j ++) {
+            size_t_points += (VIEW_PIXEL(view_edges, j, i) == 255);
+        }
     }
 
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        image_p2->int_image_data[i] = (unsigned int*)malloc(image_p2->uint_xres * sizeof(unsigned int));
-        if(uint_initialgreylevel == 0) {
-            memset(image_p2->int_image_data[i], 0, image_p2->uint_xres * sizeof(unsigned int));
-        } else {
-            /* why do I have to do this? Since memset sets bytes but an int has more than one byte */
-            for(j = 0; j < image_p2->uint_xres; j ++) {
-                image_p2->int_image_data[i][j] = uint_initialgreylevel;
+    *point_edges = (circle_point*)arena_allocate(arena_scratch, MAX(size_t_points, 1) * sizeof(circle_point));
+    if(*point_edges == NULL) return(0);
+
+    size_t_points = 0;
+    for(i = 1; i + 1 < view_edges->uint_yres; i ++) {
+        for(j = 1; j + 1 < view_edges->uint_xres; j ++) {
+            if(VIEW_PIXEL(view_edges, j, i) != 255) continue;
+
+            for(y = 0; y < SOBEL_KERNEL_SIZE; y ++) {
+                for(x = 0; x < SOBEL_KERNEL_SIZE; x ++) {
+                    uint16_blurred[y][x] = circle_blurred_pixel(image_input, j + x - 1, i + y - 1);
+                }
             }
+            float_gx = (float)SOBEL_U16_GX(uint16_blurred[0], uint16_blurred[1], uint16_blurred[2], 1);
+            float_gy = (float)SOBEL_U16_GY(uint16_blurred[0], uint16_blurred[1], uint16_blurred[2], 1);
+            float_magnitude = sqrtf(float_gx * float_gx + float_gy * float_gy);
+            if(float_magnitude == 0.0f) continue;
+
+            (*point_edges)[size_t_points].float_x = j;
+            (*point_edges)[size_t_points].float_y = i;
+            (*point_edges)[size_t_points].float_dx = float_gx / float_magnitude;
+            (*point_edges)[size_t_points].float_dy = float_gy / float_magnitude;
+            size_t_points ++;
         }
     }
 
-    return(0);
+    return(size_t_points);
 }
 
 
-int allocate_image_p2(image* image_p2, unsigned int uint_xres, unsigned int uint_yres, unsigned int uint_greylevel) {
- 
-    if(uint_greylevel > 255) {
-        perror("allocate_image: the max. grey level is 255.\n");
-        return(-1);
-    }
+/* Vote for the centres in the rows of one strip. Every point works out
+ * the radii that can reach the strip first, so the threads share the
+ * points but not the accumulator, and need no locks.
+ */
+void* circle_vote_strip(void* void_strip) {
+    circle_strip* strip = (circle_strip*)void_strip;
+    image_u16* image_centres = strip->image_centres;
+    const circle_point* point_edge;
+    size_t p = 0;
+    int int_sign = 0;
+    int r = 0;
+    int int_rfirst = 0;
+    int int_rlast = 0;
+    int int_cx = 0;
+    int int_cy = 0;
+    float float_dy = 0.0f;
+    float float_a = 0.0f;
+    float float_b = 0.0f;
+    uint16_t* uint16_bin;
+
+    for(p = 0; p < strip->size_t_points; p ++) {
+        point_edge = &strip->points[p];
+
+        /* bright circles on a dark background and the other way round */
+        for(int_sign = -1; int_sign <= 1; int_sign += 2) {
+            float_dy = int_sign * point_edge->float_dy;
+            if(fabsf(float_dy) < 1e-6f) {
+                if(point_edge->float_y < strip->uint_first_row || point_edge->float_y >= strip->uint_last_row) continue;
+                int_rfirst = strip->uint_rmin;
+                int_rlast = strip->uint_rmax;
+            } else {
+                float_a = (strip->uint_first_row - 0.5f - point_edge->float_y) / float_dy;
+                float_b = (strip->uint_last_row - 0.5f - point_edge->float_y) / float_dy;
+                int_rfirst = MAX((int)strip->uint_rmin, (int)floorf(MIN(float_a, float_b)) - 1);
+                int_rlast = MIN((int)strip->uint_rmax, (int)ceilf(MAX(float_a, float_b)) + 1);
+            }
 
-    image_p2->uint_xres = uint_xres;
-    image_p2->uint_yres = uint_yres;
-    image_p2->uint_max = uint_greylevel;    
+            for(r = int_rfirst; r <= int_rlast; r ++) {
+                int_cx = (int)floorf(point_edge->float_x + (float)(int_sign * r) * point_edge->float_dx + 0.5f);
+                int_cy = (int)floorf(point_edge->float_y + (float)(int_sign * r) * point_edge->float_dy + 0.5f);
+                if(int_cy < (int)strip->uint_first_row || int_cy >= (int)strip->uint_last_row) continue;
+                if(int_cx < 0 || int_cx >= (int)image_centres->uint_xres) continue;
+                uint16_bin = &U16_PIXEL(image_centres, int_cx, int_cy);
+                *uint16_bin += (*uint16_bin < UINT16_MAX);
+            }
+        }
+    }
 
-    return allocate_image_data(image_p2, uint_greylevel);
+    return(NULL);
 }
 
 
-void free_image_P2(image* image_p2) {
-    int i = 0;
+/* Vote for the centres of all points into image_centres, which has to
+ * be 0. With more than one thread every thread takes a strip of rows,
+ * the result is the same.
+ */
+int vote_circle_centres(const circle_point* point_edges, size_t size_t_points, image_u16* image_centres, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_threads) {
+    circle_strip* strips;
+    pthread_t* thread_ids;
+    unsigned int i = 0;
+    int int_result = 0;
+
+    uint_threads = MIN(MAX(uint_threads, 1), image_centres->uint_yres);
+    strips = (circle_strip*)malloc(uint_threads * sizeof(circle_strip));
+    thread_ids = (pthread_t*)malloc(uint_threads * sizeof(pthread_t));
+    if(strips == NULL || thread_ids == NULL) {
+        perror("vote_circle_centres: Error allocating storage space.\n");
+        free(strips);
+        free(thread_ids);
+        return(-1);
+    }
+
+    for(i = 0; i < uint_threads; i ++) {
+        strips[i].points = point_edges;
+        strips[i].size_t_points = size_t_points;
+        strips[i].image_centres = image_centres;
+        strips[i].uint_rmin = uint_rmin;
+        strips[i].uint_rmax = uint_rmax;
+        strips[i].uint_first_row = (unsigned int)((uint64_t)image_centres->uint_yres * i / uint_threads);
+        strips[i].uint_last_row = (unsigned int)((uint64_t)image_centres->uint_yres * (i + 1) / uint_threads);
+    }
 
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        free(image_p2->int_image_data[i]);
+    /* the calling thread works on the first strip itself */
+    for(i = 1; i < uint_threads; i ++) {
+        if(pthread_create(&thread_ids[i], NULL, circle_vote_strip, &strips[i]) != 0) {
+            perror("vote_circle_centres: Unable to start a thread.\n");
+            circle_vote_strip(&strips[i]);
+            thread_ids[i] = pthread_self();
+        }
+    }
+    circle_vote_strip(&strips[0]);
+    for(i = 1; i < uint_threads; i ++) {
+        if(!pthread_equal(thread_ids[i], pthread_self())) {
+            int_result |= pthread_join(thread_ids[i], NULL);
+        }
     }
 
-    free(image_p2->int_image_data);
+    free(thread_ids);
+    free(strips);
 
-    return;
+    return(int_result == 0 ? 0 : -1);
 }
 
 
-/*
- * This function reads only the image data.
+/* The peaks of the centre accumulator summed over 3x3 bins, strongest
+ * first. A peak has at least uint_min_votes and is larger than the bins
+ * before it and not smaller than the bins after it. image_sums has the
+ * size of image_centres.
  */
-int read_imagedata_P2(FILE* file_input, image* image_p2) {
-    int i = 0;
-    int j = 0;
-
-    /* check if the iamge has been allocated */
-    if(image_p2->uint_xres == 0 || image_p2->uint_yres == 0) {
-        perror("Image not allocated.");
+int find_circle_centres(image_u16* image_centres, image_u16* image_sums, unsigned int uint_min_votes, circle_list* candidates) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int uint_sum = 0;
+    unsigned int uint_xres = image_centres->uint_xres;
+    unsigned int uint_yres = image_centres->uint_yres;
+    uint32_t* uint32_columns;
+    uint16_t* uint16_row;
+    const uint16_t* uint16_centres;
+    int x = 0;
+    int y = 0;
+    int int_peak = 0;
+
+    /* the sums of three rows first, then of three columns of them */
+    uint32_columns = (uint32_t*)malloc((uint_xres + 2) * sizeof(uint32_t));
+    if(uint32_columns == NULL) {
+        perror("find_circle_centres: Error allocating storage space.\n");
         return(-1);
     }
-
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        for(j = 0; j < image_p2->uint_xres; j ++) {
-             if( fscanf(file_input, "%d", &(image_p2->int_image_data[i][j])) == EOF ) {
-                 perror("Unexpected end of image data.\n");
-                 exit(1);
-             }
+    uint32_columns[0] = 0;
+    uint32_columns[uint_xres + 1] = 0;
+    for(i = 0; i < uint_yres; i ++) {
+        memset(uint32_columns + 1, 0, uint_xres * sizeof(uint32_t));
+        for(y = MAX((int)i - 1, 0); y <= (int)MIN(i + 1, uint_yres - 1); y ++) {
+            uint16_centres = U16_ROW(image_centres, y);
+            for(j = 0; j < uint_xres; j ++) {
+                uint32_columns[j + 1] += uint16_centres[j];
+            }
+        }
+        uint16_row = U16_ROW(image_sums, i);
+        for(j = 0; j < uint_xres; j ++) {
+            uint_sum = uint32_columns[j] + uint32_columns[j + 1] + uint32_columns[j + 2];
+            uint16_row[j] = (uint16_t)MIN(uint_sum, UINT16_MAX);
         }
     }
- 
-    /* check if we read the entire image */
-    if(j != image_p2->uint_xres || i != image_p2->uint_yres ) {
-         perror("Unexpected end of PGM file.\n");
-         return(-1);
+    free(uint32_columns);
+
+    for(i = 0; i < uint_yres; i ++) {
+        for(j = 0; j < uint_xres; j ++) {
+            uint_sum = U16_PIXEL(image_sums, j, i);
+            if(uint_sum < uint_min_votes) continue;
+
+            int_peak = 1;
+            for(y = (int)i - 1; y <= (int)i + 1 && int_peak; y ++) {
+                for(x = (int)j - 1; x <= (int)j + 1; x ++) {
+                    if(x < 0 || y < 0 || x >= (int)uint_xres || y >= (int)uint_yres || (x == (int)j && y == (int)i)) continue;
+                    if(U16_PIXEL(image_sums, x, y) > uint_sum || (U16_PIXEL(image_sums, x, y) == uint_sum && (y < (int)i || (y == (int)i && x < (int)j)))) {
+                        int_peak = 0;
+                        break;
+                    }
+                }
+            }
+            if(int_peak && add_circle(candidates, j, i, 0, uint_sum) != 0) return(-1);
+        }
     }
 
+    qsort(candidates->circles, candidates->size_t_count, sizeof(circle), compare_circles);
+    candidates->size_t_count = MIN(candidates->size_t_count, HOUGH_CIRCLE_MAX_CANDIDATES);
+
     return(0);
 }
 
-int read_image(char* char_name, image* image_input) {
-    FILE* file_input;
-    int int_message_length;
-    char* char_error_message;
 
-    file_input = fopen(char_name, "r");
-    if( file_input == NULL ) {
-        /* I am printing a string into 0 allocated bytes.
-         * snprintf conviniently reports the number of bytes
-         * it is unable to print.
-         */
-        int_message_length = snprintf(NULL, 0, "Can't open input file: %s\n", char_name);
-        char_error_message = malloc(int_message_length);
-        sprintf(char_error_message, "Can't open input file: %s\n", char_name); 
-        perror(char_error_message);       
-        return(-1);
+/* Is the centre inside one of the circles found, or closer than
+ * uint_distance to its centre? The edges of a circle also vote for
+ * weaker centres around the true one, this keeps them out.
+ */
+int circle_near_found(circle_list* circles, unsigned int uint_x, unsigned int uint_y, unsigned int uint_distance) {
+    size_t i = 0;
+    float float_dx = 0.0f;
+    float float_dy = 0.0f;
+    float float_distance = 0.0f;
+
+    for(i = 0; i < circles->size_t_count; i ++) {
+        float_dx = (float)circles->circles[i].uint_x - uint_x;
+        float_dy = (float)circles->circles[i].uint_y - uint_y;
+        float_distance = (float)MAX(uint_distance, circles->circles[i].uint_radius);
+        if(float_dx * float_dx + float_dy * float_dy < float_distance * float_distance) return(1);
     }
-    
-    /* read the header information */
-    printf("read_image, header of image: %s.\n", char_name);
-    if( read_PBM_header(file_input, image_input) != 0 ) {
-        perror("Error reading header of image file.\n");
-        fclose(file_input);
-        return(-1);
+
+    return(0);
+}
+
+
+/* The first of the points, which are sorted by row, in row float_y or below */
+size_t circle_first_point(const circle_point* point_edges, size_t size_t_points, float float_y) {
+    size_t size_t_low = 0;
+    size_t size_t_high = size_t_points;
+    size_t size_t_middle = 0;
+
+    while(size_t_low < size_t_high) {
+        size_t_middle = size_t_low + (size_t_high - size_t_low) / 2;
+        if(point_edges[size_t_middle].float_y < float_y) {
+            size_t_low = size_t_middle + 1;
+        } else {
+            size_t_high = size_t_middle;
+        }
     }
 
-    printf("read_image, image resolution x: %d, y: %d, max. grey level: %d\n", image_input->uint_xres, image_input->uint_yres, image_input->uint_max);
+    return(size_t_low);
+}
+
 
-    /* allocate image */
-    if( allocate_image_p2(image_input, image_input->uint_xres, image_input->uint_yres, 0) != 0 ) {
-        perror("Error allocating memory to store image data\n");
-        fclose(file_input);
-        return(-1);
+/* The radius of a centre from the histogram of the distances of the
+ * edge pixels whose gradient points at it. Returns the radius, its
+ * support (the pixels at radius - 1 ... radius + 1) is in *uint_votes.
+ * Only the rows within the largest radius are looked at.
+ */
+unsigned int circle_radius(const circle_point* point_edges, size_t size_t_points, unsigned int uint_x, unsigned int uint_y, histogram* histogram_radii, unsigned int* uint_votes) {
+    size_t p = 0;
+    size_t size_t_last = 0;
+    unsigned int k = 0;
+    unsigned int uint_best = 0;
+    uint64_t uint64_support = 0;
+    uint64_t uint64_best = 0;
+    float float_dx = 0.0f;
+    float float_dy = 0.0f;
+    float float_distance = 0.0f;
+    float float_rmin = histogram_radii->uint_min - 0.5f;
+    float float_rmax = histogram_radii->uint_max + 0.5f;
+
+    clear_histogram(histogram_radii);
+    p = circle_first_point(point_edges, size_t_points, uint_y - float_rmax);
+    size_t_last = circle_first_point(point_edges, size_t_points, uint_y + float_rmax);
+    for(; p < size_t_last; p ++) {
+        float_dx = point_edges[p].float_x - uint_x;
+        float_dy = point_edges[p].float_y - uint_y;
+        if(fabsf(float_dx) >= float_rmax || fabsf(float_dy) >= float_rmax) continue;
+
+        float_distance = sqrtf(float_dx * float_dx + float_dy * float_dy);
+        if(float_distance < float_rmin || float_distance >= float_rmax) continue;
+        if(fabsf(float_dx * point_edges[p].float_dx + float_dy * point_edges[p].float_dy) < HOUGH_CIRCLE_ALIGNMENT * float_distance) continue;
+
+        histogram_radii->uint64_bins[histogram_bin(histogram_radii, (unsigned int)(float_distance + 0.5f))] ++;
     }
-    printf("Allocated memory\n");
 
-    /* read image data */
-    if( read_imagedata_P2(file_input, image_input) != 0 ) {
-        perror("Error reading image data\n");
-        fclose(file_input);
-        return(-1);
+    for(k = 0; k < histogram_radii->uint_num_bins; k ++) {
+        uint64_support = histogram_radii->uint64_bins[k];
+        if(k > 0) uint64_support += histogram_radii->uint64_bins[k - 1];
+        if(k + 1 < histogram_radii->uint_num_bins) uint64_support += histogram_radii->uint64_bins[k + 1];
+        if(uint64_support > uint64_best) {
+            uint64_best = uint64_support;
+            uint_best = k;
+        }
     }
 
-    return(0);
+    *uint_votes = (unsigned int)uint64_best;
+
+    return(histogram_bin_level(histogram_radii, uint_best));
 }
 
-int write_image_data(FILE* file_output, image* image_p2) {
+
+/* The first half of hough_circles(): collect the edge pixels of
+ * view_edges and let them vote on uint_threads threads. image_centres
+ * and the edge points are taken from arena_scratch. Returns the number
+ * of edge points, or -1 if we run out of memory.
+ */
+long circle_centre_votes(image_u16* image_input, image_view* view_edges, image_u16* image_centres, circle_point** point_edges, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_threads, image_arena* arena_scratch) {
     unsigned int i = 0;
-    unsigned int j = 0;
+    size_t size_t_points = 0;
 
-    /* check if the iamge has been allocated */
-    if(image_p2->uint_xres == 0 || image_p2->uint_yres == 0) {
-        perror("Image not allocated.");
-        return(-1);
+    *point_edges = NULL;
+    if(arena_allocate_u16(arena_scratch, image_centres, image_input->uint_xres, image_input->uint_yres, 0) != 0) return(-1);
+
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        memset(U16_ROW(image_centres, i), 0, image_input->uint_xres * sizeof(uint16_t));
     }
+    size_t_points = circle_edge_points(image_input, view_edges, point_edges, arena_scratch);
+    if(*point_edges == NULL) return(-1);
 
-    /* write header information */
-    fprintf(file_output, "P2\n%d %d\n# CREATOR: binary2ascii\n%d\n", image_p2->uint_xres, image_p2->uint_yres, image_p2->uint_max);
+    if(vote_circle_centres(*point_edges, size_t_points, image_centres, uint_rmin, uint_rmax, uint_threads) != 0) return(-1);
 
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        for(j = 0; j < image_p2->uint_xres; j ++) {
-            fprintf(file_output, "%d ", image_p2->int_image_data[i][j]);
-            //fwrite(image_p2->int_image_data[i], sizeof(char), image_p2->uint_xres, file_output);
-        }
-        fprintf(file_output, "\n");
+    return((long)size_t_points);
+}
+
+
+/* Circle detection with gradient-guided voting, see above. The edges
+ * are the 255 pixels of view_edges, e.g. from canny_u16() on the same
+ * image. Circles with a radius from uint_rmin to uint_rmax and at least
+ * uint_min_votes votes at their centre are added to circles, strongest
+ * first. No centre lies inside a circle found before it. The votes are
+ * cast on uint_threads threads. The accumulators are taken from
+ * arena_scratch, 4 bytes per pixel, plus 16 bytes per edge pixel.
+ * Returns 0, or -1 if we run out of memory.
+ */
+int hough_circles(image_u16* image_input, image_view* view_edges, circle_list* circles, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_min_votes, unsigned int uint_threads, image_arena* arena_scratch) {
+    unsigned int i = 0;
+    unsigned int uint_radius = 0;
+    unsigned int uint_votes = 0;
+    long long_points = 0;
+    image_u16 image_centres;
+    image_u16 image_sums;
+    circle_point* point_edges = NULL;
+    circle_list candidates;
+    histogram histogram_radii;
+    int int_return_value = 0;
+
+    if(uint_rmin > uint_rmax || uint_rmax == 0) return(0);
+
+    INSTRUMENT_BEGIN(hough_circles);
+    INSTRUMENT_COUNT(hough_circles, INSTRUMENT_PIXELS, (uint64_t)image_input->uint_xres * image_input->uint_yres);
+
+    memset(&candidates, 0, sizeof(circle_list));
+    if(allocate_histogram(&histogram_radii, uint_rmax - uint_rmin + 1, uint_rmin, uint_rmax) != 0) return(-1);
+
+    long_points = circle_centre_votes(image_input, view_edges, &image_centres, &point_edges, uint_rmin, uint_rmax, uint_threads, arena_scratch);
+    if(long_points < 0 || arena_allocate_u16(arena_scratch, &image_sums, image_input->uint_xres, image_input->uint_yres, 0) != 0) int_return_value = -1;
+    if(int_return_value == 0) int_return_value = find_circle_centres(&image_centres, &image_sums, uint_min_votes, &candidates);
+
+    /* the strongest centres pick their radius first */
+    for(i = 0; i < candidates.size_t_count && int_return_value == 0; i ++) {
+        if(circle_near_found(circles, candidates.circles[i].uint_x, candidates.circles[i].uint_y, uint_rmin)) continue;
+        uint_radius = circle_radius(point_edges, (size_t)long_points, candidates.circles[i].uint_x, candidates.circles[i].uint_y, &histogram_radii, &uint_votes);
+        if(uint_votes < HOUGH_CIRCLE_COVERAGE * 2.0f * M_PI * uint_radius) continue;
+        int_return_value = add_circle(circles, candidates.circles[i].uint_x, candidates.circles[i].uint_y, uint_radius, uint_votes);
     }
 
-    printf("write_image_data: end\n");
+    free_circle_list(&candidates);
+    free_histogram(&histogram_radii);
+    reset_arena(arena_scratch);
 
-    return(0);
-}
+    INSTRUMENT_END(hough_circles);
 
+    return(int_return_value);
+}
 
-int write_image(char* char_name, image* image_p2) {
-    FILE* file_output;
-    int int_message_length;
-    int int_return_value1;
-    int int_return_value2;
-    char* char_error_message;
 
-    printf("write_image: %s\n", char_name);
+/* Circle detection of a view, see hough_circles(). The view is
+ * copied into a 16 bit image from arena_scratch first.
+ */
+int hough_circles_view(image_view* view_input, image_view* view_edges, circle_list* circles, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_min_votes, unsigned int uint_threads, image_arena* arena_scratch) {
+    image_u16 image_input;
 
-    file_output = fopen(char_name, "w");
-    if( file_output == NULL ) {
-        /* I am printing a string into 0 allocated bytes.
-         * snprintf conviniently reports the number of bytes
-         * it is unable to print.
-         */
-        int_message_length = snprintf(NULL, 0, "Can't open output file: %s\n", char_name);
-        char_error_message = malloc(int_message_length);
-        sprintf(char_error_message, "Can't open output file: %s\n", char_name); 
-        perror(char_error_message);       
+    if(arena_allocate_u16(arena_scratch, &image_input, view_input->uint_xres, view_input->uint_yres, 0) != 0 ||
+        view_to_u16(view_input, &image_input) != 0) {
+        reset_arena(arena_scratch);
         return(-1);
     }
-    
-    /* Only return 0 if both writing the data and closing the file are successful.
-     * However, we have to close the file in either case.
-     */
-    int_return_value1 = write_image_data(file_output, image_p2);
-    int_return_value2 = fclose(file_output);
 
-    return(MIN(int_return_value1, int_return_value2));
+    return(hough_circles(&image_input, view_edges, circles, uint_rmin, uint_rmax, uint_min_votes, uint_threads, arena_scratch));
 }
 
 
-void display_image_p2(image* image_p2) {
+/* The brute force circle transform: every edge pixel of view_edges
+ * votes for the whole circle of centres around it for every radius,
+ * into a volume of xres x yres x radii 16 bit bins. The centres and
+ * the circles are picked like in hough_circles(), the radius of a
+ * centre is the one with the most votes.
+ * Returns 0, or -1 if we run out of memory.
+ */
+int hough_circles_3d(image_view* view_edges, circle_list* circles, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_min_votes) {
     unsigned int i = 0;
     unsigned int j = 0;
+    unsigned int r = 0;
+    unsigned int k = 0;
+    unsigned int uint_count = 0;
+    unsigned int uint_xres = view_edges->uint_xres;
+    unsigned int uint_yres = view_edges->uint_yres;
+    unsigned int uint_radii = uint_rmax - uint_rmin + 1;
+    size_t size_t_plane = (size_t)uint_xres * uint_yres;
+    size_t size_t_bin = 0;
+    int int_x = 0;
+    int int_y = 0;
+    uint16_t* uint16_volume;
+    uint16_t* uint16_bin;
+    point* point_offsets;
+    image_u16 image_centres;
+    image_u16 image_sums;
+    image_u16 image_radii;
+    circle_list candidates;
+    int int_return_value = 0;
+
+    if(uint_rmin > uint_rmax || uint_rmax == 0) return(0);
+
+    INSTRUMENT_BEGIN(hough_circles_3d);
+    INSTRUMENT_COUNT(hough_circles_3d, INSTRUMENT_PIXELS, (uint64_t)uint_xres * uint_yres);
+
+    memset(&candidates, 0, sizeof(circle_list));
+    memset(&image_centres, 0, sizeof(image_u16));
+    memset(&image_sums, 0, sizeof(image_u16));
+    memset(&image_radii, 0, sizeof(image_u16));
+    uint16_volume = (uint16_t*)calloc(size_t_plane * uint_radii, sizeof(uint16_t));
+    point_offsets = (point*)malloc(8 * (uint_rmax + 1) * sizeof(point));
+    if(uint16_volume == NULL || point_offsets == NULL ||
+        allocate_image_u16(&image_centres, uint_xres, uint_yres, 0) != 0 ||
+        allocate_image_u16(&image_sums, uint_xres, uint_yres, 0) != 0 ||
+        allocate_image_u16(&image_radii, uint_xres, uint_yres, 0) != 0) {
+        perror("hough_circles_3d: Error allocating storage space.\n");
+        free_image_u16(&image_centres);
+        free_image_u16(&image_sums);
+        free(uint16_volume);
+        free(point_offsets);
+        return(-1);
+    }
 
-    printf("display_image: %d, %d, max. grey level: %d\n", image_p2->uint_xres, image_p2->uint_yres, image_p2->uint_max);
+    /* one plane of the volume per radius */
+    for(r = uint_rmin; r <= uint_rmax; r ++) {
+        uint_count = circle_offsets(r, point_offsets);
+        for(i = 0; i < uint_yres; i ++) {
+            for(j = 0; j < uint_xres; j ++) {
+                if(VIEW_PIXEL(view_edges, j, i) != 255) continue;
+                for(k = 0; k < uint_count; k ++) {
+                    int_x = (int)j + point_offsets[k].uint_x;
+                    int_y = (int)i + point_offsets[k].uint_y;
+                    if(int_x < 0 || int_y < 0 || int_x >= (int)uint_xres || int_y >= (int)uint_yres) continue;
+                    uint16_bin = &uint16_volume[(r - uint_rmin) * size_t_plane + (size_t)int_y * uint_xres + int_x];
+                    *uint16_bin += (*uint16_bin < UINT16_MAX);
+                }
+            }
+        }
+    }
 
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        for(j = 0; j < image_p2->uint_xres; j ++) {
-            printf("%u ", image_p2->int_image_data[i][j]);
+    /* the best radius of every centre */
+    for(size_t_bin = 0; size_t_bin < size_t_plane; size_t_bin ++) {
+        for(r = 0; r < uint_radii; r ++) {
+            if(uint16_volume[r * size_t_plane + size_t_bin] > image_centres.uint16_pixels[size_t_bin]) {
+                image_centres.uint16_pixels[size_t_bin] = uint16_volume[r * size_t_plane + size_t_bin];
+                image_radii.uint16_pixels[size_t_bin] = uint_rmin + r;
+            }
         }
-        printf("\n");
     }
 
+    int_return_value = find_circle_centres(&image_centres, &image_sums, uint_min_votes, &candidates);
+    for(i = 0; i < candidates.size_t_count && int_return_value == 0; i ++) {
+        int_x = candidates.circles[i].uint_x;
+        int_y = candidates.circles[i].uint_y;
+        r = U16_PIXEL(&image_radii, int_x, int_y);
+        if(circle_near_found(circles, int_x, int_y, uint_rmin)) continue;
+        if(U16_PIXEL(&image_centres, int_x, int_y) < HOUGH_CIRCLE_COVERAGE * 2.0f * M_PI * r) continue;
+        int_return_value = add_circle(circles, int_x, int_y, r, U16_PIXEL(&image_centres, int_x, int_y));
+    }
+
+    free_circle_list(&candidates);
+    free_image_u16(&image_radii);
+    free_image_u16(&image_sums);
+    free_image_u16(&image_centres);
+    free(point_offsets);
+    free(uint16_volume);
+
+    INSTRUMENT_END(hough_circles_3d);
+
+    return(int_return_value);
+}
+
+
+/*-----------------------
+ * BATCH DRIVER
+ *---------------------*/
+
+/* Default parameters of the pipeline, all of them can be changed
+ * on the command line, see print_usage().
+ */
+#define HOUGH_THETA_BINS 10000
+/* 0 gives one bin per pixel of the image diagonal */
+#define HOUGH_RHO_BINS 0
+#define INVERSE_HOUGH_THRESHOLD 0.9
+/* 0 uses the unsigned int map of hough_transform(), see -c and -C */
+#define HOUGH_COMPACT 0
+#define HOUGH_COARSE_FACTOR 8
+/* 0 keeps the lines of the full Hough transform, see -p and -g */
+#define HOUGH_MIN_SEGMENT 0
+#define HOUGH_MAX_GAP 3
+/* 0 looks for no circles, see -O and -T */
+#define CIRCLE_RMIN 0
+#define CIRCLE_RMAX 0
+#define CIRCLE_THREADS 1
+#define BATCH_WORKERS 1
+
+/* the images we write for every input, selected with -w */
+#define DUMP_GRADIENTS 1
+#define DUMP_EDGES 2
+#define DUMP_HOUGH 4
+#define DUMP_LINES 8
+#define DUMP_BITMAP 16
+#define DUMP_DEFAULT (DUMP_EDGES | DUMP_HOUGH | DUMP_LINES)
+
+/* all parameters of the edge detection and Hough pipeline */
+typedef struct {
+    unsigned int uint_tmin;
+    unsigned int uint_tmax;
+    int int_streaming;
+    unsigned int uint_hysteresis_threads;
+    unsigned int uint_theta_bins;
+    unsigned int uint_rho_bins;
+    float float_line_threshold;
+    int int_hough_compact;
+    unsigned int uint_hough_factor;
+    unsigned int uint_min_segment;
+    unsigned int uint_max_gap;
+    unsigned int uint_circle_rmin;
+    unsigned int uint_circle_rmax;
+    unsigned int uint_circle_threads;
+    int int_dump;
+    unsigned int uint_workers;
+    const char* char_output_dir;
+} pipeline_config;
+
+/* The work queue shared by all workers. Every worker takes the next
+ * input under the mutex and processes it on its own, so we never
+ * have more than uint_workers images in memory.
+ */
+typedef struct {
+    pipeline_config* config;
+    char** char_inputs;
+    size_t size_t_num_inputs;
+    size_t size_t_next;
+    size_t size_t_failed;
+    pthread_mutex_t mutex;
+} batch_queue;
+
+
+void print_usage(char* char_program) {
+    fprintf(stderr, "Usage: %s [options] image.pgm ...\n"
+        "  Inputs may be file names or quoted glob patterns like 'frames/*.pgm'.\n"
+        "  Inputs are PGM files (P2 or P5, up to 16 bit) or grey PFM files.\n"
+        "  -f <list>     read further input names from a file, one per line (- is stdin)\n"
+        "  -l <tmin>     low hysteresis threshold (default %d)\n"
+        "  -u <tmax>     high hysteresis threshold (default %d)\n"
+        "  -a            pick the thresholds from the gradient magnitudes\n"
+        "  -s            use the streaming Canny detector\n"
+        "  -t <threads>  hysteresis threads of the streaming detector (default %d)\n"
+        "  -r <bins>     Hough theta bins (default %d)\n"
+        "  -R <bins>     Hough rho bins, 0 is the image diagonal (default %d)\n"
+        "  -k <ratio>    line threshold relative to the Hough maximum (default %.2f)\n"
+        "  -c            Hough transform into 16 bit bins, one row per theta bin,\n"
+        "                the Hough map is written as a P5 file with theta along y\n"
+        "  -C <factor>   like -c, but vote at full resolution only around the peaks of\n"
+        "                an accumulator with factor times fewer bins (e.g. %d)\n"
+        "  -p <length>   draw line segments of at least length pixels found by the\n"
+        "                progressive probabilistic Hough transform, no Hough map\n"
+        "  -g <pixels>   largest gap within a segment of -p (default %d)\n"
+        "  -O <min,max>  find circles with a radius of min to max pixels, they are\n"
+        "                written into <name>_circles.pgm\n"
+        "  -T <threads>  threads voting for the circle centres (default %d)\n"
+        "  -w <images>   images to write: any of g(radients, as PFM), e(dges), h(ough), l(ines),\n"
+        "                b(itmap of the edges), or - for none (default ehl)\n"
+        "  -o <dir>      output directory (default .)\n"
+        "  -j <workers>  number of images processed concurrently (default %d)\n"
+        "  -i <report>   write the timing and counters to a .json or .csv file,\n"
+        "                - is stdout (needs a build with -DINSTRUMENT)\n",
+        char_program, EDGE_STOP, EDGE_START, HYSTERESIS_THREADS, HOUGH_THETA_BINS,
+        HOUGH_RHO_BINS, INVERSE_HOUGH_THRESHOLD, HOUGH_COARSE_FACTOR, HOUGH_MAX_GAP, CIRCLE_THREADS, BATCH_WORKERS);
+
     return;
 }
 
 
-void clone_image_p2(image* image_parent, image* image_child) {
-    int i;
-    
-    /* allocate the child image */
-    allocate_image_p2(image_child, image_parent->uint_xres, image_parent->uint_yres, image_parent->uint_max);
+/* parse the letters of -w */
+int parse_dump_flags(char* char_flags) {
+    int int_dump = 0;
+
+    for(; *char_flags != '\0'; char_flags ++) {
+        switch(*char_flags) {
+            case 'g': int_dump |= DUMP_GRADIENTS; break;
+            case 'e': int_dump |= DUMP_EDGES; break;
+            case 'h': int_dump |= DUMP_HOUGH; break;
+            case 'l': int_dump |= DUMP_LINES; break;
+            case 'b': int_dump |= DUMP_BITMAP; break;
+            case '-': break;
+            default: return(-1);
+        }
+    }
+
+    return(int_dump);
+}
+
+
+/* Add all names of a list file to the inputs. The names are
+ * expanded like patterns on the command line.
+ */
+int read_input_list(char* char_list, glob_t* glob_inputs) {
+    FILE* file_list;
+    char char_line[FILENAME_MAX];
+    size_t size_t_length = 0;
+
+    file_list = (strcmp(char_list, "-") == 0) ? stdin : fopen(char_list, "r");
+    if(file_list == NULL) {
+        perror("read_input_list: Unable to open the input list.\n");
+        return(-1);
+    }
 
-    /* deep copy the image data */
-    for(i = 0; i < image_child->uint_yres; i ++) {
-        memcpy(image_child->int_image_data[i], image_parent->int_image_data[i], image_child->uint_xres * sizeof(int));
+    while(fgets(char_line, FILENAME_MAX, file_list) != NULL) {
+        size_t_length = strcspn(char_line, "\r\n");
+        char_line[size_t_length] = '\0';
+        if(size_t_length == 0) continue;
+        glob(char_line, GLOB_NOCHECK | (glob_inputs->gl_pathc > 0 ? GLOB_APPEND : 0), NULL, glob_inputs);
     }
 
+    if(file_list != stdin) fclose(file_list);
+
+    return(0);
+}
+
+
+/* The output names are built from the input name without its
+ * directory and extension, e.g. frames/a.pgm gives <dir>/a_edges.pgm.
+ */
+void output_name(char* char_output, pipeline_config* config, char* char_input, char* char_suffix) {
+    char* char_base = strrchr(char_input, '/');
+    char* char_extension;
+    int int_length = 0;
+
+    char_base = (char_base == NULL) ? char_input : char_base + 1;
+    char_extension = strrchr(char_base, '.');
+    int_length = (char_extension == NULL) ? (int)strlen(char_base) : (int)(char_extension - char_base);
+
+    snprintf(char_output, FILENAME_MAX, "%s/%.*s%s", config->char_output_dir, int_length, char_base, char_suffix);
+
     return;
 }
 
-/*----------------------------------------*/
 
-// temporary defines
-// should implement these as parameters
-#define HOUGH_THETA_BINS 10000
-#define HOUGH_RHO_BINS 400
-#define INVERSE_HOUGH_THRESHOLD 0.9
+/* Read a P5 or PFM file into a 16 bit image, the pixels of a PFM
+ * file are mapped onto 0 ... 65535 over their range. Returns 1 if
+ * the file is neither, so the caller reads it as a P2 file.
+ */
+int read_image_u16(char* char_input, image_u16* image_input) {
+    image_f32 image_float;
+    float float_min = 0.0f;
+    float float_max = 0.0f;
+    int int_status = 0;
+
+    if(is_image_p5(char_input)) return(read_image_p5(char_input, image_input));
+    if(!is_image_pfm(char_input)) return(1);
+
+    if(read_image_pfm(char_input, &image_float) != 0) return(-1);
+    f32_range(&image_float, &float_min, &float_max);
+    int_status = allocate_image_u16(image_input, image_float.uint_xres, image_float.uint_yres, UINT16_MAX);
+    if(int_status == 0) int_status = f32_to_u16(&image_float, image_input, float_min, float_max);
+    free_image_f32(&image_float);
+
+    return(int_status);
+}
+
+
+/* the Hough images of one input from the compact accumulator */
+int hough_compact(pipeline_config* config, char* char_input, image* image_input) {
+    image image_foundlines;
+    image_u16 image_houghmap;
+    image_view view_edgemap;
+    char char_output[FILENAME_MAX];
+    unsigned int uint_rho_bins = (config->uint_rho_bins > 0) ? config->uint_rho_bins : (unsigned int)hypot(image_input->uint_xres, image_input->uint_yres);
+
+    view_image_p2(image_input, &view_edgemap);
+    if(hough_transform_u16(&view_edgemap, &image_houghmap, config->uint_theta_bins, uint_rho_bins, config->uint_hough_factor, config->float_line_threshold) != 0) {
+        return(-1);
+    }
+    printf("%s: Hough map resolution x: %d, y: %d, max. grey level: %d\n", char_input, image_houghmap.uint_yres, image_houghmap.uint_xres, image_houghmap.uint_max);
+
+    if(config->int_dump & DUMP_HOUGH) {
+        output_name(char_output, config, char_input, "_hough.pgm");
+        write_image_p5(char_output, &image_houghmap);
+    }
+
+    /* inverse transform */
+    if(config->int_dump & DUMP_LINES) {
+        clone_image_p2(image_input, &image_foundlines);
+        reverse_transform_u16(&image_foundlines, &image_houghmap, config->float_line_threshold);
+        output_name(char_output, config, char_input, "_lines.pgm");
+        write_image_p2(char_output, &image_foundlines);
+        free_image_p2(&image_foundlines);
+    }
+
+    free_image_u16(&image_houghmap);
+
+    return(0);
+}
+
+
+/* the line segments of one input from the progressive Hough transform */
+int hough_segments(pipeline_config* config, char* char_input, image* image_input) {
+    image image_foundlines;
+    image_view view_edgemap;
+    segment_list segments;
+    char char_output[FILENAME_MAX];
+    long long_voted = 0;
+    size_t i = 0;
+    unsigned int uint_rho_bins = (config->uint_rho_bins > 0) ? config->uint_rho_bins : (unsigned int)hypot(image_input->uint_xres, image_input->uint_yres);
+
+    memset(&segments, 0, sizeof(segment_list));
+    view_image_p2(image_input, &view_edgemap);
+    long_voted = hough_progressive(&view_edgemap, &segments, config->uint_theta_bins, uint_rho_bins, config->uint_min_segment, config->uint_max_gap);
+    if(long_voted < 0) {
+        free_segment_list(&segments);
+        return(-1);
+    }
+    printf("%s: %zu line segments, %ld points voted\n", char_input, segments.size_t_count, long_voted);
+
+    clone_image_p2(image_input, &image_foundlines);
+    for(i = 0; i < segments.size_t_count; i ++) {
+        printf("found segment from (%d, %d) to (%d, %d), votes: %u\n", segments.segments[i].point_start.uint_x, segments.segments[i].point_start.uint_y,
+            segments.segments[i].point_end.uint_x, segments.segments[i].point_end.uint_y, segments.segments[i].uint_votes);
+        set_line_pixels(&image_foundlines, segments.segments[i].point_start, segments.segments[i].point_end);
+    }
+    output_name(char_output, config, char_input, "_lines.pgm");
+    write_image_p2(char_output, &image_foundlines);
+    free_image_p2(&image_foundlines);
+    free_segment_list(&segments);
+
+    return(0);
+}
 
-/* we expect the input file name in argv[1] 
- * the output file names are generated from 
- * the input file name. 
+
+/* Find the circles of the image and draw them into a copy of it, like
+ * the segments of hough_segments(). The grey levels are in image_narrow,
+ * or in view_input if image_narrow is NULL.
  */
-int main(int argc, char *argv[]) {
-    int i = 0;
-    FILE *file_input;
-    char *char_binary_imageline;
-    char *char_ascii_imageline;
-    unsigned int uint_imageline_in_bytes = 0;
+int circle_detection(pipeline_config* config, char* char_input, image_u16* image_narrow, image_view* view_input, image* image_edges, image_arena* arena_scratch) {
+    image image_foundcircles;
+    image_view view_edges;
+    image_view view_foundcircles;
+    circle_list circles;
+    char char_output[FILENAME_MAX];
+    size_t i = 0;
+    unsigned int y = 0;
+    int int_status = 0;
+
+    memset(&circles, 0, sizeof(circle_list));
+    view_image_p2(image_edges, &view_edges);
+    if(image_narrow != NULL) {
+        int_status = hough_circles(image_narrow, &view_edges, &circles, config->uint_circle_rmin, config->uint_circle_rmax, HOUGH_CIRCLE_MIN_VOTES, config->uint_circle_threads, arena_scratch);
+    } else {
+        int_status = hough_circles_view(view_input, &view_edges, &circles, config->uint_circle_rmin, config->uint_circle_rmax, HOUGH_CIRCLE_MIN_VOTES, config->uint_circle_threads, arena_scratch);
+    }
+    if(int_status != 0) {
+        free_circle_list(&circles);
+        return(-1);
+    }
+    printf("%s: %zu circles\n", char_input, circles.size_t_count);
+
+    if(allocate_image_p2(&image_foundcircles, image_edges->uint_xres, image_edges->uint_yres, 0) != 0) {
+        free_circle_list(&circles);
+        return(-1);
+    }
+    view_image_p2(&image_foundcircles, &view_foundcircles);
+    if(image_narrow != NULL) {
+        u16_to_view(image_narrow, &view_foundcircles);
+        image_foundcircles.uint_max = image_narrow->uint_max;
+    } else {
+        for(y = 0; y < view_input->uint_yres; y ++) {
+            memcpy(VIEW_ROW(&view_foundcircles, y), VIEW_ROW(view_input, y), view_input->uint_xres * sizeof(unsigned int));
+        }
+        image_foundcircles.uint_max = view_input->uint_max;
+    }
+    for(i = 0; i < circles.size_t_count; i ++) {
+        printf("found circle at (%u, %u), radius: %u, votes: %u\n", circles.circles[i].uint_x, circles.circles[i].uint_y,
+            circles.circles[i].uint_radius, circles.circles[i].uint_votes);
+        set_circle_pixels(&image_foundcircles, &circles.circles[i]);
+    }
+    output_name(char_output, config, char_input, "_circles.pgm");
+    write_image_p2(char_output, &image_foundcircles);
+    free_image_p2(&image_foundcircles);
+    free_circle_list(&circles);
+
+    return(0);
+}
+
 
+/* run the whole pipeline on one image */
+int process_image(pipeline_config* config, char* char_input, image_arena* arena_scratch) {
     image image_input;
     image image_edges;
     image image_houghmap;
     image image_foundlines;
-
-    /* We expect the file name in argv[1],
-     * otherwise print a meaningful message
-     * and exit with an error number set.
-     */
-    if( argc != 2 ) {
-        perror("Usage: binary2ascii infilename\n");
-        exit(1);
+    image_u16 image_narrow;
+    image_view view_input;
+    image_view view_edges;
+    bitmap bitmap_edges;
+    char char_output[FILENAME_MAX];
+    unsigned int uint_rho_bins = 0;
+    int int_narrow = 0;
+    int int_wide = 0;
+
+    INSTRUMENT_BEGIN(process_image);
+
+    /* P5 and PFM files are read into 16 bits, P2 files into unsigned int */
+    int_narrow = read_image_u16(char_input, &image_narrow);
+    if(int_narrow == 1) {
+        int_narrow = 0;
+        int_wide = (read_image_p2(char_input, &image_input) == 0);
+        if(!int_wide) int_narrow = -1;
+    } else if(int_narrow == 0) {
+        int_narrow = 1;
+    }
+    if(int_narrow < 0) {
+        fprintf(stderr, "Unable to read %s\n", char_input);
+        return(-1);
     }
 
-    /* Get the length of the input filename.
-     * We need it later on to create the 
-     * output file name.
-     */
-    size_t size_t_name_length = strlen(argv[1]);
+    /* the streaming detector and the Hough transform need unsigned int pixels */
+    if(int_narrow && (config->int_streaming || (config->int_dump & (DUMP_HOUGH | DUMP_LINES)))) {
+        int_wide = (allocate_image_p2(&image_input, image_narrow.uint_xres, image_narrow.uint_yres, 0) == 0);
+        if(!int_wide) {
+            free_image_u16(&image_narrow);
+            return(-1);
+        }
+        view_image_p2(&image_input, &view_input);
+        u16_to_view(&image_narrow, &view_input);
+        image_input.uint_max = image_narrow.uint_max;
+    }
 
-    /* Read the image into a image data structure.
-     * All the file handling and memory allocation
-     * is done by read_image().
-     */
-    read_image(argv[1], &image_input);
+    /* Canny edge detection and edge tracing with hysteresis */
+    if(int_wide) view_image_p2(&image_input, &view_input);
+    output_name(char_output, config, char_input, "");
+    if(config->int_streaming) {
+        if(canny_streaming(&view_input, &image_edges, config->uint_tmin, config->uint_tmax, config->uint_hysteresis_threads, arena_scratch) != 0) {
+            if(int_narrow) free_image_u16(&image_narrow);
+            if(int_wide) free_image_p2(&image_input);
+            return(-1);
+        }
+    } else if(int_narrow) {
+        canny_u16(&image_narrow, &image_edges, config->uint_tmin, config->uint_tmax, (config->int_dump & DUMP_GRADIENTS) ? char_output : NULL, arena_scratch);
+    } else {
+        canny(&view_input, &image_edges, config->uint_tmin, config->uint_tmax, (config->int_dump & DUMP_GRADIENTS) ? char_output : NULL, arena_scratch);
+    }
+    if(config->uint_circle_rmax > 0) {
+        circle_detection(config, char_input, int_narrow ? &image_narrow : NULL, &view_input, &image_edges, arena_scratch);
+    }
+    if(int_narrow) free_image_u16(&image_narrow);
+    if(config->int_dump & DUMP_EDGES) {
+        output_name(char_output, config, char_input, "_edges.pgm");
+        write_image_p2(char_output, &image_edges);
+    }
+    if(config->int_dump & DUMP_BITMAP) {
+        view_image_p2(&image_edges, &view_edges);
+        if(bitmap_from_view(&view_edges, &bitmap_edges, 255, 255) == 0) {
+            output_name(char_output, config, char_input, "_edges.pbm");
+            write_bitmap_p4(char_output, &bitmap_edges);
+            free_bitmap(&bitmap_edges);
+        }
+    }
 
-    /* Canny edge detection and edge tracing with hysteresis*/
-    canny(&image_input, &image_edges, EDGE_STOP, EDGE_START);
-    write_image("edgemap.pgm", &image_edges);
+    /* the Hough transform is only needed for its own images */
+    if(config->uint_min_segment > 0 && (config->int_dump & DUMP_LINES)) {
+        hough_segments(config, char_input, &image_input);
+    } else if(config->int_hough_compact && (config->int_dump & (DUMP_HOUGH | DUMP_LINES))) {
+        hough_compact(config, char_input, &image_input);
+    } else if(config->int_dump & (DUMP_HOUGH | DUMP_LINES)) {
+        uint_rho_bins = (config->uint_rho_bins > 0) ? config->uint_rho_bins : (unsigned int)hypot(image_input.uint_xres, image_input.uint_yres);
+        hough_transform(&image_input, &image_houghmap, config->uint_theta_bins, uint_rho_bins);
+        printf("%s: Hough map resolution x: %d, y: %d, max. grey level: %d\n", char_input, image_houghmap.uint_xres, image_houghmap.uint_yres, image_houghmap.uint_max);
+
+        if(config->int_dump & DUMP_HOUGH) {
+            output_name(char_output, config, char_input, "_hough.pgm");
+            write_image_p2(char_output, &image_houghmap);
+        }
 
-    hough_transform(&image_input, &image_houghmap, HOUGH_THETA_BINS, hypot(image_input.uint_xres, image_input.uint_yres));
-    printf("Hough map resolution x: %d, y: %d, max. grey level: %d\n", image_houghmap.uint_xres, image_houghmap.uint_yres, image_houghmap.uint_max);
+        /* inverse transform */
+        if(config->int_dump & DUMP_LINES) {
+            clone_image_p2(&image_input, &image_foundlines);
+            reverse_transform(&image_foundlines, &image_houghmap, config->float_line_threshold);
+            output_name(char_output, config, char_input, "_lines.pgm");
+            write_image_p2(char_output, &image_foundlines);
+            free_image_p2(&image_foundlines);
+        }
 
-    /* write the Hough map to file */
-    write_image("hough.pgm", &image_houghmap);
+        free_image_p2(&image_houghmap);
+    }
 
-    /* inverse transform */
-    clone_image_p2(&image_input, &image_foundlines);
-    reverse_transform(&image_foundlines, &image_houghmap, INVERSE_HOUGH_THRESHOLD);
-    write_image("foundlines.pgm", &image_foundlines);
+    if(int_wide) free_image_p2(&image_input);
+    free_image_p2(&image_edges);
 
-    /* close file */
-    free_image_P2(&image_input);
-    free_image_P2(&image_edges);
-    free_image_P2(&image_houghmap);
-    free_image_P2(&image_foundlines);
+    INSTRUMENT_END(process_image);
 
     return(0);
 }
 
+
+/* A worker takes images from the queue until it is empty. While one
+ * worker waits for its file to be read or written, the others keep
+ * computing, so the file I/O overlaps with the computation. Every worker
+ * keeps its own arena, which grows to the largest image it has seen.
+ */
+void* batch_worker(void* void_queue) {
+    batch_queue* queue = (batch_queue*)void_queue;
+    image_arena arena_scratch;
+    size_t size_t_input = 0;
+
+    allocate_arena(&arena_scratch, 0);
+
+    for(;;) {
+        pthread_mutex_lock(&queue->mutex);
+        size_t_input = queue->size_t_next ++;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if(size_t_input >= queue->size_t_num_inputs) break;
+
+        if(process_image(queue->config, queue->char_inputs[size_t_input], &arena_scratch) != 0) {
+            pthread_mutex_lock(&queue->mutex);
+            queue->size_t_failed ++;
+            pthread_mutex_unlock(&queue->mutex);
+        }
+    }
+
+    free_arena(&arena_scratch);
+
+    return(NULL);
+}
+
+
+/* Process all inputs on uint_workers threads.
+ * Returns the number of inputs that failed.
+ */
+size_t run_batch(pipeline_config* config, char** char_inputs, size_t size_t_num_inputs) {
+    unsigned int i = 0;
+    unsigned int uint_started = 0;
+    unsigned int uint_workers = MIN(MAX(config->uint_workers, 1), size_t_num_inputs);
+    pthread_t* threads;
+    batch_queue queue;
+
+    queue.config = config;
+    queue.char_inputs = char_inputs;
+    queue.size_t_num_inputs = size_t_num_inputs;
+    queue.size_t_next = 0;
+    queue.size_t_failed = 0;
+    pthread_mutex_init(&queue.mutex, NULL);
+
+    /* a single worker runs on the calling thread */
+    threads = (uint_workers > 1) ? (pthread_t*)malloc(uint_workers * sizeof(pthread_t)) : NULL;
+    if(threads != NULL) {
+        for(i = 0; i < uint_workers; i ++) {
+            if(pthread_create(&threads[i], NULL, batch_worker, &queue) != 0) break;
+        }
+        uint_started = i;
+    }
+
+    /* if we could not start any thread, we do all the work ourselves */
+    if(uint_started == 0) batch_worker(&queue);
+
+    for(i = 0; i < uint_started; i ++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&queue.mutex);
+
+    return(queue.size_t_failed);
+}
+
+
+/* The input images are given on the command line, as glob patterns
+ * or in list files. The output file names are generated from the
+ * input file names.
+ */
+int main(int argc, char *argv[]) {
+    int i = 0;
+    int int_option = 0;
+    size_t size_t_failed = 0;
+    glob_t glob_inputs;
+    pipeline_config config;
+    char* char_report = NULL;
+
+    /* the defaults, the compile time switches of earlier
+     * versions still select the detector
+     */
+    config.uint_tmin = EDGE_STOP;
+    config.uint_tmax = EDGE_START;
+    config.int_streaming = 0;
+    config.uint_hysteresis_threads = HYSTERESIS_THREADS;
+    config.uint_theta_bins = HOUGH_THETA_BINS;
+    config.uint_rho_bins = HOUGH_RHO_BINS;
+    config.float_line_threshold = INVERSE_HOUGH_THRESHOLD;
+    config.int_hough_compact = HOUGH_COMPACT;
+    config.uint_hough_factor = 1;
+    config.uint_min_segment = HOUGH_MIN_SEGMENT;
+    config.uint_max_gap = HOUGH_MAX_GAP;
+    config.uint_circle_rmin = CIRCLE_RMIN;
+    config.uint_circle_rmax = CIRCLE_RMAX;
+    config.uint_circle_threads = CIRCLE_THREADS;
+    config.int_dump = DUMP_DEFAULT;
+    config.uint_workers = BATCH_WORKERS;
+    config.char_output_dir = ".";
+#ifdef AUTO_THRESHOLDS
+    config.uint_tmin = CANNY_AUTO_THRESHOLD;
+    config.uint_tmax = CANNY_AUTO_THRESHOLD;
+#endif
+#ifdef STREAMING_CANNY
+    config.int_streaming = 1;
+#endif
+
+    glob_inputs.gl_pathc = 0;
+    glob_inputs.gl_pathv = NULL;
+
+    while((int_option = getopt(argc, argv, "f:l:u:ast:r:R:k:cC:p:g:O:T:w:o:j:i:h")) != -1) {
+        switch(int_option) {
+            case 'f':
+                if(read_input_list(optarg, &glob_inputs) != 0) exit(1);
+                break;
+            case 'l': config.uint_tmin = strtoul(optarg, NULL, 10); break;
+            case 'u': config.uint_tmax = strtoul(optarg, NULL, 10); break;
+            case 'a':
+                config.uint_tmin = CANNY_AUTO_THRESHOLD;
+                config.uint_tmax = CANNY_AUTO_THRESHOLD;
+                break;
+            case 's': config.int_streaming = 1; break;
+            case 't': config.uint_hysteresis_threads = strtoul(optarg, NULL, 10); break;
+            case 'r': config.uint_theta_bins = strtoul(optarg, NULL, 10); break;
+            case 'R': config.uint_rho_bins = strtoul(optarg, NULL, 10); break;
+            case 'k': config.float_line_threshold = strtof(optarg, NULL); break;
+            case 'c': config.int_hough_compact = 1; break;
+            case 'C':
+                config.int_hough_compact = 1;
+                config.uint_hough_factor = strtoul(optarg, NULL, 10);
+                break;
+            case 'p': config.uint_min_segment = strtoul(optarg, NULL, 10); break;
+            case 'g': config.uint_max_gap = strtoul(optarg, NULL, 10); break;
+            case 'O':
+                if(sscanf(optarg, "%u,%u", &config.uint_circle_rmin, &config.uint_circle_rmax) != 2 ||
+                    config.uint_circle_rmin == 0 || config.uint_circle_rmin > config.uint_circle_rmax) {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'T': config.uint_circle_threads = strtoul(optarg, NULL, 10); break;
+            case 'w':
+                config.int_dump = parse_dump_flags(optarg);
+                if(config.int_dump < 0) {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'o': config.char_output_dir = optarg; break;
+            case 'j': config.uint_workers = strtoul(optarg, NULL, 10); break;
+            case 'i': char_report = optarg; break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    /* the remaining arguments are file names or patterns */
+    for(i = optind; i < argc; i ++) {
+        glob(argv[i], GLOB_NOCHECK | (glob_inputs.gl_pathc > 0 ? GLOB_APPEND : 0), NULL, &glob_inputs);
+    }
+
+    if(glob_inputs.gl_pathc == 0) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    if(config.uint_theta_bins == 0) {
+        fprintf(stderr, "The Hough transform needs at least one theta bin.\n");
+        exit(1);
+    }
+
+    size_t_failed = run_batch(&config, glob_inputs.gl_pathv, glob_inputs.gl_pathc);
+    if(size_t_failed > 0) {
+        fprintf(stderr, "%zu of %zu images failed.\n", size_t_failed, (size_t)glob_inputs.gl_pathc);
+    }
+
+    globfree(&glob_inputs);
+
+    if(char_report != NULL) {
+#ifdef INSTRUMENT
+        instrument_write_report(char_report);
+#else
+        fprintf(stderr, "No report written, rebuild with -DINSTRUMENT.\n");
+#endif
+    }
+
+    return(size_t_failed > 0 ? 1 : 0);
+}
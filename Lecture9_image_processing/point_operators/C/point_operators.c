@@ -4,12 +4,17 @@
  * easy start and demonstrate how to use the function in image_p2.h.
  *
  * To compile it use:
- * gcc contrast_stretching.c pgm_routines.c -o point_operators -I . -lm
- */
-
-
-/* TODO:
- * re-write code to allocate histogram
+ * make point_operators
+ *
+ * in the top directory of the repository, or by hand:
+ * C=../../../common
+ * gcc point_operators.c $C/image_p2.c $C/image_p6.c $C/histogram.c $C/instrument.c $C/cpu_dispatch.c -o point_operators -I $C -lm -lpthread
+ *
+ * A colour (P6) image is stretched channel by channel and equalised
+ * on its luminance, see colour_point_operators().
+ *
+ * Build with make BUILD=profile or add -DINSTRUMENT to get the time
+ * spent reading and writing the images in point_operators_report.json.
  */
 
  
@@ -20,87 +25,263 @@
 #include <math.h>
 
 
-/* include our PGM routines */
+/* include our PGM and histogram routines */
 #include "image_p2.h"
+#include "image_p6.h"
+#include "histogram.h"
+#include "instrument.h"
+#include "cpu_dispatch.h"
 
 
-/* Define a simple histogram data type.
- * We simply assume there are the same number
- * of bins as there are grey levels.
+/*
+ * Linear contrast stretch.
+ * Map the grey levels uint_low ... uint_high onto the full range
+ * 0 ... uint_max of the image and clip everything outside. The
+ * image is modified in place, so pass a view on a region of
+ * interest to stretch only that region.
+ * The loop is vectorised for the CPU we run on, see cpu_dispatch.h.
  */
-typedef struct {
-    unsigned int uint_num_bins;
-    unsigned int* uint_bins;
-} histogram;
+CPU_DISPATCH int contrast_stretch(image_view* view_in, unsigned int uint_low,
+    unsigned int uint_high) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    float float_scale = 0.0f;
 
+    if(uint_high <= uint_low) {
+        perror("contrast_stretch: Invalid range of grey levels given.\n");
+        return(-1);
+    }
 
-/* 
- * Compute the histogram.
- * For simplicity whe assume that there are as many bins as grey levels.
- */
-void compute_histogram(image* image_in, histogram* histogram_data) {
-    int i = 0;
-    int j = 0;
+    float_scale = (float)view_in->uint_max / (uint_high - uint_low);
 
-    histogram_data->uint_num_bins = image_in->uint_max;
-   
-    for(i = 0; i < image_in->uint_yres; i ++) {
-        for(j = 0; j < image_in->uint_xres; j ++) {
-                histogram_data->uint_bins[image_in->int_image_data[i][j]] ++;
+    for(i = 0; i < view_in->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_in, i);
+        for(j = 0; j < view_in->uint_xres; j ++) {
+            if(uint_row[j] <= uint_low) {
+                uint_row[j] = 0;
+            } else if(uint_row[j] >= uint_high) {
+                uint_row[j] = view_in->uint_max;
+            } else {
+                uint_row[j] = (unsigned int)((uint_row[j] - uint_low) *
+                    float_scale + 0.5f);
+            }
         }
     }
 
-    return;
+    return(0);
 }
 
 
 /*
- * 
+ * Histogram equalisation.
+ * The new grey level of a pixel is given by the cumulative
+ * histogram, i.e. the share of pixels that are at most as
+ * bright. We work this out once per bin and then only look
+ * it up for every pixel. The histogram must have been computed
+ * from the same view. The image is modified in place.
  */
-void histogram_to_image(histogram* histogram_in, char* char_name, 
-    unsigned int uint_yres) {
-    int i = 0;
-    int j = 0;
-    unsigned int uint_max = 0;
-    unsigned int uint_height = 0;
-    float float_increment = 0.0f;
-    image image_out;
+int equalise_histogram(image_view* view_in, histogram* histogram_in) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    unsigned int* uint_lookup;
+    uint64_t uint64_min = 0;
+    uint64_t uint64_range = 0;
 
-    /*
-     * Allocate a temporary image data structure.
-     * We will destroy it before we leave this function.
-     */
-    allocate_image_p2(&image_out, histogram_in->uint_num_bins, 
-        uint_yres, 255); 
+    uint_lookup = (unsigned int*)malloc(histogram_in->uint_num_bins *
+        sizeof(unsigned int));
+    if(uint_lookup == NULL) {
+        perror("equalise_histogram: Error allocating storage space.\n");
+        return(-1);
+    }
 
-    /* Find the max histogram value. We need this to fit the histogram
-     * into the image height uint_yres.
-     */
-    uint_max = histogram_in->uint_bins[0];
-    for(i = 1; i < histogram_in->uint_num_bins; i ++) {
-        if(histogram_in->uint_bins[i] > uint_max) {
-            uint_max = histogram_in->uint_bins[i];
+    /* the cumulative count of the darkest grey level in the image */
+    for(i = 0; i < histogram_in->uint_num_bins; i ++) {
+        if(histogram_in->uint64_bins[i] > 0) {
+            uint64_min = histogram_in->uint64_cumulative[i];
+            break;
         }
     }
 
-    float_increment = (float)(uint_max) / uint_yres;
+    uint64_range = MAX(histogram_in->uint64_total - uint64_min, 1);
 
     for(i = 0; i < histogram_in->uint_num_bins; i ++) {
-        uint_height = (unsigned int)(histogram_in->uint_bins[i] /
-            float_increment + 0.5f);
-        for(j = uint_yres - 1; j > uint_yres - uint_height; j --) {
-            image_out.int_image_data[j][i] = 0;
+        if(histogram_in->uint64_cumulative[i] <= uint64_min) {
+            uint_lookup[i] = 0;
+        } else {
+            uint_lookup[i] = (unsigned int)(((histogram_in->uint64_cumulative[i]
+                - uint64_min) * view_in->uint_max + uint64_range / 2) /
+                uint64_range);
         }
     }
-    
-    write_image_p2(char_name, &image_out);
 
-    /*
-     * Free the temporary image. 
-     */
-    free_image_p2(&image_out);
+    for(i = 0; i < view_in->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_in, i);
+        for(j = 0; j < view_in->uint_xres; j ++) {
+            uint_row[j] = uint_lookup[histogram_bin(histogram_in,
+                uint_row[j])];
+        }
+    }
+
+    free(uint_lookup);
 
-    return;
+    return(0);
+}
+
+
+/*
+ * The percentiles between which stretch_channel() stretches
+ * every channel, and one histogram per channel.
+ */
+typedef struct {
+    histogram* histograms;
+    double double_low;
+    double double_high;
+} stretch_arguments;
+
+
+/* stretch one channel between the percentiles of its own histogram */
+int stretch_channel(image_view* view_in, image_view* view_out, int int_channel,
+    void* void_argument) {
+    stretch_arguments* arguments = (stretch_arguments*)void_argument;
+    histogram* histogram_channel = &arguments->histograms[int_channel];
+    unsigned int uint_low = histogram_percentile(histogram_channel, arguments->double_low);
+    unsigned int uint_high = histogram_percentile(histogram_channel, arguments->double_high);
+    (void)view_out;
+
+    /* a channel of a single level has nothing to stretch */
+    if(uint_high <= uint_low) return(0);
+
+    return(contrast_stretch(view_in, uint_low, uint_high));
+}
+
+
+/*
+ * Linear contrast stretch of a colour image.
+ * Every channel is stretched between the percentiles of its own
+ * histogram, so a stain that only shows in one channel gets the
+ * full range of that channel. The histograms are computed here,
+ * and the channels are stretched in parallel.
+ */
+int contrast_stretch_planar(image_planar* image_in, histogram histograms[RGB_CHANNELS],
+    double double_low, double double_high) {
+    stretch_arguments arguments;
+
+    if(compute_histogram_planar(image_in, histograms) != 0) return(-1);
+
+    arguments.histograms = histograms;
+    arguments.double_low = double_low;
+    arguments.double_high = double_high;
+
+    return(for_each_channel(image_in, NULL, stretch_channel, &arguments));
+}
+
+
+/*
+ * Histogram equalisation of a colour image.
+ * Equalising every channel on its own would shift the colours, so
+ * we only equalise the luminance Y and keep the colour differences
+ * Cb and Cr. The histogram needs one bin per level of the image.
+ */
+int equalise_luminance(image_planar* image_in, histogram* histogram_luminance) {
+    image_planar image_ycbcr;
+    image_view view_luminance;
+    int int_status = 0;
+
+    if(allocate_image_planar(&image_ycbcr, image_in->uint_xres, image_in->uint_yres,
+        image_in->uint_max) != 0) return(-1);
+
+    int_status = planar_to_ycbcr(image_in, &image_ycbcr);
+    if(int_status == 0) {
+        view_image_p2(&image_ycbcr.image_channels[YCBCR_Y], &view_luminance);
+        int_status = compute_histogram(&view_luminance, histogram_luminance);
+    }
+    if(int_status == 0) int_status = equalise_histogram(&view_luminance, histogram_luminance);
+    if(int_status == 0) int_status = ycbcr_to_planar(&image_ycbcr, image_in);
+
+    free_image_planar(&image_ycbcr);
+
+    return(int_status);
+}
+
+
+/*
+ * Render the histogram into the canvas and write it to file.
+ * The canvas is allocated once by the caller and reused for
+ * every histogram we render.
+ */
+int histogram_to_image(histogram* histogram_in, histogram_canvas* canvas,
+    char* char_name) {
+
+    if( render_histogram(histogram_in, canvas,
+        HISTOGRAM_RENDER_CUMULATIVE) != 0 ) {
+        return(-1);
+    }
+
+    return(write_image_p2(char_name, &(canvas->image_canvas)));
+}
+
+
+/*
+ * The colour version of main(): render the histogram of every
+ * channel, stretch every channel between its 1% and 99% percentile
+ * and equalise the luminance of the result.
+ */
+int colour_point_operators(char* char_name) {
+    static const char* char_channel_names[RGB_CHANNELS] = {"red", "green", "blue"};
+    char char_histogram_name[FILENAME_MAX];
+    int c = 0;
+    int int_status = 0;
+    image_rgb image_in;
+    image_planar image_planes;
+    histogram histograms[RGB_CHANNELS];
+    histogram_canvas canvas_histogram;
+
+    if(read_image_p6(char_name, &image_in) != 0) return(-1);
+    if(allocate_image_planar(&image_planes, image_in.uint_xres, image_in.uint_yres, image_in.uint_max) != 0) {
+        free_image_rgb(&image_in);
+        return(-1);
+    }
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        if(allocate_histogram(&histograms[c], image_in.uint_max + 1, 0, image_in.uint_max) != 0) {
+            while(-- c >= 0) free_histogram(&histograms[c]);
+            free_image_planar(&image_planes);
+            free_image_rgb(&image_in);
+            return(-1);
+        }
+    }
+    if(allocate_histogram_canvas(&canvas_histogram, image_in.uint_max + 1, 200) != 0) {
+        for(c = 0; c < RGB_CHANNELS; c ++) free_histogram(&histograms[c]);
+        free_image_planar(&image_planes);
+        free_image_rgb(&image_in);
+        return(-1);
+    }
+
+    rgb_to_planar(&image_in, &image_planes);
+    int_status |= compute_histogram_planar(&image_planes, histograms);
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        printf("%s: 1%% percentile: %u, 99%% percentile: %u\n", char_channel_names[c],
+            histogram_percentile(&histograms[c], 1.0), histogram_percentile(&histograms[c], 99.0));
+        snprintf(char_histogram_name, FILENAME_MAX, "histogram_%s.pgm", char_channel_names[c]);
+        int_status |= histogram_to_image(&histograms[c], &canvas_histogram, char_histogram_name);
+    }
+
+    int_status |= contrast_stretch_planar(&image_planes, histograms, 1.0, 99.0);
+    planar_to_rgb(&image_planes, &image_in);
+    int_status |= write_image_p6("contrast_stretch.ppm", &image_in);
+
+    /* the luminance histogram reuses the one of the red channel */
+    int_status |= equalise_luminance(&image_planes, &histograms[RGB_RED]);
+    planar_to_rgb(&image_planes, &image_in);
+    int_status |= write_image_p6("equalised.ppm", &image_in);
+
+    free_histogram_canvas(&canvas_histogram);
+    for(c = 0; c < RGB_CHANNELS; c ++) free_histogram(&histograms[c]);
+    free_image_planar(&image_planes);
+    free_image_rgb(&image_in);
+
+    return(int_status == 0 ? 0 : -1);
 }
 
 
@@ -110,7 +291,10 @@ void histogram_to_image(histogram* histogram_in, char* char_name,
 int main(int argc, char *argv[]) {
     int i = 0;
     image image_in;
+    image_view view_in;
+    image_view view_roi;
     histogram histogram_in;
+    histogram_canvas canvas_histogram;
 
     /* 
      * We expect the file name in argv[1],
@@ -121,6 +305,14 @@ int main(int argc, char *argv[]) {
         perror("Usage: histogram <infilename>\n");
         exit(1);
     }
+
+    if( is_image_p6(argv[1]) ) {
+        if( colour_point_operators(argv[1]) != 0 ) {
+            exit(1);
+        }
+        printf("Done.\n");
+        return(0);
+    }
  
     /* 
      * Get the length of the input filename.
@@ -141,25 +333,64 @@ int main(int argc, char *argv[]) {
     }
 
     /* 
-     * Allocate some buffer space for the histogram. 
-     * TODO: this should be encapsulated in a function.
+     * Allocate the histogram with one bin per grey level.
+     * The grey levels run from 0 to uint_max, so there
+     * are uint_max + 1 of them.
      */
-    histogram_in.uint_bins = (unsigned int*)malloc(image_in.uint_max *
-       sizeof(unsigned int));
-    memset(histogram_in.uint_bins, 0 , image_in.uint_max * 
-        sizeof(unsigned int));
+    if( allocate_histogram(&histogram_in, image_in.uint_max + 1, 0,
+        image_in.uint_max) != 0 ) {
+        perror("Unable to allocate histogram!\n");
+        exit(1);
+    }
 
     /* 
-     * Compute the image histogram and render it into an image.
+     * Compute the image histogram and render it into an image
+     * with one column per bin.
      */
-    compute_histogram(&image_in, &histogram_in);
-    histogram_to_image(&histogram_in, "histogram_example.pgm", 200);
+    if( allocate_histogram_canvas(&canvas_histogram,
+        histogram_in.uint_num_bins, 200) != 0 ) {
+        perror("Unable to allocate histogram canvas!\n");
+        exit(1);
+    }
+
+    view_image_p2(&image_in, &view_in);
+    compute_histogram(&view_in, &histogram_in);
+    histogram_to_image(&histogram_in, &canvas_histogram,
+        "histogram_example.pgm");
+
+    /*
+     * The prefix sums give us percentiles for free. We use them
+     * to stretch the contrast of the image between the 1% and
+     * 99% percentile.
+     */
+    printf("1%% percentile: %u, 99%% percentile: %u\n",
+        histogram_percentile(&histogram_in, 1.0),
+        histogram_percentile(&histogram_in, 99.0));
+    contrast_stretch(&view_in, histogram_percentile(&histogram_in, 1.0),
+        histogram_percentile(&histogram_in, 99.0));
+    write_image_p2("contrast_stretch.pgm", &image_in);
+
+    /*
+     * Equalise the histogram of the central quarter of the image only.
+     * The view shares its pixels with image_in, so this works in place.
+     */
+    roi_view_p2(&view_in, &view_roi, image_in.uint_xres / 4,
+        image_in.uint_yres / 4, image_in.uint_xres / 2, image_in.uint_yres / 2);
+    compute_histogram(&view_roi, &histogram_in);
+    equalise_histogram(&view_roi, &histogram_in);
+    write_image_p2("equalised.pgm", &image_in);
 
     /* 
      * clean-up
      */
+    free_histogram_canvas(&canvas_histogram);
+    free_histogram(&histogram_in);
     free_image_p2(&image_in);
 
+#ifdef INSTRUMENT
+    instrument_write_report("point_operators_report.json");
+#endif
+
     printf("Done.\n");
 
     return(0);
@@ -0,0 +1,1045 @@
+/*
+ * Benchmark suite for the hot paths of the image processing and
+ * binary I/O exercises.
+ *
+ * Every kernel runs on every input image and on synthetic upscaled
+ * versions of it. After some warm-up runs we time a number of
+ * repetitions and report the median, the 95th percentile and the
+ * throughput as CSV. Given a baseline file from an earlier run, we
+ * also report the change of the median and flag regressions.
+ *
+ * Build and run it with the Makefile in the top directory:
+ * make run          (compare against baseline.csv if it exists)
+ * make baseline     (store a new baseline.csv)
+ */
+
+
+/* system includes */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+
+/* include our PGM and histogram routines and the kernels under test */
+#include "image_p2.h"
+#include "histogram.h"
+#include "kernels.h"
+#include "cpu_dispatch.h"
+#include "image_bitmap.h"
+#include "image_p6.h"
+#include "image_p5.h"
+#include "image_arena.h"
+
+
+/* defaults, see print_bench_usage() */
+#define BENCH_WARMUP 1
+#define BENCH_REPETITIONS 5
+#define BENCH_REGRESSION_PERCENT 10.0
+#define BENCH_SCALES "1,4k,8k"
+
+/* the workload of the kernels */
+#define BENCH_LOW_PERCENTILE 70.0
+#define BENCH_HIGH_PERCENTILE 90.0
+#define BENCH_THETA_BINS 180
+#define BENCH_LINE_THRESHOLD 0.9f
+#define BENCH_HOUGH_COARSE 4
+#define BENCH_SEGMENT_LENGTH 20
+#define BENCH_SEGMENT_GAP 3
+/* small radii, the volume of the brute force transform grows with them */
+#define BENCH_CIRCLE_RMIN 4
+#define BENCH_CIRCLE_RMAX 12
+#define BENCH_CIRCLE_VOTES 20
+#define BENCH_CIRCLE_THREADS 4
+#define BENCH_PATTERN "0x787E"
+/* sync words for the multi-pattern search, the first is BENCH_PATTERN */
+#define BENCH_PATTERN_COUNT 32
+
+/* the units of the throughput */
+#define BENCH_PIXELS 0
+#define BENCH_BYTES 1
+
+#define BENCH_MAX_BASELINE 1024
+#define BENCH_NAME_LENGTH 128
+/* kernel,image,xres,yres: two names, two resolutions of up to 10 digits and the commas */
+#define BENCH_KEY_LENGTH (2 * BENCH_NAME_LENGTH + 32)
+
+
+/*
+ * Everything the kernels work on. The intermediate images are
+ * computed once per input, so every kernel can run on its own.
+ */
+typedef struct {
+    char char_name[BENCH_NAME_LENGTH];
+    char char_file[FILENAME_MAX];
+    image image_input;
+    image image_work;
+    image image_filtered;
+    image image_gradientx;
+    image image_gradienty;
+    image image_magnitude;
+    image image_nms;
+    image image_edges;
+    image image_edgemap;
+    image image_houghmap;
+    image image_foundlines;
+    image_view view_input;
+    image_view view_work;
+    image_view view_filtered;
+    image_view view_gradientx;
+    image_view view_gradienty;
+    image_view view_magnitude;
+    image_view view_nms;
+    image_view view_edges;
+    histogram histogram_input;
+    unsigned int uint_low;
+    unsigned int uint_high;
+    unsigned int uint_tmin;
+    unsigned int uint_tmax;
+    char* char_bytes;
+    match_list matches;
+    bit_pattern pattern;
+    pattern_set patterns;
+    uint32_t uint32_bytes;
+    size_t size_t_file_bytes;
+    unsigned char* uchar_bitmap;
+    char* char_bitmap_ascii;
+    size_t size_t_bitmap_bytes;
+    bitmap bitmap_edges;
+    bitmap bitmap_work;
+    image_rgb image_colour;
+    image_planar image_planes;
+    image_planar image_planes_work;
+    histogram histograms_planes[RGB_CHANNELS];
+    char char_file_p5[FILENAME_MAX];
+    size_t size_t_p5_bytes;
+    image_u16 image_wide;
+    image_arena arena_scratch;
+} bench_data;
+
+
+/*
+ * A kernel: setup() runs before every repetition and is not timed,
+ * run() is the part we time. Either may be NULL.
+ */
+typedef struct {
+    const char* char_name;
+    void (*setup)(bench_data*);
+    void (*run)(bench_data*);
+    int int_unit;
+} bench_kernel;
+
+
+/* a result of an earlier run */
+typedef struct {
+    char char_key[BENCH_KEY_LENGTH];
+    double double_median;
+} bench_baseline;
+
+
+/* the output of the kernels is not part of the measurement */
+static int int_saved_stdout = -1;
+
+void quiet_stdout(int int_quiet) {
+    int int_null = 0;
+
+    fflush(stdout);
+    if(int_quiet && int_saved_stdout < 0) {
+        int_saved_stdout = dup(STDOUT_FILENO);
+        int_null = open("/dev/null", O_WRONLY);
+        dup2(int_null, STDOUT_FILENO);
+        close(int_null);
+    } else if(!int_quiet && int_saved_stdout >= 0) {
+        dup2(int_saved_stdout, STDOUT_FILENO);
+        close(int_saved_stdout);
+        int_saved_stdout = -1;
+    }
+
+    return;
+}
+
+
+uint64_t bench_clock(void) {
+    struct timespec timespec_now;
+
+    clock_gettime(CLOCK_MONOTONIC, &timespec_now);
+
+    return((uint64_t)timespec_now.tv_sec * 1000000000u + timespec_now.tv_nsec);
+}
+
+
+void copy_image(image* image_from, image* image_to) {
+    memcpy(image_to->int_image_data[0], image_from->int_image_data[0],
+        (size_t)image_from->uint_xres * image_from->uint_yres * sizeof(unsigned int));
+    image_to->uint_max = image_from->uint_max;
+
+    return;
+}
+
+
+/*-----------------------
+ * KERNELS
+ *---------------------*/
+
+void run_p2_read(bench_data* data) {
+    image image_read;
+
+    read_image_p2(data->char_file, &image_read);
+    free_image_p2(&image_read);
+
+    return;
+}
+
+void run_p2_write(bench_data* data) {
+    write_image_p2(data->char_file, &data->image_input);
+
+    return;
+}
+
+/* the input scaled to 16 bit, see image_p5.h */
+void run_p5_read(bench_data* data) {
+    image_u16 image_read;
+
+    read_image_p5(data->char_file_p5, &image_read);
+    free_image_u16(&image_read);
+
+    return;
+}
+
+void run_p5_write(bench_data* data) {
+    write_image_p5(data->char_file_p5, &data->image_wide);
+
+    return;
+}
+
+void run_histogram(bench_data* data) {
+    compute_histogram(&data->view_input, &data->histogram_input);
+
+    return;
+}
+
+void setup_work(bench_data* data) {
+    copy_image(&data->image_input, &data->image_work);
+
+    return;
+}
+
+void run_contrast_stretch(bench_data* data) {
+    contrast_stretch(&data->view_work, data->uint_low, data->uint_high);
+
+    return;
+}
+
+void run_equalise(bench_data* data) {
+    equalise_histogram(&data->view_work, &data->histogram_input);
+
+    return;
+}
+
+void run_gaussian(bench_data* data) {
+    filter_image(&data->view_input, &data->view_filtered, KERNEL_GAUSSIAN_SIZE, KERNEL_GAUSSIAN_SIZE, gaussian_filter, 255);
+
+    return;
+}
+
+void run_sobel(bench_data* data) {
+    filter_image(&data->view_filtered, &data->view_gradientx, KERNEL_SOBEL_SIZE, KERNEL_SOBEL_SIZE, sobel_gx, 0);
+    filter_image(&data->view_filtered, &data->view_gradienty, KERNEL_SOBEL_SIZE, KERNEL_SOBEL_SIZE, sobel_gy, 0);
+
+    return;
+}
+
+void run_nms(bench_data* data) {
+    gradient_nms(&data->view_nms, &data->view_gradientx, &data->view_gradienty, &data->view_magnitude);
+
+    return;
+}
+
+void setup_hysteresis(bench_data* data) {
+    copy_image(&data->image_nms, &data->image_edges);
+
+    return;
+}
+
+void run_hysteresis(bench_data* data) {
+    trace_edges(&data->view_edges, &data->view_magnitude, data->uint_tmin, data->uint_tmax);
+
+    return;
+}
+
+void run_hough_forward(bench_data* data) {
+    image image_houghmap;
+
+    hough_transform(&data->image_edgemap, &image_houghmap, BENCH_THETA_BINS, (unsigned int)hypot(data->image_input.uint_xres, data->image_input.uint_yres));
+    free_image_p2(&image_houghmap);
+
+    return;
+}
+
+/* the compact accumulator, at full resolution and coarse-to-fine */
+void run_hough_compact(bench_data* data) {
+    image_u16 image_houghmap;
+    image_view view_edgemap;
+
+    view_image_p2(&data->image_edgemap, &view_edgemap);
+    if(hough_transform_u16(&view_edgemap, &image_houghmap, BENCH_THETA_BINS, (unsigned int)hypot(data->image_input.uint_xres, data->image_input.uint_yres), 1, BENCH_LINE_THRESHOLD) == 0) {
+        free_image_u16(&image_houghmap);
+    }
+
+    return;
+}
+
+void run_hough_coarse(bench_data* data) {
+    image_u16 image_houghmap;
+    image_view view_edgemap;
+
+    view_image_p2(&data->image_edgemap, &view_edgemap);
+    if(hough_transform_u16(&view_edgemap, &image_houghmap, BENCH_THETA_BINS, (unsigned int)hypot(data->image_input.uint_xres, data->image_input.uint_yres), BENCH_HOUGH_COARSE, BENCH_LINE_THRESHOLD) == 0) {
+        free_image_u16(&image_houghmap);
+    }
+
+    return;
+}
+
+/* the progressive transform votes with a fraction of the points */
+void run_hough_progressive(bench_data* data) {
+    segment_list segments;
+    image_view view_edgemap;
+
+    memset(&segments, 0, sizeof(segment_list));
+    view_image_p2(&data->image_edgemap, &view_edgemap);
+    hough_progressive(&view_edgemap, &segments, BENCH_THETA_BINS, (unsigned int)hypot(data->image_input.uint_xres, data->image_input.uint_yres), BENCH_SEGMENT_LENGTH, BENCH_SEGMENT_GAP);
+    free_segment_list(&segments);
+
+    return;
+}
+
+/* gradient-guided circle voting, on one thread and on several, against
+ * the brute force transform with a full centre x radius volume
+ */
+void run_circles(bench_data* data) {
+    circle_list circles;
+
+    memset(&circles, 0, sizeof(circle_list));
+    hough_circles(&data->image_wide, &data->view_edges, &circles, BENCH_CIRCLE_RMIN, BENCH_CIRCLE_RMAX, BENCH_CIRCLE_VOTES, 1, &data->arena_scratch);
+    free_circle_list(&circles);
+
+    return;
+}
+
+void run_circles_parallel(bench_data* data) {
+    circle_list circles;
+
+    memset(&circles, 0, sizeof(circle_list));
+    hough_circles(&data->image_wide, &data->view_edges, &circles, BENCH_CIRCLE_RMIN, BENCH_CIRCLE_RMAX, BENCH_CIRCLE_VOTES, BENCH_CIRCLE_THREADS, &data->arena_scratch);
+    free_circle_list(&circles);
+
+    return;
+}
+
+void run_circles_3d(bench_data* data) {
+    circle_list circles;
+
+    memset(&circles, 0, sizeof(circle_list));
+    hough_circles_3d(&data->view_edges, &circles, BENCH_CIRCLE_RMIN, BENCH_CIRCLE_RMAX, BENCH_CIRCLE_VOTES);
+    free_circle_list(&circles);
+
+    return;
+}
+
+void setup_hough_inverse(bench_data* data) {
+    copy_image(&data->image_input, &data->image_foundlines);
+
+    return;
+}
+
+void run_hough_inverse(bench_data* data) {
+    reverse_transform(&data->image_foundlines, &data->image_houghmap, BENCH_LINE_THRESHOLD);
+
+    return;
+}
+
+/* the match list keeps its memory from one run to the next */
+void setup_search(bench_data* data) {
+    data->matches.size_t_count = 0;
+
+    return;
+}
+
+void run_search(bench_data* data) {
+    match_pattern(&data->pattern, (unsigned char*)data->char_bytes, data->uint32_bytes, data->uint32_bytes, 0, &data->matches);
+
+    return;
+}
+
+void run_search_set(bench_data* data) {
+    match_pattern_set(&data->patterns, (unsigned char*)data->char_bytes, data->uint32_bytes, data->uint32_bytes, 0, &data->matches);
+
+    return;
+}
+
+/* the edges as a P4 bitmap, see binary2ascii.c */
+void run_p4_unpack(bench_data* data) {
+    unsigned int i = 0;
+    unsigned int uint_row_bytes = bitmap_row_bytes(data->image_input.uint_xres);
+
+    for(i = 0; i < data->image_input.uint_yres; i ++) {
+        unpack_bits_row(data->uchar_bitmap + (size_t)i * uint_row_bytes, data->char_bitmap_ascii + (size_t)i * data->image_input.uint_xres, data->image_input.uint_xres);
+    }
+
+    return;
+}
+
+void run_p1_pack(bench_data* data) {
+    unsigned int i = 0;
+    unsigned int uint_row_bytes = bitmap_row_bytes(data->image_input.uint_xres);
+
+    for(i = 0; i < data->image_input.uint_yres; i ++) {
+        pack_bits_row(data->char_bitmap_ascii + (size_t)i * data->image_input.uint_xres, data->uchar_bitmap + (size_t)i * uint_row_bytes, data->image_input.uint_xres);
+    }
+
+    return;
+}
+
+/* the edges as a text of ASCII bits, see converter.c */
+void run_text_to_bytes(bench_data* data) {
+    text_bits_state state = {0, 0, 0};
+
+    text_to_bytes(&state, data->char_bitmap_ascii, (size_t)data->image_input.uint_xres * data->image_input.uint_yres, data->uchar_bitmap);
+
+    return;
+}
+
+void run_bytes_to_text(bench_data* data) {
+    bytes_to_digits(data->uchar_bitmap, (size_t)data->image_input.uint_xres * data->image_input.uint_yres / 8, data->char_bitmap_ascii);
+
+    return;
+}
+
+/* the edges as a bitmap, see image_bitmap.h */
+void run_bitmap_open(bench_data* data) {
+    open_bitmap(&data->bitmap_edges, &data->bitmap_work);
+
+    return;
+}
+
+void run_bitmap_popcount(bench_data* data) {
+    bitmap_popcount(&data->bitmap_edges);
+
+    return;
+}
+
+/* a colour image made from the input, see image_p6.h */
+void run_rgb_to_planar(bench_data* data) {
+    rgb_to_planar(&data->image_colour, &data->image_planes);
+
+    return;
+}
+
+void run_planar_to_rgb(bench_data* data) {
+    planar_to_rgb(&data->image_planes, &data->image_colour);
+
+    return;
+}
+
+void run_rgb_to_grey(bench_data* data) {
+    rgb_to_grey(&data->image_colour, &data->view_work);
+
+    return;
+}
+
+/* the planar operators work in place on a copy of the planes */
+void setup_planes_work(bench_data* data) {
+    int c = 0;
+
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        copy_image(&data->image_planes.image_channels[c], &data->image_planes_work.image_channels[c]);
+    }
+
+    return;
+}
+
+void run_gaussian_planar(bench_data* data) {
+    filter_planar(&data->image_planes, &data->image_planes_work, KERNEL_GAUSSIAN_SIZE, KERNEL_GAUSSIAN_SIZE, gaussian_filter, 255);
+
+    return;
+}
+
+void run_histogram_planar(bench_data* data) {
+    compute_histogram_planar(&data->image_planes, data->histograms_planes);
+
+    return;
+}
+
+void run_stretch_planar(bench_data* data) {
+    contrast_stretch_planar(&data->image_planes_work, data->histograms_planes, BENCH_LOW_PERCENTILE, BENCH_HIGH_PERCENTILE);
+
+    return;
+}
+
+void run_equalise_luminance(bench_data* data) {
+    equalise_luminance(&data->image_planes_work, &data->histograms_planes[RGB_RED]);
+
+    return;
+}
+
+/* the whole Canny pipeline on 16 bit intermediates, from the view and from a 16 bit image */
+void run_canny(bench_data* data) {
+    image image_result;
+
+    canny(&data->view_input, &image_result, data->uint_tmin, data->uint_tmax, NULL, &data->arena_scratch);
+    free_image_p2(&image_result);
+
+    return;
+}
+
+void run_canny_u16(bench_data* data) {
+    image image_result;
+    unsigned int uint_scale = data->image_wide.uint_max / MAX(data->image_input.uint_max, 1);
+
+    canny_u16(&data->image_wide, &image_result, data->uint_tmin * uint_scale, data->uint_tmax * uint_scale, NULL, &data->arena_scratch);
+    free_image_p2(&image_result);
+
+    return;
+}
+
+static bench_kernel kernels[] = {
+    {"p2_read", NULL, run_p2_read, BENCH_BYTES},
+    {"p2_write", NULL, run_p2_write, BENCH_BYTES},
+    {"p5_read", NULL, run_p5_read, BENCH_BYTES},
+    {"p5_write", NULL, run_p5_write, BENCH_BYTES},
+    {"histogram", NULL, run_histogram, BENCH_PIXELS},
+    {"contrast_stretch", setup_work, run_contrast_stretch, BENCH_PIXELS},
+    {"equalise", setup_work, run_equalise, BENCH_PIXELS},
+    {"gaussian", NULL, run_gaussian, BENCH_PIXELS},
+    {"sobel", NULL, run_sobel, BENCH_PIXELS},
+    {"nms", NULL, run_nms, BENCH_PIXELS},
+    {"hysteresis", setup_hysteresis, run_hysteresis, BENCH_PIXELS},
+    {"canny", NULL, run_canny, BENCH_PIXELS},
+    {"canny_u16", NULL, run_canny_u16, BENCH_PIXELS},
+    {"hough_forward", NULL, run_hough_forward, BENCH_PIXELS},
+    {"hough_inverse", setup_hough_inverse, run_hough_inverse, BENCH_PIXELS},
+    {"hough_compact", NULL, run_hough_compact, BENCH_PIXELS},
+    {"hough_coarse", NULL, run_hough_coarse, BENCH_PIXELS},
+    {"hough_progressive", NULL, run_hough_progressive, BENCH_PIXELS},
+    {"circles", NULL, run_circles, BENCH_PIXELS},
+    {"circles_parallel", NULL, run_circles_parallel, BENCH_PIXELS},
+    {"circles_3d", NULL, run_circles_3d, BENCH_PIXELS},
+    {"binary_search", setup_search, run_search, BENCH_BYTES},
+    {"binary_search_set", setup_search, run_search_set, BENCH_BYTES},
+    {"p4_unpack", NULL, run_p4_unpack, BENCH_BYTES},
+    {"p1_pack", NULL, run_p1_pack, BENCH_BYTES},
+    {"text_to_bytes", NULL, run_text_to_bytes, BENCH_BYTES},
+    {"bytes_to_text", NULL, run_bytes_to_text, BENCH_BYTES},
+    {"bitmap_open", NULL, run_bitmap_open, BENCH_PIXELS},
+    {"bitmap_popcount", NULL, run_bitmap_popcount, BENCH_PIXELS},
+    {"rgb_to_planar", NULL, run_rgb_to_planar, BENCH_PIXELS},
+    {"planar_to_rgb", NULL, run_planar_to_rgb, BENCH_PIXELS},
+    {"rgb_to_grey", NULL, run_rgb_to_grey, BENCH_PIXELS},
+    {"gaussian_planar", NULL, run_gaussian_planar, BENCH_PIXELS},
+    {"histogram_planar", NULL, run_histogram_planar, BENCH_PIXELS},
+    {"stretch_planar", setup_planes_work, run_stretch_planar, BENCH_PIXELS},
+    {"equalise_luminance", setup_planes_work, run_equalise_luminance, BENCH_PIXELS},
+};
+
+#define BENCH_NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+
+/*-----------------------
+ * INPUT DATA
+ *---------------------*/
+
+/* nearest neighbour upscaling to uint_xres x uint_yres */
+int scale_image(image* image_from, image* image_to, unsigned int uint_xres, unsigned int uint_yres) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_from;
+
+    if(allocate_image_p2(image_to, uint_xres, uint_yres, 0) != 0) return(-1);
+    image_to->uint_max = image_from->uint_max;
+
+    for(i = 0; i < uint_yres; i ++) {
+        uint_from = image_from->int_image_data[(size_t)i * image_from->uint_yres / uint_yres];
+        for(j = 0; j < uint_xres; j ++) {
+            image_to->int_image_data[i][j] = uint_from[(size_t)j * image_from->uint_xres / uint_xres];
+        }
+    }
+
+    return(0);
+}
+
+
+/* allocate an image of the input size and a view on it */
+void allocate_like(bench_data* data, image* image_new, image_view* view_new, unsigned int uint_greylevel) {
+    allocate_image_p2(image_new, data->image_input.uint_xres, data->image_input.uint_yres, uint_greylevel);
+    if(view_new != NULL) view_image_p2(image_new, view_new);
+
+    return;
+}
+
+
+/*
+ * Compute all intermediate results of the input image once.
+ * image_input has to be set already.
+ */
+int prepare_bench_data(bench_data* data, char* char_directory) {
+    size_t size_t_j = 0;
+    size_t size_t_pixels = (size_t)data->image_input.uint_xres * data->image_input.uint_yres;
+    unsigned int i = 0;
+    int c = 0;
+    histogram histogram_magnitude;
+    FILE* file_p2;
+    char char_sync_words[BENCH_PATTERN_COUNT][8];
+    char* char_patterns[BENCH_PATTERN_COUNT];
+    char* char_masks[BENCH_PATTERN_COUNT];
+
+    view_image_p2(&data->image_input, &data->view_input);
+    allocate_like(data, &data->image_work, &data->view_work, 0);
+    allocate_like(data, &data->image_filtered, &data->view_filtered, 0);
+    allocate_like(data, &data->image_gradientx, &data->view_gradientx, 0);
+    allocate_like(data, &data->image_gradienty, &data->view_gradienty, 0);
+    allocate_like(data, &data->image_magnitude, &data->view_magnitude, 0);
+    allocate_like(data, &data->image_nms, &data->view_nms, 0);
+    allocate_like(data, &data->image_edges, &data->view_edges, 0);
+    allocate_like(data, &data->image_edgemap, NULL, 0);
+    allocate_like(data, &data->image_foundlines, NULL, 0);
+
+    /* the grey levels for the point operators */
+    if(allocate_histogram(&data->histogram_input, data->image_input.uint_max + 1, 0, data->image_input.uint_max) != 0) return(-1);
+    compute_histogram(&data->view_input, &data->histogram_input);
+    data->uint_low = histogram_percentile(&data->histogram_input, 1.0);
+    data->uint_high = histogram_percentile(&data->histogram_input, 99.0);
+
+    /* the Canny stages, with thresholds from the gradient magnitudes */
+    run_gaussian(data);
+    run_sobel(data);
+    if(allocate_magnitude_histogram(&histogram_magnitude, data->image_input.uint_max) != 0) return(-1);
+    gradient_magnitude(&data->view_magnitude, &data->view_gradientx, &data->view_gradienty, &histogram_magnitude);
+    update_cumulative_histogram(&histogram_magnitude);
+    data->uint_tmin = histogram_percentile(&histogram_magnitude, BENCH_LOW_PERCENTILE);
+    data->uint_tmax = histogram_percentile(&histogram_magnitude, BENCH_HIGH_PERCENTILE);
+    free_histogram(&histogram_magnitude);
+    data->image_nms.uint_max = 255;
+    run_nms(data);
+    setup_hysteresis(data);
+    run_hysteresis(data);
+
+    /* hough_transform() votes for every pixel that is not white */
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        data->image_edgemap.int_image_data[0][size_t_j] = (data->image_edges.int_image_data[0][size_t_j] == 255) ? 0 : 255;
+    }
+    data->image_edgemap.uint_max = 255;
+    hough_transform(&data->image_edgemap, &data->image_houghmap, BENCH_THETA_BINS, (unsigned int)hypot(data->image_input.uint_xres, data->image_input.uint_yres));
+
+    /* a P2 file to read, and some binary data to search */
+    snprintf(data->char_file, FILENAME_MAX, "%s/bench_%d.pgm", char_directory, (int)getpid());
+    run_p2_write(data);
+    file_p2 = fopen(data->char_file, "r");
+    if(file_p2 == NULL) return(-1);
+    fseek(file_p2, 0, SEEK_END);
+    data->size_t_file_bytes = ftell(file_p2);
+    fclose(file_p2);
+
+    /* the same image with 16 bit grey levels as a P5 file */
+    if(allocate_image_u16(&data->image_wide, data->image_input.uint_xres, data->image_input.uint_yres, 0) != 0) return(-1);
+    view_to_u16(&data->view_input, &data->image_wide);
+    for(i = 0; i < data->image_wide.uint_yres; i ++) {
+        for(size_t_j = 0; size_t_j < data->image_wide.uint_xres; size_t_j ++) {
+            U16_PIXEL(&data->image_wide, size_t_j, i) *= UINT16_MAX / MAX(data->image_input.uint_max, 1);
+        }
+    }
+    data->image_wide.uint_max = data->image_input.uint_max * (UINT16_MAX / MAX(data->image_input.uint_max, 1));
+    snprintf(data->char_file_p5, FILENAME_MAX, "%s/bench_%d_16.pgm", char_directory, (int)getpid());
+    run_p5_write(data);
+    file_p2 = fopen(data->char_file_p5, "r");
+    if(file_p2 == NULL) return(-1);
+    fseek(file_p2, 0, SEEK_END);
+    data->size_t_p5_bytes = ftell(file_p2);
+    fclose(file_p2);
+    if(allocate_arena(&data->arena_scratch, 0) != 0) return(-1);
+
+    data->uint32_bytes = (uint32_t)(size_t_pixels * sizeof(unsigned int));
+    data->char_bytes = (char*)data->image_input.int_image_data[0];
+    memset(&data->matches, 0, sizeof(match_list));
+    if(compile_pattern(&data->pattern, BENCH_PATTERN, NULL) != 0) return(-1);
+    for(i = 0; i < BENCH_PATTERN_COUNT; i ++) {
+        snprintf(char_sync_words[i], sizeof(char_sync_words[i]), "0x%04X", (i == 0) ? 0x787E : (0x787E + 0x9E37 * i) & 0xFFFF);
+        char_patterns[i] = char_sync_words[i];
+        char_masks[i] = NULL;
+    }
+    if(compile_pattern_set(&data->patterns, char_patterns, char_masks, BENCH_PATTERN_COUNT) != 0) return(-1);
+
+    /* the edges as ASCII digits, packed into a bitmap */
+    data->size_t_bitmap_bytes = (size_t)bitmap_row_bytes(data->image_input.uint_xres) * data->image_input.uint_yres;
+    data->uchar_bitmap = (unsigned char*)malloc(data->size_t_bitmap_bytes);
+    data->char_bitmap_ascii = (char*)malloc(size_t_pixels);
+    if(data->uchar_bitmap == NULL || data->char_bitmap_ascii == NULL) return(-1);
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        data->char_bitmap_ascii[size_t_j] = (data->image_edges.int_image_data[0][size_t_j] == 255) ? '1' : '0';
+    }
+    run_p1_pack(data);
+    if(bitmap_from_view(&data->view_edges, &data->bitmap_edges, 255, 255) != 0) return(-1);
+    if(allocate_bitmap(&data->bitmap_work, data->image_input.uint_xres, data->image_input.uint_yres) != 0) return(-1);
+
+    /* a colour image made from the input and the edges */
+    if(allocate_image_rgb(&data->image_colour, data->image_input.uint_xres, data->image_input.uint_yres, 255) != 0) return(-1);
+    if(allocate_image_planar(&data->image_planes, data->image_input.uint_xres, data->image_input.uint_yres, 255) != 0) return(-1);
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_RED] = data->image_input.int_image_data[0][size_t_j] & 255;
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_GREEN] = data->image_edges.int_image_data[0][size_t_j] & 255;
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_BLUE] = 255 - (data->image_input.int_image_data[0][size_t_j] & 255);
+    }
+    run_rgb_to_planar(data);
+    if(allocate_image_planar(&data->image_planes_work, data->image_input.uint_xres, data->image_input.uint_yres, 255) != 0) return(-1);
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        if(allocate_histogram(&data->histograms_planes[c], 256, 0, 255) != 0) return(-1);
+    }
+
+    return(0);
+}
+
+
+void free_bench_data(bench_data* data) {
+    int c = 0;
+
+    remove(data->char_file);
+    remove(data->char_file_p5);
+    free_image_u16(&data->image_wide);
+    free_arena(&data->arena_scratch);
+    free_match_list(&data->matches);
+    free_pattern_set(&data->patterns);
+    free(data->uchar_bitmap);
+    free(data->char_bitmap_ascii);
+    free_bitmap(&data->bitmap_edges);
+    free_bitmap(&data->bitmap_work);
+    free_image_rgb(&data->image_colour);
+    free_image_planar(&data->image_planes);
+    free_image_planar(&data->image_planes_work);
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        free_histogram(&data->histograms_planes[c]);
+    }
+    free_histogram(&data->histogram_input);
+    free_image_p2(&data->image_input);
+    free_image_p2(&data->image_work);
+    free_image_p2(&data->image_filtered);
+    free_image_p2(&data->image_gradientx);
+    free_image_p2(&data->image_gradienty);
+    free_image_p2(&data->image_magnitude);
+    free_image_p2(&data->image_nms);
+    free_image_p2(&data->image_edges);
+    free_image_p2(&data->image_edgemap);
+    free_image_p2(&data->image_houghmap);
+    free_image_p2(&data->image_foundlines);
+
+    return;
+}
+
+
+/*-----------------------
+ * MEASUREMENT
+ *---------------------*/
+
+int compare_uint64(const void* void_a, const void* void_b) {
+    uint64_t uint64_a = *(const uint64_t*)void_a;
+    uint64_t uint64_b = *(const uint64_t*)void_b;
+
+    return((uint64_a > uint64_b) - (uint64_a < uint64_b));
+}
+
+
+/* look up the median of the same kernel and image in the baseline */
+double find_baseline(bench_baseline* baseline, int int_num_baseline, char* char_key) {
+    int i = 0;
+
+    for(i = 0; i < int_num_baseline; i ++) {
+        if(strcmp(baseline[i].char_key, char_key) == 0) return(baseline[i].double_median);
+    }
+
+    return(-1.0);
+}
+
+
+/*
+ * Read the CSV of an earlier run. We only need the key
+ * (kernel, image, resolution) and the median.
+ */
+int read_baseline(char* char_name, bench_baseline* baseline) {
+    FILE* file_baseline;
+    char char_line[4 * BENCH_NAME_LENGTH];
+    char char_kernel[BENCH_NAME_LENGTH];
+    char char_image[BENCH_NAME_LENGTH];
+    unsigned int uint_xres = 0;
+    unsigned int uint_yres = 0;
+    double double_median = 0.0;
+    int int_num_baseline = 0;
+
+    file_baseline = fopen(char_name, "r");
+    if(file_baseline == NULL) {
+        perror("read_baseline: Can't open the baseline file.\n");
+        return(-1);
+    }
+
+    while(int_num_baseline < BENCH_MAX_BASELINE && fgets(char_line, sizeof(char_line), file_baseline) != NULL) {
+        if(sscanf(char_line, "%127[^,],%127[^,],%u,%u,%lf", char_kernel, char_image, &uint_xres, &uint_yres, &double_median) != 5) continue;
+        snprintf(baseline[int_num_baseline].char_key, BENCH_KEY_LENGTH, "%s,%s,%u,%u", char_kernel, char_image, uint_xres, uint_yres);
+        baseline[int_num_baseline].double_median = double_median;
+        int_num_baseline ++;
+    }
+
+    fclose(file_baseline);
+
+    return(int_num_baseline);
+}
+
+
+/*
+ * Time one kernel on one input and print a CSV line.
+ * Returns 1 if the kernel got slower than the baseline allows.
+ */
+int bench_kernel_run(bench_kernel* kernel, bench_data* data, int int_warmup, int int_repetitions, FILE* file_report, bench_baseline* baseline, int int_num_baseline, double double_threshold) {
+    int i = 0;
+    uint64_t uint64_start = 0;
+    uint64_t* uint64_samples;
+    double double_median = 0.0;
+    double double_p95 = 0.0;
+    double double_units = 0.0;
+    double double_baseline = -1.0;
+    double double_change = 0.0;
+    char char_key[BENCH_KEY_LENGTH];
+    char char_line[4 * BENCH_NAME_LENGTH];
+    int int_regression = 0;
+
+    uint64_samples = (uint64_t*)malloc(int_repetitions * sizeof(uint64_t));
+    if(uint64_samples == NULL) return(0);
+
+    quiet_stdout(1);
+    for(i = 0; i < int_warmup + int_repetitions; i ++) {
+        if(kernel->setup != NULL) kernel->setup(data);
+        uint64_start = bench_clock();
+        kernel->run(data);
+        if(i >= int_warmup) uint64_samples[i - int_warmup] = bench_clock() - uint64_start;
+    }
+    quiet_stdout(0);
+
+    qsort(uint64_samples, int_repetitions, sizeof(uint64_t), compare_uint64);
+    double_median = (int_repetitions % 2 == 1) ? uint64_samples[int_repetitions / 2] : 0.5 * (uint64_samples[int_repetitions / 2 - 1] + uint64_samples[int_repetitions / 2]);
+    double_p95 = uint64_samples[(int)ceil(0.95 * int_repetitions) - 1];
+
+    double_units = (double)data->image_input.uint_xres * data->image_input.uint_yres;
+    if(kernel->run == run_search || kernel->run == run_search_set) {
+        double_units = data->uint32_bytes;
+    } else if(kernel->run == run_p4_unpack || kernel->run == run_p1_pack) {
+        double_units = data->size_t_bitmap_bytes;
+    } else if(kernel->run == run_p5_read || kernel->run == run_p5_write) {
+        double_units = data->size_t_p5_bytes;
+    } else if(kernel->run == run_text_to_bytes || kernel->run == run_bytes_to_text) {
+        double_units = (double)data->image_input.uint_xres * data->image_input.uint_yres;
+    } else if(kernel->int_unit == BENCH_BYTES) {
+        double_units = data->size_t_file_bytes;
+    }
+
+    snprintf(char_key, sizeof(char_key), "%s,%s,%u,%u", kernel->char_name, data->char_name, data->image_input.uint_xres, data->image_input.uint_yres);
+    snprintf(char_line, sizeof(char_line), "%s,%.0f,%.0f,%.3f,%s", char_key, double_median, double_p95, double_units / double_median * 1000.0, (kernel->int_unit == BENCH_BYTES) ? "MB/s" : "Mpixel/s");
+
+    double_baseline = find_baseline(baseline, int_num_baseline, char_key);
+    if(double_baseline > 0.0) {
+        double_change = 100.0 * (double_median - double_baseline) / double_baseline;
+        int_regression = (double_change > double_threshold);
+        printf("%s,%.0f,%+.1f%s\n", char_line, double_baseline, double_change, int_regression ? ",REGRESSION" : "");
+    } else {
+        printf("%s\n", char_line);
+    }
+    fflush(stdout);
+
+    if(file_report != NULL) fprintf(file_report, "%s\n", char_line);
+
+    free(uint64_samples);
+
+    return(int_regression);
+}
+
+
+/* no selection runs all kernels */
+int kernel_selected(const char* char_kernel, char** char_selected, int int_num_selected) {
+    int i = 0;
+
+    for(i = 0; i < int_num_selected; i ++) {
+        if(strcmp(char_selected[i], char_kernel) == 0) return(1);
+    }
+
+    return(int_num_selected == 0);
+}
+
+
+/* the name of an image without directory and extension, e.g. head@4k */
+void image_name(char* char_name, char* char_file, char* char_scale) {
+    char* char_base = strrchr(char_file, '/');
+    char* char_extension;
+    int int_length = 0;
+
+    char_base = (char_base == NULL) ? char_file : char_base + 1;
+    char_extension = strrchr(char_base, '.');
+    int_length = (char_extension == NULL) ? (int)strlen(char_base) : (int)(char_extension - char_base);
+
+    if(strcmp(char_scale, "1") == 0) {
+        snprintf(char_name, BENCH_NAME_LENGTH, "%.*s", int_length, char_base);
+    } else {
+        snprintf(char_name, BENCH_NAME_LENGTH, "%.*s@%s", int_length, char_base, char_scale);
+    }
+
+    return;
+}
+
+
+/* the resolution of a scale, 1 keeps the image as it is */
+int scale_resolution(char* char_scale, unsigned int* uint_xres, unsigned int* uint_yres) {
+    if(strcmp(char_scale, "1") == 0) return(0);
+    if(strcmp(char_scale, "4k") == 0) {
+        *uint_xres = 3840;
+        *uint_yres = 2160;
+        return(0);
+    }
+    if(strcmp(char_scale, "8k") == 0) {
+        *uint_xres = 7680;
+        *uint_yres = 4320;
+        return(0);
+    }
+
+    return(-1);
+}
+
+
+void print_bench_usage(char* char_program) {
+    fprintf(stderr, "Usage: %s [options] image.pgm ...\n"
+        "  -w <runs>      warm-up runs per kernel (default %d)\n"
+        "  -n <runs>      timed runs per kernel (default %d)\n"
+        "  -x <scales>    comma separated list of 1, 4k and 8k (default %s)\n"
+        "  -k <kernel>    only run this kernel, may be given more than once\n"
+        "  -s <file>      save the results as CSV, e.g. as a new baseline\n"
+        "  -b <file>      compare the medians against this baseline\n"
+        "  -t <percent>   slow down that counts as a regression (default %.0f)\n"
+        "  -d <dir>       directory for temporary files (default /tmp)\n"
+        "The exit status is 1 if any kernel regressed.\n",
+        char_program, BENCH_WARMUP, BENCH_REPETITIONS, BENCH_SCALES, BENCH_REGRESSION_PERCENT);
+
+    return;
+}
+
+
+int main(int argc, char *argv[]) {
+    int i = 0;
+    int k = 0;
+    int int_option = 0;
+    int int_warmup = BENCH_WARMUP;
+    int int_repetitions = BENCH_REPETITIONS;
+    double double_threshold = BENCH_REGRESSION_PERCENT;
+    char char_scales[BENCH_NAME_LENGTH] = BENCH_SCALES;
+    char char_scale_list[BENCH_NAME_LENGTH];
+    char* char_scale;
+    char* char_directory = "/tmp";
+    char* char_report = NULL;
+    char* char_baseline = NULL;
+    char* char_selected[BENCH_NUM_KERNELS];
+    int int_num_selected = 0;
+    int int_regressions = 0;
+    int int_num_baseline = 0;
+    unsigned int uint_xres = 0;
+    unsigned int uint_yres = 0;
+    static bench_baseline baseline[BENCH_MAX_BASELINE];
+    FILE* file_report = NULL;
+    image image_read;
+    bench_data data;
+
+    while((int_option = getopt(argc, argv, "w:n:x:k:s:b:t:d:h")) != -1) {
+        switch(int_option) {
+            case 'w': int_warmup = MAX(atoi(optarg), 0); break;
+            case 'n': int_repetitions = MAX(atoi(optarg), 1); break;
+            case 'x': snprintf(char_scales, BENCH_NAME_LENGTH, "%s", optarg); break;
+            case 'k':
+                if(int_num_selected < (int)BENCH_NUM_KERNELS) char_selected[int_num_selected ++] = optarg;
+                break;
+            case 's': char_report = optarg; break;
+            case 'b': char_baseline = optarg; break;
+            case 't': double_threshold = atof(optarg); break;
+            case 'd': char_directory = optarg; break;
+            default:
+                print_bench_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    if(optind >= argc) {
+        print_bench_usage(argv[0]);
+        exit(1);
+    }
+
+    if(char_baseline != NULL) {
+        int_num_baseline = read_baseline(char_baseline, baseline);
+        if(int_num_baseline < 0) exit(1);
+    }
+
+    if(char_report != NULL) {
+        file_report = fopen(char_report, "w");
+        if(file_report == NULL) {
+            perror("Can't open the report file.\n");
+            exit(1);
+        }
+        fprintf(file_report, "kernel,image,xres,yres,median_ns,p95_ns,throughput,unit\n");
+    }
+
+    /* the timings depend on the clones of the hot loops we run */
+    fprintf(stderr, "CPU dispatch: %s\n", cpu_dispatch_name(cpu_dispatch_level()));
+
+    quiet_stdout(1);
+    allocate_digits_table();
+    quiet_stdout(0);
+
+    printf("kernel,image,xres,yres,median_ns,p95_ns,throughput,unit%s\n", (int_num_baseline > 0) ? ",baseline_ns,change_percent" : "");
+
+    for(i = optind; i < argc; i ++) {
+        if(read_image_p2(argv[i], &image_read) != 0) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            continue;
+        }
+
+        snprintf(char_scale_list, BENCH_NAME_LENGTH, "%s", char_scales);
+        for(char_scale = strtok(char_scale_list, ","); char_scale != NULL; char_scale = strtok(NULL, ",")) {
+            uint_xres = image_read.uint_xres;
+            uint_yres = image_read.uint_yres;
+            if(scale_resolution(char_scale, &uint_xres, &uint_yres) != 0) {
+                fprintf(stderr, "Unknown scale %s\n", char_scale);
+                continue;
+            }
+
+            memset(&data, 0, sizeof(bench_data));
+            image_name(data.char_name, argv[i], char_scale);
+            if(scale_image(&image_read, &data.image_input, uint_xres, uint_yres) != 0 || prepare_bench_data(&data, char_directory) != 0) {
+                fprintf(stderr, "Unable to prepare %s\n", data.char_name);
+                exit(1);
+            }
+
+            for(k = 0; k < (int)BENCH_NUM_KERNELS; k ++) {
+                if(!kernel_selected(kernels[k].char_name, char_selected, int_num_selected)) continue;
+
+                int_regressions += bench_kernel_run(&kernels[k], &data, int_warmup, int_repetitions, file_report, baseline, int_num_baseline, double_threshold);
+            }
+
+            free_bench_data(&data);
+        }
+
+        free_image_p2(&image_read);
+    }
+
+    if(file_report != NULL) fclose(file_report);
+
+    if(int_regressions > 0) {
+        fprintf(stderr, "%d kernels are more than %.0f%% slower than the baseline.\n", int_regressions, double_threshold);
+        return(1);
+    }
+
+    return(0);
+}
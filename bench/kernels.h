@@ -0,0 +1,174 @@
+/*
+ * Function definitions of the kernels that bench.c and verify.c
+ * work on.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __BENCH_KERNELS__
+#define __BENCH_KERNELS__
+
+
+/*
+ * System level includes
+ */
+#include <stdint.h>
+
+
+/* include our PGM and histogram routines */
+#include "image_p2.h"
+#include "image_p6.h"
+#include "image_p5.h"
+#include "image_arena.h"
+#include "histogram.h"
+#include "bit_digits.h"
+
+
+/* the filter sizes of the Gaussian and Sobel kernels in edge_detection.c */
+#define KERNEL_GAUSSIAN_SIZE 5
+#define KERNEL_SOBEL_SIZE 3
+
+
+/*
+ * The kernels under test. They live in the exercise programs,
+ * which have no headers of their own.
+ */
+int gaussian_filter(image_view* the_image, unsigned int uint_x, unsigned int uint_y);
+int sobel_gx(image_view* the_image, unsigned int uint_x, unsigned int uint_y);
+int sobel_gy(image_view* the_image, unsigned int uint_x, unsigned int uint_y);
+void filter_image(image_view* the_image, image_view* image_gradient, unsigned int uint_width, unsigned int uint_height, int (filter_pixel)(image_view*, unsigned int, unsigned int), unsigned int uint_neutral);
+void gradient_magnitude(image_view* image_gradientmagnitude, image_view* image_gradientx, image_view* image_gradienty, histogram* histogram_magnitude);
+unsigned int magnitude_shift(unsigned int uint_max_grey);
+int allocate_magnitude_histogram(histogram* histogram_magnitude, unsigned int uint_max_grey);
+void gradient_nms(image_view* image_nms, image_view* image_gradientx, image_view* image_gradienty, image_view* image_gradientmagnitude);
+void trace_edges(image_view* image_edges, image_view* image_gradientmap, unsigned int uint_tmin, unsigned int uint_tmax);
+void canny(image_view* view_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, const char* char_dump_prefix, image_arena* arena_scratch);
+void gaussian_row_u16(image_u16* image_input, uint16_t* restrict uint16_blurred, unsigned int uint_y);
+void canny_u16(image_u16* image_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, const char* char_dump_prefix, image_arena* arena_scratch);
+int canny_streaming(image_view* view_input, image* image_edges, unsigned int uint_tmin, unsigned int uint_tmax, unsigned int uint_threads, image_arena* arena_scratch);
+void hough_transform(image* image_edgemap, image* image_houghmap, unsigned int uint_binstheta, unsigned int uint_binsrho);
+void reverse_transform(image* image_foundlines, image* image_houghmap, float float_threshold);
+int hough_transform_u16(image_view* view_edgemap, image_u16* image_houghmap, unsigned int uint_binstheta, unsigned int uint_binsrho, unsigned int uint_factor, float float_threshold);
+void reverse_transform_u16(image* image_foundlines, image_u16* image_houghmap, float float_threshold);
+int contrast_stretch(image_view* view_in, unsigned int uint_low, unsigned int uint_high);
+int equalise_histogram(image_view* view_in, histogram* histogram_in);
+int filter_planar(image_planar* image_input, image_planar* image_output, unsigned int uint_width, unsigned int uint_height, int (filter_pixel)(image_view*, unsigned int, unsigned int), unsigned int uint_neutral);
+int contrast_stretch_planar(image_planar* image_in, histogram histograms[RGB_CHANNELS], double double_low, double double_high);
+int equalise_luminance(image_planar* image_in, histogram* histogram_luminance);
+
+/* the line segments of edge_detection.c */
+typedef struct {
+    int uint_x;
+    int uint_y;
+} point;
+
+typedef struct {
+    point point_start;
+    point point_end;
+    unsigned int uint_votes;
+} line_segment;
+
+typedef struct {
+    line_segment* segments;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} segment_list;
+
+long hough_progressive(image_view* view_edgemap, segment_list* segments, unsigned int uint_binstheta, unsigned int uint_binsrho, unsigned int uint_min_length, unsigned int uint_max_gap);
+void free_segment_list(segment_list* segments);
+
+/* the circles of edge_detection.c */
+typedef struct {
+    unsigned int uint_x;
+    unsigned int uint_y;
+    unsigned int uint_radius;
+    unsigned int uint_votes;
+} circle;
+
+typedef struct {
+    circle* circles;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} circle_list;
+
+typedef struct {
+    float float_x;
+    float float_y;
+    float float_dx;
+    float float_dy;
+} circle_point;
+
+long circle_centre_votes(image_u16* image_input, image_view* view_edges, image_u16* image_centres, circle_point** point_edges, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_threads, image_arena* arena_scratch);
+int hough_circles(image_u16* image_input, image_view* view_edges, circle_list* circles, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_min_votes, unsigned int uint_threads, image_arena* arena_scratch);
+int hough_circles_3d(image_view* view_edges, circle_list* circles, unsigned int uint_rmin, unsigned int uint_rmax, unsigned int uint_min_votes);
+void free_circle_list(circle_list* circles);
+
+/* the matches of search_binary.c */
+typedef struct {
+    uint64_t uint64_offset;
+    unsigned int uint_pattern;
+} match;
+
+typedef struct {
+    match* matches;
+    size_t size_t_count;
+    size_t size_t_capacity;
+} match_list;
+
+/* a compiled pattern of search_binary.c, the sizes have to match */
+#define KERNEL_PATTERN_MAX_BYTES (1024 / 8 + 1)
+typedef struct {
+    unsigned int uint_bits;
+    unsigned int uint_care_bits;
+    unsigned int uint_bytes[8];
+    unsigned int uint_span_bytes;
+    unsigned int uint_filter_bytes;
+    unsigned char uchar_value[8][KERNEL_PATTERN_MAX_BYTES];
+    unsigned char uchar_mask[8][KERNEL_PATTERN_MAX_BYTES];
+    uint64_t uint64_table[256];
+    uint64_t uint64_start;
+    uint64_t uint64_accept;
+} bit_pattern;
+
+/* several compiled patterns of search_binary.c */
+typedef struct {
+    unsigned int uint_pattern;
+    unsigned int uint_alignment;
+    unsigned int uint_key_byte;
+} pattern_candidate;
+
+#define KERNEL_KEY_BITS 16
+typedef struct {
+    bit_pattern* patterns;
+    unsigned int uint_count;
+    unsigned int uint_span_bytes;
+    unsigned int uint_max_key_byte;
+    uint32_t* uint32_first;
+    pattern_candidate* candidates;
+    pattern_candidate* always;
+    unsigned int uint_num_always;
+    uint64_t uint64_present[(1 << KERNEL_KEY_BITS) / 64];
+} pattern_set;
+
+int compile_pattern(bit_pattern* pattern, char* char_pattern, char* char_mask);
+int match_pattern(bit_pattern* pattern, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_end, uint64_t uint64_offset, match_list* matches);
+void free_match_list(match_list* matches);
+int compile_pattern_set(pattern_set* set, char** char_patterns, char** char_masks, unsigned int uint_count);
+int match_pattern_set(pattern_set* set, const unsigned char* uchar_buffer, size_t size_t_length, size_t size_t_end, uint64_t uint64_offset, match_list* matches);
+void free_pattern_set(pattern_set* set);
+unsigned int bitmap_row_bytes(unsigned int uint_xres);
+void unpack_bits_row(unsigned char* uchar_binary, char* char_ascii, unsigned int uint_xres);
+void pack_bits_row(char* char_ascii, unsigned char* uchar_binary, unsigned int uint_xres);
+
+/* the state of text_to_bytes() in converter.c */
+typedef struct {
+    unsigned int uint_partial;
+    unsigned int uint_pending;
+    uint64_t uint64_invalid;
+} text_bits_state;
+
+size_t text_to_bytes(text_bits_state* state, const char* char_input, size_t size_t_length, unsigned char* uchar_output);
+
+#endif
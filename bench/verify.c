@@ -0,0 +1,1100 @@
+/*
+ * Golden output check for the image processing kernels.
+ *
+ * Every kernel that may get an optimised rewrite is run next to a
+ * plain scalar reference implementation, on the example images and
+ * on random fuzz images. The outputs have to match bit by bit, or
+ * within the tolerance of the kernel. For every mismatch we report
+ * the first differing pixel.
+ *
+ * The reference implementations below are deliberately simple and
+ * must not be optimised. They are the definition of the right answer.
+ *
+ * Build and run it with the Makefile in the top directory:
+ * make verify
+ */
+
+
+/* system includes */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+
+/* include our PGM and histogram routines and the kernels under test */
+#include "image_p2.h"
+#include "histogram.h"
+#include "image_p6.h"
+#include "image_arena.h"
+#include "kernels.h"
+
+
+/* defaults, see print_verify_usage() */
+#define VERIFY_FUZZ_IMAGES 200
+#define VERIFY_SEED 20121
+#define VERIFY_FUZZ_MAX_SIZE 256
+
+#define VERIFY_NAME_LENGTH 128
+
+/* the hysteresis thresholds of the canny kernel in multiples of the max. grey level */
+#define VERIFY_CANNY_TMIN 2
+#define VERIFY_CANNY_TMAX 3
+
+/* the threads of the parallel hysteresis of the streaming canny kernel */
+#define VERIFY_HYSTERESIS_THREADS 3
+
+/* the radii of the circles kernel and the threads of its optimised version */
+#define VERIFY_CIRCLE_RMIN 2
+#define VERIFY_CIRCLE_RMAX 9
+#define VERIFY_CIRCLE_THREADS 3
+
+
+/*
+ * The data of one input. The reference results of every stage
+ * are the input of the next stage, so a mismatch in one kernel
+ * does not show up in the kernels after it.
+ */
+typedef struct {
+    char char_name[VERIFY_NAME_LENGTH];
+    image image_input;
+    image image_reference;
+    image image_optimised;
+    image image_filtered;
+    image image_gradientx;
+    image image_gradienty;
+    image image_magnitude;
+    image image_edgemap;
+    image image_wide;
+    image_view view_input;
+    image_view view_reference;
+    image_view view_optimised;
+    image_view view_filtered;
+    image_view view_gradientx;
+    image_view view_gradienty;
+    image_view view_magnitude;
+    image_view view_wide;
+    image_rgb image_colour;
+} verify_data;
+
+
+/*
+ * A kernel: both functions write their result into the given view,
+ * which is cleared to 0 before. uint_tolerance is the largest
+ * difference of a pixel we accept.
+ */
+typedef struct {
+    const char* char_name;
+    void (*reference)(verify_data*, image_view*);
+    void (*optimised)(verify_data*, image_view*);
+    unsigned int uint_tolerance;
+} verify_kernel;
+
+
+void allocate_like(verify_data* data, image* image_new, image_view* view_new);
+
+
+/*-----------------------
+ * REFERENCE KERNELS
+ *---------------------*/
+
+/* is x, y on the border that filter_image() sets to the neutral value? */
+int is_filter_border(image_view* view, unsigned int uint_size, unsigned int x, unsigned int y) {
+    return(y <= uint_size / 2 || y >= view->uint_yres - uint_size / 2 ||
+        x <= uint_size / 2 || x >= view->uint_xres - uint_size / 2);
+}
+
+
+/* The border is 255, or the max. grey level of brighter images */
+void reference_blur(image_view* view_in, image_view* view_out) {
+    static const int int_weights[5][5] = {{1, 4, 7, 4, 1},
+                                          {4, 16, 26, 16, 4},
+                                          {7, 26, 41, 26, 7},
+                                          {4, 16, 26, 16, 4},
+                                          {1, 4, 7, 4, 1}};
+    unsigned int x = 0;
+    unsigned int y = 0;
+    int i = 0;
+    int j = 0;
+    float float_sum = 0.0f;
+
+    for(y = 0; y < view_in->uint_yres; y ++) {
+        for(x = 0; x < view_in->uint_xres; x ++) {
+            if(is_filter_border(view_in, KERNEL_GAUSSIAN_SIZE, x, y)) {
+                VIEW_PIXEL(view_out, x, y) = MAX(view_in->uint_max, 255);
+                continue;
+            }
+
+            float_sum = 0.0f;
+            for(i = -2; i <= 2; i ++) {
+                for(j = -2; j <= 2; j ++) {
+                    float_sum += int_weights[i + 2][j + 2] * VIEW_PIXEL(view_in, x + j, y + i);
+                }
+            }
+            VIEW_PIXEL(view_out, x, y) = (int)(float_sum / 273.0f + 0.5f);
+        }
+    }
+
+    return;
+}
+
+
+void reference_gaussian(verify_data* data, image_view* view_out) {
+    reference_blur(&data->view_input, view_out);
+
+    return;
+}
+
+
+/* the same on the input scaled to 16 bits */
+void reference_gaussian_u16(verify_data* data, image_view* view_out) {
+    reference_blur(&data->view_wide, view_out);
+
+    return;
+}
+
+
+/* the Sobel operator, int_xweight[i][j] is the weight of pixel x + j - 1, y + i - 1 */
+void reference_sobel(image_view* view_in, image_view* view_out, const int int_weights[3][3]) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    int i = 0;
+    int j = 0;
+    int int_sum = 0;
+
+    for(y = 0; y < view_in->uint_yres; y ++) {
+        for(x = 0; x < view_in->uint_xres; x ++) {
+            if(is_filter_border(view_in, KERNEL_SOBEL_SIZE, x, y)) {
+                VIEW_PIXEL(view_out, x, y) = 0;
+                continue;
+            }
+
+            int_sum = 0;
+            for(i = -1; i <= 1; i ++) {
+                for(j = -1; j <= 1; j ++) {
+                    int_sum += int_weights[i + 1][j + 1] * (int)VIEW_PIXEL(view_in, x + j, y + i);
+                }
+            }
+            VIEW_PIXEL(view_out, x, y) = int_sum;
+        }
+    }
+
+    return;
+}
+
+
+void reference_sobel_gx(verify_data* data, image_view* view_out) {
+    static const int int_weights[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
+
+    reference_sobel(&data->view_filtered, view_out, int_weights);
+
+    return;
+}
+
+
+void reference_sobel_gy(verify_data* data, image_view* view_out) {
+    static const int int_weights[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
+
+    reference_sobel(&data->view_filtered, view_out, int_weights);
+
+    return;
+}
+
+
+/* The magnitude shifted right by uint_shift bits, see magnitude_shift().
+ * The squares are summed in float, they overflow 32 bit for 16 bit images.
+ */
+void reference_gradient_magnitude(image_view* view_gradientx, image_view* view_gradienty, image_view* view_magnitude, unsigned int uint_shift) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    float float_gx = 0.0f;
+    float float_gy = 0.0f;
+
+    for(y = 0; y < view_magnitude->uint_yres; y ++) {
+        for(x = 0; x < view_magnitude->uint_xres; x ++) {
+            float_gx = (float)(int)VIEW_PIXEL(view_gradientx, x, y);
+            float_gy = (float)(int)VIEW_PIXEL(view_gradienty, x, y);
+            VIEW_PIXEL(view_magnitude, x, y) = (unsigned int)(int)(sqrtf(float_gx * float_gx + float_gy * float_gy) + 0.5f) >> uint_shift;
+        }
+    }
+
+    return;
+}
+
+
+/* The magnitude is not under test, it is the input of the NMS. */
+void reference_magnitude(verify_data* data) {
+    reference_gradient_magnitude(&data->view_gradientx, &data->view_gradienty, &data->view_magnitude, 0);
+
+    return;
+}
+
+
+/*
+ * Keep a pixel if it is a maximum along its gradient direction.
+ * The direction is mapped onto 0 ... 8, one unit is 22.5 degrees.
+ * Note that the direction tests of the diagonals and of 90 degrees
+ * accept every direction, we reproduce gradient_nms() as it is.
+ */
+void reference_suppress(image_view* view_mag, image_view* view_gradientx, image_view* view_gradienty, image_view* view_out) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int m = 0;
+    float float_direction = 0.0f;
+    int int_keep = 0;
+
+    for(y = 1; y + 1 < view_mag->uint_yres; y ++) {
+        for(x = 1; x + 1 < view_mag->uint_xres; x ++) {
+            m = VIEW_PIXEL(view_mag, x, y);
+            if(m == 0) continue;
+
+            float_direction = (fmodf(atan2((float)VIEW_PIXEL(view_gradienty, x, y), (float)VIEW_PIXEL(view_gradientx, x, y)) + M_PI, M_PI) / M_PI) * 8.0f;
+
+            int_keep = ((float_direction <= 1 || float_direction > 7) && m >= VIEW_PIXEL(view_mag, x + 1, y) && m > VIEW_PIXEL(view_mag, x - 1, y)) ||
+                (m > VIEW_PIXEL(view_mag, x - 1, y - 1) && m > VIEW_PIXEL(view_mag, x + 1, y + 1)) ||
+                (m >= VIEW_PIXEL(view_mag, x, y + 1) && m > VIEW_PIXEL(view_mag, x, y - 1)) ||
+                (m > VIEW_PIXEL(view_mag, x + 1, y - 1) && m > VIEW_PIXEL(view_mag, x - 1, y + 1));
+
+            VIEW_PIXEL(view_out, x, y) = int_keep ? m : 0;
+        }
+    }
+
+    return;
+}
+
+
+void reference_nms(verify_data* data, image_view* view_out) {
+    reference_suppress(&data->view_magnitude, &data->view_gradientx, &data->view_gradienty, view_out);
+
+    return;
+}
+
+
+/*
+ * The edges of the unsigned int stages of edge_detection.c: the
+ * suppression above and the recursive hysteresis of trace_edges().
+ * canny() has to find the same edges with its 16 bit intermediates.
+ */
+void reference_canny(verify_data* data, image_view* view_out) {
+    reference_nms(data, view_out);
+    trace_edges(view_out, &data->view_magnitude, VERIFY_CANNY_TMIN * data->view_input.uint_max, VERIFY_CANNY_TMAX * data->view_input.uint_max);
+
+    return;
+}
+
+
+/*
+ * The edges of canny_u16() on the input scaled to 16 bits. The canny
+ * kernel checks its stages against the ones above, so it is the
+ * reference of the streaming detector, which has no images of its own
+ * to compare stage by stage.
+ */
+void reference_canny_u16(verify_data* data, image_view* view_out) {
+    image image_edges;
+    image_u16 image_input;
+    unsigned int y = 0;
+    image_arena arena_scratch;
+
+    if(allocate_arena(&arena_scratch, 0) != 0) return;
+    if(allocate_image_u16(&image_input, data->view_wide.uint_xres, data->view_wide.uint_yres, 0) == 0) {
+        if(view_to_u16(&data->view_wide, &image_input) == 0) {
+            canny_u16(&image_input, &image_edges, VERIFY_CANNY_TMIN * data->view_wide.uint_max, VERIFY_CANNY_TMAX * data->view_wide.uint_max, NULL, &arena_scratch);
+            for(y = 0; y < view_out->uint_yres; y ++) {
+                memcpy(VIEW_ROW(view_out, y), image_edges.int_image_data[y], view_out->uint_xres * sizeof(unsigned int));
+            }
+            free_image_p2(&image_edges);
+        }
+        free_image_u16(&image_input);
+    }
+    free_arena(&arena_scratch);
+
+    return;
+}
+
+
+/*
+ * Hysteresis as connected components: a suppressed pixel above tmin
+ * becomes an edge if it is 8-connected through such pixels to one
+ * above tmax. This is trace_edges() without its limit on the length
+ * of an edge, the pixels are followed with a stack instead of recursion.
+ */
+void reference_hysteresis(image_view* view_edges, image_view* view_mag, unsigned int uint_tmin, unsigned int uint_tmax) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int uint_x = 0;
+    unsigned int uint_y = 0;
+    int i = 0;
+    int j = 0;
+    size_t size_t_top = 0;
+    size_t* size_t_stack = (size_t*)malloc((size_t)view_edges->uint_xres * view_edges->uint_yres * sizeof(size_t));
+
+    if(size_t_stack == NULL) return;
+
+    for(y = 1; y + 1 < view_edges->uint_yres; y ++) {
+        for(x = 1; x + 1 < view_edges->uint_xres; x ++) {
+            if(VIEW_PIXEL(view_mag, x, y) <= uint_tmax || VIEW_PIXEL(view_edges, x, y) != 0) continue;
+
+            VIEW_PIXEL(view_edges, x, y) = 255;
+            size_t_stack[size_t_top ++] = (size_t)y * view_edges->uint_xres + x;
+            while(size_t_top > 0) {
+                size_t_top --;
+                uint_x = size_t_stack[size_t_top] % view_edges->uint_xres;
+                uint_y = size_t_stack[size_t_top] / view_edges->uint_xres;
+                for(i = -1; i <= 1; i ++) {
+                    for(j = -1; j <= 1; j ++) {
+                        if(uint_x + j < 1 || uint_y + i < 1 || uint_x + j + 1 >= view_edges->uint_xres || uint_y + i + 1 >= view_edges->uint_yres) continue;
+                        if(VIEW_PIXEL(view_mag, uint_x + j, uint_y + i) <= uint_tmin || VIEW_PIXEL(view_edges, uint_x + j, uint_y + i) != 0) continue;
+                        VIEW_PIXEL(view_edges, uint_x + j, uint_y + i) = 255;
+                        size_t_stack[size_t_top ++] = (size_t)(uint_y + i) * view_edges->uint_xres + uint_x + j;
+                    }
+                }
+            }
+        }
+    }
+    free(size_t_stack);
+
+    return;
+}
+
+
+/*
+ * The stages above on the input scaled to 16 bits, with the magnitude
+ * and the thresholds shifted like canny_u16() and the hysteresis as
+ * connected components. The parallel hysteresis does not stop after
+ * MAX_RECURSIONS pixels, so this is where it has to match.
+ */
+void reference_canny_components(verify_data* data, image_view* view_out) {
+    static const int int_xweights[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
+    static const int int_yweights[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
+    unsigned int uint_shift = magnitude_shift(data->view_wide.uint_max);
+    image image_blurred;
+    image image_gradientx;
+    image image_gradienty;
+    image image_magnitude;
+    image_view view_blurred;
+    image_view view_gradientx;
+    image_view view_gradienty;
+    image_view view_magnitude;
+
+    allocate_like(data, &image_blurred, &view_blurred);
+    allocate_like(data, &image_gradientx, &view_gradientx);
+    allocate_like(data, &image_gradienty, &view_gradienty);
+    allocate_like(data, &image_magnitude, &view_magnitude);
+
+    reference_blur(&data->view_wide, &view_blurred);
+    reference_sobel(&view_blurred, &view_gradientx, int_xweights);
+    reference_sobel(&view_blurred, &view_gradienty, int_yweights);
+    reference_gradient_magnitude(&view_gradientx, &view_gradienty, &view_magnitude, uint_shift);
+    reference_suppress(&view_magnitude, &view_gradientx, &view_gradienty, view_out);
+    reference_hysteresis(view_out, &view_magnitude, (VERIFY_CANNY_TMIN * data->view_wide.uint_max) >> uint_shift, (VERIFY_CANNY_TMAX * data->view_wide.uint_max) >> uint_shift);
+
+    free_image_p2(&image_blurred);
+    free_image_p2(&image_gradientx);
+    free_image_p2(&image_gradienty);
+    free_image_p2(&image_magnitude);
+
+    return;
+}
+
+
+/* equalisation straight from the definition, with one bin per grey level */
+void reference_equalise(verify_data* data, image_view* view_out) {
+    image_view* view_in = &data->view_input;
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int i = 0;
+    uint64_t* uint64_cumulative;
+    uint64_t uint64_total = (uint64_t)view_in->uint_xres * view_in->uint_yres;
+    uint64_t uint64_min = 0;
+    uint64_t uint64_range = 0;
+    uint64_t uint64_below = 0;
+
+    uint64_cumulative = (uint64_t*)calloc(view_in->uint_max + 1, sizeof(uint64_t));
+    if(uint64_cumulative == NULL) return;
+
+    for(y = 0; y < view_in->uint_yres; y ++) {
+        for(x = 0; x < view_in->uint_xres; x ++) {
+            uint64_cumulative[MIN(VIEW_PIXEL(view_in, x, y), view_in->uint_max)] ++;
+        }
+    }
+    for(i = 1; i <= view_in->uint_max; i ++) {
+        uint64_cumulative[i] += uint64_cumulative[i - 1];
+    }
+
+    /* the count of the darkest grey level in the image */
+    for(i = 0; i <= view_in->uint_max; i ++) {
+        if(uint64_cumulative[i] > 0) {
+            uint64_min = uint64_cumulative[i];
+            break;
+        }
+    }
+    uint64_range = MAX(uint64_total - uint64_min, 1);
+
+    for(y = 0; y < view_in->uint_yres; y ++) {
+        for(x = 0; x < view_in->uint_xres; x ++) {
+            uint64_below = uint64_cumulative[MIN(VIEW_PIXEL(view_in, x, y), view_in->uint_max)];
+            VIEW_PIXEL(view_out, x, y) = (uint64_below <= uint64_min) ? 0 :
+                (unsigned int)(((uint64_below - uint64_min) * view_in->uint_max + uint64_range / 2) / uint64_range);
+        }
+    }
+
+    free(uint64_cumulative);
+
+    return;
+}
+
+
+/* the grey level of a colour pixel, with the weights of ITU-R BT.601 */
+void reference_grey(verify_data* data, image_view* view_out) {
+    unsigned char* uchar_pixel;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        for(x = 0; x < view_out->uint_xres; x ++) {
+            uchar_pixel = RGB_PIXEL(&data->image_colour, x, y);
+            VIEW_PIXEL(view_out, x, y) = (unsigned int)floor(0.299 * uchar_pixel[RGB_RED] +
+                0.587 * uchar_pixel[RGB_GREEN] + 0.114 * uchar_pixel[RGB_BLUE] + 0.5);
+        }
+    }
+
+    return;
+}
+
+
+/* the green channel of the colour image */
+void reference_green(verify_data* data, image_view* view_out) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        for(x = 0; x < view_out->uint_xres; x ++) {
+            VIEW_PIXEL(view_out, x, y) = RGB_PIXEL(&data->image_colour, x, y)[RGB_GREEN];
+        }
+    }
+
+    return;
+}
+
+
+/* The Hough map with one theta bin per column and one rho bin per
+ * row, so it has the size of the input. The bins are clipped like
+ * the 16 bit bins of the compact accumulator.
+ */
+void reference_hough(verify_data* data, image_view* view_out) {
+    image image_houghmap;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    hough_transform(&data->image_edgemap, &image_houghmap, view_out->uint_xres, view_out->uint_yres);
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        for(x = 0; x < view_out->uint_xres; x ++) {
+            VIEW_PIXEL(view_out, x, y) = MIN(image_houghmap.int_image_data[y][x], UINT16_MAX);
+        }
+    }
+    free_image_p2(&image_houghmap);
+
+    return;
+}
+
+
+/* The circle centre votes, one pixel after the other. The bright half
+ * of the grey levels are the edges, every edge pixel off the Sobel
+ * border votes along its gradient in the blurred image.
+ */
+void reference_circles(verify_data* data, image_view* view_out) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    int r = 0;
+    int int_sign = 0;
+    int int_cx = 0;
+    int int_cy = 0;
+    float float_gx = 0.0f;
+    float float_gy = 0.0f;
+    float float_magnitude = 0.0f;
+    float float_dx = 0.0f;
+    float float_dy = 0.0f;
+
+    for(y = 1; y + 1 < data->view_input.uint_yres; y ++) {
+        for(x = 1; x + 1 < data->view_input.uint_xres; x ++) {
+            if(data->image_edgemap.int_image_data[y][x] != 255) continue;
+
+            float_gx = (float)sobel_gx(&data->view_filtered, x, y);
+            float_gy = (float)sobel_gy(&data->view_filtered, x, y);
+            float_magnitude = sqrtf(float_gx * float_gx + float_gy * float_gy);
+            if(float_magnitude == 0.0f) continue;
+            float_dx = float_gx / float_magnitude;
+            float_dy = float_gy / float_magnitude;
+
+            for(int_sign = -1; int_sign <= 1; int_sign += 2) {
+                for(r = VERIFY_CIRCLE_RMIN; r <= VERIFY_CIRCLE_RMAX; r ++) {
+                    int_cx = (int)floorf((float)x + (float)(int_sign * r) * float_dx + 0.5f);
+                    int_cy = (int)floorf((float)y + (float)(int_sign * r) * float_dy + 0.5f);
+                    if(int_cx < 0 || int_cy < 0 || int_cx >= (int)view_out->uint_xres || int_cy >= (int)view_out->uint_yres) continue;
+                    if(VIEW_PIXEL(view_out, int_cx, int_cy) < UINT16_MAX) VIEW_PIXEL(view_out, int_cx, int_cy) ++;
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+
+/*-----------------------
+ * KERNELS UNDER TEST
+ *---------------------*/
+
+void optimised_gaussian(verify_data* data, image_view* view_out) {
+    filter_image(&data->view_input, view_out, KERNEL_GAUSSIAN_SIZE, KERNEL_GAUSSIAN_SIZE, gaussian_filter, 255);
+
+    return;
+}
+
+
+/* the blurred rows of canny_u16() */
+void optimised_gaussian_u16(verify_data* data, image_view* view_out) {
+    image_u16 image_input;
+    uint16_t* uint16_blurred;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    if(allocate_image_u16(&image_input, data->view_wide.uint_xres, data->view_wide.uint_yres, 0) != 0) return;
+    uint16_blurred = (uint16_t*)malloc(data->view_wide.uint_xres * sizeof(uint16_t));
+    if(uint16_blurred != NULL && view_to_u16(&data->view_wide, &image_input) == 0) {
+        for(y = 0; y < view_out->uint_yres; y ++) {
+            gaussian_row_u16(&image_input, uint16_blurred, y);
+            for(x = 0; x < view_out->uint_xres; x ++) {
+                VIEW_PIXEL(view_out, x, y) = uint16_blurred[x];
+            }
+        }
+    }
+    free(uint16_blurred);
+    free_image_u16(&image_input);
+
+    return;
+}
+
+
+void optimised_sobel_gx(verify_data* data, image_view* view_out) {
+    filter_image(&data->view_filtered, view_out, KERNEL_SOBEL_SIZE, KERNEL_SOBEL_SIZE, sobel_gx, 0);
+
+    return;
+}
+
+
+void optimised_sobel_gy(verify_data* data, image_view* view_out) {
+    filter_image(&data->view_filtered, view_out, KERNEL_SOBEL_SIZE, KERNEL_SOBEL_SIZE, sobel_gy, 0);
+
+    return;
+}
+
+
+void optimised_nms(verify_data* data, image_view* view_out) {
+    gradient_nms(view_out, &data->view_gradientx, &data->view_gradienty, &data->view_magnitude);
+
+    return;
+}
+
+
+void optimised_canny(verify_data* data, image_view* view_out) {
+    image image_edges;
+    image_arena arena_scratch;
+    unsigned int y = 0;
+
+    if(allocate_arena(&arena_scratch, 0) != 0) return;
+    canny(&data->view_input, &image_edges, VERIFY_CANNY_TMIN * data->view_input.uint_max, VERIFY_CANNY_TMAX * data->view_input.uint_max, NULL, &arena_scratch);
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        memcpy(VIEW_ROW(view_out, y), image_edges.int_image_data[y], view_out->uint_xres * sizeof(unsigned int));
+    }
+    free_image_p2(&image_edges);
+    free_arena(&arena_scratch);
+
+    return;
+}
+
+
+/* equalisation works in place, so we hand it a copy of the input */
+/* the streaming detector on the 16 bit input, on uint_threads threads */
+void streaming_canny(verify_data* data, image_view* view_out, unsigned int uint_threads) {
+    image image_edges;
+    image_arena arena_scratch;
+    unsigned int y = 0;
+
+    if(allocate_arena(&arena_scratch, 0) != 0) return;
+    if(canny_streaming(&data->view_wide, &image_edges, VERIFY_CANNY_TMIN * data->view_wide.uint_max, VERIFY_CANNY_TMAX * data->view_wide.uint_max, uint_threads, &arena_scratch) == 0) {
+        for(y = 0; y < view_out->uint_yres; y ++) {
+            memcpy(VIEW_ROW(view_out, y), image_edges.int_image_data[y], view_out->uint_xres * sizeof(unsigned int));
+        }
+        free_image_p2(&image_edges);
+    }
+    free_arena(&arena_scratch);
+
+    return;
+}
+
+
+void optimised_canny_streaming(verify_data* data, image_view* view_out) {
+    streaming_canny(data, view_out, 0);
+
+    return;
+}
+
+
+void optimised_canny_parallel(verify_data* data, image_view* view_out) {
+    streaming_canny(data, view_out, VERIFY_HYSTERESIS_THREADS);
+
+    return;
+}
+
+
+void optimised_equalise(verify_data* data, image_view* view_out) {
+    histogram histogram_input;
+    unsigned int y = 0;
+
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        memcpy(VIEW_ROW(view_out, y), VIEW_ROW(&data->view_input, y), view_out->uint_xres * sizeof(unsigned int));
+    }
+    view_out->uint_max = data->view_input.uint_max;
+
+    if(allocate_histogram(&histogram_input, data->view_input.uint_max + 1, 0, data->view_input.uint_max) != 0) return;
+    compute_histogram(view_out, &histogram_input);
+    equalise_histogram(view_out, &histogram_input);
+    free_histogram(&histogram_input);
+
+    return;
+}
+
+
+void optimised_rgb_grey(verify_data* data, image_view* view_out) {
+    rgb_to_grey(&data->image_colour, view_out);
+
+    return;
+}
+
+
+void optimised_planar_grey(verify_data* data, image_view* view_out) {
+    image_planar image_planes;
+
+    if(allocate_image_planar(&image_planes, data->image_colour.uint_xres, data->image_colour.uint_yres, data->image_colour.uint_max) != 0) return;
+    rgb_to_planar(&data->image_colour, &image_planes);
+    planar_to_grey(&image_planes, view_out);
+    free_image_planar(&image_planes);
+
+    return;
+}
+
+
+/* the green channel after a round trip through the planar layout */
+void optimised_rgb_planar(verify_data* data, image_view* view_out) {
+    image_planar image_planes;
+    image_rgb image_copy;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    if(allocate_image_planar(&image_planes, data->image_colour.uint_xres, data->image_colour.uint_yres, data->image_colour.uint_max) != 0) return;
+    if(allocate_image_rgb(&image_copy, data->image_colour.uint_xres, data->image_colour.uint_yres, data->image_colour.uint_max) != 0) {
+        free_image_planar(&image_planes);
+        return;
+    }
+    rgb_to_planar(&data->image_colour, &image_planes);
+    planar_to_rgb(&image_planes, &image_copy);
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        for(x = 0; x < view_out->uint_xres; x ++) {
+            VIEW_PIXEL(view_out, x, y) = RGB_PIXEL(&image_copy, x, y)[RGB_GREEN];
+        }
+    }
+    free_image_rgb(&image_copy);
+    free_image_planar(&image_planes);
+
+    return;
+}
+
+
+/* the red channel of the colour image is the input, see prepare_verify_data() */
+void optimised_gaussian_planar(verify_data* data, image_view* view_out) {
+    image_planar image_planes;
+    image_planar image_filtered;
+    unsigned int y = 0;
+
+    if(allocate_image_planar(&image_planes, data->image_colour.uint_xres, data->image_colour.uint_yres, data->image_colour.uint_max) != 0) return;
+    if(allocate_image_planar(&image_filtered, data->image_colour.uint_xres, data->image_colour.uint_yres, data->image_colour.uint_max) != 0) {
+        free_image_planar(&image_planes);
+        return;
+    }
+    rgb_to_planar(&data->image_colour, &image_planes);
+    filter_planar(&image_planes, &image_filtered, KERNEL_GAUSSIAN_SIZE, KERNEL_GAUSSIAN_SIZE, gaussian_filter, 255);
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        memcpy(VIEW_ROW(view_out, y), image_filtered.image_channels[RGB_RED].int_image_data[y], view_out->uint_xres * sizeof(unsigned int));
+    }
+    free_image_planar(&image_filtered);
+    free_image_planar(&image_planes);
+
+    return;
+}
+
+
+/* the compact accumulator has one row per theta bin */
+void optimised_hough(verify_data* data, image_view* view_out) {
+    image_u16 image_houghmap;
+    image_view view_edgemap;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    view_image_p2(&data->image_edgemap, &view_edgemap);
+    if(hough_transform_u16(&view_edgemap, &image_houghmap, view_out->uint_xres, view_out->uint_yres, 1, 0.0f) != 0) return;
+    for(y = 0; y < view_out->uint_yres; y ++) {
+        for(x = 0; x < view_out->uint_xres; x ++) {
+            VIEW_PIXEL(view_out, x, y) = U16_PIXEL(&image_houghmap, y, x);
+        }
+    }
+    free_image_u16(&image_houghmap);
+
+    return;
+}
+
+
+/* the centre accumulator of hough_circles(), voted for on several threads */
+void optimised_circles(verify_data* data, image_view* view_out) {
+    image_arena arena_scratch;
+    image_u16 image_input;
+    image_u16 image_centres;
+    image_view view_edges;
+    circle_point* point_edges;
+    unsigned int x = 0;
+    unsigned int y = 0;
+
+    allocate_arena(&arena_scratch, 0);
+    view_image_p2(&data->image_edgemap, &view_edges);
+    if(arena_allocate_u16(&arena_scratch, &image_input, data->view_input.uint_xres, data->view_input.uint_yres, 0) == 0 &&
+        view_to_u16(&data->view_input, &image_input) == 0 &&
+        circle_centre_votes(&image_input, &view_edges, &image_centres, &point_edges, VERIFY_CIRCLE_RMIN, VERIFY_CIRCLE_RMAX, VERIFY_CIRCLE_THREADS, &arena_scratch) >= 0) {
+        for(y = 0; y < view_out->uint_yres; y ++) {
+            for(x = 0; x < view_out->uint_xres; x ++) {
+                VIEW_PIXEL(view_out, x, y) = U16_PIXEL(&image_centres, x, y);
+            }
+        }
+    }
+    free_arena(&arena_scratch);
+
+    return;
+}
+
+
+static verify_kernel kernels[] = {
+    {"gaussian", reference_gaussian, optimised_gaussian, 0},
+    {"gaussian_u16", reference_gaussian_u16, optimised_gaussian_u16, 0},
+    {"sobel_gx", reference_sobel_gx, optimised_sobel_gx, 0},
+    {"sobel_gy", reference_sobel_gy, optimised_sobel_gy, 0},
+    {"nms", reference_nms, optimised_nms, 0},
+    {"canny", reference_canny, optimised_canny, 0},
+    {"canny_streaming", reference_canny_u16, optimised_canny_streaming, 0},
+    {"canny_parallel", reference_canny_components, optimised_canny_parallel, 0},
+    {"hough", reference_hough, optimised_hough, 0},
+    {"circles", reference_circles, optimised_circles, 0},
+    {"equalise", reference_equalise, optimised_equalise, 0},
+    {"rgb_grey", reference_grey, optimised_rgb_grey, 1},
+    {"planar_grey", reference_grey, optimised_planar_grey, 1},
+    {"rgb_planar", reference_green, optimised_rgb_planar, 0},
+    {"gaussian_planar", reference_gaussian, optimised_gaussian_planar, 0},
+};
+
+#define VERIFY_NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+
+/*-----------------------
+ * INPUT DATA
+ *---------------------*/
+
+/* xorshift, so the fuzz images are the same on every machine */
+uint32_t verify_random(uint32_t* uint32_state) {
+    *uint32_state ^= *uint32_state << 13;
+    *uint32_state ^= *uint32_state >> 17;
+    *uint32_state ^= *uint32_state << 5;
+
+    return(*uint32_state);
+}
+
+
+/*
+ * A random image. Small sizes are likely, so the borders get tested
+ * as well. The content is noise, a ramp, a constant or a few spikes
+ * on black, with 2, 16 or 256 grey levels.
+ */
+int fuzz_image(image* image_fuzz, uint32_t* uint32_state, char* char_name, int int_number) {
+    static const unsigned int uint_levels[3] = {1, 15, 255};
+    unsigned int uint_xres = 1 + verify_random(uint32_state) % ((verify_random(uint32_state) % 4 == 0) ? 8 : VERIFY_FUZZ_MAX_SIZE);
+    unsigned int uint_yres = 1 + verify_random(uint32_state) % ((verify_random(uint32_state) % 4 == 0) ? 8 : VERIFY_FUZZ_MAX_SIZE);
+    unsigned int uint_max = uint_levels[verify_random(uint32_state) % 3];
+    unsigned int uint_mode = verify_random(uint32_state) % 4;
+    unsigned int uint_constant = verify_random(uint32_state) % (uint_max + 1);
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int* uint_pixel;
+
+    if(allocate_image_p2(image_fuzz, uint_xres, uint_yres, 0) != 0) return(-1);
+    image_fuzz->uint_max = uint_max;
+
+    for(y = 0; y < uint_yres; y ++) {
+        for(x = 0; x < uint_xres; x ++) {
+            uint_pixel = &image_fuzz->int_image_data[y][x];
+            switch(uint_mode) {
+                case 0: *uint_pixel = verify_random(uint32_state) % (uint_max + 1); break;
+                case 1: *uint_pixel = (x + y) * uint_max / (uint_xres + uint_yres); break;
+                case 2: *uint_pixel = uint_constant; break;
+                default: *uint_pixel = (verify_random(uint32_state) % 16 == 0) ? uint_max : 0; break;
+            }
+        }
+    }
+
+    snprintf(char_name, VERIFY_NAME_LENGTH, "fuzz%d_%ux%u_max%u_mode%u", int_number, uint_xres, uint_yres, uint_max, uint_mode);
+
+    return(0);
+}
+
+
+void allocate_like(verify_data* data, image* image_new, image_view* view_new) {
+    allocate_image_p2(image_new, data->image_input.uint_xres, data->image_input.uint_yres, 0);
+    view_image_p2(image_new, view_new);
+
+    return;
+}
+
+
+/* the reference results every later stage starts from */
+void prepare_verify_data(verify_data* data) {
+    size_t size_t_j = 0;
+    size_t size_t_pixels = (size_t)data->image_input.uint_xres * data->image_input.uint_yres;
+    unsigned int uint_grey = 0;
+
+    view_image_p2(&data->image_input, &data->view_input);
+    allocate_like(data, &data->image_reference, &data->view_reference);
+    allocate_like(data, &data->image_optimised, &data->view_optimised);
+    allocate_like(data, &data->image_filtered, &data->view_filtered);
+    allocate_like(data, &data->image_gradientx, &data->view_gradientx);
+    allocate_like(data, &data->image_gradienty, &data->view_gradienty);
+    allocate_like(data, &data->image_magnitude, &data->view_magnitude);
+    allocate_image_p2(&data->image_edgemap, data->image_input.uint_xres, data->image_input.uint_yres, 0);
+    allocate_image_p2(&data->image_wide, data->image_input.uint_xres, data->image_input.uint_yres, 0);
+
+    reference_gaussian(data, &data->view_filtered);
+    reference_sobel_gx(data, &data->view_gradientx);
+    reference_sobel_gy(data, &data->view_gradienty);
+    reference_magnitude(data);
+
+    /* the dark half of the grey levels votes in the Hough transform */
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        data->image_edgemap.int_image_data[0][size_t_j] = (data->image_input.int_image_data[0][size_t_j] * 2 < data->image_input.uint_max) ? 0 : 255;
+    }
+    data->image_edgemap.uint_max = 255;
+
+    /* the input stretched to 16 bits, like a P5 file with 2 bytes per pixel */
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        data->image_wide.int_image_data[0][size_t_j] = data->image_input.int_image_data[0][size_t_j] * (UINT16_MAX / MAX(data->image_input.uint_max, 1));
+    }
+    data->image_wide.uint_max = data->image_input.uint_max * (UINT16_MAX / MAX(data->image_input.uint_max, 1));
+    view_image_p2(&data->image_wide, &data->view_wide);
+
+    /* a colour image with three different channels made from the input */
+    allocate_image_rgb(&data->image_colour, data->image_input.uint_xres, data->image_input.uint_yres, 255);
+    for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+        uint_grey = data->image_input.int_image_data[0][size_t_j] & 255;
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_RED] = uint_grey;
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_GREEN] = (37 * uint_grey + size_t_j) & 255;
+        data->image_colour.uchar_rgb[RGB_CHANNELS * size_t_j + RGB_BLUE] = 255 - uint_grey;
+    }
+
+    return;
+}
+
+
+void free_verify_data(verify_data* data) {
+    free_image_p2(&data->image_input);
+    free_image_p2(&data->image_reference);
+    free_image_p2(&data->image_optimised);
+    free_image_p2(&data->image_filtered);
+    free_image_p2(&data->image_gradientx);
+    free_image_p2(&data->image_gradienty);
+    free_image_p2(&data->image_magnitude);
+    free_image_p2(&data->image_edgemap);
+    free_image_p2(&data->image_wide);
+    free_image_rgb(&data->image_colour);
+
+    return;
+}
+
+
+/*-----------------------
+ * COMPARISON
+ *---------------------*/
+
+void clear_view(image_view* view) {
+    unsigned int y = 0;
+
+    for(y = 0; y < view->uint_yres; y ++) {
+        memset(VIEW_ROW(view, y), 0, view->uint_xres * sizeof(unsigned int));
+    }
+
+    return;
+}
+
+
+/*
+ * Run both implementations of a kernel and compare them.
+ * Returns 0 if they match within the tolerance.
+ */
+int verify_kernel_run(verify_kernel* kernel, verify_data* data, int int_verbose) {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int uint_expected = 0;
+    unsigned int uint_got = 0;
+    unsigned int uint_difference = 0;
+    unsigned int uint_first_x = 0;
+    unsigned int uint_first_y = 0;
+    unsigned int uint_first_expected = 0;
+    unsigned int uint_first_got = 0;
+    size_t size_t_mismatches = 0;
+
+    clear_view(&data->view_reference);
+    clear_view(&data->view_optimised);
+    kernel->reference(data, &data->view_reference);
+    kernel->optimised(data, &data->view_optimised);
+
+    for(y = 0; y < data->view_reference.uint_yres; y ++) {
+        for(x = 0; x < data->view_reference.uint_xres; x ++) {
+            uint_expected = VIEW_PIXEL(&data->view_reference, x, y);
+            uint_got = VIEW_PIXEL(&data->view_optimised, x, y);
+            uint_difference = (uint_expected > uint_got) ? uint_expected - uint_got : uint_got - uint_expected;
+            if(uint_difference <= kernel->uint_tolerance) continue;
+
+            if(size_t_mismatches == 0) {
+                uint_first_x = x;
+                uint_first_y = y;
+                uint_first_expected = uint_expected;
+                uint_first_got = uint_got;
+            }
+            size_t_mismatches ++;
+        }
+    }
+
+    if(size_t_mismatches > 0) {
+        printf("FAIL %s %s: %zu pixels differ by more than %u, first at x: %u, y: %u, expected: %u, got: %u\n",
+            kernel->char_name, data->char_name, size_t_mismatches, kernel->uint_tolerance,
+            uint_first_x, uint_first_y, uint_first_expected, uint_first_got);
+        return(-1);
+    }
+
+    if(int_verbose) printf("ok   %s %s\n", kernel->char_name, data->char_name);
+
+    return(0);
+}
+
+
+/* run all kernels on one input, returns the number of failures */
+int verify_input(verify_data* data, int int_verbose) {
+    int k = 0;
+    int int_failures = 0;
+
+    prepare_verify_data(data);
+    for(k = 0; k < (int)VERIFY_NUM_KERNELS; k ++) {
+        int_failures += (verify_kernel_run(&kernels[k], data, int_verbose) != 0);
+    }
+    free_verify_data(data);
+
+    return(int_failures);
+}
+
+
+/* -t name=levels sets the tolerance of a kernel */
+int set_tolerance(char* char_option) {
+    int k = 0;
+    char* char_value = strchr(char_option, '=');
+
+    if(char_value == NULL) return(-1);
+
+    for(k = 0; k < (int)VERIFY_NUM_KERNELS; k ++) {
+        if(strncmp(kernels[k].char_name, char_option, char_value - char_option) == 0 &&
+            kernels[k].char_name[char_value - char_option] == '\0') {
+            kernels[k].uint_tolerance = strtoul(char_value + 1, NULL, 10);
+            return(0);
+        }
+    }
+
+    return(-1);
+}
+
+
+void print_verify_usage(char* char_program) {
+    fprintf(stderr, "Usage: %s [options] [image.pgm ...]\n"
+        "  -f <images>       number of random fuzz images (default %d)\n"
+        "  -s <seed>         seed of the fuzz images (default %d)\n"
+        "  -t <kernel>=<n>   accept differences up to n grey levels\n"
+        "  -v                also report the kernels that match\n"
+        "Kernels: gaussian, gaussian_u16, sobel_gx, sobel_gy, nms, canny,\n"
+        "  canny_streaming, canny_parallel, hough, circles, equalise,\n"
+        "  rgb_grey, planar_grey, rgb_planar, gaussian_planar.\n"
+        "The exit status is 1 if any kernel does not match its reference.\n",
+        char_program, VERIFY_FUZZ_IMAGES, VERIFY_SEED);
+
+    return;
+}
+
+
+int main(int argc, char *argv[]) {
+    int i = 0;
+    int int_option = 0;
+    int int_fuzz_images = VERIFY_FUZZ_IMAGES;
+    int int_verbose = 0;
+    int int_failures = 0;
+    int int_inputs = 0;
+    uint32_t uint32_state = VERIFY_SEED;
+    verify_data data;
+
+    while((int_option = getopt(argc, argv, "f:s:t:vh")) != -1) {
+        switch(int_option) {
+            case 'f': int_fuzz_images = MAX(atoi(optarg), 0); break;
+            case 's': uint32_state = strtoul(optarg, NULL, 10); break;
+            case 't':
+                if(set_tolerance(optarg) != 0) {
+                    print_verify_usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'v': int_verbose = 1; break;
+            default:
+                print_verify_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    /* xorshift must not start at 0 */
+    if(uint32_state == 0) uint32_state = VERIFY_SEED;
+
+    for(i = optind; i < argc; i ++) {
+        memset(&data, 0, sizeof(verify_data));
+        if(read_image_p2(argv[i], &data.image_input) != 0) {
+            fprintf(stderr, "Unable to read %s\n", argv[i]);
+            int_failures ++;
+            continue;
+        }
+        snprintf(data.char_name, VERIFY_NAME_LENGTH, "%s", argv[i]);
+        int_failures += verify_input(&data, int_verbose);
+        int_inputs ++;
+    }
+
+    for(i = 0; i < int_fuzz_images; i ++) {
+        memset(&data, 0, sizeof(verify_data));
+        if(fuzz_image(&data.image_input, &uint32_state, data.char_name, i) != 0) {
+            int_failures ++;
+            continue;
+        }
+        int_failures += verify_input(&data, int_verbose);
+        int_inputs ++;
+    }
+
+    printf("%d inputs, %d kernels, %d failures\n", int_inputs, (int)VERIFY_NUM_KERNELS, int_failures);
+
+    return(int_failures > 0 ? 1 : 0);
+}
@@ -0,0 +1,66 @@
+/*-----------------------------------------
+ * Bit digit functions
+ * Expand bytes into their 8 ASCII digits with
+ * a table look-up and pack 8 digits into a
+ * byte with a single multiplication.
+ *---------------------------------------*/
+
+
+/* Include our routines for the digits of bytes. */
+#include "bit_digits.h"
+
+
+/* the 8 ASCII digits of every byte, the most significant bit first */
+static char char_digits_table[256][BITS_PER_BYTE];
+
+
+/* "public" function */
+void allocate_digits_table(void) {
+    int i = 0;
+    int k = 0;
+
+    for(i = 0; i < 256; i ++) {
+        for(k = 0; k < BITS_PER_BYTE; k ++) {
+            char_digits_table[i][k] = ASCII_ZERO + ((i >> (BITS_PER_BYTE - 1 - k)) & 1);
+        }
+    }
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Expand size_t_length bytes into 8 ASCII digits each.
+ */
+void bytes_to_digits(const unsigned char* uchar_bytes, size_t size_t_length,
+    char* char_digits) {
+    size_t size_t_i = 0;
+
+    for(size_t_i = 0; size_t_i < size_t_length; size_t_i ++) {
+        memcpy(char_digits + size_t_i * BITS_PER_BYTE, char_digits_table[uchar_bytes[size_t_i]], BITS_PER_BYTE);
+    }
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Pack 8 ASCII digits each into size_t_length bytes. Only the lowest
+ * bit of a digit is used, so the digits are not checked.
+ */
+void digits_to_bytes(const char* char_digits, size_t size_t_length,
+    unsigned char* uchar_bytes) {
+    size_t size_t_i = 0;
+    uint64_t uint64_digits = 0;
+
+    for(size_t_i = 0; size_t_i < size_t_length; size_t_i ++) {
+        memcpy(&uint64_digits, char_digits + size_t_i * BITS_PER_BYTE, BITS_PER_BYTE);
+        uchar_bytes[size_t_i] = PACK_DIGITS(uint64_digits);
+    }
+
+    return;
+}
@@ -0,0 +1,51 @@
+/*
+ * Function definitions to convert bytes into ASCII digits '0' and '1'
+ * and back, the most significant bit first. A P4 bitmap row becomes a
+ * P1 row this way, and the bytes of a binary file become text.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __BIT_DIGITS__
+#define __BIT_DIGITS__
+
+
+/*
+ * System level includes
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+#define BITS_PER_BYTE 8
+#define ASCII_ZERO 48
+
+
+/*
+ * Eight digits loaded into a 64 bit word. Every byte of the word is
+ * '0' or '1' if only its lowest bit differs from DIGITS_ZERO.
+ * Multiplying the lowest bits by PACK_BITS_MULTIPLIER moves the bit of
+ * byte k to bit 7 - k of the top byte, so PACK_DIGITS() packs all eight
+ * digits into their byte with a single multiplication.
+ */
+#define DIGITS_ZERO 0x3030303030303030ull
+#define DIGITS_LOW_BIT 0x0101010101010101ull
+#define PACK_BITS_MULTIPLIER 0x8040201008040201ull
+#define PACK_DIGITS(UINT64_DIGITS) ((unsigned char)((((UINT64_DIGITS) & DIGITS_LOW_BIT) * PACK_BITS_MULTIPLIER) >> 56))
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ * Call allocate_digits_table() once before bytes_to_digits().
+ */
+void allocate_digits_table(void);
+void bytes_to_digits(const unsigned char* uchar_bytes, size_t size_t_length,
+    char* char_digits);
+void digits_to_bytes(const char* char_digits, size_t size_t_length,
+    unsigned char* uchar_bytes);
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * Find out which of the CPU_DISPATCH clones runs on this CPU.
+ */
+#include "cpu_dispatch.h"
+
+
+/*
+ * "Public" function
+ * The instruction set the loader picked for the CPU_DISPATCH
+ * functions. Without dispatching this is always the default.
+ */
+int cpu_dispatch_level(void) {
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(NO_CPU_DISPATCH)
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx512f")) return(CPU_LEVEL_AVX512);
+    if(__builtin_cpu_supports("avx2")) return(CPU_LEVEL_AVX2);
+    if(__builtin_cpu_supports("sse4.2")) return(CPU_LEVEL_SSE42);
+#endif
+
+    return(CPU_LEVEL_DEFAULT);
+}
+
+
+/*
+ * "Public" function
+ * A printable name of a level returned by cpu_dispatch_level().
+ */
+const char* cpu_dispatch_name(int int_level) {
+    static const char* char_names[] = {"default", "sse4.2", "avx2", "avx512f"};
+
+    if(int_level < CPU_LEVEL_DEFAULT || int_level > CPU_LEVEL_AVX512) return("unknown");
+
+    return(char_names[int_level]);
+}
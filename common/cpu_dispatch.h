@@ -0,0 +1,61 @@
+/*
+ * Function definitions for picking the fastest code path at run time.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __CPU_DISPATCH__
+#define __CPU_DISPATCH__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/*
+ * The instruction sets we compile the hot loops for,
+ * as returned by cpu_dispatch_level().
+ */
+#define CPU_LEVEL_DEFAULT 0
+#define CPU_LEVEL_SSE42 1
+#define CPU_LEVEL_AVX2 2
+#define CPU_LEVEL_AVX512 3
+
+
+/*
+ * Put CPU_DISPATCH in front of a function with a loop the compiler
+ * can vectorise, e.g.
+ *
+ * CPU_DISPATCH void gradient_magnitude_row(...) { ... }
+ *
+ * GCC then compiles one clone of the function per instruction set
+ * and the loader picks the best one for the CPU we run on. So a
+ * single binary uses AVX-512 where it is available and still runs
+ * on any x86-64. Compile with -DNO_CPU_DISPATCH to get plain
+ * functions, e.g. for a profiler that gets confused by the clones.
+ *
+ * The clones have to give the same results as the default version,
+ * so only use it on integer loops or on float loops without
+ * reductions, and compile with -ffp-contract=off so no clone
+ * fuses a multiply and an add.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && !defined(NO_CPU_DISPATCH)
+#define CPU_DISPATCH __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#else
+#define CPU_DISPATCH
+#endif
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ */
+int cpu_dispatch_level(void);
+const char* cpu_dispatch_name(int int_level);
+
+#endif
@@ -0,0 +1,493 @@
+/*-----------------------------------------
+ * Generic histogram functions
+ * A histogram with an arbitrary number of
+ * bins over an arbitrary range of grey levels
+ * (up to 16 bit) and 64 bit counts.
+ *---------------------------------------*/
+
+
+/* Include our histogram routines. */
+#include "histogram.h"
+
+
+/* "public" function */
+int allocate_histogram(histogram* histogram_data, unsigned int uint_num_bins,
+    unsigned int uint_min, unsigned int uint_max) {
+
+    if(uint_num_bins == 0) {
+        perror("allocate_histogram: The number of bins is zero.\n");
+        return(-1);
+    }
+
+    if(uint_max < uint_min || uint_max > HISTOGRAM_MAX_LEVEL) {
+        perror("allocate_histogram: Invalid range of grey levels given.\n");
+        return(-1);
+    }
+
+    /* there is no point in having more bins than grey levels */
+    if(uint_num_bins > uint_max - uint_min + 1) {
+        perror("allocate_histogram: More bins than grey levels.\n");
+        return(-1);
+    }
+
+    histogram_data->uint_num_bins = uint_num_bins;
+    histogram_data->uint_min = uint_min;
+    histogram_data->uint_max = uint_max;
+    histogram_data->uint64_total = 0;
+
+    /*
+     * calloc sets all counts to zero, so we get
+     * an empty histogram right away.
+     */
+    histogram_data->uint64_bins = (uint64_t*)calloc(uint_num_bins,
+        sizeof(uint64_t));
+    histogram_data->uint64_cumulative = (uint64_t*)calloc(uint_num_bins,
+        sizeof(uint64_t));
+    if(histogram_data->uint64_bins == NULL ||
+        histogram_data->uint64_cumulative == NULL) {
+        perror("allocate_histogram: Error allocating storage space.\n");
+        free(histogram_data->uint64_bins);
+        free(histogram_data->uint64_cumulative);
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_histogram(histogram* histogram_data) {
+    free(histogram_data->uint64_bins);
+    free(histogram_data->uint64_cumulative);
+
+    histogram_data->uint64_bins = NULL;
+    histogram_data->uint64_cumulative = NULL;
+    histogram_data->uint_num_bins = 0;
+
+    return;
+}
+
+
+/* "public" function */
+void clear_histogram(histogram* histogram_data) {
+    memset(histogram_data->uint64_bins, 0,
+        histogram_data->uint_num_bins * sizeof(uint64_t));
+    memset(histogram_data->uint64_cumulative, 0,
+        histogram_data->uint_num_bins * sizeof(uint64_t));
+    histogram_data->uint64_total = 0;
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Map a grey level to its bin. Grey levels outside the
+ * range of the histogram are clamped to the first or last bin.
+ */
+unsigned int histogram_bin(histogram* histogram_data, unsigned int uint_level) {
+    uint64_t uint64_range = (uint64_t)histogram_data->uint_max -
+        histogram_data->uint_min + 1;
+
+    if(uint_level <= histogram_data->uint_min) return(0);
+    if(uint_level >= histogram_data->uint_max) {
+        return(histogram_data->uint_num_bins - 1);
+    }
+
+    return((unsigned int)((uint_level - histogram_data->uint_min) *
+        (uint64_t)histogram_data->uint_num_bins / uint64_range));
+}
+
+
+/*
+ * "public" function
+ *
+ * The lowest grey level that falls into a bin.
+ */
+unsigned int histogram_bin_level(histogram* histogram_data,
+    unsigned int uint_bin) {
+    uint64_t uint64_range = (uint64_t)histogram_data->uint_max -
+        histogram_data->uint_min + 1;
+
+    /* smallest level with level * bins / range >= bin, i.e. a ceiling */
+    return(histogram_data->uint_min + (unsigned int)((uint_bin * uint64_range +
+        histogram_data->uint_num_bins - 1) / histogram_data->uint_num_bins));
+}
+
+
+/*
+ * "public" function
+ *
+ * Add the grey levels of an image (or a region of it)
+ * to the histogram without clearing it first. This allows us
+ * to collect the histogram of an entire image set. Call
+ * update_cumulative_histogram() when you are done.
+ */
+void accumulate_histogram(image_view* view_in, histogram* histogram_data) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    uint64_t* uint64_bins = histogram_data->uint64_bins;
+
+    if(histogram_data->uint_min == 0 && histogram_data->uint_num_bins ==
+        histogram_data->uint_max + 1) {
+        /* one bin per grey level, we can index the bins directly */
+        for(i = 0; i < view_in->uint_yres; i ++) {
+            uint_row = VIEW_ROW(view_in, i);
+            for(j = 0; j < view_in->uint_xres; j ++) {
+                uint64_bins[MIN(uint_row[j], histogram_data->uint_max)] ++;
+            }
+        }
+    } else {
+        for(i = 0; i < view_in->uint_yres; i ++) {
+            uint_row = VIEW_ROW(view_in, i);
+            for(j = 0; j < view_in->uint_xres; j ++) {
+                uint64_bins[histogram_bin(histogram_data, uint_row[j])] ++;
+            }
+        }
+    }
+
+    histogram_data->uint64_total += (uint64_t)view_in->uint_xres *
+        view_in->uint_yres;
+
+    return;
+}
+
+
+/* "public" function */
+int compute_histogram(image_view* view_in, histogram* histogram_data) {
+
+    if(histogram_data->uint64_bins == NULL) {
+        perror("compute_histogram: Histogram not allocated.\n");
+        return(-1);
+    }
+
+    clear_histogram(histogram_data);
+    accumulate_histogram(view_in, histogram_data);
+    update_cumulative_histogram(histogram_data);
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * The histogram of a 16 bit image. Like compute_histogram(),
+ * but we read 2 bytes per pixel instead of 4.
+ */
+int compute_histogram_u16(image_u16* image_in, histogram* histogram_data) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    uint16_t* uint16_row;
+    uint64_t* uint64_bins = histogram_data->uint64_bins;
+
+    if(histogram_data->uint64_bins == NULL) {
+        perror("compute_histogram_u16: Histogram not allocated.\n");
+        return(-1);
+    }
+
+    clear_histogram(histogram_data);
+
+    if(histogram_data->uint_min == 0 && histogram_data->uint_num_bins ==
+        histogram_data->uint_max + 1) {
+        /* one bin per grey level, we can index the bins directly */
+        for(i = 0; i < image_in->uint_yres; i ++) {
+            uint16_row = U16_ROW(image_in, i);
+            for(j = 0; j < image_in->uint_xres; j ++) {
+                uint64_bins[MIN(uint16_row[j], histogram_data->uint_max)] ++;
+            }
+        }
+    } else {
+        for(i = 0; i < image_in->uint_yres; i ++) {
+            uint16_row = U16_ROW(image_in, i);
+            for(j = 0; j < image_in->uint_xres; j ++) {
+                uint64_bins[histogram_bin(histogram_data, uint16_row[j])] ++;
+            }
+        }
+    }
+
+    histogram_data->uint64_total = (uint64_t)image_in->uint_xres *
+        image_in->uint_yres;
+    update_cumulative_histogram(histogram_data);
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * The histogram of a float image. float_min ... float_max is
+ * mapped onto the grey levels uint_min ... uint_max of the
+ * histogram, values outside are clamped and NaN is skipped.
+ * Use f32_range() to cover all pixels.
+ */
+int compute_histogram_f32(image_f32* image_in, histogram* histogram_data,
+    float float_min, float float_max) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    float* float_row;
+    float float_level = 0.0f;
+    float float_scale = 0.0f;
+    uint64_t* uint64_bins = histogram_data->uint64_bins;
+
+    if(histogram_data->uint64_bins == NULL) {
+        perror("compute_histogram_f32: Histogram not allocated.\n");
+        return(-1);
+    }
+
+    if(float_max > float_min) {
+        float_scale = (float)(histogram_data->uint_max - histogram_data->uint_min) /
+            (float_max - float_min);
+    }
+
+    clear_histogram(histogram_data);
+
+    for(i = 0; i < image_in->uint_yres; i ++) {
+        float_row = F32_ROW(image_in, i);
+        for(j = 0; j < image_in->uint_xres; j ++) {
+            if(isnan(float_row[j])) continue;
+            float_level = (float_row[j] - float_min) * float_scale + 0.5f;
+            float_level = MIN(MAX(float_level, 0.0f), (float)(histogram_data->uint_max - histogram_data->uint_min));
+            uint64_bins[histogram_bin(histogram_data, histogram_data->uint_min + (unsigned int)float_level)] ++;
+            histogram_data->uint64_total ++;
+        }
+    }
+
+    update_cumulative_histogram(histogram_data);
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * Compute the prefix sums of the bins. We need these
+ * for all cumulative and percentile queries.
+ */
+void update_cumulative_histogram(histogram* histogram_data) {
+    unsigned int i = 0;
+    uint64_t uint64_sum = 0;
+
+    for(i = 0; i < histogram_data->uint_num_bins; i ++) {
+        uint64_sum += histogram_data->uint64_bins[i];
+        histogram_data->uint64_cumulative[i] = uint64_sum;
+    }
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Number of pixels in all bins below the bin of uint_level.
+ */
+uint64_t histogram_count_below(histogram* histogram_data,
+    unsigned int uint_level) {
+    unsigned int uint_bin = histogram_bin(histogram_data, uint_level);
+
+    if(uint_bin == 0 || uint_level <= histogram_data->uint_min) return(0);
+
+    return(histogram_data->uint64_cumulative[uint_bin - 1]);
+}
+
+
+/*
+ * "public" function
+ *
+ * Return the lowest grey level of the bin that contains the given
+ * percentile (0.0 ... 100.0) of all pixels. This is a binary search
+ * on the prefix sums, so it takes O(log bins) time.
+ */
+unsigned int histogram_percentile(histogram* histogram_data,
+    double double_percentile) {
+    unsigned int uint_low = 0;
+    unsigned int uint_high = histogram_data->uint_num_bins - 1;
+    unsigned int uint_middle = 0;
+    uint64_t uint64_target = 0;
+
+    double_percentile = MAX(0.0, MIN(100.0, double_percentile));
+
+    /* the number of pixels we have to cover, at least one */
+    uint64_target = (uint64_t)ceil(double_percentile / 100.0 *
+        histogram_data->uint64_total);
+    uint64_target = MAX(uint64_target, 1);
+
+    /* find the first bin whose prefix sum reaches the target */
+    while(uint_low < uint_high) {
+        uint_middle = uint_low + (uint_high - uint_low) / 2;
+        if(histogram_data->uint64_cumulative[uint_middle] < uint64_target) {
+            uint_low = uint_middle + 1;
+        } else {
+            uint_high = uint_middle;
+        }
+    }
+
+    return(histogram_bin_level(histogram_data, uint_low));
+}
+
+
+/*
+ * "public" function
+ *
+ * Allocate a canvas of uint_xres columns and uint_yres rows.
+ */
+int allocate_histogram_canvas(histogram_canvas* canvas, unsigned int uint_xres,
+    unsigned int uint_yres) {
+
+    if( allocate_image_p2(&(canvas->image_canvas), uint_xres, uint_yres,
+        HISTOGRAM_BACKGROUND_GREY) != 0 ) {
+        perror("allocate_histogram_canvas: Error allocating the image.\n");
+        return(-1);
+    }
+
+    canvas->uint_bar_heights = (unsigned int*)malloc(uint_xres *
+        sizeof(unsigned int));
+    canvas->uint_curve_heights = (unsigned int*)malloc(uint_xres *
+        sizeof(unsigned int));
+    if(canvas->uint_bar_heights == NULL || canvas->uint_curve_heights == NULL) {
+        perror("allocate_histogram_canvas: Error allocating storage space.\n");
+        free_histogram_canvas(canvas);
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_histogram_canvas(histogram_canvas* canvas) {
+    free_image_p2(&(canvas->image_canvas));
+    free(canvas->uint_bar_heights);
+    free(canvas->uint_curve_heights);
+
+    canvas->uint_bar_heights = NULL;
+    canvas->uint_curve_heights = NULL;
+
+    return;
+}
+
+
+/*
+ * "private" function
+ *
+ * Work out the height of the bar (and of the cumulative curve)
+ * in every column of the canvas. If there are more bins than
+ * columns a column shows the highest of its bins, so we do not
+ * lose any peaks.
+ */
+void histogram_column_heights(histogram* histogram_data,
+    histogram_canvas* canvas) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int uint_first = 0;
+    unsigned int uint_last = 0;
+    unsigned int uint_xres = canvas->image_canvas.uint_xres;
+    unsigned int uint_yres = canvas->image_canvas.uint_yres;
+    uint64_t uint64_max = 0;
+    uint64_t uint64_count = 0;
+
+    /* the highest bin defines the scale of the bars */
+    for(i = 0; i < histogram_data->uint_num_bins; i ++) {
+        uint64_max = MAX(uint64_max, histogram_data->uint64_bins[i]);
+    }
+
+    for(i = 0; i < uint_xres; i ++) {
+        /* the range of bins shown in this column */
+        uint_first = (unsigned int)((uint64_t)i *
+            histogram_data->uint_num_bins / uint_xres);
+        uint_last = (unsigned int)((uint64_t)(i + 1) *
+            histogram_data->uint_num_bins / uint_xres);
+        uint_last = MAX(uint_last, uint_first + 1) - 1;
+
+        uint64_count = 0;
+        for(j = uint_first; j <= uint_last; j ++) {
+            uint64_count = MAX(uint64_count, histogram_data->uint64_bins[j]);
+        }
+
+        if(uint64_max == 0) {
+            canvas->uint_bar_heights[i] = 0;
+        } else {
+            canvas->uint_bar_heights[i] = (unsigned int)((uint64_count *
+                uint_yres + uint64_max / 2) / uint64_max);
+        }
+
+        if(histogram_data->uint64_total == 0) {
+            canvas->uint_curve_heights[i] = 0;
+        } else {
+            canvas->uint_curve_heights[i] = (unsigned int)(
+                (histogram_data->uint64_cumulative[uint_last] * uint_yres +
+                histogram_data->uint64_total / 2) /
+                histogram_data->uint64_total);
+        }
+    }
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Render the histogram into the canvas. The bars are filled row
+ * by row: a pixel belongs to a bar if the bar of its column reaches
+ * up to its row. This walks the image in memory order and does not
+ * need any branches in the inner loop. With HISTOGRAM_RENDER_CUMULATIVE
+ * the cumulative histogram is drawn on top as a curve. Bins with a
+ * count of zero have no bar at all.
+ */
+int render_histogram(histogram* histogram_data, histogram_canvas* canvas,
+    int int_flags) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int uint_level = 0;
+    unsigned int uint_from = 0;
+    unsigned int uint_to = 0;
+    unsigned int uint_previous = 0;
+    unsigned int* uint_row;
+    unsigned int* uint_heights = canvas->uint_bar_heights;
+    unsigned int uint_xres = canvas->image_canvas.uint_xres;
+    unsigned int uint_yres = canvas->image_canvas.uint_yres;
+
+    if(histogram_data->uint64_bins == NULL || uint_heights == NULL) {
+        perror("render_histogram: Histogram or canvas not allocated.\n");
+        return(-1);
+    }
+
+    histogram_column_heights(histogram_data, canvas);
+
+    /* row i is covered by all bars of at least uint_yres - i pixels */
+    for(i = 0; i < uint_yres; i ++) {
+        uint_row = canvas->image_canvas.int_image_data[i];
+        uint_level = uint_yres - i;
+        for(j = 0; j < uint_xres; j ++) {
+            uint_row[j] = (uint_heights[j] >= uint_level) ? HISTOGRAM_BAR_GREY :
+                HISTOGRAM_BACKGROUND_GREY;
+        }
+    }
+
+    if(int_flags & HISTOGRAM_RENDER_CUMULATIVE) {
+        /*
+         * The curve only ever goes up, so we connect each column
+         * to the previous one with a vertical run of pixels.
+         */
+        uint_previous = 1;
+        for(j = 0; j < uint_xres; j ++) {
+            uint_from = MAX(uint_previous, 1);
+            uint_to = MAX(canvas->uint_curve_heights[j], uint_from);
+            for(uint_level = uint_from; uint_level <= uint_to; uint_level ++) {
+                canvas->image_canvas.int_image_data[uint_yres - uint_level][j] =
+                    HISTOGRAM_CURVE_GREY;
+            }
+            uint_previous = uint_to;
+        }
+    }
+
+    canvas->image_canvas.uint_max = HISTOGRAM_BACKGROUND_GREY;
+
+    return(0);
+}
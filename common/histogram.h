@@ -0,0 +1,117 @@
+/*
+ * Function definitions for a generic grey level histogram.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __HISTOGRAM__
+#define __HISTOGRAM__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+
+/* include our PGM routines and the 16 bit and float images */
+#include "image_p2.h"
+#include "image_p5.h"
+
+
+/*
+ * The largest grey level a histogram can cover.
+ * 16 bit images have 65536 grey levels (0 ... 65535).
+ */
+#define HISTOGRAM_MAX_LEVEL 65535
+
+
+/*
+ * Grey levels used to render a histogram into an image.
+ * Bars are black on a white background, the cumulative
+ * curve is drawn in mid grey on top of the bars.
+ */
+#define HISTOGRAM_BACKGROUND_GREY 255
+#define HISTOGRAM_BAR_GREY 0
+#define HISTOGRAM_CURVE_GREY 128
+
+/* flags for render_histogram() */
+#define HISTOGRAM_RENDER_BARS 0
+#define HISTOGRAM_RENDER_CUMULATIVE 1
+
+
+/*
+ * Type definition of a histogram.
+ * The grey levels uint_min ... uint_max are distributed evenly
+ * across uint_num_bins bins. The counts are 64 bit, so even very
+ * large images or accumulated image sets do not overflow.
+ * uint64_cumulative holds the prefix sums of the bins, i.e.
+ * uint64_cumulative[i] = uint64_bins[0] + ... + uint64_bins[i].
+ */
+typedef struct {
+    unsigned int uint_num_bins;
+    unsigned int uint_min;
+    unsigned int uint_max;
+    uint64_t* uint64_bins;
+    uint64_t* uint64_cumulative;
+    uint64_t uint64_total;
+} histogram;
+
+
+/*
+ * A canvas to render histograms into. Allocate it once and
+ * render as many histograms into it as you like, no memory is
+ * allocated while rendering. image_canvas holds the rendered
+ * histogram, the other buffers are scratch space with one entry
+ * per column.
+ */
+typedef struct {
+    image image_canvas;
+    unsigned int* uint_bar_heights;
+    unsigned int* uint_curve_heights;
+} histogram_canvas;
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ */
+int allocate_histogram(histogram* histogram_data, unsigned int uint_num_bins,
+    unsigned int uint_min, unsigned int uint_max);
+void free_histogram(histogram* histogram_data);
+void clear_histogram(histogram* histogram_data);
+int compute_histogram(image_view* view_in, histogram* histogram_data);
+void accumulate_histogram(image_view* view_in, histogram* histogram_data);
+int compute_histogram_u16(image_u16* image_in, histogram* histogram_data);
+int compute_histogram_f32(image_f32* image_in, histogram* histogram_data,
+    float float_min, float float_max);
+void update_cumulative_histogram(histogram* histogram_data);
+unsigned int histogram_bin(histogram* histogram_data, unsigned int uint_level);
+unsigned int histogram_bin_level(histogram* histogram_data,
+    unsigned int uint_bin);
+uint64_t histogram_count_below(histogram* histogram_data,
+    unsigned int uint_level);
+unsigned int histogram_percentile(histogram* histogram_data,
+    double double_percentile);
+int allocate_histogram_canvas(histogram_canvas* canvas, unsigned int uint_xres,
+    unsigned int uint_yres);
+void free_histogram_canvas(histogram_canvas* canvas);
+int render_histogram(histogram* histogram_data, histogram_canvas* canvas,
+    int int_flags);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+void histogram_column_heights(histogram* histogram_data,
+    histogram_canvas* canvas);
+
+#endif
@@ -0,0 +1,255 @@
+/*-----------------------------------------
+ * Image arena
+ * A bump pointer allocator for temporary
+ * images. Used by multi-stage pipelines like
+ * canny() to avoid one malloc per image row.
+ *---------------------------------------*/
+
+
+/* Include our arena routines. */
+#include "image_arena.h"
+
+/* Include the timing and counters, compiled out unless -DINSTRUMENT */
+#include "instrument.h"
+
+
+/*
+ * "private" function
+ *
+ * Round a size up to the next multiple of ARENA_ALIGNMENT.
+ */
+size_t arena_align(size_t size_t_size) {
+    return((size_t_size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1));
+}
+
+
+/* "public" function */
+int allocate_arena(image_arena* arena, size_t size_t_capacity) {
+
+    arena->size_t_capacity = arena_align(size_t_capacity);
+    arena->size_t_used = 0;
+    arena->size_t_overflow = 0;
+    arena->overflow_blocks = NULL;
+    arena->uchar_memory = NULL;
+
+    if(arena->size_t_capacity == 0) return(0);
+
+    arena->uchar_memory = (unsigned char*)aligned_alloc(ARENA_ALIGNMENT,
+        arena->size_t_capacity);
+    if(arena->uchar_memory == NULL) {
+        perror("allocate_arena: Error allocating storage space.\n");
+        arena->size_t_capacity = 0;
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_arena, INSTRUMENT_ALLOCATIONS, 1);
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_arena(image_arena* arena) {
+    arena_overflow* overflow_next;
+
+    while(arena->overflow_blocks != NULL) {
+        overflow_next = arena->overflow_blocks->next;
+        free(arena->overflow_blocks);
+        arena->overflow_blocks = overflow_next;
+    }
+
+    free(arena->uchar_memory);
+    arena->uchar_memory = NULL;
+    arena->size_t_capacity = 0;
+    arena->size_t_used = 0;
+    arena->size_t_overflow = 0;
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Release all allocations at once. Unless the arena overflowed
+ * this only resets the fill level. After an overflow we replace
+ * the arena by one large enough for everything we needed, so the
+ * next round of allocations fits.
+ */
+void reset_arena(image_arena* arena) {
+    size_t size_t_needed = 0;
+
+    if(arena->size_t_overflow > 0) {
+        size_t_needed = arena->size_t_used + arena->size_t_overflow;
+        free_arena(arena);
+        allocate_arena(arena, size_t_needed);
+    }
+
+    arena->size_t_used = 0;
+
+    return;
+}
+
+
+/*
+ * "private" function
+ *
+ * Fall back on malloc if the arena is full.
+ */
+void* arena_allocate_overflow(image_arena* arena, size_t size_t_size) {
+    arena_overflow* overflow_block;
+    size_t size_t_header = arena_align(sizeof(arena_overflow));
+
+    overflow_block = (arena_overflow*)aligned_alloc(ARENA_ALIGNMENT,
+        size_t_header + size_t_size);
+    if(overflow_block == NULL) {
+        perror("arena_allocate: Error allocating storage space.\n");
+        return(NULL);
+    }
+
+    overflow_block->size_t_size = size_t_size;
+    overflow_block->next = arena->overflow_blocks;
+    arena->overflow_blocks = overflow_block;
+    arena->size_t_overflow += size_t_size;
+
+    INSTRUMENT_COUNT(arena_overflow, INSTRUMENT_ALLOCATIONS, 1);
+
+    return((unsigned char*)overflow_block + size_t_header);
+}
+
+
+/* "public" function */
+void* arena_allocate(image_arena* arena, size_t size_t_size) {
+    void* void_memory;
+
+    size_t_size = arena_align(size_t_size);
+
+    if(arena->size_t_used + size_t_size > arena->size_t_capacity) {
+        return(arena_allocate_overflow(arena, size_t_size));
+    }
+
+    void_memory = arena->uchar_memory + arena->size_t_used;
+    arena->size_t_used += size_t_size;
+
+    return(void_memory);
+}
+
+
+/*
+ * "public" function
+ *
+ * The number of bytes arena_allocate_image() takes from the arena.
+ * Use it to size an arena for a given number of images.
+ */
+size_t arena_image_size(unsigned int uint_xres, unsigned int uint_yres) {
+    return(arena_align(uint_yres * sizeof(unsigned int*)) +
+        arena_align((size_t)uint_xres * uint_yres * sizeof(unsigned int)));
+}
+
+
+/*
+ * "public" function
+ *
+ * Works like allocate_image_p2(), but takes the row pointers and
+ * the image data from the arena. The rows are stored one after
+ * the other in a single block.
+ */
+int arena_allocate_image(image_arena* arena, image* image_p2,
+    unsigned int uint_xres, unsigned int uint_yres,
+    unsigned int uint_greylevel) {
+    unsigned int i = 0;
+    size_t size_t_j = 0;
+    size_t size_t_pixels = (size_t)uint_xres * uint_yres;
+    unsigned int* uint_data;
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("arena_allocate_image: At least one dimension is zero.");
+        return(-1);
+    }
+
+    if(uint_greylevel > PGM_MAX_LEVEL) {
+        perror("arena_allocate_image: the max. allowed grey level is 65535.\n");
+        return(-1);
+    }
+
+    image_p2->int_image_data = (unsigned int**)arena_allocate(arena,
+        uint_yres * sizeof(unsigned int*));
+    uint_data = (unsigned int*)arena_allocate(arena,
+        size_t_pixels * sizeof(unsigned int));
+    if(image_p2->int_image_data == NULL || uint_data == NULL) {
+        perror("arena_allocate_image: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    image_p2->uint_xres = uint_xres;
+    image_p2->uint_yres = uint_yres;
+    image_p2->uint_max = uint_greylevel;
+
+    if(uint_greylevel == 0) {
+        memset(uint_data, 0, size_t_pixels * sizeof(unsigned int));
+    } else {
+        for(size_t_j = 0; size_t_j < size_t_pixels; size_t_j ++) {
+            uint_data[size_t_j] = uint_greylevel;
+        }
+    }
+
+    for(i = 0; i < uint_yres; i ++) {
+        image_p2->int_image_data[i] = uint_data + (size_t)i * uint_xres;
+    }
+
+    return(0);
+}
+
+
+/*
+ * "public" functions
+ *
+ * Work like allocate_image_u16() and allocate_image_f32(),
+ * but take the pixels from the arena. They are not cleared,
+ * so the caller has to write every pixel.
+ */
+int arena_allocate_u16(image_arena* arena, image_u16* image_new,
+    unsigned int uint_xres, unsigned int uint_yres, unsigned int uint_max) {
+
+    if(uint_xres == 0 || uint_yres == 0 || uint_max > UINT16_MAX) {
+        perror("arena_allocate_u16: Invalid size or max. grey level.\n");
+        return(-1);
+    }
+
+    image_new->uint16_pixels = (uint16_t*)arena_allocate(arena,
+        (size_t)uint_xres * uint_yres * sizeof(uint16_t));
+    if(image_new->uint16_pixels == NULL) {
+        perror("arena_allocate_u16: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_stride = uint_xres;
+    image_new->uint_max = uint_max;
+
+    return(0);
+}
+
+
+int arena_allocate_f32(image_arena* arena, image_f32* image_new,
+    unsigned int uint_xres, unsigned int uint_yres) {
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("arena_allocate_f32: At least one dimension is zero.");
+        return(-1);
+    }
+
+    image_new->float_pixels = (float*)arena_allocate(arena,
+        (size_t)uint_xres * uint_yres * sizeof(float));
+    if(image_new->float_pixels == NULL) {
+        perror("arena_allocate_f32: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_stride = uint_xres;
+
+    return(0);
+}
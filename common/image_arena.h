@@ -0,0 +1,95 @@
+/*
+ * Function definitions for an arena to allocate temporary images.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __IMAGE_ARENA__
+#define __IMAGE_ARENA__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/* include our PGM routines and the 16 bit and float images */
+#include "image_p2.h"
+#include "image_p5.h"
+
+
+/*
+ * Every allocation starts on a cache line boundary,
+ * so two images never share a cache line.
+ */
+#define ARENA_ALIGNMENT 64
+
+
+/*
+ * A block of memory that did not fit into the arena.
+ * These are chained up and only freed on reset_arena().
+ */
+typedef struct arena_overflow {
+    struct arena_overflow* next;
+    size_t size_t_size;
+} arena_overflow;
+
+
+/*
+ * Type definition of an image arena.
+ * An arena is one large block of memory. Allocating from it
+ * just moves a pointer forward (size_t_used), so it is much
+ * cheaper than calling malloc for every image row. You never
+ * free a single image from an arena. Instead reset_arena()
+ * releases all images at once, and the memory is reused for
+ * the next frame.
+ *
+ * If an allocation does not fit, we fall back on malloc and
+ * remember how much we needed. The next reset_arena() then
+ * grows the arena, so after the first frame all allocations
+ * come from the arena.
+ */
+typedef struct {
+    unsigned char* uchar_memory;
+    size_t size_t_capacity;
+    size_t size_t_used;
+    size_t size_t_overflow;
+    arena_overflow* overflow_blocks;
+} image_arena;
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ * Images allocated from an arena must not be
+ * freed with free_image_p2().
+ */
+int allocate_arena(image_arena* arena, size_t size_t_capacity);
+void free_arena(image_arena* arena);
+void reset_arena(image_arena* arena);
+void* arena_allocate(image_arena* arena, size_t size_t_size);
+int arena_allocate_image(image_arena* arena, image* image_p2,
+    unsigned int uint_xres, unsigned int uint_yres,
+    unsigned int uint_greylevel);
+size_t arena_image_size(unsigned int uint_xres, unsigned int uint_yres);
+int arena_allocate_u16(image_arena* arena, image_u16* image_new,
+    unsigned int uint_xres, unsigned int uint_yres, unsigned int uint_max);
+int arena_allocate_f32(image_arena* arena, image_f32* image_new,
+    unsigned int uint_xres, unsigned int uint_yres);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+size_t arena_align(size_t size_t_size);
+void* arena_allocate_overflow(image_arena* arena, size_t size_t_size);
+
+#endif
@@ -0,0 +1,485 @@
+/*-----------------------------------------
+ * Bitmap functions
+ * Read and write a PBM binary encoded bitmap
+ * and work on it 64 pixels at a time.
+ * This code only accepts P4 images.
+ *---------------------------------------*/
+
+
+/* Include our routines to handle a bitmap. */
+#include "image_bitmap.h"
+
+/* Include the timing and counters, compiled out unless -DINSTRUMENT */
+#include "instrument.h"
+
+/* Include the CPU dispatch for the word loops */
+#include "cpu_dispatch.h"
+
+
+/*
+ * "private" function
+ *
+ * Read the image header. Comments may appear anywhere
+ * in it, and after the resolution there is exactly one
+ * white space character before the pixels start.
+ */
+int read_PBM_header_p4(FILE* file_input, bitmap* bitmap_input) {
+    char char_magic[2];
+
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2 ||
+        char_magic[0] != 'P' || char_magic[1] != '4') {
+        perror("Not a P4 image (binary encoded portable bitmap)\n");
+        return(-1);
+    }
+
+    if(skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(bitmap_input->uint_xres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(bitmap_input->uint_yres)) != 1) {
+        perror("read_bitmap: Invalid resolution in the header.\n");
+        return(-1);
+    }
+    fgetc(file_input);
+
+    return(0);
+}
+
+
+/* "private" function, P4 stores the leftmost pixel in the highest bit */
+unsigned char reverse_bits(unsigned char uchar_byte) {
+    uchar_byte = (uchar_byte & 0xF0) >> 4 | (uchar_byte & 0x0F) << 4;
+    uchar_byte = (uchar_byte & 0xCC) >> 2 | (uchar_byte & 0x33) << 2;
+    uchar_byte = (uchar_byte & 0xAA) >> 1 | (uchar_byte & 0x55) << 1;
+
+    return(uchar_byte);
+}
+
+
+/* "private" function, clear the bits after the last pixel of a row */
+void clear_padding_bits(bitmap* bitmap_p4, uint64_t* uint64_row) {
+
+    if(bitmap_p4->uint_xres % BITMAP_WORD_BITS > 0) {
+        uint64_row[bitmap_p4->uint_words - 1] &=
+            (1ull << (bitmap_p4->uint_xres % BITMAP_WORD_BITS)) - 1;
+    }
+
+    return;
+}
+
+
+/* "public" function */
+int allocate_bitmap(bitmap* bitmap_new, unsigned int uint_xres,
+    unsigned int uint_yres) {
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("allocate_bitmap: At least one dimension is zero.");
+        return(-1);
+    }
+
+    bitmap_new->uint_xres = uint_xres;
+    bitmap_new->uint_yres = uint_yres;
+    bitmap_new->uint_words = (uint_xres + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+    /* all pixels start clear */
+    bitmap_new->uint64_bits = (uint64_t*)calloc((size_t)bitmap_new->uint_words *
+        uint_yres, sizeof(uint64_t));
+    if(bitmap_new->uint64_bits == NULL) {
+        perror("allocate_bitmap: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_bitmap, INSTRUMENT_ALLOCATIONS, 1);
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_bitmap(bitmap* bitmap_old) {
+
+    free(bitmap_old->uint64_bits);
+    bitmap_old->uint64_bits = NULL;
+
+    return;
+}
+
+
+/* "public" function */
+int read_bitmap_p4(char* char_name, bitmap* bitmap_input) {
+    FILE* file_input;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int uint_row_bytes = 0;
+    unsigned char* uchar_row;
+    uint64_t* uint64_row;
+
+    INSTRUMENT_BEGIN(read_bitmap);
+
+    file_input = fopen(char_name, "rb");
+    if(file_input == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", char_name);
+        return(-1);
+    }
+
+    if(read_PBM_header_p4(file_input, bitmap_input) != 0 ||
+        allocate_bitmap(bitmap_input, bitmap_input->uint_xres,
+        bitmap_input->uint_yres) != 0) {
+        perror("Error reading header of bitmap file.\n");
+        fclose(file_input);
+        return(-1);
+    }
+
+    uint_row_bytes = (bitmap_input->uint_xres + 7) / 8;
+    uchar_row = (unsigned char*)malloc(uint_row_bytes);
+    if(uchar_row == NULL) {
+        perror("read_bitmap: Error allocating storage space.\n");
+        free_bitmap(bitmap_input);
+        fclose(file_input);
+        return(-1);
+    }
+
+    /* byte j of a P4 row holds the pixels 8 j ... 8 j + 7 */
+    for(i = 0; i < bitmap_input->uint_yres; i ++) {
+        if(fread(uchar_row, 1, uint_row_bytes, file_input) != uint_row_bytes) {
+            perror("Unexpected end of PBM file.\n");
+            free(uchar_row);
+            free_bitmap(bitmap_input);
+            fclose(file_input);
+            return(-1);
+        }
+
+        uint64_row = BITMAP_ROW(bitmap_input, i);
+        for(j = 0; j < uint_row_bytes; j ++) {
+            uint64_row[j / 8] |= (uint64_t)reverse_bits(uchar_row[j]) << (8 * (j % 8));
+        }
+        clear_padding_bits(bitmap_input, uint64_row);
+    }
+
+    INSTRUMENT_COUNT(read_bitmap, INSTRUMENT_BYTES_READ, ftell(file_input));
+    INSTRUMENT_COUNT(read_bitmap, INSTRUMENT_PIXELS,
+        (uint64_t)bitmap_input->uint_xres * bitmap_input->uint_yres);
+    free(uchar_row);
+    fclose(file_input);
+    INSTRUMENT_END(read_bitmap);
+
+    return(0);
+}
+
+
+/* "public" function */
+int write_bitmap_p4(char* char_name, bitmap* bitmap_output) {
+    FILE* file_output;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int uint_row_bytes = (bitmap_output->uint_xres + 7) / 8;
+    unsigned char* uchar_row;
+    uint64_t* uint64_row;
+    int int_return_value = 0;
+
+    file_output = fopen(char_name, "wb");
+    if(file_output == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", char_name);
+        return(-1);
+    }
+
+    uchar_row = (unsigned char*)malloc(uint_row_bytes);
+    if(uchar_row == NULL) {
+        perror("write_bitmap: Error allocating storage space.\n");
+        fclose(file_output);
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(write_bitmap);
+    fprintf(file_output, "P4\n# CREATOR: image_bitmap\n%u %u\n",
+        bitmap_output->uint_xres, bitmap_output->uint_yres);
+
+    for(i = 0; i < bitmap_output->uint_yres; i ++) {
+        uint64_row = BITMAP_ROW(bitmap_output, i);
+        for(j = 0; j < uint_row_bytes; j ++) {
+            uchar_row[j] = reverse_bits((unsigned char)(uint64_row[j / 8] >> (8 * (j % 8))));
+        }
+        if(fwrite(uchar_row, 1, uint_row_bytes, file_output) != uint_row_bytes) {
+            int_return_value = -1;
+        }
+    }
+
+    INSTRUMENT_COUNT(write_bitmap, INSTRUMENT_BYTES_WRITTEN, ftell(file_output));
+    INSTRUMENT_COUNT(write_bitmap, INSTRUMENT_PIXELS,
+        (uint64_t)bitmap_output->uint_xres * bitmap_output->uint_yres);
+    free(uchar_row);
+    if(fclose(file_output) != 0) int_return_value = -1;
+    INSTRUMENT_END(write_bitmap);
+
+    return(int_return_value);
+}
+
+
+/*
+ * "public" function
+ * Set every pixel with uint_low <= grey level <= uint_high, e.g.
+ * bitmap_from_view(&view_edges, &bitmap_edges, 255, 255) for the
+ * edges traced by canny(). The bitmap is allocated here.
+ */
+int bitmap_from_view(image_view* view_input, bitmap* bitmap_output,
+    unsigned int uint_low, unsigned int uint_high) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    uint64_t* uint64_row;
+
+    if(allocate_bitmap(bitmap_output, view_input->uint_xres,
+        view_input->uint_yres) != 0) {
+        return(-1);
+    }
+
+    for(i = 0; i < view_input->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_input, i);
+        uint64_row = BITMAP_ROW(bitmap_output, i);
+        for(j = 0; j < view_input->uint_xres; j ++) {
+            uint64_row[j / BITMAP_WORD_BITS] |= (uint64_t)(uint_row[j] >= uint_low &&
+                uint_row[j] <= uint_high) << (j % BITMAP_WORD_BITS);
+        }
+    }
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ * Write uint_set or uint_clear into every pixel of a view
+ * of the same size as the bitmap.
+ */
+int bitmap_to_view(bitmap* bitmap_input, image_view* view_output,
+    unsigned int uint_set, unsigned int uint_clear) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+
+    if(bitmap_input->uint_xres != view_output->uint_xres ||
+        bitmap_input->uint_yres != view_output->uint_yres) {
+        perror("bitmap_to_view: The view has a different size.\n");
+        return(-1);
+    }
+
+    for(i = 0; i < view_output->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_output, i);
+        for(j = 0; j < view_output->uint_xres; j ++) {
+            uint_row[j] = BITMAP_PIXEL(bitmap_input, j, i) ? uint_set : uint_clear;
+        }
+    }
+
+    return(0);
+}
+
+
+/* "private" function */
+int check_bitmap_size(bitmap* bitmap_a, bitmap* bitmap_b) {
+
+    if(bitmap_a->uint_xres != bitmap_b->uint_xres ||
+        bitmap_a->uint_yres != bitmap_b->uint_yres) {
+        perror("bitmap: The bitmaps have different sizes.\n");
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+/*
+ * "public" functions
+ * Combine two bitmaps pixel by pixel. The rows have no gaps,
+ * so we run over all words in one go.
+ */
+CPU_DISPATCH int bitmap_and(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output) {
+    size_t size_t_i = 0;
+    size_t size_t_words = (size_t)bitmap_a->uint_words * bitmap_a->uint_yres;
+
+    if(check_bitmap_size(bitmap_a, bitmap_b) != 0 ||
+        check_bitmap_size(bitmap_a, bitmap_output) != 0) return(-1);
+
+    for(size_t_i = 0; size_t_i < size_t_words; size_t_i ++) {
+        bitmap_output->uint64_bits[size_t_i] = bitmap_a->uint64_bits[size_t_i] & bitmap_b->uint64_bits[size_t_i];
+    }
+
+    return(0);
+}
+
+
+CPU_DISPATCH int bitmap_or(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output) {
+    size_t size_t_i = 0;
+    size_t size_t_words = (size_t)bitmap_a->uint_words * bitmap_a->uint_yres;
+
+    if(check_bitmap_size(bitmap_a, bitmap_b) != 0 ||
+        check_bitmap_size(bitmap_a, bitmap_output) != 0) return(-1);
+
+    for(size_t_i = 0; size_t_i < size_t_words; size_t_i ++) {
+        bitmap_output->uint64_bits[size_t_i] = bitmap_a->uint64_bits[size_t_i] | bitmap_b->uint64_bits[size_t_i];
+    }
+
+    return(0);
+}
+
+
+CPU_DISPATCH int bitmap_xor(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output) {
+    size_t size_t_i = 0;
+    size_t size_t_words = (size_t)bitmap_a->uint_words * bitmap_a->uint_yres;
+
+    if(check_bitmap_size(bitmap_a, bitmap_b) != 0 ||
+        check_bitmap_size(bitmap_a, bitmap_output) != 0) return(-1);
+
+    for(size_t_i = 0; size_t_i < size_t_words; size_t_i ++) {
+        bitmap_output->uint64_bits[size_t_i] = bitmap_a->uint64_bits[size_t_i] ^ bitmap_b->uint64_bits[size_t_i];
+    }
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ * The number of set pixels. The padding bits are clear,
+ * so they don't count.
+ */
+CPU_DISPATCH uint64_t bitmap_popcount(bitmap* bitmap_input) {
+    size_t size_t_i = 0;
+    size_t size_t_words = (size_t)bitmap_input->uint_words * bitmap_input->uint_yres;
+    uint64_t uint64_count = 0;
+
+    for(size_t_i = 0; size_t_i < size_t_words; size_t_i ++) {
+        uint64_count += __builtin_popcountll(bitmap_input->uint64_bits[size_t_i]);
+    }
+
+    return(uint64_count);
+}
+
+
+/*
+ * "private" function
+ * Combine every pixel of a row with its left and right neighbour:
+ * AND for an erosion, OR for a dilation. Shifting a word by one
+ * moves all 64 pixels at once, the pixel that drops out at the end
+ * comes in from the next word.
+ */
+CPU_DISPATCH void bitmap_row_neighbours(uint64_t* uint64_row, uint64_t* uint64_output,
+    unsigned int uint_words, int int_dilate) {
+    unsigned int k = 0;
+    uint64_t uint64_left = 0;
+    uint64_t uint64_right = 0;
+
+    for(k = 0; k < uint_words; k ++) {
+        uint64_left = (uint64_row[k] << 1) | ((k > 0) ? uint64_row[k - 1] >> 63 : 0);
+        uint64_right = (uint64_row[k] >> 1) | ((k + 1 < uint_words) ? uint64_row[k + 1] << 63 : 0);
+        if(int_dilate) {
+            uint64_output[k] = uint64_row[k] | uint64_left | uint64_right;
+        } else {
+            uint64_output[k] = uint64_row[k] & uint64_left & uint64_right;
+        }
+    }
+
+    return;
+}
+
+
+/*
+ * "private" function
+ * A 3 x 3 erosion or dilation is a 3 pixel wide one along the rows
+ * followed by a 3 pixel high one along the columns. We keep the row
+ * results of the rows above, at and below the current row in a ring
+ * of 3 rows. Row i of the input is no longer needed once row i + 1
+ * has been combined, so the output may be the input.
+ */
+int morphology_bitmap(bitmap* bitmap_input, bitmap* bitmap_output,
+    int int_dilate) {
+    unsigned int i = 0;
+    unsigned int k = 0;
+    unsigned int uint_words = bitmap_input->uint_words;
+    uint64_t* uint64_ring;
+    uint64_t* uint64_above;
+    uint64_t* uint64_row;
+    uint64_t* uint64_below;
+    uint64_t* uint64_output;
+
+    if(check_bitmap_size(bitmap_input, bitmap_output) != 0) return(-1);
+
+    /* one more row of zeros for the rows outside the bitmap */
+    uint64_ring = (uint64_t*)calloc((size_t)4 * uint_words, sizeof(uint64_t));
+    if(uint64_ring == NULL) {
+        perror("morphology_bitmap: Error allocating storage space.\n");
+        return(-1);
+    }
+#define RING_BITMAP_ROW(Y) (uint64_ring + (size_t)((Y) % 3) * uint_words)
+
+    bitmap_row_neighbours(BITMAP_ROW(bitmap_input, 0), RING_BITMAP_ROW(0), uint_words, int_dilate);
+
+    for(i = 0; i < bitmap_input->uint_yres; i ++) {
+        if(i + 1 < bitmap_input->uint_yres) {
+            bitmap_row_neighbours(BITMAP_ROW(bitmap_input, i + 1), RING_BITMAP_ROW(i + 1), uint_words, int_dilate);
+        }
+
+        uint64_above = (i > 0) ? RING_BITMAP_ROW(i - 1) : uint64_ring + (size_t)3 * uint_words;
+        uint64_row = RING_BITMAP_ROW(i);
+        uint64_below = (i + 1 < bitmap_input->uint_yres) ? RING_BITMAP_ROW(i + 1) : uint64_ring + (size_t)3 * uint_words;
+        uint64_output = BITMAP_ROW(bitmap_output, i);
+
+        for(k = 0; k < uint_words; k ++) {
+            if(int_dilate) {
+                uint64_output[k] = uint64_above[k] | uint64_row[k] | uint64_below[k];
+            } else {
+                uint64_output[k] = uint64_above[k] & uint64_row[k] & uint64_below[k];
+            }
+        }
+        clear_padding_bits(bitmap_output, uint64_output);
+    }
+
+#undef RING_BITMAP_ROW
+    free(uint64_ring);
+
+    return(0);
+}
+
+
+/* "public" function */
+int erode_bitmap(bitmap* bitmap_input, bitmap* bitmap_output) {
+    int int_return_value = 0;
+
+    INSTRUMENT_BEGIN(erode_bitmap);
+    int_return_value = morphology_bitmap(bitmap_input, bitmap_output, 0);
+    INSTRUMENT_COUNT(erode_bitmap, INSTRUMENT_PIXELS,
+        (uint64_t)bitmap_input->uint_xres * bitmap_input->uint_yres);
+    INSTRUMENT_END(erode_bitmap);
+
+    return(int_return_value);
+}
+
+
+/* "public" function */
+int dilate_bitmap(bitmap* bitmap_input, bitmap* bitmap_output) {
+    int int_return_value = 0;
+
+    INSTRUMENT_BEGIN(dilate_bitmap);
+    int_return_value = morphology_bitmap(bitmap_input, bitmap_output, 1);
+    INSTRUMENT_COUNT(dilate_bitmap, INSTRUMENT_PIXELS,
+        (uint64_t)bitmap_input->uint_xres * bitmap_input->uint_yres);
+    INSTRUMENT_END(dilate_bitmap);
+
+    return(int_return_value);
+}
+
+
+/* "public" function, an erosion followed by a dilation removes specks */
+int open_bitmap(bitmap* bitmap_input, bitmap* bitmap_output) {
+
+    if(erode_bitmap(bitmap_input, bitmap_output) != 0) return(-1);
+
+    return(dilate_bitmap(bitmap_output, bitmap_output));
+}
+
+
+/* "public" function, a dilation followed by an erosion fills gaps */
+int close_bitmap(bitmap* bitmap_input, bitmap* bitmap_output) {
+
+    if(dilate_bitmap(bitmap_input, bitmap_output) != 0) return(-1);
+
+    return(erode_bitmap(bitmap_output, bitmap_output));
+}
@@ -0,0 +1,95 @@
+/*
+ * Function definitions to handle a binary image with one bit per pixel,
+ * read from and written to a PBM (P4) file.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __IMAGE_BITMAP__
+#define __IMAGE_BITMAP__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/* include our PGM routines, a bitmap can be made from a view */
+#include "image_p2.h"
+
+
+/* pixels per word of a bitmap row */
+#define BITMAP_WORD_BITS 64
+
+
+/*
+ * Type definition of a bitmap
+ * A pixel is either set (1, black in a PBM file) or clear (0, white).
+ * Every row is an array of uint_words 64 bit words, pixel x is bit
+ * x % 64 of word x / 64. The bits after the last pixel of a row are
+ * always clear, so we can work on whole words: an erosion or a
+ * popcount handles 64 pixels at once, and a bitmap needs 32 times
+ * less memory than an image of the same size.
+ */
+typedef struct {
+    uint64_t* uint64_bits;
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_words;
+} bitmap;
+
+
+/* The first word of row Y of a bitmap and the pixel at X, Y (0 or 1) */
+#define BITMAP_ROW(BITMAP, Y) ((BITMAP)->uint64_bits + (size_t)(Y) * (BITMAP)->uint_words)
+#define BITMAP_PIXEL(BITMAP, X, Y) ((BITMAP_ROW(BITMAP, Y)[(X) / BITMAP_WORD_BITS] >> ((X) % BITMAP_WORD_BITS)) & 1)
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ * The output bitmap of the operators below has to be allocated
+ * with the size of the input. It may be one of the inputs, so
+ * all operators also work in place.
+ * The morphology uses a 3 x 3 square, and pixels outside the
+ * bitmap count as clear. So an erosion clears the border pixels.
+ */
+int read_bitmap_p4(char* char_name, bitmap* bitmap_input);
+int write_bitmap_p4(char* char_name, bitmap* bitmap_output);
+int allocate_bitmap(bitmap* bitmap_new, unsigned int uint_xres,
+    unsigned int uint_yres);
+void free_bitmap(bitmap* bitmap_old);
+int bitmap_from_view(image_view* view_input, bitmap* bitmap_output,
+    unsigned int uint_low, unsigned int uint_high);
+int bitmap_to_view(bitmap* bitmap_input, image_view* view_output,
+    unsigned int uint_set, unsigned int uint_clear);
+int bitmap_and(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output);
+int bitmap_or(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output);
+int bitmap_xor(bitmap* bitmap_a, bitmap* bitmap_b, bitmap* bitmap_output);
+uint64_t bitmap_popcount(bitmap* bitmap_input);
+int erode_bitmap(bitmap* bitmap_input, bitmap* bitmap_output);
+int dilate_bitmap(bitmap* bitmap_input, bitmap* bitmap_output);
+int open_bitmap(bitmap* bitmap_input, bitmap* bitmap_output);
+int close_bitmap(bitmap* bitmap_input, bitmap* bitmap_output);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+int read_PBM_header_p4(FILE* file_input, bitmap* bitmap_input);
+unsigned char reverse_bits(unsigned char uchar_byte);
+void clear_padding_bits(bitmap* bitmap_p4, uint64_t* uint64_row);
+int check_bitmap_size(bitmap* bitmap_a, bitmap* bitmap_b);
+void bitmap_row_neighbours(uint64_t* uint64_row, uint64_t* uint64_output,
+    unsigned int uint_words, int int_dilate);
+int morphology_bitmap(bitmap* bitmap_input, bitmap* bitmap_output,
+    int int_dilate);
+
+#endif
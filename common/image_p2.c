@@ -9,6 +9,9 @@
 /* Include our routines to handle a PGM file.*/
 #include "image_p2.h"
 
+/* Include the timing and counters, compiled out unless -DINSTRUMENT */
+#include "instrument.h"
+
 
 /*
  * "private" function
@@ -61,15 +64,15 @@ int read_PBM_header_p2(FILE* file_input, image* image_input) {
 
 /* "private" function */
 int allocate_image_data_p2(image* image_p2, unsigned int uint_initialgreylevel) {
-    int i = 0;
-    int j = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
 
     if(image_p2->uint_xres == 0 || image_p2->uint_yres == 0) {
         perror("allocate_image: At least one dimension is zero.");
         return(-1);
     }
 
-    if(uint_initialgreylevel > 255) {
+    if(uint_initialgreylevel > PGM_MAX_LEVEL) {
        perror("allocate image: Invalid initial grey level given.\n");
        return(-1);
     }
@@ -81,11 +84,24 @@ int allocate_image_data_p2(image* image_p2, unsigned int uint_initialgreylevel)
         return(-1);
     }
 
-    image_p2->int_image_data = (unsigned int**)malloc(image_p2->uint_yres * sizeof(unsigned int*));
+    /*
+     * All rows are stored in one block, so we only need a single
+     * malloc and an image can be addressed with a stride (see image_view).
+     */
+    image_p2->int_image_data[0] = (unsigned int*)malloc(
+        (size_t)image_p2->uint_xres * image_p2->uint_yres *
+        sizeof(unsigned int));
+    if(image_p2->int_image_data[0] == NULL) {
+        perror("allocate_image: Error allocating storage space.\n");
+        free(image_p2->int_image_data);
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_image, INSTRUMENT_ALLOCATIONS, 2);
 
     for(i = 0; i < image_p2->uint_yres; i ++) {
-        image_p2->int_image_data[i] = (unsigned int*)malloc(
-            image_p2->uint_xres * sizeof(unsigned int));
+        image_p2->int_image_data[i] = image_p2->int_image_data[0] +
+            (size_t)i * image_p2->uint_xres;
         if(uint_initialgreylevel == 0) {
             memset(image_p2->int_image_data[i], 0, image_p2->uint_xres *
                 sizeof(unsigned int));
@@ -108,8 +124,8 @@ int allocate_image_data_p2(image* image_p2, unsigned int uint_initialgreylevel)
 int allocate_image_p2(image* image_p2, unsigned int uint_xres, 
     unsigned int uint_yres, unsigned int uint_greylevel) {
  
-    if(uint_greylevel > 255) {
-        perror("allocate_image: the max. allowed grey level is 255.\n");
+    if(uint_greylevel > PGM_MAX_LEVEL) {
+        perror("allocate_image: the max. allowed grey level is 65535.\n");
         return(-1);
     }
 
@@ -123,12 +139,9 @@ int allocate_image_p2(image* image_p2, unsigned int uint_xres,
 
 /* "public" function */
 void free_image_p2(image* image_p2) {
-    int i = 0;
-
-    for(i = 0; i < image_p2->uint_yres; i ++) {
-        free(image_p2->int_image_data[i]);
-    }
 
+    /* the rows are stored in a single block, see allocate_image_data_p2() */
+    free(image_p2->int_image_data[0]);
     free(image_p2->int_image_data);
 
     return;
@@ -141,8 +154,8 @@ void free_image_p2(image* image_p2) {
  * This function reads only the image data.
  */
 int read_image_data_p2(FILE* file_input, image* image_p2) {
-    int i = 0;
-    int j = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
 
     /* check if the iamge has been allocated */
     if(image_p2->uint_xres == 0 || image_p2->uint_yres == 0) {
@@ -176,6 +189,8 @@ int read_image_p2(char* char_name, image* image_input) {
     int int_message_length;
     char* char_error_message;
 
+    INSTRUMENT_BEGIN(read_image);
+
     file_input = fopen(char_name, "r");
     if( file_input == NULL ) {
         /* I am printing a string into 0 allocated bytes.
@@ -222,6 +237,12 @@ int read_image_p2(char* char_name, image* image_input) {
         return(-1);
     }
 
+    INSTRUMENT_COUNT(read_image, INSTRUMENT_BYTES_READ, ftell(file_input));
+    INSTRUMENT_COUNT(read_image, INSTRUMENT_PIXELS,
+        (uint64_t)image_input->uint_xres * image_input->uint_yres);
+    fclose(file_input);
+    INSTRUMENT_END(read_image);
+
     return(0);
 }
 
@@ -284,8 +305,13 @@ int write_image_p2(char* char_name, image* image_p2) {
      * the file are successful. However, we have to close 
      * the file in either case.
      */
+    INSTRUMENT_BEGIN(write_image);
     int_return_value1 = write_image_data_p2(file_output, image_p2);
+    INSTRUMENT_COUNT(write_image, INSTRUMENT_BYTES_WRITTEN, ftell(file_output));
+    INSTRUMENT_COUNT(write_image, INSTRUMENT_PIXELS,
+        (uint64_t)image_p2->uint_xres * image_p2->uint_yres);
     int_return_value2 = fclose(file_output);
+    INSTRUMENT_END(write_image);
 
     return(MIN(int_return_value1, int_return_value2));
 }
@@ -312,8 +338,7 @@ void display_image_p2(image* image_p2) {
 
 /* "public" function */
 void clone_image_p2(image* image_parent, image* image_child) {
-    int i;
-    
+
     /* allocate the child image */
     allocate_image_p2(image_child, image_parent->uint_xres, 
         image_parent->uint_yres, image_parent->uint_max);
@@ -321,15 +346,102 @@ void clone_image_p2(image* image_parent, image* image_child) {
     /* copy the number of grey levels */
     image_child->uint_max = image_parent->uint_max;
 
+#ifdef DEBUG
     printf("clone image, max grey: %d\n", image_child->uint_max);
+#endif
 
-    /* deep copy the image data */
-    for(i = 0; i < image_child->uint_yres; i ++) {
-        memcpy(image_child->int_image_data[i], 
-            image_parent->int_image_data[i], 
-            image_child->uint_xres * sizeof(int));
-    }
+    /* deep copy the image data, the rows are stored in a single block */
+    memcpy(image_child->int_image_data[0], image_parent->int_image_data[0],
+        (size_t)image_child->uint_xres * image_child->uint_yres *
+        sizeof(unsigned int));
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Create a view on the entire image. The view shares
+ * the pixels with the image, nothing is copied.
+ */
+void view_image_p2(image* image_parent, image_view* view) {
+    view->uint_origin = image_parent->int_image_data[0];
+    view->uint_xres = image_parent->uint_xres;
+    view->uint_yres = image_parent->uint_yres;
+    view->uint_stride = image_parent->uint_xres;
+    view->uint_max = image_parent->uint_max;
 
     return;
 }
 
+
+/*
+ * "public" function
+ *
+ * Create a view on a region of interest of another view.
+ * The region starts at uint_x, uint_y and has to lie
+ * entirely inside the parent view.
+ */
+int roi_view_p2(image_view* view_parent, image_view* view_roi,
+    unsigned int uint_x, unsigned int uint_y, unsigned int uint_xres,
+    unsigned int uint_yres) {
+
+    if(uint_xres == 0 || uint_yres == 0 ||
+        uint_x + uint_xres > view_parent->uint_xres ||
+        uint_y + uint_yres > view_parent->uint_yres) {
+        perror("roi_view: Region of interest outside of the image.\n");
+        return(-1);
+    }
+
+    view_roi->uint_origin = &VIEW_PIXEL(view_parent, uint_x, uint_y);
+    view_roi->uint_xres = uint_xres;
+    view_roi->uint_yres = uint_yres;
+    view_roi->uint_stride = view_parent->uint_stride;
+    view_roi->uint_max = view_parent->uint_max;
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * Skip white space and comments in the header of a binary
+ * PBM, PGM, PPM or PFM file, so the next fscanf() reads a
+ * number. Returns -1 at the end of the file.
+ */
+int skip_PBM_space(FILE* file_input) {
+    int int_char = 0;
+
+    while((int_char = fgetc(file_input)) != EOF) {
+        if(int_char == '#') {
+            while((int_char = fgetc(file_input)) != EOF && int_char != '\n');
+        } else if(int_char != ' ' && int_char != '\t' && int_char != '\n' && int_char != '\r') {
+            ungetc(int_char, file_input);
+            return(0);
+        }
+    }
+
+    return(-1);
+}
+
+
+/*
+ * "public" function
+ *
+ * Does the file start with the magic number P<char_type>,
+ * e.g. '5' for a P5 image or 'f' for a PFM file? Use it to
+ * pick the function to read a file with.
+ */
+int is_image_type(char* char_name, char char_type) {
+    FILE* file_input;
+    char char_magic[2] = {0, 0};
+
+    file_input = fopen(char_name, "rb");
+    if(file_input == NULL) return(0);
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2) char_magic[0] = 0;
+    fclose(file_input);
+
+    return(char_magic[0] == 'P' && char_magic[1] == char_type);
+}
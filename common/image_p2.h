@@ -7,7 +7,7 @@
  * Pre-processor directives to ensure we include this file only once.
  */
 #ifndef __IMAGE_P2__
-#define __IMAGE_P2___
+#define __IMAGE_P2__
 
 
 /*
@@ -32,13 +32,18 @@
  */
 #define INT_BUFFERLENGTH 1024
 
-
 /*
- * Define the max. grey level
+ * The largest grey level of a PGM file, 16 bit. Images with more
+ * than 255 grey levels are stored with 2 bytes per pixel in a P5
+ * file, see image_p5.h.
  */
-#define INT_MAX_GREY 255
+#define PGM_MAX_LEVEL 65535
 
-/* Type definition of a P2 grey level image */
+/*
+ * Type definition of a P2 grey level image
+ * The pixels are stored in one block, row after row.
+ * int_image_data[i] points to the first pixel of row i.
+ */
 typedef struct {
     unsigned int** int_image_data;
     unsigned int uint_xres;
@@ -47,6 +52,28 @@ typedef struct {
 } image;
 
 
+/*
+ * Type definition of a view on an image
+ * A view does not own any pixels. It is a rectangular region
+ * of another image: uint_origin points to its top left pixel,
+ * and the next row starts uint_stride pixels further on.
+ * Views are cheap to create, so use them to work on a region of
+ * interest or on a tile of an image without copying it.
+ */
+typedef struct {
+    unsigned int* uint_origin;
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_stride;
+    unsigned int uint_max;
+} image_view;
+
+
+/* The first pixel of row Y of a view and the pixel at X, Y */
+#define VIEW_ROW(VIEW, Y) ((VIEW)->uint_origin + (size_t)(Y) * (VIEW)->uint_stride)
+#define VIEW_PIXEL(VIEW, X, Y) (VIEW_ROW(VIEW, Y)[X])
+
+
 /* 
  * "Public" functions
  * You should use these in your code.
@@ -59,9 +86,15 @@ int read_image_p2(char* char_name, image* image_input);
 int write_image_p2(char* char_name, image* image_output);
 int allocate_image_p2(image* image_p2, unsigned int uint_xres, 
     unsigned int uint_yres, unsigned int uint_greylevel);
-void free_image_P2(image* image_p2);
+void free_image_p2(image* image_p2);
 void display_image_p2(image* image_p2);
 void clone_image_p2(image* image_parent, image* image_child);
+void view_image_p2(image* image_parent, image_view* view);
+int roi_view_p2(image_view* view_parent, image_view* view_roi,
+    unsigned int uint_x, unsigned int uint_y, unsigned int uint_xres,
+    unsigned int uint_yres);
+int skip_PBM_space(FILE* file_input);
+int is_image_type(char* char_name, char char_type);
 
 
 /* 
@@ -0,0 +1,611 @@
+/*-----------------------------------------
+ * 16 bit and float image functions
+ * Read and write a PGM binary encoded grey map
+ * with 8 or 16 bit pixels (P5) and a grey PFM
+ * file with float pixels (Pf), and convert them
+ * between each other and an image view.
+ *---------------------------------------*/
+
+
+/* Include our routines to handle 16 bit and float images. */
+#include "image_p5.h"
+
+/* isfinite() for the range of a float image */
+#include <math.h>
+
+/* Include the timing and counters, compiled out unless -DINSTRUMENT */
+#include "instrument.h"
+
+/* Include the CPU dispatch for the row loops */
+#include "cpu_dispatch.h"
+
+
+/*
+ * "private" function
+ *
+ * Read the image header. Comments may appear anywhere
+ * in it, and after the max. grey level there is exactly
+ * one white space character before the pixels start.
+ */
+int read_PBM_header_p5(FILE* file_input, image_u16* image_input) {
+    char char_magic[2];
+
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2 ||
+        char_magic[0] != 'P' || char_magic[1] != '5') {
+        perror("Not a P5 image (binary encoded portable greymap)\n");
+        return(-1);
+    }
+
+    if(skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_xres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_yres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_max)) != 1) {
+        perror("read_image_p5: Invalid header.\n");
+        return(-1);
+    }
+    fgetc(file_input);
+
+    if(image_input->uint_max == 0 || image_input->uint_max > UINT16_MAX) {
+        fprintf(stderr, "read_image_p5: Invalid max. grey level %u.\n",
+            image_input->uint_max);
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+/*
+ * "private" function
+ *
+ * Read the header of a grey PFM file. The scale factor after the
+ * resolution gives the byte order: negative is little endian.
+ */
+int read_PFM_header(FILE* file_input, image_f32* image_input,
+    int* int_little_endian) {
+    char char_magic[2];
+    float float_scale = 0.0f;
+
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2 ||
+        char_magic[0] != 'P' || char_magic[1] != 'f') {
+        perror("Not a grey PFM image (portable float map, Pf)\n");
+        return(-1);
+    }
+
+    if(skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_xres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_yres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%f", &float_scale) != 1 || float_scale == 0.0f) {
+        perror("read_image_pfm: Invalid header.\n");
+        return(-1);
+    }
+    fgetc(file_input);
+
+    *int_little_endian = (float_scale < 0.0f);
+
+    return(0);
+}
+
+
+/* "private" function, PFM files may have either byte order */
+int host_is_little_endian(void) {
+    uint16_t uint16_one = 1;
+
+    return(*(unsigned char*)&uint16_one == 1);
+}
+
+
+/* "public" function */
+int allocate_image_u16(image_u16* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max) {
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("allocate_image_u16: At least one dimension is zero.");
+        return(-1);
+    }
+
+    if(uint_max > UINT16_MAX) {
+        perror("allocate_image_u16: the max. allowed grey level is 65535.\n");
+        return(-1);
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_stride = uint_xres;
+    image_new->uint_max = uint_max;
+
+    /* all pixels start black */
+    image_new->uint16_pixels = (uint16_t*)calloc((size_t)uint_xres * uint_yres,
+        sizeof(uint16_t));
+    if(image_new->uint16_pixels == NULL) {
+        perror("allocate_image_u16: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_image_u16, INSTRUMENT_ALLOCATIONS, 1);
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_image_u16(image_u16* image_old) {
+
+    free(image_old->uint16_pixels);
+    image_old->uint16_pixels = NULL;
+
+    return;
+}
+
+
+/* "public" function */
+int allocate_image_f32(image_f32* image_new, unsigned int uint_xres,
+    unsigned int uint_yres) {
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("allocate_image_f32: At least one dimension is zero.");
+        return(-1);
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_stride = uint_xres;
+
+    /* all bits zero is 0.0f */
+    image_new->float_pixels = (float*)calloc((size_t)uint_xres * uint_yres,
+        sizeof(float));
+    if(image_new->float_pixels == NULL) {
+        perror("allocate_image_f32: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_image_f32, INSTRUMENT_ALLOCATIONS, 1);
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_image_f32(image_f32* image_old) {
+
+    free(image_old->float_pixels);
+    image_old->float_pixels = NULL;
+
+    return;
+}
+
+
+/*
+ * "private" functions
+ * Convert a row between the bytes of a P5 file and 16 bit pixels.
+ * With 2 bytes per pixel the most significant byte comes first.
+ * We assemble the pixels from their bytes, so this works on any
+ * host and the loops are vectorised. Pixels above 255 are clipped
+ * if we write 1 byte per pixel.
+ */
+CPU_DISPATCH void unpack_p5_row(const unsigned char* restrict uchar_bytes,
+    uint16_t* restrict uint16_row, unsigned int uint_xres,
+    unsigned int uint_bytes_per_pixel) {
+    size_t j = 0;
+
+    if(uint_bytes_per_pixel == 1) {
+        for(j = 0; j < uint_xres; j ++) {
+            uint16_row[j] = uchar_bytes[j];
+        }
+    } else {
+        for(j = 0; j < uint_xres; j ++) {
+            uint16_row[j] = (uint16_t)(uchar_bytes[2 * j] << 8 | uchar_bytes[2 * j + 1]);
+        }
+    }
+
+    return;
+}
+
+
+CPU_DISPATCH void pack_p5_row(const uint16_t* restrict uint16_row,
+    unsigned char* restrict uchar_bytes, unsigned int uint_xres,
+    unsigned int uint_bytes_per_pixel) {
+    size_t j = 0;
+
+    if(uint_bytes_per_pixel == 1) {
+        for(j = 0; j < uint_xres; j ++) {
+            uchar_bytes[j] = (unsigned char)MIN(uint16_row[j], P5_MAX_BYTE_LEVEL);
+        }
+    } else {
+        for(j = 0; j < uint_xres; j ++) {
+            uchar_bytes[2 * j] = (unsigned char)(uint16_row[j] >> 8);
+            uchar_bytes[2 * j + 1] = (unsigned char)(uint16_row[j] & 0xFF);
+        }
+    }
+
+    return;
+}
+
+
+/* "private" function, reverse the bytes of every float of a row */
+void swap_bytes_f32_row(float* float_row, unsigned int uint_xres) {
+    size_t j = 0;
+    uint32_t uint32_bits = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        memcpy(&uint32_bits, &float_row[j], sizeof(float));
+        uint32_bits = __builtin_bswap32(uint32_bits);
+        memcpy(&float_row[j], &uint32_bits, sizeof(float));
+    }
+
+    return;
+}
+
+
+/* "public" function */
+int read_image_p5(char* char_name, image_u16* image_input) {
+    FILE* file_input;
+    unsigned char* uchar_bytes;
+    unsigned int uint_bytes_per_pixel = 0;
+    unsigned int i = 0;
+    size_t size_t_row_bytes = 0;
+
+    INSTRUMENT_BEGIN(read_image_p5);
+
+    file_input = fopen(char_name, "rb");
+    if(file_input == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", char_name);
+        return(-1);
+    }
+
+    if(read_PBM_header_p5(file_input, image_input) != 0 ||
+        allocate_image_u16(image_input, image_input->uint_xres,
+        image_input->uint_yres, image_input->uint_max) != 0) {
+        perror("Error reading header of image file.\n");
+        fclose(file_input);
+        return(-1);
+    }
+
+    uint_bytes_per_pixel = (image_input->uint_max > P5_MAX_BYTE_LEVEL) ? 2 : 1;
+    size_t_row_bytes = (size_t)image_input->uint_xres * uint_bytes_per_pixel;
+    uchar_bytes = (unsigned char*)malloc(size_t_row_bytes);
+    if(uchar_bytes == NULL) {
+        perror("read_image_p5: Error allocating storage space.\n");
+        free_image_u16(image_input);
+        fclose(file_input);
+        return(-1);
+    }
+
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        if(fread(uchar_bytes, 1, size_t_row_bytes, file_input) != size_t_row_bytes) {
+            perror("Unexpected end of PGM file.\n");
+            free(uchar_bytes);
+            free_image_u16(image_input);
+            fclose(file_input);
+            return(-1);
+        }
+        unpack_p5_row(uchar_bytes, U16_ROW(image_input, i), image_input->uint_xres,
+            uint_bytes_per_pixel);
+    }
+
+    free(uchar_bytes);
+
+    INSTRUMENT_COUNT(read_image_p5, INSTRUMENT_BYTES_READ, ftell(file_input));
+    INSTRUMENT_COUNT(read_image_p5, INSTRUMENT_PIXELS,
+        (uint64_t)image_input->uint_xres * image_input->uint_yres);
+    fclose(file_input);
+    INSTRUMENT_END(read_image_p5);
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * Images with a max. grey level up to 255 are written with
+ * 1 byte per pixel, all others with 2.
+ */
+int write_image_p5(char* char_name, image_u16* image_output) {
+    FILE* file_output;
+    unsigned char* uchar_bytes;
+    unsigned int uint_max = MAX(image_output->uint_max, 1);
+    unsigned int uint_bytes_per_pixel = (uint_max > P5_MAX_BYTE_LEVEL) ? 2 : 1;
+    unsigned int i = 0;
+    size_t size_t_row_bytes = (size_t)image_output->uint_xres * uint_bytes_per_pixel;
+    int int_return_value = 0;
+
+    uchar_bytes = (unsigned char*)malloc(size_t_row_bytes);
+    if(uchar_bytes == NULL) {
+        perror("write_image_p5: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    file_output = fopen(char_name, "wb");
+    if(file_output == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", char_name);
+        free(uchar_bytes);
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(write_image_p5);
+    fprintf(file_output, "P5\n# CREATOR: image_p5\n%u %u\n%u\n",
+        image_output->uint_xres, image_output->uint_yres, uint_max);
+
+    for(i = 0; i < image_output->uint_yres && int_return_value == 0; i ++) {
+        pack_p5_row(U16_ROW(image_output, i), uchar_bytes, image_output->uint_xres,
+            uint_bytes_per_pixel);
+        if(fwrite(uchar_bytes, 1, size_t_row_bytes, file_output) != size_t_row_bytes) {
+            int_return_value = -1;
+        }
+    }
+
+    INSTRUMENT_COUNT(write_image_p5, INSTRUMENT_BYTES_WRITTEN, ftell(file_output));
+    INSTRUMENT_COUNT(write_image_p5, INSTRUMENT_PIXELS,
+        (uint64_t)image_output->uint_xres * image_output->uint_yres);
+    if(fclose(file_output) != 0) int_return_value = -1;
+    INSTRUMENT_END(write_image_p5);
+
+    free(uchar_bytes);
+
+    return(int_return_value);
+}
+
+
+/* "public" function */
+int read_image_pfm(char* char_name, image_f32* image_input) {
+    FILE* file_input;
+    int int_little_endian = 0;
+    unsigned int i = 0;
+    float* float_row;
+
+    INSTRUMENT_BEGIN(read_image_pfm);
+
+    file_input = fopen(char_name, "rb");
+    if(file_input == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", char_name);
+        return(-1);
+    }
+
+    if(read_PFM_header(file_input, image_input, &int_little_endian) != 0 ||
+        allocate_image_f32(image_input, image_input->uint_xres,
+        image_input->uint_yres) != 0) {
+        perror("Error reading header of image file.\n");
+        fclose(file_input);
+        return(-1);
+    }
+
+    /* the first row of the file is the bottom row of the image */
+    for(i = image_input->uint_yres; i > 0; i --) {
+        float_row = F32_ROW(image_input, i - 1);
+        if(fread(float_row, sizeof(float), image_input->uint_xres, file_input) != image_input->uint_xres) {
+            perror("Unexpected end of PFM file.\n");
+            free_image_f32(image_input);
+            fclose(file_input);
+            return(-1);
+        }
+        if(int_little_endian != host_is_little_endian()) {
+            swap_bytes_f32_row(float_row, image_input->uint_xres);
+        }
+    }
+
+    INSTRUMENT_COUNT(read_image_pfm, INSTRUMENT_BYTES_READ, ftell(file_input));
+    INSTRUMENT_COUNT(read_image_pfm, INSTRUMENT_PIXELS,
+        (uint64_t)image_input->uint_xres * image_input->uint_yres);
+    fclose(file_input);
+    INSTRUMENT_END(read_image_pfm);
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * The file gets the byte order of the host, so the rows
+ * are written as they are.
+ */
+int write_image_pfm(char* char_name, image_f32* image_output) {
+    FILE* file_output;
+    unsigned int i = 0;
+    int int_return_value = 0;
+
+    file_output = fopen(char_name, "wb");
+    if(file_output == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", char_name);
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(write_image_pfm);
+    fprintf(file_output, "Pf\n%u %u\n%s\n", image_output->uint_xres,
+        image_output->uint_yres, host_is_little_endian() ? "-1.0" : "1.0");
+
+    for(i = image_output->uint_yres; i > 0 && int_return_value == 0; i --) {
+        if(fwrite(F32_ROW(image_output, i - 1), sizeof(float), image_output->uint_xres,
+            file_output) != image_output->uint_xres) {
+            int_return_value = -1;
+        }
+    }
+
+    INSTRUMENT_COUNT(write_image_pfm, INSTRUMENT_BYTES_WRITTEN, ftell(file_output));
+    INSTRUMENT_COUNT(write_image_pfm, INSTRUMENT_PIXELS,
+        (uint64_t)image_output->uint_xres * image_output->uint_yres);
+    if(fclose(file_output) != 0) int_return_value = -1;
+    INSTRUMENT_END(write_image_pfm);
+
+    return(int_return_value);
+}
+
+
+/*
+ * "public" functions
+ * Copy the pixels of a view into a 16 bit image and back.
+ * Grey levels above 65535 are clipped.
+ */
+int view_to_u16(image_view* view_input, image_u16* image_output) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    uint16_t* uint16_row;
+
+    if(view_input->uint_xres != image_output->uint_xres ||
+        view_input->uint_yres != image_output->uint_yres) {
+        perror("view_to_u16: The images have different sizes.\n");
+        return(-1);
+    }
+
+    for(i = 0; i < view_input->uint_yres; i ++) {
+        uint_row = VIEW_ROW(view_input, i);
+        uint16_row = U16_ROW(image_output, i);
+        for(j = 0; j < view_input->uint_xres; j ++) {
+            uint16_row[j] = (uint16_t)MIN(uint_row[j], UINT16_MAX);
+        }
+    }
+    image_output->uint_max = MIN(view_input->uint_max, UINT16_MAX);
+
+    return(0);
+}
+
+
+int u16_to_view(image_u16* image_input, image_view* view_output) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int* uint_row;
+    uint16_t* uint16_row;
+
+    if(view_output->uint_xres != image_input->uint_xres ||
+        view_output->uint_yres != image_input->uint_yres) {
+        perror("u16_to_view: The images have different sizes.\n");
+        return(-1);
+    }
+
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        uint16_row = U16_ROW(image_input, i);
+        uint_row = VIEW_ROW(view_output, i);
+        for(j = 0; j < image_input->uint_xres; j ++) {
+            uint_row[j] = uint16_row[j];
+        }
+    }
+    view_output->uint_max = image_input->uint_max;
+
+    return(0);
+}
+
+
+/*
+ * "private" function
+ * Map a row of floats onto 0 ... 65535, rounded to the nearest
+ * level. NaN ends up at 0, as the first comparison fails.
+ */
+CPU_DISPATCH void quantise_f32_row(const float* restrict float_row,
+    uint16_t* restrict uint16_row, unsigned int uint_xres,
+    float float_min, float float_scale) {
+    size_t j = 0;
+    float float_level = 0.0f;
+
+    for(j = 0; j < uint_xres; j ++) {
+        float_level = (float_row[j] - float_min) * float_scale + 0.5f;
+        float_level = MAX(float_level, 0.0f);
+        float_level = MIN(float_level, (float)UINT16_MAX);
+        uint16_row[j] = (uint16_t)float_level;
+    }
+
+    return;
+}
+
+
+/* "public" functions */
+int f32_to_u16(image_f32* image_input, image_u16* image_output,
+    float float_min, float float_max) {
+    unsigned int i = 0;
+    float float_scale = 0.0f;
+
+    if(image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("f32_to_u16: The images have different sizes.\n");
+        return(-1);
+    }
+
+    /* a flat range maps everything onto 0 */
+    if(float_max > float_min) {
+        float_scale = (float)UINT16_MAX / (float_max - float_min);
+    }
+
+    INSTRUMENT_BEGIN(f32_to_u16);
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        quantise_f32_row(F32_ROW(image_input, i), U16_ROW(image_output, i),
+            image_input->uint_xres, float_min, float_scale);
+    }
+    image_output->uint_max = UINT16_MAX;
+    INSTRUMENT_END(f32_to_u16);
+
+    return(0);
+}
+
+
+int u16_to_f32(image_u16* image_input, image_f32* image_output) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    float float_scale = 1.0f / MAX(image_input->uint_max, 1);
+    uint16_t* uint16_row;
+    float* float_row;
+
+    if(image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("u16_to_f32: The images have different sizes.\n");
+        return(-1);
+    }
+
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        uint16_row = U16_ROW(image_input, i);
+        float_row = F32_ROW(image_output, i);
+        for(j = 0; j < image_input->uint_xres; j ++) {
+            float_row[j] = uint16_row[j] * float_scale;
+        }
+    }
+
+    return(0);
+}
+
+
+/*
+ * "public" function
+ *
+ * The smallest and the largest finite pixel of a float image,
+ * both are 0.0 if there is none.
+ */
+void f32_range(image_f32* image_input, float* float_min, float* float_max) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    int int_found = 0;
+    float* float_row;
+
+    *float_min = 0.0f;
+    *float_max = 0.0f;
+
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        float_row = F32_ROW(image_input, i);
+        for(j = 0; j < image_input->uint_xres; j ++) {
+            if(!isfinite(float_row[j])) continue;
+            if(!int_found || float_row[j] < *float_min) *float_min = float_row[j];
+            if(!int_found || float_row[j] > *float_max) *float_max = float_row[j];
+            int_found = 1;
+        }
+    }
+
+    return;
+}
+
+
+/*
+ * "public" functions
+ * Check the magic number of a file, e.g. to pick the
+ * function to read it with.
+ */
+int is_image_p5(char* char_name) {
+    return(is_image_type(char_name, '5'));
+}
+
+
+int is_image_pfm(char* char_name) {
+    return(is_image_type(char_name, 'f'));
+}
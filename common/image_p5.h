@@ -0,0 +1,117 @@
+/*
+ * Function definitions to handle grey images with 16 bit and float
+ * pixels, read from and written to a PGM (P5) or a PFM file.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __IMAGE_P5__
+#define __IMAGE_P5__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/* include our PGM routines, both types convert from and to a view */
+#include "image_p2.h"
+
+
+/* A P5 file stores 1 byte per pixel up to this max. grey level, 2 bytes above */
+#define P5_MAX_BYTE_LEVEL 255
+
+
+/*
+ * Type definition of a 16 bit grey level image
+ * The pixels are stored in one block, row after row, and the next
+ * row starts uint_stride pixels further on. Grey levels go up to
+ * 65535, so this holds every P2 or P5 image, and at 2 bytes per
+ * pixel it needs half the memory of an image with the same pixels.
+ */
+typedef struct {
+    uint16_t* uint16_pixels;
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_stride;
+    unsigned int uint_max;
+} image_u16;
+
+
+/*
+ * Type definition of a float grey level image
+ * The layout is the same as image_u16. The pixels may take any
+ * value, e.g. a signed gradient, there is no max. grey level.
+ * PFM files store their rows bottom to top, we keep them top to
+ * bottom like every other image.
+ */
+typedef struct {
+    float* float_pixels;
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_stride;
+} image_f32;
+
+
+/* The first pixel of row Y and the pixel at X, Y of either type */
+#define U16_ROW(IMAGE, Y) ((IMAGE)->uint16_pixels + (size_t)(Y) * (IMAGE)->uint_stride)
+#define U16_PIXEL(IMAGE, X, Y) (U16_ROW(IMAGE, Y)[X])
+#define F32_ROW(IMAGE, Y) ((IMAGE)->float_pixels + (size_t)(Y) * (IMAGE)->uint_stride)
+#define F32_PIXEL(IMAGE, X, Y) (F32_ROW(IMAGE, Y)[X])
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ * The output of the conversions below has to be allocated with
+ * the size of the input. f32_to_u16() maps float_min ... float_max
+ * onto 0 ... 65535, values outside are clipped, and u16_to_f32()
+ * maps 0 ... uint_max onto 0.0 ... 1.0.
+ */
+int read_image_p5(char* char_name, image_u16* image_input);
+int write_image_p5(char* char_name, image_u16* image_output);
+int read_image_pfm(char* char_name, image_f32* image_input);
+int write_image_pfm(char* char_name, image_f32* image_output);
+int allocate_image_u16(image_u16* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max);
+void free_image_u16(image_u16* image_old);
+int allocate_image_f32(image_f32* image_new, unsigned int uint_xres,
+    unsigned int uint_yres);
+void free_image_f32(image_f32* image_old);
+int view_to_u16(image_view* view_input, image_u16* image_output);
+int u16_to_view(image_u16* image_input, image_view* view_output);
+int f32_to_u16(image_f32* image_input, image_u16* image_output,
+    float float_min, float float_max);
+int u16_to_f32(image_u16* image_input, image_f32* image_output);
+void f32_range(image_f32* image_input, float* float_min, float* float_max);
+int is_image_p5(char* char_name);
+int is_image_pfm(char* char_name);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+int read_PBM_header_p5(FILE* file_input, image_u16* image_input);
+int read_PFM_header(FILE* file_input, image_f32* image_input,
+    int* int_little_endian);
+int host_is_little_endian(void);
+void unpack_p5_row(const unsigned char* restrict uchar_bytes,
+    uint16_t* restrict uint16_row, unsigned int uint_xres,
+    unsigned int uint_bytes_per_pixel);
+void pack_p5_row(const uint16_t* restrict uint16_row,
+    unsigned char* restrict uchar_bytes, unsigned int uint_xres,
+    unsigned int uint_bytes_per_pixel);
+void swap_bytes_f32_row(float* float_row, unsigned int uint_xres);
+void quantise_f32_row(const float* restrict float_row,
+    uint16_t* restrict uint16_row, unsigned int uint_xres,
+    float float_min, float float_scale);
+
+#endif
@@ -0,0 +1,580 @@
+/*-----------------------------------------
+ * Colour image functions
+ * Read and write a PPM binary encoded colour image
+ * and convert it between the interleaved layout of
+ * the file and one grey image per channel.
+ * This code only accepts P6 images with 8 bit channels.
+ *---------------------------------------*/
+
+
+/* Include our routines to handle a colour image. */
+#include "image_p6.h"
+
+/* The channels are processed in parallel */
+#include <pthread.h>
+
+/* Include the timing and counters, compiled out unless -DINSTRUMENT */
+#include "instrument.h"
+
+/* Include the CPU dispatch for the row loops */
+#include "cpu_dispatch.h"
+
+
+/*
+ * "private" function
+ *
+ * Read the image header. Comments may appear anywhere
+ * in it, and after the max. value there is exactly one
+ * white space character before the pixels start.
+ */
+int read_PBM_header_p6(FILE* file_input, image_rgb* image_input) {
+    char char_magic[2];
+
+    if(fread(char_magic, sizeof(char), 2, file_input) != 2 ||
+        char_magic[0] != 'P' || char_magic[1] != '6') {
+        perror("Not a P6 image (binary encoded portable pixmap)\n");
+        return(-1);
+    }
+
+    if(skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_xres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_yres)) != 1 ||
+        skip_PBM_space(file_input) != 0 ||
+        fscanf(file_input, "%u", &(image_input->uint_max)) != 1) {
+        perror("read_image_p6: Invalid header.\n");
+        return(-1);
+    }
+    fgetc(file_input);
+
+    /* two bytes per channel would need another layout */
+    if(image_input->uint_max == 0 || image_input->uint_max > 255) {
+        fprintf(stderr, "read_image_p6: Only 8 bit images are supported, the max. value is %u.\n",
+            image_input->uint_max);
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+/* "public" function */
+int allocate_image_rgb(image_rgb* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max) {
+
+    if(uint_xres == 0 || uint_yres == 0) {
+        perror("allocate_image_rgb: At least one dimension is zero.");
+        return(-1);
+    }
+
+    if(uint_max > 255) {
+        perror("allocate_image_rgb: the max. allowed value is 255.\n");
+        return(-1);
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_max = uint_max;
+
+    /* all pixels start black */
+    image_new->uchar_rgb = (unsigned char*)calloc((size_t)uint_xres * uint_yres,
+        RGB_CHANNELS);
+    if(image_new->uchar_rgb == NULL) {
+        perror("allocate_image_rgb: Error allocating storage space.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(allocate_image_rgb, INSTRUMENT_ALLOCATIONS, 1);
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_image_rgb(image_rgb* image_old) {
+
+    free(image_old->uchar_rgb);
+    image_old->uchar_rgb = NULL;
+
+    return;
+}
+
+
+/* "public" function */
+int allocate_image_planar(image_planar* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max) {
+    int c = 0;
+
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        if(allocate_image_p2(&image_new->image_channels[c], uint_xres, uint_yres, 0) != 0) {
+            while(-- c >= 0) free_image_p2(&image_new->image_channels[c]);
+            return(-1);
+        }
+        image_new->image_channels[c].uint_max = uint_max;
+    }
+
+    image_new->uint_xres = uint_xres;
+    image_new->uint_yres = uint_yres;
+    image_new->uint_max = uint_max;
+
+    return(0);
+}
+
+
+/* "public" function */
+void free_image_planar(image_planar* image_old) {
+    int c = 0;
+
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        free_image_p2(&image_old->image_channels[c]);
+    }
+
+    return;
+}
+
+
+/* "public" function */
+int read_image_p6(char* char_name, image_rgb* image_input) {
+    FILE* file_input;
+    size_t size_t_bytes = 0;
+
+    INSTRUMENT_BEGIN(read_image_p6);
+
+    file_input = fopen(char_name, "rb");
+    if(file_input == NULL) {
+        fprintf(stderr, "Can't open input file: %s\n", char_name);
+        return(-1);
+    }
+
+    if(read_PBM_header_p6(file_input, image_input) != 0 ||
+        allocate_image_rgb(image_input, image_input->uint_xres,
+        image_input->uint_yres, image_input->uint_max) != 0) {
+        perror("Error reading header of image file.\n");
+        fclose(file_input);
+        return(-1);
+    }
+
+    /* the pixels have the layout of the image, so we read them in one go */
+    size_t_bytes = (size_t)image_input->uint_xres * image_input->uint_yres * RGB_CHANNELS;
+    if(fread(image_input->uchar_rgb, 1, size_t_bytes, file_input) != size_t_bytes) {
+        perror("Unexpected end of PPM file.\n");
+        free_image_rgb(image_input);
+        fclose(file_input);
+        return(-1);
+    }
+
+    INSTRUMENT_COUNT(read_image_p6, INSTRUMENT_BYTES_READ, ftell(file_input));
+    INSTRUMENT_COUNT(read_image_p6, INSTRUMENT_PIXELS,
+        (uint64_t)image_input->uint_xres * image_input->uint_yres);
+    fclose(file_input);
+    INSTRUMENT_END(read_image_p6);
+
+    return(0);
+}
+
+
+/* "public" function */
+int write_image_p6(char* char_name, image_rgb* image_output) {
+    FILE* file_output;
+    size_t size_t_bytes = (size_t)image_output->uint_xres * image_output->uint_yres * RGB_CHANNELS;
+    int int_return_value = 0;
+
+    file_output = fopen(char_name, "wb");
+    if(file_output == NULL) {
+        fprintf(stderr, "Can't open output file: %s\n", char_name);
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(write_image_p6);
+    fprintf(file_output, "P6\n# CREATOR: image_p6\n%u %u\n%u\n",
+        image_output->uint_xres, image_output->uint_yres, image_output->uint_max);
+
+    if(fwrite(image_output->uchar_rgb, 1, size_t_bytes, file_output) != size_t_bytes) {
+        int_return_value = -1;
+    }
+
+    INSTRUMENT_COUNT(write_image_p6, INSTRUMENT_BYTES_WRITTEN, ftell(file_output));
+    INSTRUMENT_COUNT(write_image_p6, INSTRUMENT_PIXELS,
+        (uint64_t)image_output->uint_xres * image_output->uint_yres);
+    if(fclose(file_output) != 0) int_return_value = -1;
+    INSTRUMENT_END(write_image_p6);
+
+    return(int_return_value);
+}
+
+
+/*
+ * "private" functions
+ * Split a row of RGB triples into its channels and back. The loads
+ * and stores with a stride of 3 are vectorised with shuffles, so
+ * every clone handles a whole vector of pixels per step. Values
+ * above 255 are clipped on the way back.
+ */
+CPU_DISPATCH void deinterleave_rgb_row(const unsigned char* restrict uchar_rgb,
+    unsigned int* restrict uint_red, unsigned int* restrict uint_green,
+    unsigned int* restrict uint_blue, unsigned int uint_xres) {
+    size_t j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        uint_red[j] = uchar_rgb[RGB_CHANNELS * j + RGB_RED];
+        uint_green[j] = uchar_rgb[RGB_CHANNELS * j + RGB_GREEN];
+        uint_blue[j] = uchar_rgb[RGB_CHANNELS * j + RGB_BLUE];
+    }
+
+    return;
+}
+
+
+CPU_DISPATCH void interleave_rgb_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned char* restrict uchar_rgb, unsigned int uint_xres) {
+    size_t j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        uchar_rgb[RGB_CHANNELS * j + RGB_RED] = (unsigned char)MIN(uint_red[j], 255u);
+        uchar_rgb[RGB_CHANNELS * j + RGB_GREEN] = (unsigned char)MIN(uint_green[j], 255u);
+        uchar_rgb[RGB_CHANNELS * j + RGB_BLUE] = (unsigned char)MIN(uint_blue[j], 255u);
+    }
+
+    return;
+}
+
+
+/*
+ * "private" functions
+ * The grey level of a row in fixed point, rounded to the nearest
+ * level. The sum of the weighted channels fits into 32 bit for
+ * channels up to 16 bit.
+ */
+CPU_DISPATCH void grey_rgb_row(const unsigned char* restrict uchar_rgb, unsigned int* restrict uint_grey,
+    unsigned int uint_xres) {
+    size_t j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        uint_grey[j] = (GREY_WEIGHT_RED * uchar_rgb[RGB_CHANNELS * j + RGB_RED] +
+            GREY_WEIGHT_GREEN * uchar_rgb[RGB_CHANNELS * j + RGB_GREEN] +
+            GREY_WEIGHT_BLUE * uchar_rgb[RGB_CHANNELS * j + RGB_BLUE] +
+            (1u << (GREY_WEIGHT_BITS - 1))) >> GREY_WEIGHT_BITS;
+    }
+
+    return;
+}
+
+
+CPU_DISPATCH void grey_planar_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned int* restrict uint_grey, unsigned int uint_xres) {
+    size_t j = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        uint_grey[j] = (GREY_WEIGHT_RED * uint_red[j] + GREY_WEIGHT_GREEN * uint_green[j] +
+            GREY_WEIGHT_BLUE * uint_blue[j] + (1u << (GREY_WEIGHT_BITS - 1))) >> GREY_WEIGHT_BITS;
+    }
+
+    return;
+}
+
+
+/*
+ * "public" function
+ * Split an interleaved image into its channels.
+ * The rows of both layouts have no gaps, so we convert
+ * the whole image as one long row.
+ */
+int rgb_to_planar(image_rgb* image_input, image_planar* image_output) {
+
+    if(image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("rgb_to_planar: The images have different sizes.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(rgb_to_planar);
+    deinterleave_rgb_row(image_input->uchar_rgb,
+        image_output->image_channels[RGB_RED].int_image_data[0],
+        image_output->image_channels[RGB_GREEN].int_image_data[0],
+        image_output->image_channels[RGB_BLUE].int_image_data[0],
+        image_input->uint_xres * image_input->uint_yres);
+    INSTRUMENT_END(rgb_to_planar);
+
+    return(0);
+}
+
+
+/* "public" function, the inverse of rgb_to_planar() */
+int planar_to_rgb(image_planar* image_input, image_rgb* image_output) {
+
+    if(image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("planar_to_rgb: The images have different sizes.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(planar_to_rgb);
+    interleave_rgb_row(image_input->image_channels[RGB_RED].int_image_data[0],
+        image_input->image_channels[RGB_GREEN].int_image_data[0],
+        image_input->image_channels[RGB_BLUE].int_image_data[0],
+        image_output->uchar_rgb, image_input->uint_xres * image_input->uint_yres);
+    INSTRUMENT_END(planar_to_rgb);
+
+    return(0);
+}
+
+
+/*
+ * "public" functions
+ * Write the grey level of every pixel into a view of the same size,
+ * e.g. to run the edge detection on a colour image.
+ */
+int rgb_to_grey(image_rgb* image_input, image_view* view_grey) {
+    unsigned int i = 0;
+
+    if(image_input->uint_xres != view_grey->uint_xres ||
+        image_input->uint_yres != view_grey->uint_yres) {
+        perror("rgb_to_grey: The view has a different size.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(rgb_to_grey);
+    for(i = 0; i < view_grey->uint_yres; i ++) {
+        grey_rgb_row(RGB_PIXEL(image_input, 0, i), VIEW_ROW(view_grey, i),
+            view_grey->uint_xres);
+    }
+    view_grey->uint_max = image_input->uint_max;
+    INSTRUMENT_END(rgb_to_grey);
+
+    return(0);
+}
+
+
+int planar_to_grey(image_planar* image_input, image_view* view_grey) {
+    unsigned int i = 0;
+
+    if(image_input->uint_xres != view_grey->uint_xres ||
+        image_input->uint_yres != view_grey->uint_yres) {
+        perror("planar_to_grey: The view has a different size.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(planar_to_grey);
+    for(i = 0; i < view_grey->uint_yres; i ++) {
+        grey_planar_row(image_input->image_channels[RGB_RED].int_image_data[i],
+            image_input->image_channels[RGB_GREEN].int_image_data[i],
+            image_input->image_channels[RGB_BLUE].int_image_data[i],
+            VIEW_ROW(view_grey, i), view_grey->uint_xres);
+    }
+    view_grey->uint_max = image_input->uint_max;
+    INSTRUMENT_END(planar_to_grey);
+
+    return(0);
+}
+
+
+/*
+ * "private" functions
+ * Convert a row between RGB and YCbCr in fixed point. We work in
+ * 64 bit, so the channels may have up to 16 bit. The results are
+ * rounded to the nearest level and clipped to 0 ... uint_max.
+ */
+CPU_DISPATCH void ycbcr_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned int* restrict uint_y, unsigned int* restrict uint_cb,
+    unsigned int* restrict uint_cr, unsigned int uint_xres, unsigned int uint_max) {
+    size_t j = 0;
+    int64_t int64_centre = ((int64_t)(uint_max + 1) / 2 << GREY_WEIGHT_BITS) + (1 << (GREY_WEIGHT_BITS - 1));
+    int64_t int64_cb = 0;
+    int64_t int64_cr = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        uint_y[j] = (unsigned int)(((int64_t)GREY_WEIGHT_RED * uint_red[j] + (int64_t)GREY_WEIGHT_GREEN * uint_green[j] +
+            (int64_t)GREY_WEIGHT_BLUE * uint_blue[j] + (1 << (GREY_WEIGHT_BITS - 1))) >> GREY_WEIGHT_BITS);
+        int64_cb = ((int64_t)CB_WEIGHT_RED * uint_red[j] + (int64_t)CB_WEIGHT_GREEN * uint_green[j] +
+            (int64_t)CB_WEIGHT_BLUE * uint_blue[j] + int64_centre) >> GREY_WEIGHT_BITS;
+        int64_cr = ((int64_t)CR_WEIGHT_RED * uint_red[j] + (int64_t)CR_WEIGHT_GREEN * uint_green[j] +
+            (int64_t)CR_WEIGHT_BLUE * uint_blue[j] + int64_centre) >> GREY_WEIGHT_BITS;
+        uint_cb[j] = (unsigned int)MIN(MAX(int64_cb, 0), (int64_t)uint_max);
+        uint_cr[j] = (unsigned int)MIN(MAX(int64_cr, 0), (int64_t)uint_max);
+    }
+
+    return;
+}
+
+
+CPU_DISPATCH void rgb_from_ycbcr_row(const unsigned int* restrict uint_y,
+    const unsigned int* restrict uint_cb, const unsigned int* restrict uint_cr,
+    unsigned int* restrict uint_red, unsigned int* restrict uint_green,
+    unsigned int* restrict uint_blue, unsigned int uint_xres, unsigned int uint_max) {
+    size_t j = 0;
+    int64_t int64_centre = (uint_max + 1) / 2;
+    int64_t int64_y = 0;
+    int64_t int64_cb = 0;
+    int64_t int64_cr = 0;
+    int64_t int64_red = 0;
+    int64_t int64_green = 0;
+    int64_t int64_blue = 0;
+
+    for(j = 0; j < uint_xres; j ++) {
+        int64_y = ((int64_t)uint_y[j] << GREY_WEIGHT_BITS) + (1 << (GREY_WEIGHT_BITS - 1));
+        int64_cb = (int64_t)uint_cb[j] - int64_centre;
+        int64_cr = (int64_t)uint_cr[j] - int64_centre;
+        int64_red = (int64_y + RED_WEIGHT_CR * int64_cr) >> GREY_WEIGHT_BITS;
+        int64_green = (int64_y + GREEN_WEIGHT_CB * int64_cb + GREEN_WEIGHT_CR * int64_cr) >> GREY_WEIGHT_BITS;
+        int64_blue = (int64_y + BLUE_WEIGHT_CB * int64_cb) >> GREY_WEIGHT_BITS;
+        uint_red[j] = (unsigned int)MIN(MAX(int64_red, 0), (int64_t)uint_max);
+        uint_green[j] = (unsigned int)MIN(MAX(int64_green, 0), (int64_t)uint_max);
+        uint_blue[j] = (unsigned int)MIN(MAX(int64_blue, 0), (int64_t)uint_max);
+    }
+
+    return;
+}
+
+
+/*
+ * "public" functions
+ * Convert a planar RGB image into YCbCr and back, the channels of
+ * the output are then YCBCR_Y, YCBCR_CB and YCBCR_CR. Work on the
+ * Y channel to change the brightness of a colour image without
+ * changing its colours, e.g. to equalise its histogram.
+ * The output must not be the input.
+ */
+int planar_to_ycbcr(image_planar* image_input, image_planar* image_output) {
+    unsigned int i = 0;
+
+    if(image_input == image_output || image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("planar_to_ycbcr: The images are the same or have different sizes.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(planar_to_ycbcr);
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        ycbcr_row(image_input->image_channels[RGB_RED].int_image_data[i],
+            image_input->image_channels[RGB_GREEN].int_image_data[i],
+            image_input->image_channels[RGB_BLUE].int_image_data[i],
+            image_output->image_channels[YCBCR_Y].int_image_data[i],
+            image_output->image_channels[YCBCR_CB].int_image_data[i],
+            image_output->image_channels[YCBCR_CR].int_image_data[i],
+            image_input->uint_xres, image_input->uint_max);
+    }
+    INSTRUMENT_END(planar_to_ycbcr);
+
+    return(0);
+}
+
+
+int ycbcr_to_planar(image_planar* image_input, image_planar* image_output) {
+    unsigned int i = 0;
+
+    if(image_input == image_output || image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres) {
+        perror("ycbcr_to_planar: The images are the same or have different sizes.\n");
+        return(-1);
+    }
+
+    INSTRUMENT_BEGIN(ycbcr_to_planar);
+    for(i = 0; i < image_input->uint_yres; i ++) {
+        rgb_from_ycbcr_row(image_input->image_channels[YCBCR_Y].int_image_data[i],
+            image_input->image_channels[YCBCR_CB].int_image_data[i],
+            image_input->image_channels[YCBCR_CR].int_image_data[i],
+            image_output->image_channels[RGB_RED].int_image_data[i],
+            image_output->image_channels[RGB_GREEN].int_image_data[i],
+            image_output->image_channels[RGB_BLUE].int_image_data[i],
+            image_input->uint_xres, image_input->uint_max);
+    }
+    INSTRUMENT_END(ycbcr_to_planar);
+
+    return(0);
+}
+
+
+/* "private" function, run the operator of one channel */
+void* channel_worker(void* void_task) {
+    channel_task* task = (channel_task*)void_task;
+
+    task->int_status = task->operator_channel(&task->view_input,
+        task->int_in_place ? NULL : &task->view_output, task->int_channel,
+        task->void_argument);
+
+    return(NULL);
+}
+
+
+/*
+ * "public" function
+ * Run an operator on every channel of a planar image, one thread
+ * per channel. The channels share no pixels, so the operator needs
+ * no locks as long as it only writes its own channel and its own
+ * share of void_argument. If image_output is NULL, the operator
+ * works in place and gets NULL as its output view.
+ */
+int for_each_channel(image_planar* image_input, image_planar* image_output,
+    channel_operator operator_channel, void* void_argument) {
+    int c = 0;
+    int int_result = 0;
+    pthread_t thread_ids[RGB_CHANNELS];
+    channel_task tasks[RGB_CHANNELS];
+
+    if(image_output != NULL && (image_input->uint_xres != image_output->uint_xres ||
+        image_input->uint_yres != image_output->uint_yres)) {
+        perror("for_each_channel: The images have different sizes.\n");
+        return(-1);
+    }
+
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        tasks[c].operator_channel = operator_channel;
+        view_image_p2(&image_input->image_channels[c], &tasks[c].view_input);
+        tasks[c].int_in_place = (image_output == NULL);
+        if(image_output != NULL) view_image_p2(&image_output->image_channels[c], &tasks[c].view_output);
+        tasks[c].int_channel = c;
+        tasks[c].void_argument = void_argument;
+        tasks[c].int_status = 0;
+    }
+
+    /* the calling thread works on the first channel itself */
+    for(c = 1; c < RGB_CHANNELS; c ++) {
+        if(pthread_create(&thread_ids[c], NULL, channel_worker, &tasks[c]) != 0) {
+            perror("for_each_channel: Unable to start a thread.\n");
+            channel_worker(&tasks[c]);
+            thread_ids[c] = pthread_self();
+        }
+    }
+    channel_worker(&tasks[0]);
+    for(c = 1; c < RGB_CHANNELS; c ++) {
+        if(!pthread_equal(thread_ids[c], pthread_self())) {
+            int_result |= pthread_join(thread_ids[c], NULL);
+        }
+    }
+
+    for(c = 0; c < RGB_CHANNELS; c ++) {
+        int_result |= tasks[c].int_status;
+    }
+
+    return(int_result == 0 ? 0 : -1);
+}
+
+
+/* "private" function, void_argument is an array of one histogram per channel */
+int histogram_channel(image_view* view_input, image_view* view_output,
+    int int_channel, void* void_argument) {
+    (void)view_output;
+
+    return(compute_histogram(view_input, (histogram*)void_argument + int_channel));
+}
+
+
+/*
+ * "public" function
+ * Compute the histogram of every channel, in parallel. The
+ * histograms have to be allocated, e.g. with one bin per level.
+ */
+int compute_histogram_planar(image_planar* image_input,
+    histogram histograms[RGB_CHANNELS]) {
+
+    return(for_each_channel(image_input, NULL, histogram_channel, histograms));
+}
+
+
+/* "public" function, does the file start with the magic number of a P6 image? */
+int is_image_p6(char* char_name) {
+    return(is_image_type(char_name, '6'));
+}
@@ -0,0 +1,180 @@
+/*
+ * Function definitions to handle a colour image,
+ * read from and written to a PPM (P6) file.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __IMAGE_P6__
+#define __IMAGE_P6__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/* include our PGM and histogram routines, a planar image is made of grey images */
+#include "image_p2.h"
+#include "histogram.h"
+
+
+/* the channels of a colour image */
+#define RGB_CHANNELS 3
+#define RGB_RED 0
+#define RGB_GREEN 1
+#define RGB_BLUE 2
+
+/*
+ * The weights of red, green and blue in the grey level (ITU-R BT.601)
+ * as 16 bit fixed point numbers. They add up to 1 << 16, so white
+ * stays white.
+ */
+#define GREY_WEIGHT_BITS 16
+#define GREY_WEIGHT_RED 19595
+#define GREY_WEIGHT_GREEN 38470
+#define GREY_WEIGHT_BLUE 7471
+
+/*
+ * The channels of a planar image in YCbCr (JPEG, full range).
+ * Y is the grey level above, Cb and Cr are the blue and red
+ * differences, centred on (uint_max + 1) / 2. The weights are
+ * 16 bit fixed point numbers again.
+ */
+#define YCBCR_Y 0
+#define YCBCR_CB 1
+#define YCBCR_CR 2
+#define CB_WEIGHT_RED (-11059)
+#define CB_WEIGHT_GREEN (-21709)
+#define CB_WEIGHT_BLUE 32768
+#define CR_WEIGHT_RED 32768
+#define CR_WEIGHT_GREEN (-27439)
+#define CR_WEIGHT_BLUE (-5329)
+#define RED_WEIGHT_CR 91881
+#define GREEN_WEIGHT_CB (-22554)
+#define GREEN_WEIGHT_CR (-46802)
+#define BLUE_WEIGHT_CB 116130
+
+
+/*
+ * Type definition of an interleaved colour image
+ * This is the layout of a P6 file: every pixel is three bytes,
+ * red, green and blue, and the rows follow each other without gaps.
+ * It is read and written with a single fread() or fwrite().
+ * Only 8 bit images (uint_max <= 255) are supported.
+ */
+typedef struct {
+    unsigned char* uchar_rgb;
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_max;
+} image_rgb;
+
+
+/*
+ * Type definition of a planar colour image
+ * Every channel is a grey image of its own, so all operators on
+ * images and views work on a channel, and a loop over a row of a
+ * channel touches only the values it needs.
+ * Use view_image_p2(&planar.image_channels[RGB_RED], &view) to get
+ * a view on a channel.
+ */
+typedef struct {
+    image image_channels[RGB_CHANNELS];
+    unsigned int uint_xres;
+    unsigned int uint_yres;
+    unsigned int uint_max;
+} image_planar;
+
+
+/*
+ * An operator on one channel of a planar image, see for_each_channel().
+ * view_output is NULL for operators that work in place. int_channel
+ * tells the operator which channel it works on, so it can pick its
+ * own share of void_argument, e.g. one histogram per channel.
+ */
+typedef int (*channel_operator)(image_view* view_input, image_view* view_output,
+    int int_channel, void* void_argument);
+
+
+/*
+ * The arguments of a thread of for_each_channel().
+ */
+typedef struct {
+    channel_operator operator_channel;
+    image_view view_input;
+    image_view view_output;
+    int int_in_place;
+    int int_channel;
+    void* void_argument;
+    int int_status;
+} channel_task;
+
+
+/* The first byte (the red one) of pixel X, Y of an interleaved image */
+#define RGB_PIXEL(IMAGE, X, Y) ((IMAGE)->uchar_rgb + ((size_t)(Y) * (IMAGE)->uint_xres + (X)) * RGB_CHANNELS)
+
+
+/*
+ * "Public" functions
+ * You should use these in your code.
+ * The output of the conversions below has to be allocated with
+ * the size of the input.
+ */
+int read_image_p6(char* char_name, image_rgb* image_input);
+int write_image_p6(char* char_name, image_rgb* image_output);
+int allocate_image_rgb(image_rgb* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max);
+void free_image_rgb(image_rgb* image_old);
+int allocate_image_planar(image_planar* image_new, unsigned int uint_xres,
+    unsigned int uint_yres, unsigned int uint_max);
+void free_image_planar(image_planar* image_old);
+int rgb_to_planar(image_rgb* image_input, image_planar* image_output);
+int planar_to_rgb(image_planar* image_input, image_rgb* image_output);
+int rgb_to_grey(image_rgb* image_input, image_view* view_grey);
+int planar_to_grey(image_planar* image_input, image_view* view_grey);
+int planar_to_ycbcr(image_planar* image_input, image_planar* image_output);
+int ycbcr_to_planar(image_planar* image_input, image_planar* image_output);
+int for_each_channel(image_planar* image_input, image_planar* image_output,
+    channel_operator operator_channel, void* void_argument);
+int compute_histogram_planar(image_planar* image_input,
+    histogram histograms[RGB_CHANNELS]);
+int is_image_p6(char* char_name);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+int read_PBM_header_p6(FILE* file_input, image_rgb* image_input);
+void deinterleave_rgb_row(const unsigned char* restrict uchar_rgb,
+    unsigned int* restrict uint_red, unsigned int* restrict uint_green,
+    unsigned int* restrict uint_blue, unsigned int uint_xres);
+void interleave_rgb_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned char* restrict uchar_rgb, unsigned int uint_xres);
+void grey_rgb_row(const unsigned char* restrict uchar_rgb, unsigned int* restrict uint_grey,
+    unsigned int uint_xres);
+void grey_planar_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned int* restrict uint_grey, unsigned int uint_xres);
+void ycbcr_row(const unsigned int* restrict uint_red,
+    const unsigned int* restrict uint_green, const unsigned int* restrict uint_blue,
+    unsigned int* restrict uint_y, unsigned int* restrict uint_cb,
+    unsigned int* restrict uint_cr, unsigned int uint_xres, unsigned int uint_max);
+void rgb_from_ycbcr_row(const unsigned int* restrict uint_y,
+    const unsigned int* restrict uint_cb, const unsigned int* restrict uint_cr,
+    unsigned int* restrict uint_red, unsigned int* restrict uint_green,
+    unsigned int* restrict uint_blue, unsigned int uint_xres, unsigned int uint_max);
+void* channel_worker(void* void_task);
+int histogram_channel(image_view* view_input, image_view* view_output,
+    int int_channel, void* void_argument);
+
+#endif
@@ -0,0 +1,189 @@
+/*-----------------------------------------
+ * Instrumentation
+ * Per stage timing and counters, reported
+ * as JSON or CSV. Everything in here is only
+ * compiled with -DINSTRUMENT.
+ *---------------------------------------*/
+
+
+/* Include our instrumentation routines. */
+#include "instrument.h"
+
+#ifdef INSTRUMENT
+
+#include <time.h>
+#include <pthread.h>
+
+
+/* the names of the counters in the report, see instrument.h */
+static const char* char_counter_names[INSTRUMENT_COUNTERS] = {
+    "bytes_read", "bytes_written", "pixels", "allocations"
+};
+
+/* all stages in the order they were first seen */
+static instrument_stage stages[INSTRUMENT_MAX_STAGES];
+static unsigned int uint_num_stages = 0;
+static pthread_mutex_t mutex_stages = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* "public" function */
+uint64_t instrument_clock(void) {
+    struct timespec timespec_now;
+
+    clock_gettime(CLOCK_MONOTONIC, &timespec_now);
+
+    return((uint64_t)timespec_now.tv_sec * 1000000000u + timespec_now.tv_nsec);
+}
+
+
+/*
+ * "private" function
+ *
+ * Find a stage by its name or add it. The caller has to hold
+ * mutex_stages. Stage names are usually string literals, so
+ * we compare the pointers before the strings.
+ */
+instrument_stage* instrument_find_stage(const char* char_stage) {
+    unsigned int i = 0;
+
+    for(i = 0; i < uint_num_stages; i ++) {
+        if(stages[i].char_name == char_stage || strcmp(stages[i].char_name, char_stage) == 0) {
+            return(&stages[i]);
+        }
+    }
+
+    if(uint_num_stages == INSTRUMENT_MAX_STAGES) return(NULL);
+
+    memset(&stages[uint_num_stages], 0, sizeof(instrument_stage));
+    stages[uint_num_stages].char_name = char_stage;
+
+    return(&stages[uint_num_stages ++]);
+}
+
+
+/* "public" function */
+void instrument_span(const char* char_stage, uint64_t uint64_nanoseconds) {
+    instrument_stage* stage;
+
+    pthread_mutex_lock(&mutex_stages);
+    stage = instrument_find_stage(char_stage);
+    if(stage != NULL) {
+        stage->uint64_calls ++;
+        stage->uint64_nanoseconds += uint64_nanoseconds;
+    }
+    pthread_mutex_unlock(&mutex_stages);
+
+    return;
+}
+
+
+/* "public" function */
+void instrument_count(const char* char_stage, int int_counter,
+    uint64_t uint64_amount) {
+    instrument_stage* stage;
+
+    if(int_counter < 0 || int_counter >= INSTRUMENT_COUNTERS) return;
+
+    pthread_mutex_lock(&mutex_stages);
+    stage = instrument_find_stage(char_stage);
+    if(stage != NULL) stage->uint64_counters[int_counter] += uint64_amount;
+    pthread_mutex_unlock(&mutex_stages);
+
+    return;
+}
+
+
+/* "public" function */
+void instrument_reset(void) {
+
+    pthread_mutex_lock(&mutex_stages);
+    uint_num_stages = 0;
+    pthread_mutex_unlock(&mutex_stages);
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * JSON gives one object per stage, CSV one line per stage
+ * after a header line. Times are in nanoseconds.
+ */
+void instrument_report(FILE* file_output, int int_format) {
+    unsigned int i = 0;
+    int k = 0;
+
+    pthread_mutex_lock(&mutex_stages);
+
+    if(int_format == INSTRUMENT_CSV) {
+        fprintf(file_output, "stage,calls,nanoseconds");
+        for(k = 0; k < INSTRUMENT_COUNTERS; k ++) {
+            fprintf(file_output, ",%s", char_counter_names[k]);
+        }
+        fprintf(file_output, "\n");
+
+        for(i = 0; i < uint_num_stages; i ++) {
+            fprintf(file_output, "%s,%llu,%llu", stages[i].char_name,
+                (unsigned long long)stages[i].uint64_calls,
+                (unsigned long long)stages[i].uint64_nanoseconds);
+            for(k = 0; k < INSTRUMENT_COUNTERS; k ++) {
+                fprintf(file_output, ",%llu",
+                    (unsigned long long)stages[i].uint64_counters[k]);
+            }
+            fprintf(file_output, "\n");
+        }
+    } else {
+        fprintf(file_output, "{\n  \"stages\": [");
+        for(i = 0; i < uint_num_stages; i ++) {
+            fprintf(file_output, "%s\n    {\"stage\": \"%s\", \"calls\": %llu, \"nanoseconds\": %llu",
+                (i > 0) ? "," : "", stages[i].char_name,
+                (unsigned long long)stages[i].uint64_calls,
+                (unsigned long long)stages[i].uint64_nanoseconds);
+            for(k = 0; k < INSTRUMENT_COUNTERS; k ++) {
+                fprintf(file_output, ", \"%s\": %llu", char_counter_names[k],
+                    (unsigned long long)stages[i].uint64_counters[k]);
+            }
+            fprintf(file_output, "}");
+        }
+        fprintf(file_output, "\n  ]\n}\n");
+    }
+
+    pthread_mutex_unlock(&mutex_stages);
+
+    return;
+}
+
+
+/*
+ * "public" function
+ *
+ * Write the report to a file, names ending in .csv get CSV,
+ * everything else JSON. The name - writes to stdout.
+ */
+int instrument_write_report(char* char_name) {
+    FILE* file_output;
+    size_t size_t_length = strlen(char_name);
+    int int_format = INSTRUMENT_JSON;
+
+    if(size_t_length >= 4 && strcmp(char_name + size_t_length - 4, ".csv") == 0) {
+        int_format = INSTRUMENT_CSV;
+    }
+
+    if(strcmp(char_name, "-") == 0) {
+        instrument_report(stdout, int_format);
+        return(0);
+    }
+
+    file_output = fopen(char_name, "w");
+    if(file_output == NULL) {
+        perror("instrument_write_report: Can't open the report file.\n");
+        return(-1);
+    }
+
+    instrument_report(file_output, int_format);
+
+    return(fclose(file_output));
+}
+
+#endif
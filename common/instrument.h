@@ -0,0 +1,101 @@
+/*
+ * Function definitions for timing and counting the stages of a pipeline.
+ */
+
+
+/*
+ * Pre-processor directives to ensure we include this file only once.
+ */
+#ifndef __INSTRUMENT__
+#define __INSTRUMENT__
+
+
+/*
+ * System level includes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/*
+ * The counters every stage has next to its calls and its time.
+ */
+#define INSTRUMENT_BYTES_READ 0
+#define INSTRUMENT_BYTES_WRITTEN 1
+#define INSTRUMENT_PIXELS 2
+#define INSTRUMENT_ALLOCATIONS 3
+#define INSTRUMENT_COUNTERS 4
+
+/* More stages are silently ignored. */
+#define INSTRUMENT_MAX_STAGES 64
+
+/* formats for instrument_report() */
+#define INSTRUMENT_JSON 0
+#define INSTRUMENT_CSV 1
+
+
+/*
+ * Instrument your code with these macros, e.g.
+ *
+ *     INSTRUMENT_BEGIN(hough_transform);
+ *     ...
+ *     INSTRUMENT_COUNT(hough_transform, INSTRUMENT_PIXELS, xres * yres);
+ *     INSTRUMENT_END(hough_transform);
+ *
+ * The stage name must be a valid C identifier, BEGIN and END have
+ * to be in the same block. Unless you compile with -DINSTRUMENT,
+ * the macros expand to nothing and cost nothing.
+ */
+#ifdef INSTRUMENT
+#define INSTRUMENT_BEGIN(STAGE) uint64_t uint64_instrument_##STAGE = instrument_clock()
+#define INSTRUMENT_END(STAGE) instrument_span(#STAGE, instrument_clock() - uint64_instrument_##STAGE)
+#define INSTRUMENT_COUNT(STAGE, COUNTER, N) instrument_count(#STAGE, COUNTER, (uint64_t)(N))
+#else
+#define INSTRUMENT_BEGIN(STAGE)
+#define INSTRUMENT_END(STAGE)
+#define INSTRUMENT_COUNT(STAGE, COUNTER, N)
+#endif
+
+
+/*
+ * Type definition of an instrumented stage.
+ * The time is the sum of all spans in nanoseconds, measured with
+ * a monotonic clock. Spans of different threads add up, so on
+ * several threads a stage may take longer than the whole program.
+ */
+typedef struct {
+    const char* char_name;
+    uint64_t uint64_calls;
+    uint64_t uint64_nanoseconds;
+    uint64_t uint64_counters[INSTRUMENT_COUNTERS];
+} instrument_stage;
+
+
+#ifdef INSTRUMENT
+
+/*
+ * "Public" functions
+ * You should use these in your code. They are safe to call
+ * from several threads at once.
+ */
+uint64_t instrument_clock(void);
+void instrument_span(const char* char_stage, uint64_t uint64_nanoseconds);
+void instrument_count(const char* char_stage, int int_counter,
+    uint64_t uint64_amount);
+void instrument_reset(void);
+void instrument_report(FILE* file_output, int int_format);
+int instrument_write_report(char* char_name);
+
+
+/*
+ * "Private" functions
+ * They are for internal use only, so you shouldn't
+ * use them in your code.
+ */
+instrument_stage* instrument_find_stage(const char* char_stage);
+
+#endif
+
+#endif